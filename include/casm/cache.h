@@ -0,0 +1,82 @@
+/*
+ * EmberOS CASM Build Cache Header
+ * In-memory cache of assembled images for casm -r
+ *
+ * Entries are keyed by a 64-bit FNV-1a hash of the source bytes and the
+ * assembler options, so an edited file simply misses and no entry ever
+ * has to be invalidated. The least recently used entry is evicted when
+ * the cache runs out of slots or bytes.
+ *
+ * One spinlock guards the table, so casm -r may run on several CPUs at
+ * once. A lookup pins the entry it returns: it is not freed, even by
+ * cache_clear(), until its user has copied the image and unpinned it.
+ */
+
+#ifndef EMBEROS_CASM_CACHE_H
+#define EMBEROS_CASM_CACHE_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using size_t = unsigned long;
+
+namespace casm {
+
+/*
+ * Cache limits: at most CACHE_ENTRIES images totalling CACHE_MAX_BYTES
+ * Larger images are assembled every time
+ */
+constexpr size_t CACHE_ENTRIES = 8;
+constexpr size_t CACHE_MAX_BYTES = 256 * 1024;
+
+/*
+ * Assembler options that change the output and so belong in the key
+ */
+constexpr uint32_t CACHE_OPT_OPTIMIZE = 1 << 0;
+
+/*
+ * Cache statistics
+ */
+struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t entries;
+    size_t bytes;               // Image bytes held
+};
+
+/*
+ * Build the cache key for a source buffer assembled with options
+ */
+uint64_t cache_key(const char* source, size_t length, uint32_t options);
+
+/*
+ * Find the image assembled for key, mark it most recently used and pin it
+ * Returns nullptr (and counts a miss) if it is not cached; otherwise the
+ * pointer stays valid until it is passed to cache_unpin()
+ */
+const uint8_t* cache_lookup(uint64_t key, size_t* size);
+
+/*
+ * Release an image returned by cache_lookup()
+ */
+void cache_unpin(const uint8_t* image);
+
+/*
+ * Store a copy of an assembled image under key
+ * Returns false if the image is too large, no memory is available or
+ * pinned entries leave no room
+ */
+bool cache_insert(uint64_t key, const uint8_t* image, size_t size);
+
+/*
+ * Drop every entry (the hit/miss counters are kept); pinned ones are
+ * freed when unpinned
+ */
+void cache_clear();
+
+void get_cache_stats(CacheStats* stats);
+
+} // namespace casm
+
+#endif // EMBEROS_CASM_CACHE_H
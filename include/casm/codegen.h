@@ -13,10 +13,16 @@
 namespace casm {
 
 /*
- * Maximum number of symbols in symbol table
+ * Initial symbol table capacity; the table doubles when full
+ * The hash index always has twice as many slots as the table
  * Requirements: 7.6
  */
-constexpr int MAX_SYMBOLS = 64;
+constexpr int INITIAL_SYMBOLS = 64;
+
+/*
+ * Initial fixup record capacity; the array doubles when full
+ */
+constexpr int INITIAL_FIXUPS = 64;
 
 /*
  * Maximum symbol name length
@@ -24,43 +30,134 @@ constexpr int MAX_SYMBOLS = 64;
 constexpr int MAX_SYMBOL_NAME = 32;
 
 /*
- * Maximum code buffer size (4KB)
+ * Maximum program image size (TEXT + DATA + BSS)
+ * Section buffers grow as code is emitted; this only bounds the image to
+ * what B/BL and ADD-immediate sequences can reach
  * Requirements: 7.10
  */
-constexpr size_t MAX_CODE_SIZE = 4096;
+constexpr size_t MAX_IMAGE_SIZE = 1024 * 1024;
+
+/*
+ * Fixed data window used by programs that address memory by number
+ * Immediates in [DATA_WINDOW_START, DATA_WINDOW_END) are translated to
+ * x28-relative addresses, so runners always provide at least
+ * DATA_WINDOW_END bytes of program memory
+ */
+constexpr int64_t DATA_WINDOW_START = 0x400;
+constexpr int64_t DATA_WINDOW_END = 0x2000;
+
+/*
+ * Number of recently emitted instructions the -O peephole pass inspects
+ */
+constexpr int PEEPHOLE_WINDOW = 2;
+
+/*
+ * Alignment of the DATA and BSS sections within the image
+ */
+constexpr size_t SECTION_ALIGN = 16;
 
 /*
  * Maximum error message length
  */
 constexpr int MAX_CODEGEN_ERROR = 256;
 
+/*
+ * Section types for code organization
+ * The image is laid out TEXT, DATA, BSS, each aligned to SECTION_ALIGN
+ * Requirements: 7.8
+ */
+enum class Section {
+    TEXT,   // Code section
+    DATA,   // Initialized data
+    BSS     // Uninitialized data
+};
+
+constexpr int NUM_SECTIONS = 3;
+
 /*
  * Symbol table entry for label tracking
+ * Label addresses are section offsets while assembling and image offsets
+ * once generate() returns; .equ constants hold their value
  * Requirements: 7.6
  */
 struct Symbol {
     char name[MAX_SYMBOL_NAME];
     uint64_t address;
+    uint32_t hash;          // Case-insensitive name hash
+    int fixups;             // Head of the pending fixup chain, -1 if none
+    Section section;
+    bool is_label;
     bool defined;
     bool is_global;
 };
 
 /*
- * Section types for code organization
- * Requirements: 7.8
+ * Field of an emitted instruction that waits on a label address
  */
-enum class Section {
-    TEXT,   // Code section
-    DATA,   // Initialized data
-    BSS     // Uninitialized data
+enum class FixupKind : uint8_t {
+    BRANCH26,       // B/BL imm26 (PC-relative)
+    IMM19,          // B.cond, CBZ/CBNZ, LDR (literal) imm19 (PC-relative)
+    IMM12,          // ADD/SUB/CMP imm12 holding the label's image offset
+    IMM12_PAIR      // Two consecutive imm12 words: offset low 12 bits, then high
+};
+
+/*
+ * A label reference that could not be encoded when it was emitted
+ * Forward references wait on their symbol's chain until the label is
+ * defined; references that depend on where DATA and BSS land wait on the
+ * deferred chain until the sections are laid out
+ */
+struct Fixup {
+    FixupKind kind;
+    Section section;        // Section holding the instruction
+    size_t offset;          // Section offset of the (first) word to patch
+    int symbol;             // Index into the symbol table
+    int line;               // Source line, for error reports
+    int next;               // Next fixup on the same chain, -1 at the end
+};
+
+/*
+ * One recently emitted instruction, as seen by the peephole pass
+ */
+struct PeepholeEntry {
+    uint32_t word;
+    size_t offset;          // Section offset of the word
+    int fixup;              // Fixup patching this word, -1 if none
+};
+
+/*
+ * Counts of what the peephole pass changed
+ */
+struct OptimizerStats {
+    int nops_removed;           // mov xN, xN and add/sub xN, xN, #0 (always on)
+    int pairs_merged;           // Adjacent LDR/STR merged into LDP/STP
+    int constants_folded;       // MOVZ/MOVN+MOVK runs replaced by one MOVZ/MOVN/ORR
+    int constants_shortened;    // MOVZ/MOVN+MOVK runs re-encoded with fewer MOVKs
+    int cbz_formed;             // CMP Rn, #0 + B.EQ/B.NE turned into CBZ/CBNZ
+    int branches_removed;       // Branches to the next instruction
+    size_t bytes_saved;
 };
 
 /*
  * Code Generator class for CASM assembler
  * 
- * Implements two-pass assembly:
- *   Pass 1: Collect all label definitions and calculate addresses
- *   Pass 2: Generate machine code with resolved label references
+ * Implements single-pass assembly: each instruction is encoded once,
+ * straight into a growable per-section buffer. A label reference that
+ * cannot be encoded yet leaves a zero field and a Fixup record, which is
+ * patched when the label is defined or, for addresses that depend on the
+ * final layout, once every section has been placed. .equ constants are
+ * collected up front so forward references to them are plain values.
+ * 
+ * Section buffers and the image come from memory::alloc_pages and are
+ * freed with the generator.
+ * 
+ * With set_optimize(true) a peephole pass rewrites the tail of the
+ * current section as instructions arrive: LDR/STR pairs, MOVZ/MOVK
+ * constant runs, compare-with-zero branches and branches to the next
+ * instruction. It never looks across a label or directive. CBZ/CBNZ
+ * leaves NZCV as it was, so it is only formed when both the next
+ * instruction and the one at the target overwrite the flags before
+ * anything reads them.
  * 
  * Usage:
  *   CodeGenerator codegen;
@@ -80,6 +177,14 @@ public:
      */
     CodeGenerator();
     
+    /*
+     * Release the image buffer and symbol table
+     */
+    ~CodeGenerator();
+    
+    CodeGenerator(const CodeGenerator&) = delete;
+    CodeGenerator& operator=(const CodeGenerator&) = delete;
+    
     /*
      * Generate machine code from AST
      * Returns true on success, false on error
@@ -87,14 +192,21 @@ public:
     bool generate(ASTNode* ast);
     
     /*
-     * Get generated machine code buffer
+     * Get the generated image: TEXT, DATA, then BSS as zeroes
+     */
+    const uint8_t* get_code() const { return image_; }
+    
+    /*
+     * Get size of the generated image in bytes
      */
-    const uint8_t* get_code() const { return code_; }
+    size_t get_code_size() const { return image_size_; }
     
     /*
-     * Get size of generated code in bytes
+     * Get the size of one section in bytes
      */
-    size_t get_code_size() const { return code_offset_; }
+    size_t get_section_size(Section section) const {
+        return section_size_[static_cast<int>(section)];
+    }
     
     /*
      * Get error message if generation failed
@@ -118,6 +230,16 @@ public:
      */
     void reset();
     
+    /*
+     * Enable the peephole pass (casm -O); call before generate()
+     */
+    void set_optimize(bool enable) { optimize_ = enable; }
+    
+    /*
+     * Get what the peephole pass changed in the last generate()
+     */
+    const OptimizerStats& get_optimizer_stats() const { return opt_stats_; }
+    
     /*
      * Look up a symbol by name
      * Returns nullptr if not found
@@ -135,13 +257,33 @@ public:
     const Symbol* get_symbol(int index) const;
 
 private:
-    // Code buffer
-    uint8_t code_[MAX_CODE_SIZE];
-    size_t code_offset_;
+    // Final image (pages from memory::alloc_pages), built by layout_sections()
+    uint8_t* image_;
+    size_t image_size_;
+    size_t image_pages_;
     
-    // Symbol table
-    Symbol symbols_[MAX_SYMBOLS];
+    // Per-section buffers (none for BSS), grown geometrically while emitting
+    uint8_t* section_buf_[NUM_SECTIONS];
+    size_t section_pages_[NUM_SECTIONS];
+    
+    // Per-section layout: final sizes and bases, and the emission cursor
+    size_t section_size_[NUM_SECTIONS];
+    size_t section_base_[NUM_SECTIONS];
+    size_t section_offset_[NUM_SECTIONS];
+    
+    // Symbol table in definition order, grown geometrically, plus an
+    // open-addressed (linear probing) index of symbol numbers, -1 = empty
+    Symbol* symbols_;
     int symbol_count_;
+    int symbol_capacity_;
+    int* symbol_index_;
+    int symbol_slots_;
+    
+    // Fixup records, grown geometrically, and the deferred chain
+    Fixup* fixups_;
+    int fixup_count_;
+    int fixup_capacity_;
+    int deferred_fixups_;
     
     // Current section
     Section current_section_;
@@ -154,13 +296,20 @@ private:
     // Current line for error reporting
     int current_line_;
     
-    // Pass tracking
-    bool is_first_pass_;
-    
-    // Peephole optimization state
-    uint32_t last_instr_;      // Last emitted instruction
-    size_t last_instr_offset_; // Offset of last instruction
-    bool has_last_instr_;      // Whether we have a previous instruction
+    // Peephole optimization state: the last instructions emitted since the
+    // last label or directive (oldest first), and the constant being built
+    // by a trailing MOVZ/MOVN/MOVK run
+    bool optimize_;
+    OptimizerStats opt_stats_;
+    PeepholeEntry window_[PEEPHOLE_WINDOW];
+    int window_count_;
+    int const_reg_;             // Destination of the run, -1 if none
+    bool const_is_64bit_;
+    uint64_t const_value_;
+    int const_words_;           // Words in the run
+    size_t const_offset_;       // Section offset of the run's first word
+    ASTNode* program_;          // Statements, for looking past a branch
+    ASTNode* branch_node_;      // Last B.cond entered in the window
     
     // Error handling
     void error(const char* message);
@@ -170,6 +319,22 @@ private:
     Symbol* add_symbol(const char* name, size_t len);
     Symbol* find_symbol(const char* name, size_t len);
     bool define_symbol(const char* name, size_t len, uint64_t address);
+    bool grow_symbols();
+    void declare_constants(ASTNode* ast);
+    
+    // Label fixups
+    void add_fixup(ASTNode* operand, FixupKind kind);
+    bool grow_fixups();
+    bool fixup_ready(const Fixup& fixup, bool laid_out) const;
+    void apply_fixup(const Fixup& fixup);
+    void resolve_fixups(Symbol* sym);
+    bool resolve_deferred_fixups();
+    
+    // Section layout
+    size_t current_offset() const;
+    bool grow_section(int section, size_t needed);
+    bool layout_sections();
+    void release();
     
     // Code emission
     void emit_byte(uint8_t byte);
@@ -178,16 +343,24 @@ private:
     void emit_quad(uint64_t quad);
     void align_to(size_t alignment);
     
-    // Two-pass assembly
-    bool first_pass(ASTNode* ast);
-    bool second_pass(ASTNode* ast);
-    
     // Node processing
     void process_node(ASTNode* node);
     void process_label(ASTNode* node);
     void process_instruction(ASTNode* node);
     void process_directive(ASTNode* node);
     
+    // Peephole pass (casm -O)
+    void reset_window();
+    void push_window(uint32_t word, size_t offset, int fixup);
+    void rewrite_word(size_t offset, uint32_t word);
+    void form_cbz(ASTNode* next);
+    bool flags_dead_after(const ASTNode* insn, int depth) const;
+    bool flags_dead_at(const ASTNode* target, int depth) const;
+    bool merge_load_store_pair(uint32_t word);
+    bool fold_constant(uint32_t word);
+    void track_constant(uint32_t word, size_t offset);
+    void remove_branch_to_next(Symbol* label);
+    
     // Instruction encoding
     // Requirements: 7.2, 7.3, 7.4, 7.5
     uint32_t encode_instruction(ASTNode* node);
@@ -206,7 +379,10 @@ private:
     int64_t get_immediate(ASTNode* operand);
     bool get_memory_operand(ASTNode* operand, int* base, int64_t* offset, 
                            bool* pre_index, bool* post_index);
-    int64_t resolve_label(ASTNode* operand);
+    bool symbol_value(ASTNode* operand, int64_t* value) const;
+    bool pc_relative_offset(ASTNode* operand, FixupKind kind, int64_t* offset);
+    bool is_label_operand(ASTNode* operand) const;
+    uint32_t encode_image_address(int rd, int64_t offset, bool fixed_size);
     
     // Instruction helpers
     bool token_equals(const Token& token, const char* str) const;
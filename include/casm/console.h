@@ -0,0 +1,49 @@
+/*
+ * EmberOS CASM Console Ring Header
+ * Shared-memory output ring between CASM programs and the kernel
+ *
+ * x26 points at a ConsoleRing while a program runs. The putc pseudo-op
+ * stores a byte at data[head % CONSOLE_RING_SIZE] and then advances head,
+ * without trapping. The kernel is the only consumer: it writes the bytes
+ * between tail and head to the UART and advances tail on the flush SVC,
+ * when the ring is full, before any other CASM SVC (so trapped output
+ * stays in order), on halt, and from the timer tick.
+ *
+ * head and tail are free-running 32-bit counters, so head - tail is the
+ * number of queued bytes even after they wrap.
+ */
+
+#ifndef EMBEROS_CASM_CONSOLE_H
+#define EMBEROS_CASM_CONSOLE_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint32_t = unsigned int;
+using size_t = unsigned long;
+
+namespace casm {
+
+/*
+ * Ring capacity; a power of two so putc can mask with one AND
+ */
+constexpr uint32_t CONSOLE_RING_SIZE = 4096;
+
+/*
+ * SVC number of the flush pseudo-op
+ */
+constexpr uint32_t SVC_FLUSH = 0x106;
+
+/*
+ * Ring layout; putc hardcodes these offsets (head +0, tail +4, data +8)
+ */
+struct ConsoleRing {
+    volatile uint32_t head;         // Written by the program
+    volatile uint32_t tail;         // Written by the kernel
+    uint8_t data[CONSOLE_RING_SIZE];
+};
+
+static_assert(sizeof(ConsoleRing) == 8 + CONSOLE_RING_SIZE, "putc hardcodes the ring layout");
+
+} // namespace casm
+
+#endif // EMBEROS_CASM_CONSOLE_H
@@ -0,0 +1,81 @@
+/*
+ * EmberOS CASM Framebuffer Header
+ * Character-cell canvas for the CASM graphics opcodes
+ *
+ * Programs draw into cells/colors, through the SVC opcodes or directly
+ * with the plot pseudo-op (x27 = cells, x25 = colors). fb_render() shows
+ * the canvas on the console. The first render draws every cell; after
+ * that a shadow copy of what the terminal shows is compared and only the
+ * changed runs are sent, using cursor movement relative to the line
+ * below the canvas. Any other console output in between moves that line,
+ * so output paths call fb_invalidate() and the next render is full again.
+ */
+
+#ifndef EMBEROS_CASM_FRAMEBUFFER_H
+#define EMBEROS_CASM_FRAMEBUFFER_H
+
+namespace casm {
+
+/*
+ * Canvas limits; rows are FB_STRIDE bytes so plot can address them
+ */
+constexpr int FB_MAX_WIDTH = 80;
+constexpr int FB_MAX_HEIGHT = 24;
+constexpr int FB_ROWS = 25;
+constexpr int FB_STRIDE = 81;
+
+/*
+ * Unchanged cells a changed run absorbs rather than ending and
+ * repositioning the cursor (a cursor move costs about this many bytes)
+ */
+constexpr int FB_RUN_GAP = 4;
+
+/*
+ * Canvas and the shadow of what the terminal currently shows
+ * Color bytes are fg | bg << 4
+ */
+struct Framebuffer {
+    char cells[FB_ROWS][FB_STRIDE];
+    char colors[FB_ROWS][FB_MAX_WIDTH];
+    char shown[FB_ROWS][FB_MAX_WIDTH];
+    char shown_colors[FB_ROWS][FB_MAX_WIDTH];
+    int width;
+    int height;
+    bool active;
+    int fg;
+    int bg;
+    bool presented;             // shown[] is on screen above the cursor
+    int shown_width;
+    int shown_height;
+};
+
+/*
+ * Inactive canvas, white on black, nothing presented
+ */
+void fb_reset(Framebuffer* fb);
+
+/*
+ * Blank every cell (white on black)
+ */
+void fb_clear(Framebuffer* fb);
+
+/*
+ * Set one cell in the current colors (ignored outside the canvas)
+ */
+void fb_plot(Framebuffer* fb, int x, int y, char ch);
+
+/*
+ * Show the canvas: everything the first time, then only changed cells
+ */
+void fb_render(Framebuffer* fb);
+
+/*
+ * Other output moved the cursor; the next render redraws everything
+ */
+inline void fb_invalidate(Framebuffer* fb) {
+    fb->presented = false;
+}
+
+} // namespace casm
+
+#endif // EMBEROS_CASM_FRAMEBUFFER_H
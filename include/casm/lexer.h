@@ -17,6 +17,8 @@ using int64_t = long long;
 using size_t = unsigned long;
 using uintptr_t = unsigned long;
 
+#include "casm/opcodes.h"
+
 namespace casm {
 
 /*
@@ -55,6 +57,7 @@ struct Token {
     size_t length;          // Length of token text
     int line;               // Line number (1-based)
     int64_t number_value;   // Numeric value for NUMBER tokens
+    Opcode opcode;          // Mnemonic for IDENTIFIER tokens, else Opcode::NONE
 };
 
 /*
@@ -76,6 +79,12 @@ public:
      */
     explicit Lexer(const char* source);
     
+    /*
+     * Construct a lexer over length bytes of source
+     * The source need not be null-terminated (e.g. a ramfs::map_file view)
+     */
+    Lexer(const char* source, size_t length);
+    
     /*
      * Get the next token from the source
      * Advances the lexer position
@@ -97,11 +106,12 @@ public:
     /*
      * Check if lexer has reached end of input
      */
-    bool is_at_end() const { return *current_ == '\0'; }
+    bool is_at_end() const { return current_ >= end_ || *current_ == '\0'; }
 
 private:
     const char* source_;    // Original source string
     const char* current_;   // Current position in source
+    const char* end_;       // One past the last source character
     const char* start_;     // Start of current token
     int line_;              // Current line number
     
@@ -154,6 +164,7 @@ enum class ExtendedOpcode : uint16_t {
     PRTC  = 0x101,   // Print character in w0
     PRTN  = 0x102,   // Print number in x0
     INP   = 0x103,   // Input character, result in w0
+    FLUSH = 0x106,   // Write out the console ring (putc stores to it without an SVC)
     
     // Graphics opcodes (0x110-0x11F)
     CLS   = 0x110,   // Clear canvas area (not whole screen)
@@ -163,6 +174,7 @@ enum class ExtendedOpcode : uint16_t {
     BOX   = 0x114,   // Draw box at x0,y0 size x1,y1
     RESET = 0x115,   // Reset terminal colors
     CANVAS= 0x116,   // Set canvas size (w0=width, w1=height) - creates drawing area
+    RENDER= 0x117,   // Show the canvas now (only changed cells after the first)
     
     // System opcodes (0x1F0-0x1FF)
     SLEEP = 0x1F0,   // Sleep for x0 milliseconds
@@ -0,0 +1,244 @@
+/*
+ * EmberOS CASM Opcode Table Header
+ * Mnemonic, condition code and shift name lookup for the lexer and code generator
+ *
+ * Every mnemonic CASM recognizes has an Opcode. The lexer resolves an
+ * identifier's Opcode once when it builds the token, so the code generator
+ * dispatches on an integer instead of comparing strings per instruction.
+ * Each entry carries the encoder class that handles it and a template
+ * word the encoder ORs operand fields into.
+ *
+ * Requirements: 7.2, 7.3, 7.4, 7.5
+ */
+
+#ifndef EMBEROS_CASM_OPCODES_H
+#define EMBEROS_CASM_OPCODES_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint16_t = unsigned short;
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using size_t = unsigned long;
+
+namespace casm {
+
+/*
+ * Longest mnemonic in the table, excluding the terminator
+ */
+constexpr size_t MAX_MNEMONIC_LENGTH = 7;
+
+/*
+ * Instruction mnemonics, in the same (alphabetical) order as the opcode
+ * table so an Opcode indexes its entry directly
+ */
+enum class Opcode : uint8_t {
+    NONE,           // Not a mnemonic (labels, registers, directive names)
+    ABS,
+    ADC,
+    ADCS,
+    ADD,
+    ADDS,
+    AND,
+    ANDS,
+    ASR,
+    B,
+    B_AL,
+    B_CC,
+    B_CS,
+    B_EQ,
+    B_GE,
+    B_GT,
+    B_HI,
+    B_HS,
+    B_LE,
+    B_LO,
+    B_LS,
+    B_LT,
+    B_MI,
+    B_NE,
+    B_PL,
+    B_VC,
+    B_VS,
+    BAL,
+    BCC,
+    BCS,
+    BEQ,
+    BGE,
+    BGT,
+    BHI,
+    BHS,
+    BIC,
+    BICS,
+    BL,
+    BLE,
+    BLO,
+    BLR,
+    BLS,
+    BLT,
+    BMI,
+    BNE,
+    BOX,
+    BPL,
+    BR,
+    BVC,
+    BVS,
+    CANVAS,
+    CBNZ,
+    CBZ,
+    CLS,
+    CMN,
+    CMP,
+    DMB,
+    DSB,
+    EON,
+    EOR,
+    FADD,
+    FCOPY,
+    FCREAT,
+    FDEL,
+    FDIV,
+    FEXIST,
+    FLUSH,
+    FMOV,
+    FMOVE,
+    FMUL,
+    FREAD,
+    FSUB,
+    FWRITE,
+    HALT,
+    HVC,
+    INP,
+    INPS,
+    ISB,
+    LDAR,
+    LDAXR,
+    LDP,
+    LDR,
+    LDRB,
+    LDRH,
+    LDRSB,
+    LDRSH,
+    LDRSW,
+    LINE,
+    LSL,
+    LSR,
+    MADD,
+    MEMCPY,
+    MEMSET,
+    MNEG,
+    MOV,
+    MOVK,
+    MOVN,
+    MOVZ,
+    MRS,
+    MSR,
+    MSUB,
+    MUL,
+    MVN,
+    NEG,
+    NEGS,
+    NGC,
+    NGCS,
+    NOP,
+    ORN,
+    ORR,
+    PLOT,
+    PRT,
+    PRTC,
+    PRTN,
+    PRTX,
+    PUTC,
+    RENDER,
+    RESET,
+    RET,
+    RND,
+    ROR,
+    SBC,
+    SBCS,
+    SDIV,
+    SETC,
+    SEV,
+    SEVL,
+    SLEEP,
+    SMC,
+    STLR,
+    STLXR,
+    STP,
+    STR,
+    STRB,
+    STRH,
+    STRLEN,
+    SUB,
+    SUBS,
+    SVC,
+    TBNZ,
+    TBZ,
+    TICK,
+    TST,
+    UDIV,
+    WFE,
+    WFI,
+    COUNT
+};
+
+/*
+ * Which encoder handles an opcode
+ */
+enum class EncoderClass : uint8_t {
+    NONE,           // Not an instruction
+    FIXED,          // Whole instruction is the template (NOP, CASM SVC opcodes)
+    BARRIER,        // DMB/DSB/ISB: template | option << 8
+    EXCEPTION,      // SVC/HVC/SMC: template | imm16 << 5
+    RET,            // RET {Xn}: template | Rn << 5, Rn defaults to x30
+    BRANCH_REG,     // BR/BLR Xn: template | Rn << 5
+    BRANCH,         // B/BL label
+    BRANCH_COND,    // B.cond label; template holds the condition number
+    CBZ,            // CBZ/CBNZ; template is 1 for CBNZ
+    MOV,            // MOV/MOVZ/MOVN/MOVK
+    DATA_PROC,      // Register form: template | sf << 31 | Rm << 16 | Rn << 5 | Rd
+    LOAD_STORE,     // LDR/STR and their byte/half/signed variants
+    LOAD_STORE_PAIR,// LDP/STP; template is 1 for loads
+    PLOT,           // CASM plot: inline framebuffer store sequence
+    PUTC,           // CASM putc: inline console ring store sequence
+    HALT,           // CASM halt: template SVC followed by RET
+    UNSUPPORTED     // Recognized mnemonic with no encoder yet
+};
+
+/*
+ * Opcode table entry
+ */
+struct OpcodeInfo {
+    char name[MAX_MNEMONIC_LENGTH + 1];     // Lowercase mnemonic
+    Opcode opcode;
+    EncoderClass encoder;
+    uint32_t bits;                          // Encoding template
+};
+
+/*
+ * Look up a mnemonic (case-insensitive, not null-terminated)
+ * Returns nullptr if it is not an instruction mnemonic
+ */
+const OpcodeInfo* find_opcode(const char* name, size_t length);
+
+/*
+ * Get the table entry for an opcode
+ * Opcode::NONE yields an entry with EncoderClass::NONE
+ */
+const OpcodeInfo& opcode_info(Opcode opcode);
+
+/*
+ * Look up a condition code suffix ("eq", "hs", ...)
+ * Returns the 4-bit condition number, or -1 if unknown
+ */
+int find_condition(const char* name, size_t length);
+
+/*
+ * Look up a shift name ("lsl", "lsr", "asr", "ror")
+ * Returns the 2-bit shift type, or -1 if unknown
+ */
+int find_shift(const char* name, size_t length);
+
+} // namespace casm
+
+#endif // EMBEROS_CASM_OPCODES_H
@@ -33,14 +33,15 @@ enum class NodeType {
 constexpr int MAX_AST_CHILDREN = 4;
 
 /*
- * Maximum number of statements in a program
+ * AST nodes are carved from chunks of this many pages, allocated on demand
+ * so node addresses stay stable as the pool grows
  */
-constexpr int MAX_STATEMENTS = 256;
+constexpr size_t AST_CHUNK_PAGES = 4;
 
 /*
- * Maximum number of nodes in AST pool
+ * Initial capacity of the statement array; it doubles when full
  */
-constexpr int MAX_AST_NODES = 512;
+constexpr int INITIAL_STATEMENTS = 512;
 
 /*
  * Maximum error message length
@@ -84,6 +85,9 @@ struct ASTNode {
     bool is_64bit;                      // For registers: true=X, false=W
 };
 
+// Chunk of the AST node pool (defined in parser.cpp)
+struct NodeChunk;
+
 /*
  * Parser class for C.ASM source code
  * 
@@ -104,6 +108,14 @@ public:
      */
     explicit Parser(Lexer& lexer);
     
+    /*
+     * Release the node pool and statement array
+     */
+    ~Parser();
+    
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
+    
     /*
      * Parse the entire source and return AST root
      * Returns nullptr on error
@@ -138,12 +150,13 @@ private:
     char error_msg_[MAX_ERROR_LEN];
     int error_line_;
     
-    // AST node pool (simple allocation)
-    ASTNode node_pool_[MAX_AST_NODES];
+    // AST node pool: chunks from memory::alloc_pages, newest first
+    NodeChunk* chunks_;
     int node_count_;
     
-    // Statement array for PROGRAM node
-    ASTNode* statements_[MAX_STATEMENTS];
+    // Statement array for PROGRAM node, grown geometrically
+    ASTNode** statements_;
+    int statement_capacity_;
     int statement_count_;
     
     // Token handling
@@ -160,6 +173,8 @@ private:
     // AST node creation
     ASTNode* alloc_node(NodeType type);
     ASTNode* create_node(NodeType type, const Token& token);
+    bool grow_statements();
+    void release();
     
     // Parsing methods
     ASTNode* parse_program();
@@ -0,0 +1,81 @@
+/*
+ * EmberOS CASM Profiler Header
+ * Timer-sampled execution profile of a native CASM program
+ *
+ * While a profiled program runs, a periodic timer interrupts it every
+ * PROF_INTERVAL_MS and adds one sample: to the counter of the instruction
+ * word the interrupted ELR points at when it lies inside the image, to
+ * outside otherwise. The CASM SVC dispatcher also counts calls and counter
+ * ticks per SVC number. IRQs are masked inside an SVC, so a tick that
+ * lands there is taken on return and charged to the instruction after
+ * the svc; svc_ticks is the exact figure.
+ */
+
+#ifndef EMBEROS_CASM_PROFILE_H
+#define EMBEROS_CASM_PROFILE_H
+
+// Freestanding type definitions
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using size_t = unsigned long;
+
+namespace casm {
+
+/*
+ * Sampling period
+ */
+constexpr uint64_t PROF_INTERVAL_MS = 1;
+
+/*
+ * SVC numbers 0x100 + n are counted in slot n
+ */
+constexpr uint32_t PROF_SVC_BASE = 0x100;
+constexpr size_t PROF_SVC_SLOTS = 256;
+
+/*
+ * Hottest instructions casm prof lists
+ */
+constexpr size_t PROF_TOP = 16;
+
+struct Profile {
+    uint32_t* hits;             // One counter per instruction word of the image
+    size_t words;
+    size_t pages;
+    uint64_t samples;           // All samples taken while the program ran
+    uint64_t outside;           // Samples with the ELR outside the image
+    uint64_t svc_calls[PROF_SVC_SLOTS];
+    uint64_t svc_ticks[PROF_SVC_SLOTS];
+};
+
+/*
+ * Allocate zeroed counters for an image of image_size bytes
+ * Returns false if no memory is available
+ */
+bool profile_init(Profile* prof, size_t image_size);
+
+/*
+ * Release the counters
+ */
+void profile_free(Profile* prof);
+
+/*
+ * Record one sample at byte offset pc into the image (IRQ context)
+ */
+inline void profile_sample(Profile* prof, uint64_t pc) {
+    prof->samples++;
+    if (pc / 4 < prof->words) {
+        prof->hits[pc / 4]++;
+    } else {
+        prof->outside++;
+    }
+}
+
+/*
+ * Fill offsets with the byte offsets of up to max sampled instructions,
+ * most samples first; returns how many were written
+ */
+size_t profile_top(const Profile* prof, uint64_t* offsets, size_t max);
+
+} // namespace casm
+
+#endif // EMBEROS_CASM_PROFILE_H
@@ -0,0 +1,171 @@
+/*
+ * EmberOS CASM Virtual Machine Header
+ * Safe-mode interpreter for CASM binaries (casm run -v / -d)
+ *
+ * The image is decoded once into an array of VmOps with the register
+ * and immediate fields unpacked and branch targets turned into op
+ * indices. run() then dispatches through a label table (computed goto),
+ * so the per-instruction cost is one indirect jump and a budget check.
+ * Condition flags are not computed by compares; the operands of the last
+ * flag-setting instruction are kept and NZCV is derived only when a
+ * conditional branch asks for it.
+ *
+ * Every memory access is bounds-checked against the program arena:
+ * out-of-range loads read zero and out-of-range stores are dropped.
+ * Addresses are arena offsets (x28, the image base, is 0), SP starts at
+ * the top of the arena, and x30 starts past the image so a top-level RET
+ * ends the program.
+ */
+
+#ifndef EMBEROS_CASM_VM_H
+#define EMBEROS_CASM_VM_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint16_t = unsigned short;
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using int16_t = short;
+using int32_t = int;
+using int64_t = long long;
+using size_t = unsigned long;
+
+namespace casm {
+
+/*
+ * Default instruction budget for casm run -v/-d (-b overrides it)
+ */
+constexpr uint64_t DEFAULT_VM_BUDGET = 10000000;
+
+/*
+ * Register file: x0-x30, SP, a zero register and a sink for writes to
+ * XZR/WZR, so decoded ops never test for register 31
+ */
+constexpr int VM_SP = 31;
+constexpr int VM_ZR = 32;
+constexpr int VM_SINK = 33;
+constexpr int VM_REGISTERS = 34;
+
+/*
+ * Why run() returned
+ */
+enum class VmStatus {
+    BUDGET,         // Instruction budget used up (run again to continue)
+    HALTED,         // halt (SVC #0x1FF)
+    RETURNED,       // Top-level RET, or control left the image
+    STOPPED,        // SVC handler asked to stop
+    UNKNOWN         // Instruction the VM does not implement
+};
+
+/*
+ * Handler for SVC #imm16 other than halt
+ * Returns false to stop the program
+ */
+class Vm;
+using VmSvcHandler = bool (*)(Vm& vm, uint32_t number, void* context);
+
+// Decoded instruction, private to vm.cpp
+struct VmOp;
+
+/*
+ * Lazily evaluated NZCV: the last flag-setting operation and its inputs
+ */
+struct VmFlags {
+    uint8_t kind;           // Logical, add or subtract
+    bool wide;              // 64-bit operation
+    uint64_t a;
+    uint64_t b;
+    uint64_t result;
+};
+
+/*
+ * CASM virtual machine
+ *
+ * Usage:
+ *   Vm vm;
+ *   if (vm.load(arena, arena_size, image_size)) {
+ *       vm.set_svc_handler(handler, context);
+ *       VmStatus status = vm.run(DEFAULT_VM_BUDGET);
+ *   }
+ */
+class Vm {
+public:
+    Vm();
+    ~Vm();
+
+    Vm(const Vm&) = delete;
+    Vm& operator=(const Vm&) = delete;
+
+    /*
+     * Predecode the first image_size bytes of memory and reset the
+     * registers; memory stays owned by the caller
+     * Returns false if the op array cannot be allocated
+     */
+    bool load(uint8_t* memory, size_t memory_size, size_t image_size);
+
+    /*
+     * Set the handler for extended-opcode SVCs
+     */
+    void set_svc_handler(VmSvcHandler handler, void* context) {
+        svc_handler_ = handler;
+        svc_context_ = context;
+    }
+
+    /*
+     * Execute at most budget instructions from the current PC
+     * run(1) single-steps
+     */
+    VmStatus run(uint64_t budget);
+
+    /*
+     * Register access (0-30 = x0-x30, VM_SP = SP)
+     */
+    uint64_t& reg(int n) { return regs_[n]; }
+    uint64_t reg(int n) const { return regs_[n]; }
+
+    /*
+     * Byte offset of the next instruction
+     */
+    uint64_t pc() const { return pc_; }
+
+    /*
+     * Instruction word at the PC, for fault reports and the debugger
+     */
+    uint32_t current_word() const;
+
+    /*
+     * Derived NZCV (bit 3 = N ... bit 0 = V)
+     */
+    uint32_t nzcv() const;
+
+    uint8_t* memory() { return memory_; }
+    size_t memory_size() const { return memory_size_; }
+
+    /*
+     * Instructions executed since load()
+     */
+    uint64_t executed() const { return executed_; }
+
+private:
+    void release();
+
+    uint8_t* memory_;
+    size_t memory_size_;
+    size_t image_size_;
+
+    VmOp* ops_;
+    size_t op_count_;           // Decoded words, plus the end-of-image op
+    size_t op_pages_;
+
+    uint64_t regs_[VM_REGISTERS];
+    VmFlags flags_;
+    uint64_t pc_;
+    uint64_t executed_;
+
+    VmSvcHandler svc_handler_;
+    void* svc_context_;
+};
+
+} // namespace casm
+
+#endif // EMBEROS_CASM_VM_H
@@ -1,6 +1,6 @@
 /*
  * EmberOS Vi-like Text Editor
- * Simple line-based text editor
+ * Gap-buffer text editor with incremental redraw
  */
 
 #ifndef EMBEROS_EDITOR_H
@@ -10,10 +10,6 @@
 
 namespace editor {
 
-// Editor limits
-constexpr size_t MAX_LINES = 256;
-constexpr size_t MAX_LINE_LEN = 256;
-
 // Editor result
 enum class Result {
     SAVED,
@@ -3,6 +3,10 @@
  * ARM GICv2 for QEMU virt machine
  * 
  * Requirements: 3.1
+ *
+ * The distributor is shared by all CPUs; each CPU has its own CPU
+ * interface at the same address, and its own banked copy of the SGI/PPI
+ * (0-31) enable, pending and priority registers.
  */
 
 #ifndef EMBEROS_GIC_H
@@ -60,6 +64,11 @@ constexpr uint32_t GICC_HPPIR      = 0x018;  // Highest Priority Pending Interru
  */
 void init();
 
+/*
+ * Initialize the calling secondary CPU's interface and enable its SGIs
+ */
+void init_cpu();
+
 /*
  * Enable a specific IRQ
  */
@@ -72,6 +81,7 @@ void disable_irq(uint32_t irq);
 
 /*
  * Set priority for a specific IRQ (0 = highest, 255 = lowest)
+ * For an SGI or PPI this sets the calling CPU's banked copy
  */
 void set_priority(uint32_t irq, uint8_t priority);
 
@@ -82,17 +92,19 @@ void set_target(uint32_t irq, uint8_t cpu_mask);
 
 /*
  * Acknowledge an interrupt (read IAR)
- * Returns the IRQ number (1023 = spurious)
+ * Returns the IAR value: the IRQ number in bits 9:0 (1023 = spurious)
+ * and, for an SGI, the sending CPU in bits 12:10
  */
 uint32_t acknowledge_irq();
 
 /*
- * Signal end of interrupt (write EOIR)
+ * Signal end of interrupt (write EOIR) with the value acknowledge_irq()
+ * returned; an SGI is only completed with its source CPU included
  */
-void end_irq(uint32_t irq);
+void end_irq(uint32_t iar);
 
 /*
- * Send Software Generated Interrupt (SGI)
+ * Send Software Generated Interrupt (SGI) to the CPUs in target_list
  */
 void send_sgi(uint32_t irq, uint8_t target_list);
 
@@ -3,6 +3,14 @@
  * ARM64 exception handling and GIC driver
  * 
  * Requirements: 3.1, 3.2, 3.3, 3.4, 3.5
+ *
+ * One IRQ exception drains every interrupt pending at or above the
+ * running priority before returning, so a burst pays for one context
+ * save. Handlers of PRIORITY_NORMAL IRQs (the timer and its callbacks)
+ * run with IRQs unmasked: the GIC then only signals interrupts of higher
+ * priority, which preempt them through a nested exception. Such handlers
+ * must take their spinlocks with the irqsave variants. Higher-priority
+ * handlers run masked and must be short.
  */
 
 #ifndef EMBEROS_INTERRUPTS_H
@@ -23,9 +31,35 @@ namespace interrupts {
 constexpr uint32_t MAX_IRQ = 256;
 
 // Common IRQ numbers for QEMU virt machine
+constexpr uint32_t IRQ_PMU = 23;        // PMU counter overflow (PPI)
 constexpr uint32_t IRQ_TIMER = 30;      // Non-secure physical timer (PPI)
 constexpr uint32_t IRQ_UART = 33;       // UART0 (SPI)
 
+// GIC priorities (lower value = higher priority; the default is NORMAL)
+constexpr uint8_t PRIORITY_HIGH = 0x80;     // UART: its RX FIFO overflows quickly
+constexpr uint8_t PRIORITY_IPI = 0x90;      // SGIs: another CPU may be waiting
+constexpr uint8_t PRIORITY_NORMAL = 0xA0;   // Everything else; preemptible
+
+/*
+ * Per-IRQ statistics, kept per CPU; times are counter ticks
+ */
+struct IrqStats {
+    uint64_t count;
+    uint32_t max_latency;   // Assertion to handler start; timer PPI only (from CVAL)
+    uint32_t max_queue;     // Exception entry to handler start (behind a batch)
+    uint32_t max_time;      // Handler start to end of interrupt
+};
+
+/*
+ * Per-CPU IRQ exception statistics
+ */
+struct CpuIrqStats {
+    uint64_t entries;       // IRQ exceptions taken
+    uint64_t handled;       // Interrupts handled by them
+    uint64_t nested;        // Exceptions that preempted a handler
+    uint32_t max_batch;     // Most interrupts handled by one exception
+};
+
 // Interrupt handler function type
 using Handler = void (*)(uint32_t irq);
 
@@ -42,6 +76,27 @@ struct ExceptionContext {
     uint64_t far;           // Fault Address Register
 };
 
+// Size of the ExceptionContext frame save_context pushes
+constexpr size_t FRAME_SIZE = 288;
+
+static_assert(sizeof(ExceptionContext) == FRAME_SIZE, "ExceptionContext must match vectors.S");
+
+/*
+ * Mask IRQs, returning the previous DAIF value for restore()
+ */
+static inline uint64_t save_and_disable() {
+    uint64_t flags;
+    asm volatile("mrs %0, daif\n\tmsr daifset, #2" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+/*
+ * Restore the DAIF value returned by save_and_disable()
+ */
+static inline void restore(uint64_t flags) {
+    asm volatile("msr daif, %0" :: "r"(flags) : "memory");
+}
+
 /*
  * Initialize interrupt handling
  * Sets up exception vectors and GIC
@@ -60,6 +115,36 @@ void register_handler(uint32_t irq, Handler handler);
  */
 void unregister_handler(uint32_t irq);
 
+/*
+ * Set an IRQ's GIC priority (PRIORITY_*)
+ * SGI and PPI priorities are banked per CPU; init_cpu() applies them to
+ * each secondary CPU
+ */
+void set_priority(uint32_t irq, uint8_t priority);
+
+/*
+ * Set up the calling secondary CPU's GIC interface and banked priorities
+ */
+void init_cpu();
+
+/*
+ * The frame of the code the current IRQ interrupted (not of a handler a
+ * nested IRQ preempted), or nullptr outside IRQ handlers
+ */
+ExceptionContext* irq_context();
+
+/*
+ * Copy the statistics of an IRQ, or of all IRQs, taken on a CPU
+ * Returns false if cpu or irq is out of range
+ */
+bool get_irq_stats(uint32_t cpu, uint32_t irq, IrqStats* stats);
+bool get_cpu_stats(uint32_t cpu, CpuIrqStats* stats);
+
+/*
+ * Zero all IRQ statistics
+ */
+void reset_stats();
+
 /*
  * Enable specific IRQ in GIC
  * Requirements: 3.1
@@ -89,6 +174,11 @@ bool is_enabled();
 
 } // namespace interrupts
 
+namespace casm {
+struct ConsoleRing;
+struct Profile;
+}
+
 /*
  * CASM Native Execution
  * Run compiled CASM code natively with SVC trapping
@@ -97,14 +187,22 @@ namespace casm_native {
 
 /*
  * Initialize native execution environment
+ * With profile set, timer samples and SVC times are recorded into it
  */
-void init(uint8_t* buffer, size_t size);
+void init(uint8_t* buffer, size_t size, casm::Profile* profile = nullptr);
 
 /*
  * Cleanup after execution
  */
 void cleanup();
 
+/*
+ * Write out the bytes putc queued in a console ring (casm/console.h)
+ * With block false only what the UART takes without waiting is written
+ * Returns true if any bytes were written
+ */
+bool drain_console(casm::ConsoleRing* ring, bool block);
+
 /*
  * Check if halt was requested
  */
@@ -112,9 +210,17 @@ bool is_halted();
 
 /*
  * Run code natively starting at given address
- * Returns when halt is called or error occurs
+ * Returns when halt is called or error occurs, with the number of SVCs
+ * the program made
+ */
+uint64_t run(void* code_start);
+
+/*
+ * Time count SVC round trips (TICK) in counter ticks, through the vectors.S
+ * fast path or, with fast_path false, the full save_context path
+ * Returns 0 if no memory is available
  */
-void run(void* code_start);
+uint64_t bench_svc(uint32_t count, bool fast_path);
 
 } // namespace casm_native
 
@@ -0,0 +1,73 @@
+/*
+ * EmberOS Kernel Library Header
+ * Freestanding memory and string routines shared by all subsystems
+ *
+ * Bulk routines work a 64-bit word at a time and move 64-byte blocks as
+ * four LDP/STP pairs. They rely on unaligned access to Normal memory,
+ * which is available once boot.S has enabled the MMU, so they must not
+ * be used on Device memory (MMIO).
+ *
+ * Building with KLIB_NEON=1 compiles klib.cpp without -mgeneral-regs-only
+ * and uses 128-bit SIMD registers (q0-q3) for the block loops. Exception
+ * entry and task switches do not save SIMD state, so each block runs with
+ * IRQs masked; nothing else in the kernel or in CASM programs may keep
+ * values in SIMD registers.
+ *
+ * The C symbols memcpy, memmove, memset and memcmp are also exported,
+ * since the compiler may emit calls to them for struct copies and
+ * zeroing loops even in a freestanding build.
+ */
+
+#ifndef EMBEROS_KLIB_H
+#define EMBEROS_KLIB_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint16_t = unsigned short;
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using size_t = unsigned long;
+using uintptr_t = unsigned long;
+
+namespace klib {
+
+/*
+ * Copy n bytes from src to dst; the regions must not overlap,
+ * except that dst below src is safe (the copy runs forward)
+ */
+void* memcpy(void* dst, const void* src, size_t n);
+
+/*
+ * Copy n bytes from src to dst; the regions may overlap
+ */
+void* memmove(void* dst, const void* src, size_t n);
+
+/*
+ * Fill n bytes at dst with the byte value
+ */
+void* memset(void* dst, int value, size_t n);
+
+/*
+ * Compare n bytes; returns <0, 0 or >0 like the C library
+ */
+int memcmp(const void* a, const void* b, size_t n);
+
+/*
+ * Length of a NUL-terminated string
+ */
+size_t strlen(const char* s);
+
+/*
+ * Compare two NUL-terminated strings; returns <0, 0 or >0
+ */
+int strcmp(const char* a, const char* b);
+
+/*
+ * Copy at most size - 1 characters of src and NUL-terminate dst
+ * Does nothing if size is 0
+ */
+void strlcpy(char* dst, const char* src, size_t size);
+
+} // namespace klib
+
+#endif // EMBEROS_KLIB_H
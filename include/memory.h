@@ -1,6 +1,7 @@
 /*
  * EmberOS Memory Manager Header
- * Physical page allocator using bitmap-based tracking
+ * Physical page allocator: buddy system with per-order free lists,
+ * backed by a bitmap of allocated pages
  * 
  * Requirements: 2.1, 2.2, 2.3, 2.4
  */
@@ -21,11 +22,17 @@ namespace memory {
 // Page size constant (4KB)
 constexpr size_t PAGE_SIZE = 4096;
 
+// Largest buddy block is 2^MAX_ORDER pages (128MB with 4KB pages)
+constexpr size_t MAX_ORDER = 15;
+
 // Memory statistics structure
 struct MemStats {
     size_t total_pages;
     size_t free_pages;
     size_t used_pages;
+    size_t largest_free_block;          // Pages in the largest free buddy block
+    uint32_t fragmentation;             // 0-100: share of free pages outside the largest block
+    size_t free_blocks[MAX_ORDER + 1];  // Free block count per order
 };
 
 /*
@@ -37,6 +44,8 @@ void init(uintptr_t start, uintptr_t end);
 
 /*
  * Allocate n contiguous pages
+ * Takes the smallest free block of order >= ceil(log2(n)), splits it down,
+ * and returns the unused tail pages to the free lists
  * Returns physical address of allocated pages, or nullptr on failure
  * Requirements: 2.2, 2.3
  */
@@ -44,14 +53,23 @@ void* alloc_pages(size_t n);
 
 /*
  * Free previously allocated pages
- * Marks pages as available for reuse
+ * Any page-aligned sub-range of an allocation may be freed; freed pages
+ * are coalesced with their free buddies. Pages not currently allocated
+ * are ignored.
  * Requirements: 2.4
  */
 void free_pages(void* addr, size_t n);
 
+/*
+ * Get the start of the naturally aligned 2^order page block containing addr
+ * Blocks returned by alloc_pages(1 << order) always start on such a
+ * boundary, so this maps any address inside one back to its first page
+ */
+void* block_base(void* addr, size_t order);
+
 /*
  * Get memory statistics
- * Returns total, free, and used page counts
+ * Returns page counts plus free-block and fragmentation figures
  */
 MemStats get_stats();
 
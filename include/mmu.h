@@ -0,0 +1,43 @@
+/*
+ * EmberOS MMU and Cache Header
+ * Translation and cache state set up by boot.S, plus cache maintenance
+ *
+ * boot.S identity-maps RAM (0x40000000, 128MB) as Normal write-back
+ * cacheable memory and the low 1GB (GIC, UART) as Device-nGnRE, then
+ * enables the MMU with I- and D-caches on.
+ */
+
+#ifndef EMBEROS_MMU_H
+#define EMBEROS_MMU_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint16_t = unsigned short;
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using size_t = unsigned long;
+using uintptr_t = unsigned long;
+
+namespace mmu {
+
+/*
+ * Check whether the MMU and both caches are enabled (SCTLR_EL1 M, C, I)
+ */
+bool caches_enabled();
+
+/*
+ * Make freshly written instructions visible to instruction fetch
+ * Cleans the D-cache to the point of unification and invalidates the
+ * I-cache over [addr, addr + len). Must be called after writing code
+ * to memory and before branching to it.
+ */
+void sync_icache(const void* addr, size_t len);
+
+/*
+ * Print translation and cache configuration to the console
+ */
+void print_info();
+
+} // namespace mmu
+
+#endif // EMBEROS_MMU_H
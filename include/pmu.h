@@ -0,0 +1,80 @@
+/*
+ * EmberOS PMU Driver Header
+ * ARMv8 Performance Monitors: cycle and event counters for perf stat
+ *
+ * Every CPU counts from boot: the 64-bit cycle counter plus one event
+ * counter per Event, at EL0 and EL1 alike. The event counters are 32
+ * bits wide; their overflow interrupt (the PMU PPI) adds 2^32 to a
+ * per-CPU software high half, so readings are 64-bit. Counters are never
+ * stopped or reset, so a measurement is the difference of two samples
+ * taken on the same CPU, and nested measurements do not disturb each
+ * other. They count everything that CPU runs, kernel and IRQs included.
+ *
+ * EL0 access (PMUSERENR_EL0) stays off: CASM programs cannot read them.
+ */
+
+#ifndef EMBEROS_PMU_H
+#define EMBEROS_PMU_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using size_t = unsigned long;
+
+namespace pmu {
+
+/*
+ * Events counted, each on its own event counter
+ */
+enum class Event : uint32_t {
+    INSTRUCTIONS = 0,   // INST_RETIRED
+    L1D_ACCESSES,       // L1D_CACHE
+    L1D_REFILLS,        // L1D_CACHE_REFILL
+    L2D_REFILLS,        // L2D_CACHE_REFILL
+    BRANCH_MISSES,      // BR_MIS_PRED
+    EXCEPTIONS,         // EXC_TAKEN
+};
+
+constexpr uint32_t NUM_EVENTS = 6;
+
+struct Counts {
+    uint64_t cycles;
+    uint64_t events[NUM_EVENTS];    // Indexed by Event
+};
+
+/*
+ * Detect the PMU and start counting on CPU 0
+ */
+void init();
+
+/*
+ * Start counting on the calling secondary CPU
+ */
+void init_cpu();
+
+/*
+ * Whether the CPU has a PMU, and whether it counts an event (the
+ * implementation may lack it, or have too few counters)
+ */
+bool available();
+bool supported(Event event);
+
+/*
+ * Name of an event, as perf list prints it
+ */
+const char* event_name(Event event);
+
+/*
+ * Read the calling CPU's counters
+ */
+void sample(Counts* counts);
+
+/*
+ * Counts on the calling CPU since start was sampled
+ */
+void since(const Counts* start, Counts* delta);
+
+} // namespace pmu
+
+#endif // EMBEROS_PMU_H
@@ -19,9 +19,9 @@ namespace ramfs {
 // Filesystem limits
 constexpr size_t MAX_FILENAME = 64;
 constexpr size_t MAX_PATH = 256;
-constexpr size_t MAX_FILES = 128;
+constexpr size_t MAX_FILES = 1024;
 constexpr size_t MAX_FILE_SIZE = 65536;  // 64KB per file
-constexpr size_t MAX_DIR_ENTRIES = 32;
+constexpr size_t MAX_DIR_ENTRIES = 256;
 
 // File types
 enum class FileType {
@@ -37,16 +37,29 @@ struct FSNode {
     char name[MAX_FILENAME];
     FileType type;
     size_t size;              // For files: content size, for dirs: entry count
+    size_t capacity;          // Bytes allocated for data (slab class or whole pages)
     uint8_t* data;            // For files: content, for dirs: nullptr
     FSNode* parent;           // Parent directory
     FSNode* children;         // For directories: first child
     FSNode* next;             // Next sibling in same directory
+    FSNode* hash_next;        // Next node in the same dentry hash bucket
+    uint32_t name_hash;       // Hash of name, checked before comparing names
+    uint32_t pins;            // Active map_file() views; blocks modification
+    bool image;               // data points into the boot image (read-only, capacity 0)
     bool in_use;
 };
 
 // Initialize the filesystem
 void init();
 
+/*
+ * Mount a boot image (see ramfs_image.h) into the tree
+ * Directories are created as needed and files reference the image bytes
+ * in place until first modified; the image must stay mapped for good.
+ * Returns false if the image is malformed or the tree is full.
+ */
+bool mount_image(const uint8_t* image, size_t size);
+
 // Path operations
 FSNode* get_root();
 FSNode* get_cwd();
@@ -61,6 +74,19 @@ size_t read_file(FSNode* node, uint8_t* buffer, size_t offset, size_t count);
 size_t write_file(FSNode* node, const uint8_t* buffer, size_t offset, size_t count);
 bool truncate_file(FSNode* node, size_t size);
 
+/*
+ * Map a file's contents for reading in place
+ * Sets *data and *length to a read-only view of the file bytes and pins
+ * the node: write, truncate and delete fail until unmap_file() is called.
+ * An empty file maps as (nullptr, 0). Returns false if node is not a file.
+ */
+bool map_file(FSNode* node, const uint8_t** data, size_t* length);
+
+/*
+ * Release a view obtained from map_file()
+ */
+void unmap_file(FSNode* node);
+
 // Directory operations
 FSNode* create_dir(const char* path);
 bool delete_dir(const char* path, bool recursive);
@@ -83,8 +109,11 @@ FSNode* dir_next(DirIterator* iter);
 struct FSStats {
     size_t total_nodes;
     size_t used_nodes;
-    size_t total_bytes;
+    size_t total_bytes;           // used_bytes plus free RAM, capped by the file limits
     size_t used_bytes;
+    size_t image_bytes;           // Part of used_bytes still served from the boot image
+    uint64_t path_cache_hits;     // resolve_path served from the path cache
+    uint64_t path_cache_misses;   // resolve_path that walked the tree
 };
 
 FSStats get_stats();
@@ -0,0 +1,56 @@
+/*
+ * EmberOS RAMFS Boot Image Format
+ * Directory tree packed at build time and linked into the kernel
+ *
+ * tools/mkramfs writes the image and ramfs::mount_image() mounts it at
+ * boot. Files are not copied: their nodes point straight at the image
+ * bytes and get a buffer of their own on the first write (copy on write).
+ *
+ * Layout, all fields little-endian:
+ *
+ *   ImageHeader
+ *   ImageEntry[entry_count]      parents before their children
+ *   name table                   NUL-terminated paths relative to /
+ *   file data                    each file IMAGE_ALIGN-aligned
+ *
+ * Offsets are from the start of the image. This header is shared with
+ * the host tool, so it only uses the fixed-size types both sides agree on.
+ */
+
+#ifndef EMBEROS_RAMFS_IMAGE_H
+#define EMBEROS_RAMFS_IMAGE_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint32_t = unsigned int;
+
+namespace ramfs {
+
+constexpr uint32_t IMAGE_MAGIC = 0x53464D45;    // "EMFS"
+constexpr uint32_t IMAGE_VERSION = 1;
+constexpr uint32_t IMAGE_ALIGN = 16;
+
+// ImageEntry::type
+constexpr uint32_t IMAGE_FILE = 0;
+constexpr uint32_t IMAGE_DIR = 1;
+
+struct ImageHeader {
+    uint32_t magic;             // IMAGE_MAGIC
+    uint32_t version;           // IMAGE_VERSION
+    uint32_t entry_count;
+    uint32_t size;              // Total image bytes
+};
+
+struct ImageEntry {
+    uint32_t type;              // IMAGE_FILE or IMAGE_DIR
+    uint32_t name_offset;       // Path in the name table
+    uint32_t data_offset;       // Files: first byte of content
+    uint32_t size;              // Files: content bytes
+};
+
+static_assert(sizeof(ImageHeader) == 16, "image header is 16 bytes");
+static_assert(sizeof(ImageEntry) == 16, "image entries are 16 bytes");
+
+} // namespace ramfs
+
+#endif // EMBEROS_RAMFS_IMAGE_H
@@ -0,0 +1,155 @@
+/*
+ * EmberOS Scheduler Header
+ * Preemptive round-robin scheduling of kernel tasks
+ *
+ * Every task has its own kernel stack. A task is switched out by saving
+ * its ExceptionContext frame (built by vectors.S on that stack) and
+ * returning another task's frame to the exception return path, either
+ * from the timer IRQ when the quantum expires or from SVC_YIELD when the
+ * task blocks. The boot thread that runs the shell is task 1; task 0 is
+ * the idle task, which only runs when nothing else is ready.
+ *
+ * Every CPU schedules its own tasks and has its own idle task (all with
+ * PID 0). A task is placed on a CPU when it is spawned and stays there.
+ */
+
+#ifndef EMBEROS_SCHED_H
+#define EMBEROS_SCHED_H
+
+#include "interrupts.h"
+
+namespace sched {
+
+// Task table size (including the shell and one idle task per CPU)
+constexpr size_t MAX_TASKS = 24;
+constexpr size_t MAX_TASK_NAME = 32;
+
+// Kernel stack per spawned task
+constexpr size_t TASK_STACK_PAGES = 16;
+
+// Default time slice; set_quantum_ms() changes it
+constexpr uint64_t DEFAULT_QUANTUM_MS = 20;
+
+// SVC number a task issues to give up the CPU (CASM uses 0x100-0x1FF)
+constexpr uint32_t SVC_YIELD = 0;
+
+/*
+ * Task state
+ */
+enum class TaskState {
+    FREE = 0,
+    READY,
+    RUNNING,
+    SLEEPING,
+    EXITED          // Finished; its stack is freed at the next switch
+};
+
+/*
+ * Task entry point; returning from it exits the task
+ */
+using TaskEntry = void (*)(void* arg);
+
+/*
+ * Task information for ps/top
+ */
+struct TaskInfo {
+    int pid;
+    TaskState state;
+    const char* name;
+    uint32_t cpu;               // CPU the task runs on
+    uint64_t start_ms;          // Uptime when the task was created
+    uint64_t cpu_ms;            // Measured time on the CPU
+    size_t stack_bytes;
+    uint64_t switches;          // Times the task was switched in
+};
+
+/*
+ * Initialize the scheduler: the calling (boot) thread becomes task 1 and
+ * an idle task is created; preemption starts once a second task is ready
+ * Must be called after memory::init() and timer::init()
+ */
+void init();
+
+/*
+ * Make the calling secondary CPU's boot thread, running on stack, its
+ * idle task. Returns false if the task table is full
+ */
+bool init_cpu(uint8_t* stack, size_t stack_bytes);
+
+/*
+ * Create a task that runs entry(arg) on a new kernel stack, on the CPU
+ * with the fewest tasks
+ * Returns the new PID, or -1 if the task table is full or out of memory
+ */
+int spawn(const char* name, TaskEntry entry, void* arg);
+
+/*
+ * End the calling task (never returns)
+ */
+[[noreturn]] void exit();
+
+/*
+ * Let other ready tasks run before continuing
+ */
+void yield();
+
+/*
+ * Block the calling task for at least ms milliseconds
+ * Falls back to timer::sleep_ms() before the scheduler is running
+ */
+void sleep_ms(uint64_t ms);
+
+/*
+ * Idle until the next interrupt: run another task if one is ready,
+ * otherwise WFI. For wait loops that hold IRQs masked around the wait
+ */
+void wait_for_interrupt();
+
+/*
+ * End another task, on any CPU; the idle and shell tasks cannot be killed
+ * Memory the task allocated for itself is not reclaimed
+ * Returns false if no such task can be killed
+ */
+bool kill(int pid);
+
+/*
+ * PID of the calling task
+ */
+int current_pid();
+
+/*
+ * One pointer of per-task state, for subsystems that keep a session per
+ * task (casm_native)
+ */
+void* get_local();
+void set_local(void* local);
+
+/*
+ * The task's standard streams (a stream::Io), nullptr for the console;
+ * a new task starts on the console
+ */
+void* get_io();
+void set_io(void* io);
+
+/*
+ * Time slice length
+ */
+void set_quantum_ms(uint64_t ms);
+uint64_t get_quantum_ms();
+
+/*
+ * Context switch hook for the exception return path: returns the frame
+ * to restore, which is ctx unless a switch is due
+ */
+interrupts::ExceptionContext* switch_context(interrupts::ExceptionContext* ctx);
+
+/*
+ * Task statistics
+ */
+size_t task_count();
+bool get_task_info(size_t index, TaskInfo* info);
+uint64_t get_switch_count();
+
+} // namespace sched
+
+#endif // EMBEROS_SCHED_H
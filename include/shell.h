@@ -22,34 +22,12 @@ namespace shell {
 constexpr size_t MAX_CMD_LEN = 256;
 constexpr size_t MAX_ARGS = 16;
 constexpr size_t HISTORY_SIZE = 20;
-constexpr size_t MAX_COMMANDS = 48;
+constexpr size_t MAX_COMMANDS = 64;
 constexpr size_t MAX_ALIASES = 16;
 constexpr size_t MAX_ENV_VARS = 32;
 constexpr size_t MAX_VAR_NAME = 32;
 constexpr size_t MAX_VAR_VALUE = 128;
-constexpr size_t MAX_PROCESSES = 16;
-
-/*
- * Process state
- */
-enum class ProcessState {
-    FREE = 0,
-    RUNNING,
-    SLEEPING,
-    STOPPED
-};
-
-/*
- * Process info structure
- */
-struct ProcessInfo {
-    int pid;
-    ProcessState state;
-    char name[32];
-    uint64_t start_time;    // When process started (ms)
-    uint64_t cpu_time;      // CPU time used (ms)
-    uint32_t memory;        // Memory usage (bytes)
-};
+constexpr size_t MAX_PIPELINE = 4;      // Commands joined by '|'
 
 /*
  * Command handler function type
@@ -136,16 +114,10 @@ const char* get_history_entry(int index);
 int get_history_count();
 
 /*
- * Process management
+ * Run a parsed command line in a background task
+ * Returns the task's PID, or -1 if it could not be started
  */
-int create_process(const char* name);
-void destroy_process(int pid);
-void update_process(int pid, ProcessState state, uint32_t cpu_delta);
-ProcessInfo* get_process(int pid);
-int get_process_count();
-ProcessInfo* get_process_by_index(int index);
-int get_current_pid();
-void set_current_pid(int pid);
+int run_background(int argc, char* argv[]);
 
 } // namespace shell
 
@@ -0,0 +1,96 @@
+/*
+ * EmberOS Slab Allocator Header
+ * Object caches for small kernel allocations, layered on memory::alloc_pages
+ *
+ * Each cache carves fixed-size objects out of slabs of 2^order pages.
+ * General-purpose kmalloc/kfree use power-of-two size classes from
+ * MIN_OBJECT_SIZE to MAX_OBJECT_SIZE.
+ */
+
+#ifndef EMBEROS_SLAB_H
+#define EMBEROS_SLAB_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint16_t = unsigned short;
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using size_t = unsigned long;
+using uintptr_t = unsigned long;
+
+namespace slab {
+
+// Size class limits for kmalloc
+constexpr size_t MIN_OBJECT_SIZE = 16;
+constexpr size_t MAX_OBJECT_SIZE = 2048;
+constexpr size_t NUM_SIZE_CLASSES = 8;     // 16, 32, ..., 2048
+
+// Maximum number of caches (size classes plus named caches)
+constexpr size_t MAX_CACHES = 16;
+constexpr size_t MAX_CACHE_NAME = 16;
+
+// Opaque cache handle
+struct Cache;
+
+// Per-cache statistics
+struct CacheStats {
+    const char* name;
+    size_t object_size;
+    size_t slab_pages;          // Pages per slab
+    size_t slabs;               // Slabs currently held
+    size_t objects_in_use;
+    size_t objects_total;       // Capacity of all held slabs
+    uint64_t hits;              // Allocations served from an existing slab
+    uint64_t misses;            // Allocations that needed a new slab
+};
+
+/*
+ * Initialize the slab allocator and the kmalloc size classes
+ * Must be called after memory::init()
+ */
+void init();
+
+/*
+ * Create a cache of fixed-size objects
+ * Returns nullptr if the cache table is full or the size is too large
+ */
+Cache* cache_create(const char* name, size_t object_size);
+
+/*
+ * Allocate one object from a cache
+ * Returns nullptr if no memory is available
+ */
+void* cache_alloc(Cache* cache);
+
+/*
+ * Return an object to the cache it was allocated from
+ */
+void cache_free(Cache* cache, void* obj);
+
+/*
+ * Allocate size bytes from the matching size class
+ * Returns nullptr for size 0 or size > MAX_OBJECT_SIZE
+ */
+void* kmalloc(size_t size);
+
+/*
+ * Free a kmalloc allocation; size must be the size passed to kmalloc
+ * or the value returned by kmalloc_size() for it
+ */
+void kfree(void* ptr, size_t size);
+
+/*
+ * Get the usable size of a kmalloc(size) allocation (its size class)
+ * Returns 0 if size is not served by kmalloc
+ */
+size_t kmalloc_size(size_t size);
+
+/*
+ * Cache statistics
+ */
+size_t cache_count();
+bool get_cache_stats(size_t index, CacheStats* stats);
+
+} // namespace slab
+
+#endif // EMBEROS_SLAB_H
@@ -0,0 +1,85 @@
+/*
+ * EmberOS SMP Header
+ * Secondary CPU bring-up, per-CPU data and inter-processor interrupts
+ *
+ * CPU 0 boots through _start. smp::init() starts the others with PSCI
+ * CPU_ON (the firmware interface QEMU virt provides), one per MPIDR
+ * affinity 0..MAX_CPUS-1, until PSCI reports there are no more. Each
+ * secondary enters boot.S at secondary_entry with the MMU off, enables it
+ * with the same static tables as CPU 0, and runs on a stack allocated
+ * here, which then serves as its idle task's stack.
+ *
+ * The logical CPU number lives in TPIDR_EL1. Cross-CPU requests are GIC
+ * software-generated interrupts (SGIs): SGI_RESCHED asks a CPU to look
+ * at its run queue.
+ */
+
+#ifndef EMBEROS_SMP_H
+#define EMBEROS_SMP_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using size_t = unsigned long;
+
+namespace smp {
+
+// GICv2 serves at most 8 CPU interfaces
+constexpr uint32_t MAX_CPUS = 8;
+
+// Stack a secondary CPU starts on (and keeps as its idle task's stack)
+constexpr size_t CPU_STACK_PAGES = 4;
+
+// How long CPU 0 waits for a started CPU to report in
+constexpr uint64_t CPU_ON_TIMEOUT_MS = 100;
+
+// SGI numbers (0-15 are software-generated)
+constexpr uint32_t SGI_RESCHED = 1;
+
+/*
+ * Per-CPU state and statistics
+ */
+struct PerCpu {
+    volatile bool online;
+    uint64_t mpidr;
+    uint64_t irqs;              // Interrupts taken, SGIs included
+    uint64_t ipis;              // SGIs taken
+};
+
+/*
+ * Logical number of the calling CPU (0 = boot CPU)
+ * Stable for a task: tasks never migrate between CPUs
+ */
+static inline uint32_t cpu_id() {
+    uint64_t id;
+    asm volatile("mrs %0, tpidr_el1" : "=r"(id));
+    return static_cast<uint32_t>(id);
+}
+
+/*
+ * Start the secondary CPUs; call on CPU 0 once the scheduler is running
+ */
+void init();
+
+/*
+ * Per-CPU data of the calling CPU, or of CPU cpu
+ */
+PerCpu* this_cpu();
+PerCpu* get_cpu(uint32_t cpu);
+
+/*
+ * Number of CPUs online, and GIC target mask of them all
+ */
+uint32_t online_count();
+uint8_t online_mask();
+
+/*
+ * Send SGI sgi to one CPU, or to every online CPU but the caller
+ */
+void send_ipi(uint32_t cpu, uint32_t sgi);
+void send_ipi_others(uint32_t sgi);
+
+} // namespace smp
+
+#endif // EMBEROS_SMP_H
@@ -0,0 +1,102 @@
+/*
+ * EmberOS Spinlock Header
+ * Test-and-set locks for data shared between CPUs
+ *
+ * A lock is one word taken with a load-acquire/store-exclusive loop and
+ * released with a store-release. A waiter sleeps in WFE between attempts;
+ * the releasing store clears its exclusive monitor, which wakes it. The
+ * cortex-a53 has no LSE atomics, so this is the ARMv8.0 sequence.
+ *
+ * Code that takes a lock also reachable from an IRQ handler must use the
+ * irqsave variants, so the handler cannot spin on its own CPU's lock.
+ * Never block or yield while holding one.
+ */
+
+#ifndef EMBEROS_SPINLOCK_H
+#define EMBEROS_SPINLOCK_H
+
+#include "interrupts.h"
+
+namespace spinlock {
+
+struct Lock {
+    volatile uint32_t value;    // 0 = free, 1 = held
+};
+
+/*
+ * Take the lock, spinning until it is free
+ */
+static inline void lock(Lock* l) {
+    uint32_t held, failed;
+    asm volatile(
+        "   sevl\n"
+        "1: wfe\n"
+        "2: ldaxr   %w0, [%2]\n"
+        "   cbnz    %w0, 1b\n"
+        "   stxr    %w1, %w3, [%2]\n"
+        "   cbnz    %w1, 2b\n"
+        : "=&r"(held), "=&r"(failed)
+        : "r"(&l->value), "r"(1u)
+        : "memory");
+}
+
+/*
+ * Take the lock if it is free; returns false without waiting otherwise
+ */
+static inline bool try_lock(Lock* l) {
+    uint32_t held, failed;
+    asm volatile(
+        "1: ldaxr   %w0, [%2]\n"
+        "   cbnz    %w0, 2f\n"
+        "   stxr    %w1, %w3, [%2]\n"
+        "   cbnz    %w1, 1b\n"
+        "2:\n"
+        : "=&r"(held), "=&r"(failed)
+        : "r"(&l->value), "r"(1u)
+        : "memory");
+    return held == 0;
+}
+
+/*
+ * Release the lock
+ */
+static inline void unlock(Lock* l) {
+    asm volatile("stlr wzr, [%0]" :: "r"(&l->value) : "memory");
+}
+
+/*
+ * Mask IRQs and take the lock, returning the previous DAIF value
+ */
+static inline uint64_t lock_irqsave(Lock* l) {
+    uint64_t flags = interrupts::save_and_disable();
+    lock(l);
+    return flags;
+}
+
+/*
+ * Release the lock and restore the DAIF value from lock_irqsave()
+ */
+static inline void unlock_irqrestore(Lock* l, uint64_t flags) {
+    unlock(l);
+    interrupts::restore(flags);
+}
+
+/*
+ * Holds a lock (IRQs masked) for the rest of the enclosing scope, for
+ * functions with many early returns
+ */
+class Guard {
+public:
+    explicit Guard(Lock* l) : lock_(l), flags_(lock_irqsave(l)) {}
+    ~Guard() { unlock_irqrestore(lock_, flags_); }
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+
+private:
+    Lock* lock_;
+    uint64_t flags_;
+};
+
+} // namespace spinlock
+
+#endif // EMBEROS_SPINLOCK_H
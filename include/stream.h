@@ -0,0 +1,101 @@
+/*
+ * EmberOS Stream Header
+ * Standard input/output of shell commands: console, pipe or file
+ *
+ * Every task has an Io (sched::get_io()); a task without one reads and
+ * writes the console. Commands write their results through stream::write,
+ * puts and printf, and read piped input with stream::read, so the shell
+ * can connect them with pipes or redirect them into a file without the
+ * command knowing. Diagnostics still go straight to the UART.
+ *
+ * A pipe is a bounded PIPE_SIZE-byte ring with one reading and one
+ * writing end. A writer blocks while it is full and a reader while it is
+ * empty (sleeping a millisecond at a time). Once the writer closes, the
+ * reader drains what is left and then sees end of file; once the reader
+ * closes, writes are dropped. The pipe is freed when both ends are
+ * closed. Reading the console returns end of file at once.
+ */
+
+#ifndef EMBEROS_STREAM_H
+#define EMBEROS_STREAM_H
+
+// Freestanding type definitions
+using uint8_t = unsigned char;
+using uint32_t = unsigned int;
+using size_t = unsigned long;
+
+namespace ramfs {
+struct FSNode;
+}
+
+namespace stream {
+
+// Pipe buffer capacity (one page)
+constexpr size_t PIPE_SIZE = 4096;
+
+struct Pipe;
+
+enum class Kind : uint8_t {
+    CONSOLE,
+    PIPE_READ,      // Reading end of pipe
+    PIPE_WRITE,     // Writing end of pipe
+    FILE,           // Written at offset, which advances
+};
+
+struct Stream {
+    Kind kind;
+    Pipe* pipe;
+    ramfs::FSNode* file;
+    size_t offset;
+};
+
+struct Io {
+    Stream in;
+    Stream out;
+};
+
+/*
+ * A console stream
+ */
+Stream console();
+
+/*
+ * Create a pipe, returning its two ends
+ * Returns false if no memory is available
+ */
+bool pipe(Stream* read_end, Stream* write_end);
+
+/*
+ * Open path for output, truncating it, or appending with append
+ * The file is created if it does not exist; returns false if it cannot be
+ */
+bool open_output(const char* path, bool append, Stream* out);
+
+/*
+ * Close a stream; a pipe end is released, the others need nothing
+ */
+void close(Stream* s);
+
+/*
+ * Read up to len bytes of the calling task's input, blocking until some
+ * are available; returns 0 at end of file
+ */
+size_t read(char* buf, size_t len);
+
+/*
+ * Write to the calling task's output, blocking while a pipe is full
+ */
+void write(const char* data, size_t len);
+void puts(const char* str);
+void putc(char c);
+void printf(const char* fmt, ...);
+
+/*
+ * Whether the calling task's input or output is the console
+ */
+bool input_is_console();
+bool output_is_console();
+
+} // namespace stream
+
+#endif // EMBEROS_STREAM_H
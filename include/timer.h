@@ -1,8 +1,17 @@
 /*
  * EmberOS Timer Driver Header
  * ARM Generic Timer for QEMU virt machine
- * 
+ *
  * Requirements: 9.1, 9.2, 9.3, 9.4, 9.5, 3.5
+ *
+ * The timer is tickless: pending timers are kept in a min-heap ordered by
+ * their deadline in counter ticks, and the comparator (CNTP_CVAL_EL0) is
+ * programmed to the earliest one only. With nothing pending the timer
+ * interrupt is masked, so an idle CPU sleeps until the next device IRQ.
+ * Deadlines have counter resolution (16 ns at 62.5 MHz).
+ *
+ * Every CPU has its own comparator and heap. Timers are armed on the
+ * calling CPU and their handlers and callbacks run there.
  */
 
 #ifndef EMBEROS_TIMER_H
@@ -18,12 +27,16 @@ using uintptr_t = unsigned long;
 
 namespace timer {
 
-// Maximum number of timer callbacks
-constexpr size_t MAX_CALLBACKS = 8;
+// Maximum number of pending timers per CPU (one-shot and periodic)
+constexpr size_t MAX_TIMERS = 32;
 
-// Timer callback function type
+// Periodic timer callback function type
 using Callback = void (*)();
 
+// One-shot timer handler; runs in IRQ context, preemptible by higher-priority
+// IRQs (interrupts.h), so locks it takes must be the irqsave kind
+using Handler = void (*)(void* arg);
+
 /*
  * Initialize timer subsystem
  * Configures the ARM generic timer and enables timer interrupts
@@ -31,6 +44,11 @@ using Callback = void (*)();
  */
 void init();
 
+/*
+ * Enable the calling secondary CPU's timer (init() did CPU 0's)
+ */
+void init_cpu();
+
 /*
  * Get current tick count (monotonic)
  * Returns the raw counter value from CNTPCT_EL0
@@ -38,6 +56,12 @@ void init();
  */
 uint64_t get_ticks();
 
+/*
+ * Get the calling CPU's compare value (CNTP_CVAL_EL0): until the handler
+ * reprograms it, the counter value the pending timer PPI was raised at
+ */
+uint64_t get_compare();
+
 /*
  * Get timer frequency in Hz
  * Returns the value of CNTFRQ_EL0
@@ -52,22 +76,35 @@ uint64_t get_frequency();
 uint64_t get_uptime_ms();
 
 /*
- * Set timer to fire after specified milliseconds
- * Configures CNTP_TVAL_EL0 for the next interrupt
+ * Run handler(arg) once, delay_us microseconds from now
+ * Returns a timer id for cancel(), or -1 if MAX_TIMERS are pending
  * Requirements: 9.3
  */
-void set_timeout(uint64_t ms);
+int add_oneshot(uint64_t delay_us, Handler handler, void* arg);
+
+/*
+ * Run handler(arg) once when the counter reaches deadline (get_ticks()
+ * units); a deadline already passed fires at once
+ * Returns a timer id for cancel(), or -1 if MAX_TIMERS are pending
+ */
+int add_oneshot_at(uint64_t deadline, Handler handler, void* arg);
+
+/*
+ * Cancel a pending timer
+ * Returns false if it already fired or id is stale
+ */
+bool cancel(int id);
 
 /*
- * Register a periodic timer callback
+ * Register a periodic timer callback on the calling CPU
  * The callback will be invoked at the specified interval
- * Returns true if registration succeeded, false if callback table is full
+ * Returns true if registration succeeded, false if the timer table is full
  * Requirements: 9.5
  */
 bool register_callback(Callback cb, uint64_t interval_ms);
 
 /*
- * Unregister a timer callback
+ * Unregister a timer callback registered on the calling CPU
  * Returns true if the callback was found and removed
  */
 bool unregister_callback(Callback cb);
@@ -79,10 +116,15 @@ bool unregister_callback(Callback cb);
 void sleep_ms(uint64_t ms);
 
 /*
- * Get timer interrupt count (for debugging/verification)
+ * Get timer interrupt count, all CPUs (for debugging/verification)
  */
 uint64_t get_interrupt_count();
 
+/*
+ * Number of timers currently pending on all CPUs
+ */
+size_t pending_count();
+
 } // namespace timer
 
 #endif // EMBEROS_TIMER_H
@@ -0,0 +1,158 @@
+/*
+ * EmberOS Trace Header
+ * Per-CPU binary event trace for chasing latency spikes
+ *
+ * Each CPU appends 16-byte records to its own ring: IRQ entry and exit,
+ * CASM SVCs with their duration, page allocations and frees, RAMFS
+ * operations and context switches. Recording is a flag test, a counter
+ * read and four stores with IRQs masked, so it takes no lock and never
+ * waits; a full ring overwrites its oldest records. Nothing is decoded
+ * while recording: dump() merges the rings by timestamp and prints them
+ * after the capture is stopped.
+ *
+ * Timestamps are CNTPCT counter ticks, the same clock timer::get_ticks()
+ * reads, so records from different CPUs are directly comparable.
+ */
+
+#ifndef EMBEROS_TRACE_H
+#define EMBEROS_TRACE_H
+
+#include "interrupts.h"
+#include "smp.h"
+
+// Freestanding type definitions
+using uint16_t = unsigned short;
+using uint32_t = unsigned int;
+using uint64_t = unsigned long long;
+using size_t = unsigned long;
+
+namespace trace {
+
+/*
+ * Records kept per CPU; a power of two so the index is masked
+ */
+constexpr uint32_t RING_RECORDS = 1024;
+
+static_assert((RING_RECORDS & (RING_RECORDS - 1)) == 0, "RING_RECORDS must be a power of two");
+
+/*
+ * Event types and what their two arguments hold
+ */
+enum class Event : uint16_t {
+    NONE = 0,
+    IRQ_ENTER,      // arg16 = IRQ number
+    IRQ_EXIT,       // arg16 = IRQ number
+    SVC,            // arg16 = SVC number, arg32 = duration in ticks (time = start)
+    PAGE_ALLOC,     // arg16 = pages, arg32 = page frame number (0 = failed)
+    PAGE_FREE,      // arg16 = pages, arg32 = page frame number
+    FS,             // arg16 = FsOp, arg32 = bytes or new size
+    SWITCH,         // arg16 = PID switched out, arg32 = PID switched in
+};
+
+/*
+ * RAMFS operations recorded by Event::FS
+ */
+enum class FsOp : uint16_t {
+    CREATE = 0,
+    DELETE,
+    READ,
+    WRITE,
+    TRUNCATE,
+    MKDIR,
+    RMDIR,
+};
+
+/*
+ * Event classes, for dump() filtering
+ */
+constexpr uint32_t CLASS_IRQ = 1 << 0;
+constexpr uint32_t CLASS_SVC = 1 << 1;
+constexpr uint32_t CLASS_MEM = 1 << 2;
+constexpr uint32_t CLASS_FS = 1 << 3;
+constexpr uint32_t CLASS_SCHED = 1 << 4;
+constexpr uint32_t CLASS_ALL = 0x1F;
+
+struct Record {
+    uint64_t time;              // CNTPCT at the event
+    uint16_t event;             // Event
+    uint16_t arg16;
+    uint32_t arg32;
+};
+
+static_assert(sizeof(Record) == 16, "trace records are 16 bytes");
+
+struct alignas(64) Ring {
+    Record records[RING_RECORDS];
+    uint32_t head;              // Records written since start(); free-running
+};
+
+// Recording state, defined in trace.cpp; use the functions below
+extern volatile bool g_enabled;
+extern Ring g_rings[smp::MAX_CPUS];
+
+/*
+ * Append a record with an explicit timestamp to the calling CPU's ring
+ * IRQs are masked so an interrupt cannot claim the same slot
+ */
+static inline void record_at(uint64_t time, Event event, uint32_t arg16, uint32_t arg32) {
+    if (!g_enabled) return;
+    uint64_t flags = interrupts::save_and_disable();
+    Ring* ring = &g_rings[smp::cpu_id()];
+    Record* rec = &ring->records[ring->head & (RING_RECORDS - 1)];
+    ring->head = ring->head + 1;
+    rec->time = time;
+    rec->event = static_cast<uint16_t>(event);
+    rec->arg16 = static_cast<uint16_t>(arg16 > 0xFFFF ? 0xFFFF : arg16);
+    rec->arg32 = arg32;
+    interrupts::restore(flags);
+}
+
+/*
+ * Append a record stamped now
+ */
+static inline void record(Event event, uint32_t arg16, uint32_t arg32) {
+    if (!g_enabled) return;
+    uint64_t now;
+    asm volatile("mrs %0, cntpct_el0" : "=r"(now));
+    record_at(now, event, arg16, arg32);
+}
+
+/*
+ * Is a capture running
+ */
+static inline bool enabled() {
+    return g_enabled;
+}
+
+/*
+ * Empty every CPU's ring and start recording
+ */
+void start();
+
+/*
+ * Stop recording; the rings keep what was captured
+ */
+void stop();
+
+/*
+ * Records captured on a CPU since start(), and how many of them the ring
+ * still holds
+ */
+uint32_t recorded(uint32_t cpu);
+uint32_t retained(uint32_t cpu);
+
+/*
+ * Stop recording and print the retained records of the classes in mask,
+ * all CPUs merged in time order, with IRQ durations and a summary of the
+ * longest IRQ and SVC
+ */
+void dump(uint32_t classes);
+
+/*
+ * Class bits for a filter name (irq, svc, mem, fs, sched, all), or 0
+ */
+uint32_t class_for_name(const char* name);
+
+} // namespace trace
+
+#endif // EMBEROS_TRACE_H
@@ -18,21 +18,93 @@ using uintptr_t = unsigned long;
 
 namespace uart {
 
+// Software ring sizes (must be powers of two)
+constexpr size_t RX_RING_SIZE = 256;
+constexpr size_t TX_RING_SIZE = 1024;
+
+// Driver statistics (read by uartstat)
+struct Stats {
+    uint64_t rx_bytes;          // Bytes received from the RX FIFO
+    uint64_t tx_bytes;          // Bytes written to the TX FIFO
+    uint64_t rx_overflows;      // Bytes dropped because the RX ring was full
+    uint64_t rx_fifo_overruns;  // Hardware RX FIFO overruns (OE)
+    uint64_t rx_errors;         // Framing/parity/break errors
+    uint64_t tx_stalls;         // Writers that blocked on a full TX ring
+    uint64_t irq_count;         // UART interrupts serviced
+    uint32_t rx_pending;        // Bytes currently queued in the RX ring
+    uint32_t tx_pending;        // Bytes currently queued in the TX ring
+    uint32_t rx_peak;           // RX ring high-water mark
+    uint32_t tx_peak;           // TX ring high-water mark
+    bool irq_mode;              // True once enable_interrupts() has run
+};
+
 /*
  * Initialize UART hardware
  * Configures PL011 UART at 0x09000000 for QEMU virt machine
+ * The driver runs polled until enable_interrupts() is called
  * Requirements: 4.1
  */
 void init();
 
+/*
+ * Switch to interrupt-driven operation
+ * Registers the UART IRQ handler and unmasks RX/TX FIFO interrupts.
+ * Must be called after interrupts::init()
+ */
+void enable_interrupts();
+
+/*
+ * Get driver statistics
+ */
+Stats get_stats();
+
 /*
  * Write a single character to the console
+ * Queues into the TX ring in interrupt mode; blocks only if the ring is full
  * Requirements: 4.2
  */
 void putc(char c);
 
+/*
+ * Write up to len raw bytes without blocking
+ * Bytes are queued (interrupt mode) or written straight into the FIFO
+ * (polled mode); returns how many were accepted
+ */
+size_t write(const char* buf, size_t len);
+
+/*
+ * Write len raw bytes, blocking while the TX ring is full
+ */
+void write_all(const char* buf, size_t len);
+
+/*
+ * Write len bytes of text, translating '\n' to "\r\n" like puts()
+ * Unlike puts() the buffer need not be NUL-terminated
+ */
+void write_text(const char* buf, size_t len);
+
+/*
+ * Start transmitting coalesced output now (non-blocking)
+ * Output is otherwise flushed on newline, when a FIFO's worth is queued,
+ * on the timer tick, and before getc() blocks
+ */
+void flush();
+
+/*
+ * Block until all queued output has been handed to the hardware
+ * Use before halting or resetting
+ */
+void drain();
+
+/*
+ * Enable/disable output coalescing (enabled by default)
+ * When disabled every write starts transmission immediately
+ */
+void set_coalescing(bool enable);
+
 /*
  * Read a single character from the console (blocking)
+ * Waits in WFI for the RX interrupt when interrupts are enabled
  * Requirements: 4.3
  */
 char getc();
@@ -56,6 +128,17 @@ void puts(const char* str);
  */
 void printf(const char* fmt, ...);
 
+/*
+ * Receives formatted text from format() in pieces of up to 128 bytes
+ */
+using Sink = void (*)(void* context, const char* data, size_t len);
+
+/*
+ * printf() into sink instead of the console; '\n' is passed through
+ * untranslated
+ */
+void format(Sink sink, void* context, const char* fmt, __builtin_va_list args);
+
 } // namespace uart
 
 #endif // EMBEROS_UART_H
@@ -0,0 +1,237 @@
+/*
+ * EmberOS CASM Build Cache Implementation
+ * In-memory LRU of assembled images for casm -r
+ *
+ * Each image is copied into its own run of pages from memory::alloc_pages.
+ * With only CACHE_ENTRIES slots, lookups and evictions scan the table.
+ * Images are copied in and freed outside the lock; under it the table
+ * only changes hands.
+ */
+
+#include "casm/cache.h"
+#include "klib.h"
+#include "memory.h"
+#include "spinlock.h"
+
+namespace casm {
+
+struct CacheEntry {
+    uint64_t key;
+    uint8_t* image;             // nullptr if the slot is free
+    size_t size;
+    size_t pages;
+    uint64_t last_used;         // g_clock value at the last hit or insert
+    uint32_t pins;              // Lookups not yet unpinned
+    bool dropped;               // Out of the cache, freed at the last unpin
+};
+
+// ============================================================================
+// Global State
+// ============================================================================
+
+static spinlock::Lock g_lock;                   // Guards everything below
+static CacheEntry g_entries[CACHE_ENTRIES];
+static size_t g_bytes = 0;
+static uint64_t g_clock = 0;
+static uint64_t g_hits = 0;
+static uint64_t g_misses = 0;
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+// Pages to free once the lock is dropped
+struct Garbage {
+    uint8_t* image[CACHE_ENTRIES + 1];
+    size_t pages[CACHE_ENTRIES + 1];
+    size_t count;
+};
+
+static void free_garbage(Garbage* garbage) {
+    for (size_t i = 0; i < garbage->count; i++) {
+        memory::free_pages(garbage->image[i], garbage->pages[i]);
+    }
+}
+
+// Free the slot, or leave a pinned image for its last unpin to free.
+// Called with g_lock held; the pages go on garbage
+static void release(CacheEntry* entry, Garbage* garbage) {
+    if (!entry->dropped) {
+        g_bytes -= entry->size;
+    }
+    if (entry->pins > 0) {
+        entry->dropped = true;
+        return;
+    }
+    garbage->image[garbage->count] = entry->image;
+    garbage->pages[garbage->count] = entry->pages;
+    garbage->count++;
+    entry->image = nullptr;
+    entry->size = 0;
+    entry->pages = 0;
+    entry->dropped = false;
+}
+
+static inline bool cached(const CacheEntry* entry) {
+    return entry->image && !entry->dropped;
+}
+
+// Least recently used entry that can be freed now, or nullptr if none
+static CacheEntry* oldest() {
+    CacheEntry* victim = nullptr;
+    for (size_t i = 0; i < CACHE_ENTRIES; i++) {
+        CacheEntry* entry = &g_entries[i];
+        if (cached(entry) && entry->pins == 0 &&
+            (!victim || entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+    return victim;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+uint64_t cache_key(const char* source, size_t length, uint32_t options) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<uint8_t>(source[i]);
+        hash *= 1099511628211ULL;
+    }
+    // Fold in the options and length so they cannot collide with content
+    hash ^= options;
+    hash *= 1099511628211ULL;
+    hash ^= length;
+    hash *= 1099511628211ULL;
+    return hash;
+}
+
+const uint8_t* cache_lookup(uint64_t key, size_t* size) {
+    spinlock::Guard guard(&g_lock);
+    for (size_t i = 0; i < CACHE_ENTRIES; i++) {
+        CacheEntry* entry = &g_entries[i];
+        if (cached(entry) && entry->key == key) {
+            entry->last_used = ++g_clock;
+            entry->pins++;
+            g_hits++;
+            *size = entry->size;
+            return entry->image;
+        }
+    }
+    g_misses++;
+    return nullptr;
+}
+
+void cache_unpin(const uint8_t* image) {
+    Garbage garbage;
+    garbage.count = 0;
+
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+    for (size_t i = 0; i < CACHE_ENTRIES; i++) {
+        CacheEntry* entry = &g_entries[i];
+        if (entry->image == image && entry->pins > 0) {
+            entry->pins--;
+            if (entry->dropped && entry->pins == 0) {
+                release(entry, &garbage);
+            }
+            break;
+        }
+    }
+    spinlock::unlock_irqrestore(&g_lock, flags);
+    free_garbage(&garbage);
+}
+
+bool cache_insert(uint64_t key, const uint8_t* image, size_t size) {
+    if (size == 0 || size > CACHE_MAX_BYTES) {
+        return false;
+    }
+
+    size_t pages = (size + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
+    uint8_t* copy = static_cast<uint8_t*>(memory::alloc_pages(pages));
+    if (!copy) {
+        return false;
+    }
+    klib::memcpy(copy, image, size);
+
+    Garbage garbage;
+    garbage.count = 0;
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+
+    // Replace an existing entry for the same key
+    for (size_t i = 0; i < CACHE_ENTRIES; i++) {
+        if (cached(&g_entries[i]) && g_entries[i].key == key) {
+            release(&g_entries[i], &garbage);
+        }
+    }
+
+    // Evict until there is a free slot and room for the image; pinned
+    // entries cannot go, so give up if only they are left
+    CacheEntry* slot = nullptr;
+    while (true) {
+        if (!slot) {
+            for (size_t i = 0; i < CACHE_ENTRIES; i++) {
+                if (!g_entries[i].image) {
+                    slot = &g_entries[i];
+                    break;
+                }
+            }
+        }
+        if (slot && g_bytes + size <= CACHE_MAX_BYTES) {
+            break;
+        }
+        CacheEntry* victim = oldest();
+        if (!victim) {
+            slot = nullptr;
+            break;
+        }
+        release(victim, &garbage);
+    }
+
+    if (slot) {
+        slot->key = key;
+        slot->image = copy;
+        slot->size = size;
+        slot->pages = pages;
+        slot->last_used = ++g_clock;
+        slot->pins = 0;
+        slot->dropped = false;
+        g_bytes += size;
+    } else {
+        garbage.image[garbage.count] = copy;
+        garbage.pages[garbage.count] = pages;
+        garbage.count++;
+    }
+    spinlock::unlock_irqrestore(&g_lock, flags);
+    free_garbage(&garbage);
+    return slot != nullptr;
+}
+
+void cache_clear() {
+    Garbage garbage;
+    garbage.count = 0;
+
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+    for (size_t i = 0; i < CACHE_ENTRIES; i++) {
+        if (cached(&g_entries[i])) {
+            release(&g_entries[i], &garbage);
+        }
+    }
+    spinlock::unlock_irqrestore(&g_lock, flags);
+    free_garbage(&garbage);
+}
+
+void get_cache_stats(CacheStats* stats) {
+    spinlock::Guard guard(&g_lock);
+    stats->hits = g_hits;
+    stats->misses = g_misses;
+    stats->entries = 0;
+    for (size_t i = 0; i < CACHE_ENTRIES; i++) {
+        if (cached(&g_entries[i])) {
+            stats->entries++;
+        }
+    }
+    stats->bytes = g_bytes;
+}
+
+} // namespace casm
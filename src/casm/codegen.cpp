@@ -6,25 +6,13 @@
  */
 
 #include "casm/codegen.h"
+#include "casm/console.h"
+#include "klib.h"
+#include "memory.h"
 
 namespace casm {
 
 // String helper functions (freestanding environment)
-static size_t str_len(const char* s) {
-    size_t len = 0;
-    while (s[len] != '\0') len++;
-    return len;
-}
-
-static void str_copy(char* dest, const char* src, size_t max_len) {
-    size_t i = 0;
-    while (i < max_len - 1 && src[i] != '\0') {
-        dest[i] = src[i];
-        i++;
-    }
-    dest[i] = '\0';
-}
-
 static void str_copy_n(char* dest, const char* src, size_t n, size_t max_len) {
     size_t i = 0;
     size_t limit = (n < max_len - 1) ? n : max_len - 1;
@@ -41,7 +29,7 @@ static char to_lower(char c) {
 }
 
 static bool str_equal_nocase(const char* a, size_t a_len, const char* b) {
-    size_t b_len = str_len(b);
+    size_t b_len = klib::strlen(b);
     if (a_len != b_len) return false;
     for (size_t i = 0; i < a_len; i++) {
         if (to_lower(a[i]) != to_lower(b[i])) return false;
@@ -57,43 +45,127 @@ static bool str_equal_n(const char* a, size_t a_len, const char* b, size_t b_len
     return true;
 }
 
+static inline size_t align_up(size_t value, size_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+static size_t pages_for(size_t bytes) {
+    return (bytes + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
+}
+
+// FNV-1a hash of a symbol name; case-insensitive like symbol matching
+static uint32_t hash_name(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<uint8_t>(to_lower(name[i]));
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 /*
  * Constructor
  */
 CodeGenerator::CodeGenerator()
-    : code_offset_(0)
+    : image_(nullptr)
+    , image_size_(0)
+    , image_pages_(0)
+    , symbols_(nullptr)
     , symbol_count_(0)
+    , symbol_capacity_(0)
+    , symbol_index_(nullptr)
+    , symbol_slots_(0)
+    , fixups_(nullptr)
+    , fixup_count_(0)
+    , fixup_capacity_(0)
+    , deferred_fixups_(-1)
     , current_section_(Section::TEXT)
     , has_error_(false)
     , error_line_(0)
     , current_line_(1)
-    , is_first_pass_(true)
-    , last_instr_(0)
-    , last_instr_offset_(0)
-    , has_last_instr_(false)
+    , optimize_(false)
+    , window_count_(0)
+    , const_reg_(-1)
+    , const_is_64bit_(false)
+    , const_value_(0)
+    , const_words_(0)
+    , const_offset_(0)
+    , program_(nullptr)
+    , branch_node_(nullptr)
 {
     error_msg_[0] = '\0';
-    // Zero out code buffer
-    for (size_t i = 0; i < MAX_CODE_SIZE; i++) {
-        code_[i] = 0;
+    klib::memset(&opt_stats_, 0, sizeof(opt_stats_));
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        section_buf_[i] = nullptr;
+        section_pages_[i] = 0;
+        section_size_[i] = 0;
+        section_base_[i] = 0;
+        section_offset_[i] = 0;
+    }
+}
+
+CodeGenerator::~CodeGenerator() {
+    release();
+}
+
+/*
+ * Return the image, section buffers, symbol table and fixups to the
+ * page allocator
+ */
+void CodeGenerator::release() {
+    if (image_) {
+        memory::free_pages(image_, image_pages_);
+        image_ = nullptr;
+    }
+    image_size_ = 0;
+    image_pages_ = 0;
+    
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        if (section_buf_[i]) {
+            memory::free_pages(section_buf_[i], section_pages_[i]);
+            section_buf_[i] = nullptr;
+        }
+        section_pages_[i] = 0;
+    }
+    
+    if (symbols_) {
+        memory::free_pages(symbols_, pages_for(symbol_capacity_ * sizeof(Symbol)));
+        symbols_ = nullptr;
+    }
+    if (symbol_index_) {
+        memory::free_pages(symbol_index_, pages_for(symbol_slots_ * sizeof(int)));
+        symbol_index_ = nullptr;
+    }
+    symbol_count_ = 0;
+    symbol_capacity_ = 0;
+    symbol_slots_ = 0;
+    
+    if (fixups_) {
+        memory::free_pages(fixups_, pages_for(fixup_capacity_ * sizeof(Fixup)));
+        fixups_ = nullptr;
     }
+    fixup_count_ = 0;
+    fixup_capacity_ = 0;
+    deferred_fixups_ = -1;
 }
 
 /*
  * Reset generator state
  */
 void CodeGenerator::reset() {
-    code_offset_ = 0;
-    symbol_count_ = 0;
+    release();
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        section_size_[i] = 0;
+        section_base_[i] = 0;
+        section_offset_[i] = 0;
+    }
     current_section_ = Section::TEXT;
     has_error_ = false;
     error_msg_[0] = '\0';
     error_line_ = 0;
     current_line_ = 1;
-    is_first_pass_ = true;
-    last_instr_ = 0;
-    last_instr_offset_ = 0;
-    has_last_instr_ = false;
+    klib::memset(&opt_stats_, 0, sizeof(opt_stats_));
+    reset_window();
 }
 
 /*
@@ -104,7 +176,7 @@ void CodeGenerator::error(const char* message) {
     if (has_error_) return;
     has_error_ = true;
     error_line_ = current_line_;
-    str_copy(error_msg_, message, MAX_CODEGEN_ERROR);
+    klib::strlcpy(error_msg_, message, MAX_CODEGEN_ERROR);
 }
 
 /*
@@ -115,7 +187,7 @@ void CodeGenerator::error_at(int line, const char* message) {
     if (has_error_) return;
     has_error_ = true;
     error_line_ = line;
-    str_copy(error_msg_, message, MAX_CODEGEN_ERROR);
+    klib::strlcpy(error_msg_, message, MAX_CODEGEN_ERROR);
 }
 
 /*
@@ -125,21 +197,85 @@ bool CodeGenerator::token_equals(const Token& token, const char* str) const {
     return str_equal_nocase(token.start, token.length, str);
 }
 
+// ============================================================================
+// Symbol Table
+// ============================================================================
+
+/*
+ * Double the symbol table, keeping existing entries, and rebuild the hash
+ * index at twice the new capacity so it stays at most half full
+ * Pointers into the old table are invalidated; fixups hold indices
+ */
+bool CodeGenerator::grow_symbols() {
+    int capacity = symbol_capacity_ ? symbol_capacity_ * 2 : INITIAL_SYMBOLS;
+    int slots = capacity * 2;
+    Symbol* grown = static_cast<Symbol*>(
+        memory::alloc_pages(pages_for(capacity * sizeof(Symbol))));
+    int* index = static_cast<int*>(memory::alloc_pages(pages_for(slots * sizeof(int))));
+    if (!grown || !index) {
+        if (grown) memory::free_pages(grown, pages_for(capacity * sizeof(Symbol)));
+        if (index) memory::free_pages(index, pages_for(slots * sizeof(int)));
+        error("Out of memory for symbol table");
+        return false;
+    }
+    
+    if (symbols_) {
+        klib::memcpy(grown, symbols_, symbol_count_ * sizeof(Symbol));
+        memory::free_pages(symbols_, pages_for(symbol_capacity_ * sizeof(Symbol)));
+    }
+    if (symbol_index_) {
+        memory::free_pages(symbol_index_, pages_for(symbol_slots_ * sizeof(int)));
+    }
+    
+    // 0xFF bytes make every slot -1 (empty)
+    klib::memset(index, 0xFF, slots * sizeof(int));
+    uint32_t mask = static_cast<uint32_t>(slots - 1);
+    for (int i = 0; i < symbol_count_; i++) {
+        uint32_t slot = grown[i].hash & mask;
+        while (index[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        index[slot] = i;
+    }
+    
+    symbols_ = grown;
+    symbol_capacity_ = capacity;
+    symbol_index_ = index;
+    symbol_slots_ = slots;
+    return true;
+}
+
 /*
  * Add a new symbol to the table
+ * The caller has checked that the name is not already present
  * Requirements: 7.6
  */
 Symbol* CodeGenerator::add_symbol(const char* name, size_t len) {
-    if (symbol_count_ >= MAX_SYMBOLS) {
-        error("Symbol table full");
+    if (len >= static_cast<size_t>(MAX_SYMBOL_NAME)) {
+        error("Symbol name too long");
+        return nullptr;
+    }
+    if (symbol_count_ >= symbol_capacity_ && !grow_symbols()) {
         return nullptr;
     }
     
-    Symbol* sym = &symbols_[symbol_count_++];
+    int number = symbol_count_++;
+    Symbol* sym = &symbols_[number];
     str_copy_n(sym->name, name, len, MAX_SYMBOL_NAME);
     sym->address = 0;
+    sym->hash = hash_name(name, len);
+    sym->fixups = -1;
+    sym->section = Section::TEXT;
+    sym->is_label = false;
     sym->defined = false;
     sym->is_global = false;
+    
+    uint32_t mask = static_cast<uint32_t>(symbol_slots_ - 1);
+    uint32_t slot = sym->hash & mask;
+    while (symbol_index_[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    symbol_index_[slot] = number;
     return sym;
 }
 
@@ -148,23 +284,23 @@ Symbol* CodeGenerator::add_symbol(const char* name, size_t len) {
  * Requirements: 7.6
  */
 Symbol* CodeGenerator::find_symbol(const char* name, size_t len) {
-    for (int i = 0; i < symbol_count_; i++) {
-        size_t sym_len = str_len(symbols_[i].name);
-        if (str_equal_n(name, len, symbols_[i].name, sym_len)) {
-            return &symbols_[i];
-        }
-    }
-    return nullptr;
+    return const_cast<Symbol*>(lookup_symbol(name, len));
 }
 
 /*
  * Look up a symbol (const version)
+ * Probes the hash index from the name's home slot to the first empty slot
  */
 const Symbol* CodeGenerator::lookup_symbol(const char* name, size_t len) const {
-    for (int i = 0; i < symbol_count_; i++) {
-        size_t sym_len = str_len(symbols_[i].name);
-        if (str_equal_n(name, len, symbols_[i].name, sym_len)) {
-            return &symbols_[i];
+    if (symbol_slots_ == 0) return nullptr;
+    
+    uint32_t hash = hash_name(name, len);
+    uint32_t mask = static_cast<uint32_t>(symbol_slots_ - 1);
+    for (uint32_t slot = hash & mask; symbol_index_[slot] >= 0; slot = (slot + 1) & mask) {
+        const Symbol* sym = &symbols_[symbol_index_[slot]];
+        if (sym->hash == hash &&
+            str_equal_n(name, len, sym->name, klib::strlen(sym->name))) {
+            return sym;
         }
     }
     return nullptr;
@@ -204,20 +340,328 @@ bool CodeGenerator::define_symbol(const char* name, size_t len, uint64_t address
 }
 
 /*
- * Emit a single byte
+ * Define every .equ/.set constant before assembling, so a forward
+ * reference to a constant is a known value and any other name that is
+ * still undefined when it is used can only be a label
+ */
+void CodeGenerator::declare_constants(ASTNode* ast) {
+    for (int i = 0; i < ast->statement_count && !has_error_; i++) {
+        ASTNode* node = ast->statements[i];
+        if (!node || node->type != NodeType::DIRECTIVE || node->child_count < 2) continue;
+        if (!token_equals(node->token, "equ") && !token_equals(node->token, "set")) continue;
+        
+        ASTNode* name_node = node->children[0];
+        ASTNode* value_node = node->children[1];
+        if (name_node && value_node) {
+            current_line_ = node->token.line;
+            define_symbol(name_node->token.start, name_node->token.length,
+                          value_node->data.imm_value);
+        }
+    }
+}
+
+// ============================================================================
+// Label Fixups
+// ============================================================================
+
+/*
+ * Double the fixup array, keeping existing records
+ */
+bool CodeGenerator::grow_fixups() {
+    int capacity = fixup_capacity_ ? fixup_capacity_ * 2 : INITIAL_FIXUPS;
+    Fixup* grown = static_cast<Fixup*>(
+        memory::alloc_pages(pages_for(capacity * sizeof(Fixup))));
+    if (!grown) {
+        error("Out of memory for fixups");
+        return false;
+    }
+    
+    if (fixups_) {
+        klib::memcpy(grown, fixups_, fixup_count_ * sizeof(Fixup));
+        memory::free_pages(fixups_, pages_for(fixup_capacity_ * sizeof(Fixup)));
+    }
+    fixups_ = grown;
+    fixup_capacity_ = capacity;
+    return true;
+}
+
+/*
+ * Record that the word at the current offset needs the label named by
+ * operand patched in. A defined label only gets here when its address
+ * depends on the layout, so its fixup goes straight to the deferred chain
+ */
+void CodeGenerator::add_fixup(ASTNode* operand, FixupKind kind) {
+    Symbol* sym = find_symbol(operand->token.start, operand->token.length);
+    if (!sym) {
+        sym = add_symbol(operand->token.start, operand->token.length);
+        if (!sym) return;
+    }
+    if (fixup_count_ >= fixup_capacity_ && !grow_fixups()) {
+        return;
+    }
+    
+    int number = fixup_count_++;
+    Fixup* fixup = &fixups_[number];
+    fixup->kind = kind;
+    fixup->section = current_section_;
+    fixup->offset = current_offset();
+    fixup->symbol = static_cast<int>(sym - symbols_);
+    fixup->line = current_line_;
+    
+    if (sym->defined) {
+        fixup->next = deferred_fixups_;
+        deferred_fixups_ = number;
+    } else {
+        fixup->next = sym->fixups;
+        sym->fixups = number;
+    }
+}
+
+/*
+ * Whether a fixup can be patched now that its label is defined
+ * Before layout only TEXT addresses (base 0) and PC-relative references
+ * within one section are final
+ */
+bool CodeGenerator::fixup_ready(const Fixup& fixup, bool laid_out) const {
+    if (laid_out) return true;
+    
+    const Symbol& sym = symbols_[fixup.symbol];
+    if (fixup.kind == FixupKind::BRANCH26 || fixup.kind == FixupKind::IMM19) {
+        return sym.section == fixup.section;
+    }
+    return sym.section == Section::TEXT;
+}
+
+/*
+ * Patch a label address into the instruction(s) a fixup points at
+ * Before layout every section base is still zero, which is exact for the
+ * references fixup_ready() accepts
+ */
+void CodeGenerator::apply_fixup(const Fixup& fixup) {
+    const Symbol& sym = symbols_[fixup.symbol];
+    int64_t target = static_cast<int64_t>(
+        section_base_[static_cast<int>(sym.section)] + sym.address);
+    int64_t place = static_cast<int64_t>(
+        section_base_[static_cast<int>(fixup.section)] + fixup.offset);
+    uint8_t* word = section_buf_[static_cast<int>(fixup.section)] + fixup.offset;
+    uint32_t patch = 0;
+    
+    switch (fixup.kind) {
+        case FixupKind::BRANCH26: {
+            int64_t offset = target - place;
+            if (offset < -134217728 || offset > 134217724 || (offset & 3) != 0) {
+                error_at(fixup.line, "Branch target out of range");
+                return;
+            }
+            patch = static_cast<uint32_t>((offset >> 2) & 0x3FFFFFF);
+            break;
+        }
+        case FixupKind::IMM19: {
+            int64_t offset = target - place;
+            if (offset < -1048576 || offset > 1048572 || (offset & 3) != 0) {
+                error_at(fixup.line, "PC-relative offset out of range");
+                return;
+            }
+            patch = static_cast<uint32_t>(((offset >> 2) & 0x7FFFF) << 5);
+            break;
+        }
+        case FixupKind::IMM12:
+            if (target > 0xFFF) {
+                error_at(fixup.line, "Label out of range for immediate");
+                return;
+            }
+            patch = static_cast<uint32_t>(target << 10);
+            break;
+        case FixupKind::IMM12_PAIR: {
+            uint32_t high = static_cast<uint32_t>((target >> 12) & 0xFFF) << 10;
+            word[4] |= high & 0xFF;
+            word[5] |= (high >> 8) & 0xFF;
+            word[6] |= (high >> 16) & 0xFF;
+            patch = static_cast<uint32_t>(target & 0xFFF) << 10;
+            break;
+        }
+    }
+    
+    word[0] |= patch & 0xFF;
+    word[1] |= (patch >> 8) & 0xFF;
+    word[2] |= (patch >> 16) & 0xFF;
+    word[3] |= (patch >> 24) & 0xFF;
+}
+
+/*
+ * A label has just been defined: patch the references waiting on it and
+ * move the ones that need the final layout to the deferred chain
+ */
+void CodeGenerator::resolve_fixups(Symbol* sym) {
+    int next = sym->fixups;
+    sym->fixups = -1;
+    
+    while (next >= 0 && !has_error_) {
+        Fixup& fixup = fixups_[next];
+        int number = next;
+        next = fixup.next;
+        
+        if (fixup_ready(fixup, false)) {
+            apply_fixup(fixup);
+        } else {
+            fixup.next = deferred_fixups_;
+            deferred_fixups_ = number;
+        }
+    }
+}
+
+/*
+ * After layout: report labels that were never defined, then patch every
+ * deferred reference against the final section bases
+ */
+bool CodeGenerator::resolve_deferred_fixups() {
+    for (int i = 0; i < symbol_count_; i++) {
+        if (symbols_[i].fixups < 0) continue;
+        
+        // Report the first use; chains are in reverse source order
+        int line = 0;
+        for (int f = symbols_[i].fixups; f >= 0; f = fixups_[f].next) {
+            line = fixups_[f].line;
+        }
+        error_at(line, "Undefined symbol");
+        return false;
+    }
+    
+    for (int f = deferred_fixups_; f >= 0 && !has_error_; f = fixups_[f].next) {
+        apply_fixup(fixups_[f]);
+    }
+    deferred_fixups_ = -1;
+    return !has_error_;
+}
+
+// ============================================================================
+// Sections and Emission
+// ============================================================================
+
+/*
+ * Offset of the next byte in the current section
+ */
+size_t CodeGenerator::current_offset() const {
+    return section_offset_[static_cast<int>(current_section_)];
+}
+
+/*
+ * Grow a section buffer geometrically to hold at least needed bytes
+ */
+bool CodeGenerator::grow_section(int section, size_t needed) {
+    if (needed > MAX_IMAGE_SIZE) {
+        error("Program too large");
+        return false;
+    }
+    
+    size_t pages = section_pages_[section] ? section_pages_[section] : 1;
+    while (pages * memory::PAGE_SIZE < needed) {
+        pages *= 2;
+    }
+    
+    uint8_t* grown = static_cast<uint8_t*>(memory::alloc_pages(pages));
+    if (!grown) {
+        error("Out of memory for code");
+        return false;
+    }
+    if (section_buf_[section]) {
+        klib::memcpy(grown, section_buf_[section], section_offset_[section]);
+        memory::free_pages(section_buf_[section], section_pages_[section]);
+    }
+    section_buf_[section] = grown;
+    section_pages_[section] = pages;
+    return true;
+}
+
+/*
+ * Place the sections, patch the deferred fixups, relocate labels to image
+ * addresses and build the zero-filled image. The TEXT buffer becomes the
+ * image, grown if DATA or BSS follow it
+ * Requirements: 7.8, 7.10
+ */
+bool CodeGenerator::layout_sections() {
+    const int text = static_cast<int>(Section::TEXT);
+    const int data = static_cast<int>(Section::DATA);
+    const int bss = static_cast<int>(Section::BSS);
+    
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        section_size_[i] = section_offset_[i];
+    }
+    
+    section_base_[text] = 0;
+    section_base_[data] = align_up(section_size_[text], SECTION_ALIGN);
+    section_base_[bss] = align_up(section_base_[data] + section_size_[data], SECTION_ALIGN);
+    
+    // The image ends with the last non-empty section, so alignment padding
+    // is only added in front of a section that follows
+    size_t image_size = section_size_[text];
+    for (int i = data; i < NUM_SECTIONS; i++) {
+        if (section_size_[i] > 0) {
+            image_size = section_base_[i] + section_size_[i];
+        }
+    }
+    if (image_size > MAX_IMAGE_SIZE) {
+        error("Program too large");
+        return false;
+    }
+    
+    if (!resolve_deferred_fixups()) {
+        return false;
+    }
+    
+    for (int i = 0; i < symbol_count_; i++) {
+        if (symbols_[i].is_label && symbols_[i].defined) {
+            symbols_[i].address += section_base_[static_cast<int>(symbols_[i].section)];
+        }
+    }
+    
+    size_t needed = image_size ? image_size : 1;
+    if (section_pages_[text] * memory::PAGE_SIZE < needed && !grow_section(text, needed)) {
+        return false;
+    }
+    uint8_t* image = section_buf_[text];
+    klib::memset(image + section_size_[text], 0,
+                 section_pages_[text] * memory::PAGE_SIZE - section_size_[text]);
+    if (section_size_[data] > 0) {
+        klib::memcpy(image + section_base_[data], section_buf_[data], section_size_[data]);
+    }
+    
+    image_ = image;
+    image_pages_ = section_pages_[text];
+    image_size_ = image_size;
+    section_buf_[text] = nullptr;
+    section_pages_[text] = 0;
+    return true;
+}
+
+/*
+ * Emit a single byte into the current section
+ * BSS has no buffer and only ever holds zeroes
  * Requirements: 7.10
  */
 void CodeGenerator::emit_byte(uint8_t byte) {
-    if (is_first_pass_) {
-        code_offset_++;
+    int section = static_cast<int>(current_section_);
+    size_t offset = section_offset_[section];
+    
+    if (current_section_ == Section::BSS) {
+        if (byte != 0) {
+            error("Initialized data in .bss");
+            return;
+        }
+        if (offset >= MAX_IMAGE_SIZE) {
+            error("Program too large");
+            return;
+        }
+        section_offset_[section] = offset + 1;
         return;
     }
     
-    if (code_offset_ >= MAX_CODE_SIZE) {
-        error("Code buffer overflow");
+    if (offset >= section_pages_[section] * memory::PAGE_SIZE &&
+        !grow_section(section, offset + 1)) {
         return;
     }
-    code_[code_offset_++] = byte;
+    section_buf_[section][offset] = byte;
+    section_offset_[section] = offset + 1;
 }
 
 /*
@@ -247,11 +691,11 @@ void CodeGenerator::emit_quad(uint64_t quad) {
 }
 
 /*
- * Align code offset to boundary
+ * Align the current section to boundary
  * Requirements: 7.8
  */
 void CodeGenerator::align_to(size_t alignment) {
-    while (code_offset_ % alignment != 0) {
+    while (section_offset_[static_cast<int>(current_section_)] % alignment != 0 && !has_error_) {
         emit_byte(0);
     }
 }
@@ -259,7 +703,7 @@ void CodeGenerator::align_to(size_t alignment) {
 
 /*
  * Generate machine code from AST
- * Implements two-pass assembly
+ * Implements single-pass assembly with label fixups
  * Requirements: 7.6
  */
 bool CodeGenerator::generate(ASTNode* ast) {
@@ -268,61 +712,34 @@ bool CodeGenerator::generate(ASTNode* ast) {
         return false;
     }
     
-    // Pass 1: Collect labels and calculate addresses
-    is_first_pass_ = true;
-    code_offset_ = 0;
-    has_last_instr_ = false;
-    if (!first_pass(ast)) {
-        return false;
-    }
-    
-    // Pass 2: Generate code with resolved labels (peephole optimization active)
-    is_first_pass_ = false;
-    code_offset_ = 0;
-    has_last_instr_ = false;
-    current_line_ = 1;
-    if (!second_pass(ast)) {
-        return false;
+    current_section_ = Section::TEXT;
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        section_offset_[i] = 0;
     }
+    klib::memset(&opt_stats_, 0, sizeof(opt_stats_));
+    reset_window();
     
-    return !has_error_;
-}
-
-/*
- * First pass: collect labels and calculate addresses
- * Requirements: 7.6
- */
-bool CodeGenerator::first_pass(ASTNode* ast) {
-    if (!ast) return true;
-    
+    program_ = ast->type == NodeType::PROGRAM ? ast : nullptr;
+    branch_node_ = nullptr;
     if (ast->type == NodeType::PROGRAM) {
+        declare_constants(ast);
         // Use statement array instead of children
         for (int i = 0; i < ast->statement_count && !has_error_; i++) {
-            first_pass(ast->statements[i]);
+            process_node(ast->statements[i]);
         }
     } else {
         process_node(ast);
     }
     
-    return !has_error_;
-}
-
-/*
- * Second pass: generate machine code
- */
-bool CodeGenerator::second_pass(ASTNode* ast) {
-    if (!ast) return true;
+    if (optimize_ && !has_error_) {
+        form_cbz(nullptr);
+    }
     
-    if (ast->type == NodeType::PROGRAM) {
-        // Use statement array instead of children
-        for (int i = 0; i < ast->statement_count && !has_error_; i++) {
-            second_pass(ast->statements[i]);
-        }
-    } else {
-        process_node(ast);
+    if (has_error_) {
+        return false;
     }
     
-    return !has_error_;
+    return layout_sections();
 }
 
 /*
@@ -350,15 +767,25 @@ void CodeGenerator::process_node(ASTNode* node) {
 
 /*
  * Process label definition
+ * Labels record their section offset here; layout_sections() turns
+ * them into image addresses once every section has been placed
  * Requirements: 7.6
  */
 void CodeGenerator::process_label(ASTNode* node) {
-    if (is_first_pass_) {
-        // Define the label with current address
-        if (!define_symbol(node->token.start, node->token.length, code_offset_)) {
-            // Error already set
+    if (optimize_) {
+        Symbol* sym = find_symbol(node->token.start, node->token.length);
+        if (sym && !sym->defined) {
+            remove_branch_to_next(sym);
         }
     }
+    reset_window();
+    
+    if (define_symbol(node->token.start, node->token.length, current_offset())) {
+        Symbol* sym = find_symbol(node->token.start, node->token.length);
+        sym->is_label = true;
+        sym->section = current_section_;
+        resolve_fixups(sym);
+    }
     // Labels don't emit code
 }
 
@@ -368,6 +795,7 @@ void CodeGenerator::process_label(ASTNode* node) {
  */
 void CodeGenerator::process_directive(ASTNode* node) {
     const Token& name = node->token;
+    reset_window();
     
     // .text - switch to text section
     if (token_equals(name, "text")) {
@@ -473,6 +901,10 @@ void CodeGenerator::process_directive(ASTNode* node) {
     if (token_equals(name, "space") || token_equals(name, "skip")) {
         if (node->child_count > 0 && node->children[0]) {
             int64_t size = node->children[0]->data.imm_value;
+            if (size < 0 || size > static_cast<int64_t>(MAX_IMAGE_SIZE)) {
+                error("Invalid .space size");
+                return;
+            }
             uint8_t fill = 0;
             if (node->child_count > 1 && node->children[1]) {
                 fill = node->children[1]->data.imm_value & 0xFF;
@@ -535,16 +967,8 @@ void CodeGenerator::process_directive(ASTNode* node) {
         return;
     }
     
-    // .equ / .set - define constant (handled in first pass only)
+    // .equ / .set - define constant (already done by declare_constants)
     if (token_equals(name, "equ") || token_equals(name, "set")) {
-        if (is_first_pass_ && node->child_count >= 2) {
-            ASTNode* name_node = node->children[0];
-            ASTNode* value_node = node->children[1];
-            if (name_node && value_node) {
-                define_symbol(name_node->token.start, name_node->token.length,
-                             value_node->data.imm_value);
-            }
-        }
         return;
     }
     
@@ -568,6 +992,8 @@ int CodeGenerator::get_register(ASTNode* operand, bool* is_64bit) {
 
 /*
  * Get immediate value from operand
+ * A label operand must already have its final value here; encoders that
+ * accept forward references handle labels before calling this
  */
 int64_t CodeGenerator::get_immediate(ASTNode* operand) {
     if (!operand) return 0;
@@ -577,7 +1003,11 @@ int64_t CodeGenerator::get_immediate(ASTNode* operand) {
     }
     
     if (operand->type == NodeType::OPERAND_LABEL) {
-        return resolve_label(operand);
+        int64_t value = 0;
+        if (!symbol_value(operand, &value)) {
+            error("Label must be defined before use here");
+        }
+        return value;
     }
     
     return 0;
@@ -599,70 +1029,129 @@ bool CodeGenerator::get_memory_operand(ASTNode* operand, int* base, int64_t* off
 }
 
 /*
- * Resolve label to address
+ * Get the value of a label or constant operand if it is already final:
+ * .equ constants, and labels defined in TEXT (which starts the image)
+ * Returns false, with *value = 0, when the value needs a fixup
  * Requirements: 7.6
  */
-int64_t CodeGenerator::resolve_label(ASTNode* operand) {
-    if (!operand) return 0;
-    
+bool CodeGenerator::symbol_value(ASTNode* operand, int64_t* value) const {
+    *value = 0;
     const Symbol* sym = lookup_symbol(operand->token.start, operand->token.length);
-    if (!sym) {
-        if (!is_first_pass_) {
-            error("Undefined symbol");
-        }
-        return 0;
+    if (!sym || !sym->defined || (sym->is_label && sym->section != Section::TEXT)) {
+        return false;
     }
+    *value = static_cast<int64_t>(sym->address);
+    return true;
+}
+
+/*
+ * Get the PC-relative offset from the current instruction to a branch or
+ * literal target. A label in the same section that is already defined is
+ * encoded directly; any other label records a fixup of the given kind and
+ * yields offset 0. Returns false on error
+ * Requirements: 7.4, 7.6
+ */
+bool CodeGenerator::pc_relative_offset(ASTNode* operand, FixupKind kind, int64_t* offset) {
+    *offset = 0;
     
-    if (!sym->defined && !is_first_pass_) {
-        error("Undefined symbol");
-        return 0;
+    if (is_label_operand(operand)) {
+        const Symbol* sym = lookup_symbol(operand->token.start, operand->token.length);
+        if (sym && sym->defined && sym->section == current_section_) {
+            *offset = static_cast<int64_t>(sym->address) - static_cast<int64_t>(current_offset());
+        } else {
+            add_fixup(operand, kind);
+        }
+        return !has_error_;
     }
     
-    return sym->address;
+    // Absolute target (immediate or .equ constant): image offsets are only
+    // known before layout inside TEXT
+    int64_t target = get_immediate(operand);
+    if (current_section_ != Section::TEXT) {
+        error("Absolute branch target outside .text");
+        return false;
+    }
+    *offset = target - static_cast<int64_t>(current_offset());
+    return !has_error_;
+}
+
+/*
+ * Check whether an operand names a label (as opposed to an .equ constant)
+ * Constants are all defined before assembly starts, so a name that is not
+ * yet defined is a forward reference to a label
+ */
+bool CodeGenerator::is_label_operand(ASTNode* operand) const {
+    if (!operand || operand->type != NodeType::OPERAND_LABEL) return false;
+    const Symbol* sym = lookup_symbol(operand->token.start, operand->token.length);
+    return !sym || !sym->defined || sym->is_label;
+}
+
+/*
+ * Encode Rd = x28 + offset, the native address of an image offset
+ * Emits ADD Rd, x28, #lo and returns ADD Rd, Rd, #hi, LSL #12 when the
+ * offset needs more than 12 bits or fixed_size is set (label operands,
+ * whose IMM12_PAIR fixup patches both words)
+ */
+uint32_t CodeGenerator::encode_image_address(int rd, int64_t offset, bool fixed_size) {
+    uint32_t lo = offset & 0xFFF;
+    uint32_t hi = (offset >> 12) & 0xFFF;
+    
+    // ADD (immediate, 64-bit): 1 0 0 100010 sh imm12 Rn Rd
+    // Rn = x28 (data base register), Rd = destination
+    uint32_t add_lo = (1U << 31) | (0x91 << 24) | (lo << 10) | (28 << 5) | rd;
+    if (!fixed_size && hi == 0) {
+        return add_lo;
+    }
+    emit_word(add_lo);
+    return (1U << 31) | (0x91 << 24) | (1 << 22) | (hi << 10) | (rd << 5) | rd;
 }
 
 /*
  * Get condition code from string
  */
 int CodeGenerator::get_condition_code(const char* cond, size_t len) const {
-    if (len < 2) return -1;
-    
-    // Standard condition codes
-    if (str_equal_nocase(cond, len, "eq")) return 0;   // Equal
-    if (str_equal_nocase(cond, len, "ne")) return 1;   // Not equal
-    if (str_equal_nocase(cond, len, "cs") || str_equal_nocase(cond, len, "hs")) return 2;   // Carry set / unsigned higher or same
-    if (str_equal_nocase(cond, len, "cc") || str_equal_nocase(cond, len, "lo")) return 3;   // Carry clear / unsigned lower
-    if (str_equal_nocase(cond, len, "mi")) return 4;   // Minus / negative
-    if (str_equal_nocase(cond, len, "pl")) return 5;   // Plus / positive or zero
-    if (str_equal_nocase(cond, len, "vs")) return 6;   // Overflow
-    if (str_equal_nocase(cond, len, "vc")) return 7;   // No overflow
-    if (str_equal_nocase(cond, len, "hi")) return 8;   // Unsigned higher
-    if (str_equal_nocase(cond, len, "ls")) return 9;   // Unsigned lower or same
-    if (str_equal_nocase(cond, len, "ge")) return 10;  // Signed greater or equal
-    if (str_equal_nocase(cond, len, "lt")) return 11;  // Signed less than
-    if (str_equal_nocase(cond, len, "gt")) return 12;  // Signed greater than
-    if (str_equal_nocase(cond, len, "le")) return 13;  // Signed less or equal
-    if (str_equal_nocase(cond, len, "al")) return 14;  // Always
-    
-    return -1;
+    return find_condition(cond, len);
+}
+
+/*
+ * Get shift type (LSL=0, LSR=1, ASR=2, ROR=3) from string
+ */
+int CodeGenerator::get_shift_type(const char* shift, size_t len) const {
+    return find_shift(shift, len);
 }
 
 /*
  * Process instruction with peephole optimization
  * Requirements: 7.2, 7.3, 7.4, 7.5
  * 
- * Peephole optimizations:
+ * Always-on peephole optimizations:
  * 1. mov xN, #0 -> mov xN, xzr (ORR with XZR, same size but clearer)
  * 2. mov xN, xN -> eliminated (no-op)
  * 3. add xN, xN, #0 -> eliminated (no-op)
  * 4. sub xN, xN, #0 -> eliminated (no-op)
+ * 
+ * With -O, the window rules below run as well
  */
 void CodeGenerator::process_instruction(ASTNode* node) {
+    if (optimize_) {
+        form_cbz(node);
+    }
+    
+    size_t start = current_offset();
+    int fixups_before = fixup_count_;
     uint32_t encoding = encode_instruction(node);
     if (has_error_) return;
     
-    // Peephole optimization (only in second pass)
-    if (!is_first_pass_) {
+    // Encoders that emit a multi-word sequence leave its earlier words
+    // outside the window
+    if (current_offset() != start) {
+        reset_window();
+    }
+    
+    // Peephole optimization, skipped for words whose label field is not
+    // patched in yet (a placeholder ADD #0 is not a no-op)
+    bool has_fixup = fixup_count_ != fixups_before;
+    if (!has_fixup) {
         // Pattern: MOV Xd, #0 (MOVZ with imm=0)
         // Encoding: sf 10 100101 00 0000000000000000 Rd
         // 64-bit: 0xD2800000 | Rd, 32-bit: 0x52800000 | Rd
@@ -670,336 +1159,599 @@ void CodeGenerator::process_instruction(ASTNode* node) {
         
         // Pattern: MOV Xd, Xd (ORR Xd, XZR, Xd) - eliminate
         // 64-bit ORR: 1 01 01010 00 0 Rm 000000 11111 Rd = 0xAA0003E0 | (Rm << 16) | Rd
-        // If Rm == Rd, this is a no-op
-        if ((encoding & 0xFFE0FFE0) == 0xAA0003E0) {
-            int rd = encoding & 0x1F;
-            int rm = (encoding >> 16) & 0x1F;
-            if (rd == rm && rd != 31) {
-                // Skip this instruction - it's a no-op (mov xN, xN)
-                return;
-            }
-        }
         // 32-bit ORR: 0 01 01010 00 0 Rm 000000 11111 Rd = 0x2A0003E0 | (Rm << 16) | Rd
-        if ((encoding & 0xFFE0FFE0) == 0x2A0003E0) {
+        // (a 32-bit move zeroes the upper half, so only the 64-bit form is a no-op)
+        bool is_noop = false;
+        if ((encoding & 0xFFE0FFE0) == 0xAA0003E0) {
             int rd = encoding & 0x1F;
             int rm = (encoding >> 16) & 0x1F;
-            if (rd == rm && rd != 31) {
-                return; // no-op
-            }
+            is_noop = rd == rm && rd != 31;
         }
         
-        // Pattern: ADD Xd, Xd, #0 - eliminate
+        // Pattern: ADD/SUB Xd, Xd, #0 - eliminate
         // 64-bit ADD imm: 1 0 0 100010 0 000000000000 Rn Rd = 0x91000000 | (Rn << 5) | Rd
-        if ((encoding & 0xFFC003E0) == 0x91000000) {
+        // 64-bit SUB imm: 1 1 0 100010 0 000000000000 Rn Rd = 0xD1000000 | (Rn << 5) | Rd
+        if ((encoding & 0xFFFFFC00) == 0x91000000 || (encoding & 0xFFFFFC00) == 0xD1000000) {
             int rd = encoding & 0x1F;
             int rn = (encoding >> 5) & 0x1F;
-            uint32_t imm = (encoding >> 10) & 0xFFF;
-            if (rd == rn && imm == 0 && rd != 31) {
-                return; // no-op
-            }
-        }
-        // 32-bit ADD imm: 0 0 0 100010 0 imm12 Rn Rd = 0x11000000 | ...
-        if ((encoding & 0xFFC003E0) == 0x11000000) {
-            int rd = encoding & 0x1F;
-            int rn = (encoding >> 5) & 0x1F;
-            uint32_t imm = (encoding >> 10) & 0xFFF;
-            if (rd == rn && imm == 0 && rd != 31) {
-                return; // no-op
-            }
+            is_noop = rd == rn && rd != 31;
         }
         
-        // Pattern: SUB Xd, Xd, #0 - eliminate
-        // 64-bit SUB imm: 1 1 0 100010 0 000000000000 Rn Rd = 0xD1000000 | ...
-        if ((encoding & 0xFFC003E0) == 0xD1000000) {
-            int rd = encoding & 0x1F;
-            int rn = (encoding >> 5) & 0x1F;
-            uint32_t imm = (encoding >> 10) & 0xFFF;
-            if (rd == rn && imm == 0 && rd != 31) {
-                return; // no-op
-            }
-        }
-        // 32-bit SUB imm: 0 1 0 100010 0 imm12 Rn Rd = 0x51000000 | ...
-        if ((encoding & 0xFFC003E0) == 0x51000000) {
-            int rd = encoding & 0x1F;
-            int rn = (encoding >> 5) & 0x1F;
-            uint32_t imm = (encoding >> 10) & 0xFFF;
-            if (rd == rn && imm == 0 && rd != 31) {
-                return; // no-op
-            }
+        if (is_noop) {
+            opt_stats_.nops_removed++;
+            opt_stats_.bytes_saved += 4;
+            return;
         }
         
-        // Track last instruction for future multi-instruction peepholes
-        last_instr_ = encoding;
-        last_instr_offset_ = code_offset_;
-        has_last_instr_ = true;
+        if (optimize_ && (merge_load_store_pair(encoding) || fold_constant(encoding))) {
+            return;
+        }
     }
     
+    size_t offset = current_offset();
     emit_word(encoding);
+    if (optimize_) {
+        push_window(encoding, offset, has_fixup ? fixup_count_ - 1 : -1);
+        track_constant(encoding, offset);
+        if (opcode_info(node->token.opcode).encoder == EncoderClass::BRANCH_COND) {
+            branch_node_ = node;
+        }
+    }
+}
+
+// ============================================================================
+// Peephole Optimizer (casm -O)
+// ============================================================================
+
+// Instruction classes the window rules look for
+static inline bool is_cmp_zero(uint32_t word) {
+    // SUBS XZR/WZR, Rn, #0: sf 1 1 100010 0 000000000000 Rn 11111
+    return (word & 0x7FFFFC1F) == 0x7100001F;
+}
+
+static inline bool is_branch(uint32_t word) {
+    return (word & 0xFC000000) == 0x14000000;           // B imm26
+}
+
+static inline bool is_branch_cond(uint32_t word) {
+    return (word & 0xFF000010) == 0x54000000;           // B.cond imm19
+}
+
+static inline bool is_cbz_cbnz(uint32_t word) {
+    return (word & 0x7E000000) == 0x34000000;           // CBZ/CBNZ imm19
+}
+
+static inline int64_t imm19_of(uint32_t word) {
+    int64_t imm19 = (word >> 5) & 0x7FFFF;
+    return (imm19 & 0x40000) ? imm19 - 0x80000 : imm19;
 }
 
 /*
- * Encode instruction to machine code
- * Requirements: 7.2, 7.3, 7.4, 7.5
+ * Halfword-move encodings (Rd in bits 0-4, hw in 21-22, imm16 in 5-20)
  */
-uint32_t CodeGenerator::encode_instruction(ASTNode* node) {
-    if (!node || node->type != NodeType::INSTRUCTION) {
-        error("Invalid instruction node");
-        return 0;
+static inline uint32_t move_wide(uint32_t opcode, bool is_64bit, int hw, uint32_t imm16, int rd) {
+    return (is_64bit ? (1U << 31) : 0) | opcode | (hw << 21) | (imm16 << 5) | rd;
+}
+
+constexpr uint32_t MOVN_OPC = 0x12800000;
+constexpr uint32_t MOVZ_OPC = 0x52800000;
+constexpr uint32_t MOVK_OPC = 0x72800000;
+
+/*
+ * Encode value as an AArch64 logical (bitmask) immediate
+ * Returns false if it is not a replicated, rotated run of ones
+ */
+static bool encode_bitmask(uint64_t value, bool is_64bit, uint32_t* n_immr_imms) {
+    if (!is_64bit) {
+        value = (value & 0xFFFFFFFFULL) | (value << 32);
     }
-    
-    const Token& mnemonic = node->token;
-    
-    // NOP - special case
-    if (token_equals(mnemonic, "nop")) {
-        return 0xD503201F;  // NOP encoding
+    if (value == 0 || value == ~0ULL) {
+        return false;
     }
     
-    // RET - special case
-    if (token_equals(mnemonic, "ret")) {
-        int reg = 30;  // Default to LR (x30)
-        if (node->child_count > 0) {
-            bool is_64bit;
-            reg = get_register(node->children[0], &is_64bit);
-            if (reg < 0) reg = 30;
+    // Smallest element size whose pattern repeats across the register
+    uint32_t size = 64;
+    while (size > 2) {
+        uint32_t half = size / 2;
+        uint64_t mask = (1ULL << half) - 1;
+        if ((value & mask) != ((value >> half) & mask)) break;
+        size = half;
+    }
+    
+    uint64_t mask = (size == 64) ? ~0ULL : ((1ULL << size) - 1);
+    uint64_t element = value & mask;
+    uint32_t ones = 0;
+    for (uint64_t bits = element; bits; bits &= bits - 1) {
+        ones++;
+    }
+    
+    // The element must be the low run of ones rotated right by immr
+    uint64_t run = (1ULL << ones) - 1;
+    for (uint32_t immr = 0; immr < size; immr++) {
+        uint64_t rotated = immr == 0 ? run
+                         : ((run >> immr) | (run << (size - immr))) & mask;
+        if (rotated == element) {
+            uint32_t n = size == 64 ? 1 : 0;
+            uint32_t imms = ((~(2 * size - 1)) & 0x3F) | (ones - 1);
+            *n_immr_imms = (n << 22) | (immr << 16) | (imms << 10);
+            return true;
         }
-        // RET Xn: 1101011 0010 11111 000000 Rn 00000
-        return 0xD65F0000 | (reg << 5);
     }
-    
-    // BR - branch to register
-    if (token_equals(mnemonic, "br")) {
-        if (node->child_count < 1) {
-            error("BR requires register operand");
-            return 0;
-        }
-        bool is_64bit;
-        int reg = get_register(node->children[0], &is_64bit);
-        if (reg < 0) {
-            error("Invalid register for BR");
-            return 0;
+    return false;
+}
+
+/*
+ * Shortest MOVZ/MOVN/ORR (+ MOVK) sequence that puts value in Rd
+ * Returns the number of words written to words[] (1-4)
+ */
+static int materialize_constant(uint64_t value, bool is_64bit, int rd, uint32_t* words) {
+    int halves = is_64bit ? 4 : 2;
+    if (!is_64bit) {
+        value &= 0xFFFFFFFFULL;
+    }
+    
+    int zero = 0, ones = 0;
+    for (int i = 0; i < halves; i++) {
+        uint32_t half = (value >> (16 * i)) & 0xFFFF;
+        if (half == 0) zero++;
+        if (half == 0xFFFF) ones++;
+    }
+    
+    // ORR Rd, ZR, #bitmask beats a MOVZ/MOVN base that needs a MOVK
+    uint32_t bitmask;
+    if (zero < halves - 1 && ones < halves - 1 && encode_bitmask(value, is_64bit, &bitmask)) {
+        words[0] = (is_64bit ? 0xB2000000 : 0x32000000) | bitmask | (31 << 5) | rd;
+        return 1;
+    }
+    
+    // Build from all-zeroes (MOVZ) or all-ones (MOVN), whichever leaves
+    // fewer halfwords to patch with MOVK
+    bool inverted = ones > zero;
+    uint32_t fill = inverted ? 0xFFFF : 0;
+    int count = 0;
+    for (int i = 0; i < halves; i++) {
+        uint32_t half = (value >> (16 * i)) & 0xFFFF;
+        if (half == fill) continue;
+        if (count == 0) {
+            words[count++] = inverted ? move_wide(MOVN_OPC, is_64bit, i, ~half & 0xFFFF, rd)
+                                      : move_wide(MOVZ_OPC, is_64bit, i, half, rd);
+        } else {
+            words[count++] = move_wide(MOVK_OPC, is_64bit, i, half, rd);
         }
-        // BR Xn: 1101011 0000 11111 000000 Rn 00000
-        return 0xD61F0000 | (reg << 5);
     }
-    
-    // BLR - branch with link to register
-    if (token_equals(mnemonic, "blr")) {
-        if (node->child_count < 1) {
-            error("BLR requires register operand");
-            return 0;
-        }
-        bool is_64bit;
-        int reg = get_register(node->children[0], &is_64bit);
-        if (reg < 0) {
-            error("Invalid register for BLR");
-            return 0;
+    if (count == 0) {
+        words[count++] = inverted ? move_wide(MOVN_OPC, is_64bit, 0, 0, rd)
+                                  : move_wide(MOVZ_OPC, is_64bit, 0, 0, rd);
+    }
+    return count;
+}
+
+/*
+ * Forget the window, e.g. at a label that other code can branch to
+ */
+void CodeGenerator::reset_window() {
+    window_count_ = 0;
+    const_reg_ = -1;
+}
+
+void CodeGenerator::push_window(uint32_t word, size_t offset, int fixup) {
+    if (window_count_ == PEEPHOLE_WINDOW) {
+        for (int i = 1; i < PEEPHOLE_WINDOW; i++) {
+            window_[i - 1] = window_[i];
         }
-        // BLR Xn: 1101011 0001 11111 000000 Rn 00000
-        return 0xD63F0000 | (reg << 5);
+        window_count_--;
     }
-    
-    // B - unconditional branch
-    if (token_equals(mnemonic, "b")) {
-        return encode_branch(node);
+    window_[window_count_].word = word;
+    window_[window_count_].offset = offset;
+    window_[window_count_].fixup = fixup;
+    window_count_++;
+}
+
+/*
+ * Overwrite an already emitted word in the current section
+ */
+void CodeGenerator::rewrite_word(size_t offset, uint32_t word) {
+    uint8_t* dest = section_buf_[static_cast<int>(current_section_)] + offset;
+    dest[0] = word & 0xFF;
+    dest[1] = (word >> 8) & 0xFF;
+    dest[2] = (word >> 16) & 0xFF;
+    dest[3] = (word >> 24) & 0xFF;
+}
+
+/*
+ * Whether an instruction overwrites all of NZCV without reading it
+ * (ADCS and friends read C, so they do not count)
+ */
+static bool writes_flags(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::CMP:
+        case Opcode::CMN:
+        case Opcode::TST:
+        case Opcode::ADDS:
+        case Opcode::SUBS:
+        case Opcode::ANDS:
+        case Opcode::BICS:
+        case Opcode::NEGS:
+            return true;
+        default:
+            return false;
     }
+}
+
+// Unconditional branches followed when proving the flags dead
+constexpr int MAX_FLAG_HOPS = 4;
+
+/*
+ * Whether the flags are dead on entry to insn: it overwrites them, is a
+ * RET (the flags are not preserved across calls), or is a B to code whose
+ * flags are dead
+ */
+bool CodeGenerator::flags_dead_after(const ASTNode* insn, int depth) const {
+    if (!insn || insn->type != NodeType::INSTRUCTION) return false;
     
-    // BL - branch with link
-    if (token_equals(mnemonic, "bl")) {
-        return encode_branch(node);
+    Opcode opcode = insn->token.opcode;
+    if (writes_flags(opcode) || opcode == Opcode::RET) return true;
+    if (opcode == Opcode::B && insn->child_count >= 1 && depth < MAX_FLAG_HOPS) {
+        return flags_dead_at(insn->children[0], depth + 1);
     }
-    
-    // Conditional branches (b.eq, b.ne, etc.)
-    if (mnemonic.length > 2 && mnemonic.start[0] == 'b' && 
-        (mnemonic.start[1] == '.' || 
-         (mnemonic.length >= 3 && to_lower(mnemonic.start[1]) != 'l' && to_lower(mnemonic.start[1]) != 'r'))) {
-        
-        // Check for b.cond format
-        if (mnemonic.start[1] == '.') {
-            int cond = get_condition_code(mnemonic.start + 2, mnemonic.length - 2);
-            if (cond >= 0) {
-                return encode_branch_cond(node, cond);
-            }
+    return false;
+}
+
+/*
+ * Whether the flags are dead at a branch target: it must be a label whose
+ * first instruction (past any other labels) passes flags_dead_after
+ */
+bool CodeGenerator::flags_dead_at(const ASTNode* target, int depth) const {
+    if (!program_ || !target || target->type != NodeType::OPERAND_LABEL) return false;
+    
+    const Token& name = target->token;
+    for (int i = 0; i < program_->statement_count; i++) {
+        const ASTNode* node = program_->statements[i];
+        if (!node || node->type != NodeType::LABEL ||
+            !str_equal_n(node->token.start, node->token.length, name.start, name.length)) {
+            continue;
         }
-        // Check for bcond format (beq, bne, etc.)
-        else {
-            int cond = get_condition_code(mnemonic.start + 1, mnemonic.length - 1);
-            if (cond >= 0) {
-                return encode_branch_cond(node, cond);
-            }
+        for (int j = i + 1; j < program_->statement_count; j++) {
+            const ASTNode* insn = program_->statements[j];
+            if (insn && insn->type == NodeType::LABEL) continue;
+            return flags_dead_after(insn, depth);
         }
+        return false;
     }
+    return false;
+}
+
+/*
+ * CMP Rn, #0 ; B.EQ/B.NE label  ->  CBZ/CBNZ Rn, label
+ * Runs before the next instruction is encoded, so the two words can shrink
+ * to one without moving anything already placed after them. CBZ/CBNZ
+ * does not set the flags, so both the fall-through and the target must
+ * overwrite them before any instruction could read the CMP's result
+ */
+void CodeGenerator::form_cbz(ASTNode* next) {
+    if (window_count_ < 2) return;
     
-    // CBZ / CBNZ
-    if (token_equals(mnemonic, "cbz")) {
-        return encode_cbz_cbnz(node, false);
+    PeepholeEntry& cmp = window_[window_count_ - 2];
+    PeepholeEntry& branch = window_[window_count_ - 1];
+    if (!is_cmp_zero(cmp.word) || !is_branch_cond(branch.word) ||
+        (branch.word & 0xF) > 1 || branch.offset + 4 != current_offset()) {
+        return;
     }
-    if (token_equals(mnemonic, "cbnz")) {
-        return encode_cbz_cbnz(node, true);
+    if (!branch_node_ || branch_node_->child_count < 1 ||
+        !flags_dead_after(next, 0) || !flags_dead_at(branch_node_->children[0], 0)) {
+        return;
     }
     
-    // MOV variants
-    if (token_equals(mnemonic, "mov") || token_equals(mnemonic, "movz") ||
-        token_equals(mnemonic, "movn") || token_equals(mnemonic, "movk")) {
-        return encode_mov(node);
+    // The branch moves back one word: a resolved offset grows by one
+    // instruction, a pending fixup just follows the word
+    int64_t imm19 = imm19_of(branch.word);
+    if (branch.fixup >= 0) {
+        fixups_[branch.fixup].offset = cmp.offset;
+    } else {
+        imm19 += 1;
+        if (imm19 > 0x3FFFF) return;
     }
     
-    // Data processing instructions
-    if (token_equals(mnemonic, "add") || token_equals(mnemonic, "adds") ||
-        token_equals(mnemonic, "sub") || token_equals(mnemonic, "subs") ||
-        token_equals(mnemonic, "and") || token_equals(mnemonic, "ands") ||
-        token_equals(mnemonic, "orr") || token_equals(mnemonic, "eor") ||
-        token_equals(mnemonic, "bic") || token_equals(mnemonic, "orn") ||
-        token_equals(mnemonic, "mvn") || token_equals(mnemonic, "neg") ||
-        token_equals(mnemonic, "cmp") || token_equals(mnemonic, "cmn") ||
-        token_equals(mnemonic, "tst") ||
-        token_equals(mnemonic, "asr") || token_equals(mnemonic, "lsl") ||
-        token_equals(mnemonic, "lsr") || token_equals(mnemonic, "ror") ||
-        token_equals(mnemonic, "mul") || token_equals(mnemonic, "udiv") ||
-        token_equals(mnemonic, "sdiv")) {
-        return encode_data_proc(node);
-    }
+    uint32_t sf = cmp.word & (1U << 31);
+    uint32_t op = (branch.word & 0xF) << 24;      // EQ -> CBZ, NE -> CBNZ
+    int rn = (cmp.word >> 5) & 0x1F;
+    uint32_t cbz = sf | 0x34000000 | op | ((imm19 & 0x7FFFF) << 5) | rn;
     
-    // Load/Store instructions
-    if (token_equals(mnemonic, "ldr") || token_equals(mnemonic, "ldrb") ||
-        token_equals(mnemonic, "ldrh") || token_equals(mnemonic, "ldrsb") ||
-        token_equals(mnemonic, "ldrsh") || token_equals(mnemonic, "ldrsw") ||
-        token_equals(mnemonic, "str") || token_equals(mnemonic, "strb") ||
-        token_equals(mnemonic, "strh")) {
-        return encode_load_store(node);
-    }
+    rewrite_word(cmp.offset, cbz);
+    section_offset_[static_cast<int>(current_section_)] -= 4;
+    cmp.word = cbz;
+    cmp.fixup = branch.fixup;
+    window_count_--;
     
-    // Load/Store pair
-    if (token_equals(mnemonic, "ldp") || token_equals(mnemonic, "stp")) {
-        return encode_load_store_pair(node);
+    opt_stats_.cbz_formed++;
+    opt_stats_.bytes_saved += 4;
+}
+
+/*
+ * LDR/STR Rt, [Rn, #imm] ; LDR/STR Rt2, [Rn, #imm +/- size]  ->  LDP/STP
+ * Both must be unsigned-offset X or W accesses of the same kind and base.
+ * Loads also need distinct targets, and the first load must not have
+ * overwritten the base the second one used
+ */
+bool CodeGenerator::merge_load_store_pair(uint32_t word) {
+    if (window_count_ < 1) return false;
+    
+    PeepholeEntry& prev = window_[window_count_ - 1];
+    if (prev.offset + 4 != current_offset() || prev.fixup >= 0) return false;
+    
+    uint32_t kind = word & 0xFFC00000;
+    if (kind != (prev.word & 0xFFC00000)) return false;
+    
+    uint32_t pair;
+    switch (kind) {
+        case 0xF9400000: pair = 0xA9400000; break;  // LDR X -> LDP X
+        case 0xF9000000: pair = 0xA9000000; break;  // STR X -> STP X
+        case 0xB9400000: pair = 0x29400000; break;  // LDR W -> LDP W
+        case 0xB9000000: pair = 0x29000000; break;  // STR W -> STP W
+        default: return false;
+    }
+    bool is_load = (kind & 0x00400000) != 0;
+    
+    int rt1 = prev.word & 0x1F, rt2 = word & 0x1F;
+    int rn1 = (prev.word >> 5) & 0x1F, rn2 = (word >> 5) & 0x1F;
+    uint32_t imm1 = (prev.word >> 10) & 0xFFF, imm2 = (word >> 10) & 0xFFF;
+    if (rn1 != rn2) return false;
+    if (is_load && (rt1 == rt2 || rt1 == rn1)) return false;
+    
+    // Lower address goes in Rt, the higher one in Rt2
+    int lo_rt, hi_rt;
+    uint32_t lo_imm;
+    if (imm2 == imm1 + 1) {
+        lo_rt = rt1; hi_rt = rt2; lo_imm = imm1;
+    } else if (imm1 == imm2 + 1) {
+        lo_rt = rt2; hi_rt = rt1; lo_imm = imm2;
+    } else {
+        return false;
     }
+    if (lo_imm > 63) return false;  // imm7 is signed
     
-    // System instructions
-    if (token_equals(mnemonic, "wfi") || token_equals(mnemonic, "wfe") ||
-        token_equals(mnemonic, "sev") || token_equals(mnemonic, "sevl") ||
-        token_equals(mnemonic, "dmb") || token_equals(mnemonic, "dsb") ||
-        token_equals(mnemonic, "isb") || token_equals(mnemonic, "svc") ||
-        token_equals(mnemonic, "hvc") || token_equals(mnemonic, "smc")) {
-        return encode_system(node);
-    }
+    // LDP/STP (signed offset): opc 101 0 010 L imm7 Rt2 Rn Rt
+    prev.word = pair | (lo_imm << 15) | (hi_rt << 10) | (rn1 << 5) | lo_rt;
+    rewrite_word(prev.offset, prev.word);
     
-    // CASM Extended I/O opcodes (encoded as SVC with special immediates)
-    if (token_equals(mnemonic, "prt")) {
-        return 0xD4002001;  // SVC #0x100
-    }
-    if (token_equals(mnemonic, "prtc")) {
-        return 0xD4002021;  // SVC #0x101
-    }
-    if (token_equals(mnemonic, "prtn")) {
-        return 0xD4002041;  // SVC #0x102
+    opt_stats_.pairs_merged++;
+    opt_stats_.bytes_saved += 4;
+    return true;
+}
+
+/*
+ * Remember the constant a MOVZ/MOVN starts building, extend it with each
+ * MOVK to the same register, and drop it for anything else
+ */
+void CodeGenerator::track_constant(uint32_t word, size_t offset) {
+    bool is_64bit = (word >> 31) != 0;
+    uint32_t opc = word & 0x7F800000;
+    int rd = word & 0x1F;
+    int hw = (word >> 21) & 0x3;
+    uint64_t imm = static_cast<uint64_t>((word >> 5) & 0xFFFF) << (16 * hw);
+    
+    if (opc == MOVZ_OPC || opc == MOVN_OPC) {
+        if (!is_64bit && hw > 1) {
+            const_reg_ = -1;
+            return;
+        }
+        const_reg_ = rd;
+        const_is_64bit_ = is_64bit;
+        const_value_ = opc == MOVZ_OPC ? imm : ~imm;
+        if (!is_64bit) {
+            const_value_ &= 0xFFFFFFFFULL;
+        }
+        const_words_ = 1;
+        const_offset_ = offset;
+    } else if (opc == MOVK_OPC && rd == const_reg_ && is_64bit == const_is_64bit_ &&
+               const_offset_ + 4 * const_words_ == offset) {
+        const_value_ = (const_value_ & ~(0xFFFFULL << (16 * hw))) | imm;
+        const_words_++;
+    } else {
+        const_reg_ = -1;
     }
-    if (token_equals(mnemonic, "inp")) {
-        return 0xD4002061;  // SVC #0x103
+}
+
+/*
+ * A MOVK extending the current constant run: if the completed value has a
+ * shorter encoding than the run plus this word, rewrite the run in place
+ */
+bool CodeGenerator::fold_constant(uint32_t word) {
+    if (const_reg_ < 0 || (word & 0x7F800000) != MOVK_OPC) return false;
+    
+    bool is_64bit = (word >> 31) != 0;
+    int rd = word & 0x1F;
+    int hw = (word >> 21) & 0x3;
+    if (rd != const_reg_ || is_64bit != const_is_64bit_ || (!is_64bit && hw > 1) ||
+        const_offset_ + 4 * const_words_ != current_offset()) {
+        return false;
     }
     
-    // CASM Extended Graphics opcodes
-    if (token_equals(mnemonic, "cls")) {
-        return 0xD4002201;  // SVC #0x110
-    }
-    if (token_equals(mnemonic, "setc")) {
-        // SVC #0x111 - handler will set fb_fg, fb_bg, and store color in x24
-        return 0xD4002221;
-    }
-    if (token_equals(mnemonic, "plot")) {
-        // Native plot: write char and color directly to framebuffer
-        // x0 = x, x1 = y, w2 = char, w24 = color (set by setc SVC handler)
-        // x27 = framebuffer base, x26 = row stride (81), x25 = fb_colors base
-        //
-        // Generate:
-        //   MADD x9, x1, x26, x0   ; x9 = y * 81 + x (framebuffer offset)
-        //   STRB w2, [x27, x9]     ; store char
-        //   MOV w10, #80           ; color row stride
-        //   MADD x11, x1, x10, x0  ; x11 = y * 80 + x (color offset)
-        //   STRB w24, [x25, x11]   ; store color
-        
-        // MADD x9, x1, x26, x0: 1 00 11011 000 11010 0 00000 00001 01001 = 0x9B1A0029
-        emit_word(0x9B1A0029);
-        // STRB w2, [x27, x9]: 00 111 0 00 00 1 01001 011 0 10 11011 00010 = 0x38296B62
-        emit_word(0x38296B62);
-        // MOV w10, #80: MOVZ w10, #80 = 0 10 100101 00 0000000001010000 01010 = 0x52800A0A
-        emit_word(0x52800A0A);
-        // MADD x11, x1, x10, x0: 1 00 11011 000 01010 0 00000 00001 01011 = 0x9B0A002B
-        emit_word(0x9B0A002B);
-        // STRB w24, [x25, x11]: 00 111 0 00 00 1 01011 011 0 10 11001 11000 = 0x382B6B38
-        return 0x382B6B38;
-    }
-    if (token_equals(mnemonic, "line")) {
-        return 0xD4002261;  // SVC #0x113
-    }
-    if (token_equals(mnemonic, "box")) {
-        return 0xD4002281;  // SVC #0x114
-    }
-    if (token_equals(mnemonic, "reset")) {
-        return 0xD40022A1;  // SVC #0x115
-    }
-    if (token_equals(mnemonic, "canvas")) {
-        return 0xD40022C1;  // SVC #0x116
-    }
+    uint64_t imm = static_cast<uint64_t>((word >> 5) & 0xFFFF) << (16 * hw);
+    uint64_t value = (const_value_ & ~(0xFFFFULL << (16 * hw))) | imm;
     
-    // CASM Extended System opcodes
-    if (token_equals(mnemonic, "sleep")) {
-        return 0xD4003E01;  // SVC #0x1F0
-    }
-    if (token_equals(mnemonic, "rnd")) {
-        return 0xD4003E21;  // SVC #0x1F1
-    }
-    if (token_equals(mnemonic, "tick")) {
-        return 0xD4003E41;  // SVC #0x1F2
-    }
-    if (token_equals(mnemonic, "halt")) {
-        // Emit SVC #0x1FF followed by RET for native execution safety
-        // The SVC handler will set halt_requested, and RET ensures clean return
-        emit_word(0xD4003FE1);  // SVC #0x1FF
-        return 0xD65F03C0;  // RET (return to caller)
-    }
+    uint32_t words[4];
+    int count = materialize_constant(value, is_64bit, rd, words);
+    if (count >= const_words_ + 1) return false;
     
-    // CASM Extended I/O opcodes (additional)
-    if (token_equals(mnemonic, "inps")) {
-        return 0xD4002081;  // SVC #0x104 - input string
-    }
-    if (token_equals(mnemonic, "prtx")) {
-        return 0xD40020A1;  // SVC #0x105 - print hex
+    for (int i = 0; i < count; i++) {
+        rewrite_word(const_offset_ + 4 * i, words[i]);
     }
+    size_t saved = 4 * (const_words_ + 1 - count);
+    section_offset_[static_cast<int>(current_section_)] = const_offset_ + 4 * count;
     
-    // CASM Extended Memory/String opcodes (0x130-0x13F)
-    if (token_equals(mnemonic, "strlen")) {
-        return 0xD4002601;  // SVC #0x130 - strlen (x0=addr -> x0=len)
-    }
-    if (token_equals(mnemonic, "memcpy")) {
-        return 0xD4002621;  // SVC #0x131 - memcpy (x0=dst, x1=src, x2=len)
-    }
-    if (token_equals(mnemonic, "memset")) {
-        return 0xD4002641;  // SVC #0x132 - memset (x0=addr, x1=byte, x2=len)
-    }
-    if (token_equals(mnemonic, "abs")) {
-        return 0xD4002661;  // SVC #0x133 - abs (x0=val -> x0=|val|)
+    if (count == 1) {
+        opt_stats_.constants_folded++;
+    } else {
+        opt_stats_.constants_shortened++;
     }
+    opt_stats_.bytes_saved += saved;
     
-    // CASM Extended File opcodes (0x120-0x12F)
-    if (token_equals(mnemonic, "fcreat")) {
-        return 0xD4002401;  // SVC #0x120 - create file (x0=name_ptr)
-    }
-    if (token_equals(mnemonic, "fwrite")) {
-        return 0xD4002421;  // SVC #0x121 - write to file (x0=name_ptr, x1=data_ptr, x2=len)
-    }
-    if (token_equals(mnemonic, "fread")) {
-        return 0xD4002441;  // SVC #0x122 - read file (x0=name_ptr, x1=buf_ptr, x2=max_len) -> x0=bytes_read
-    }
-    if (token_equals(mnemonic, "fdel")) {
-        return 0xD4002461;  // SVC #0x123 - delete file (x0=name_ptr)
-    }
-    if (token_equals(mnemonic, "fcopy")) {
-        return 0xD4002481;  // SVC #0x124 - copy file (x0=src_ptr, x1=dst_ptr)
+    // The window now ends with the rewritten run
+    window_count_ = 0;
+    push_window(words[count - 1], const_offset_ + 4 * (count - 1), -1);
+    const_value_ = value;
+    const_words_ = count;
+    return true;
+}
+
+/*
+ * A label is being defined right after a branch to it: the branch does
+ * nothing, so drop it and its pending fixup (repeatedly, for a run of them)
+ */
+void CodeGenerator::remove_branch_to_next(Symbol* label) {
+    while (window_count_ > 0) {
+        PeepholeEntry& last = window_[window_count_ - 1];
+        if (last.fixup < 0 || last.offset + 4 != current_offset()) return;
+        if (!is_branch(last.word) && !is_branch_cond(last.word) && !is_cbz_cbnz(last.word)) return;
+        if (fixups_[last.fixup].symbol != static_cast<int>(label - symbols_) ||
+            label->fixups != last.fixup) {
+            return;
+        }
+        
+        label->fixups = fixups_[last.fixup].next;
+        if (last.fixup == fixup_count_ - 1) {
+            fixup_count_--;
+        }
+        section_offset_[static_cast<int>(current_section_)] -= 4;
+        window_count_--;
+        
+        opt_stats_.branches_removed++;
+        opt_stats_.bytes_saved += 4;
     }
-    if (token_equals(mnemonic, "fmove")) {
-        return 0xD40024A1;  // SVC #0x125 - move/rename file (x0=src_ptr, x1=dst_ptr)
+}
+
+/*
+ * Encode instruction to machine code
+ * Requirements: 7.2, 7.3, 7.4, 7.5
+ */
+uint32_t CodeGenerator::encode_instruction(ASTNode* node) {
+    if (!node || node->type != NodeType::INSTRUCTION) {
+        error("Invalid instruction node");
+        return 0;
     }
-    if (token_equals(mnemonic, "fexist")) {
-        return 0xD40024C1;  // SVC #0x126 - check if file exists (x0=name_ptr) -> x0=1 if exists
+    
+    const OpcodeInfo& info = opcode_info(node->token.opcode);
+    
+    switch (info.encoder) {
+        // NOP, WFI/WFE/SEV/SEVL and the CASM extended opcodes (SVC #0x100-0x1FF)
+        case EncoderClass::FIXED:
+            return info.bits;
+        
+        case EncoderClass::BARRIER:
+        case EncoderClass::EXCEPTION:
+            return encode_system(node);
+        
+        // RET {Xn}: 1101011 0010 11111 000000 Rn 00000
+        case EncoderClass::RET: {
+            int reg = 30;  // Default to LR (x30)
+            if (node->child_count > 0) {
+                bool is_64bit;
+                reg = get_register(node->children[0], &is_64bit);
+                if (reg < 0) reg = 30;
+            }
+            return info.bits | (reg << 5);
+        }
+        
+        // BR/BLR Xn: 1101011 000L 11111 000000 Rn 00000
+        case EncoderClass::BRANCH_REG: {
+            if (node->child_count < 1) {
+                error("Branch to register requires register operand");
+                return 0;
+            }
+            bool is_64bit;
+            int reg = get_register(node->children[0], &is_64bit);
+            if (reg < 0) {
+                error("Invalid register for branch");
+                return 0;
+            }
+            return info.bits | (reg << 5);
+        }
+        
+        case EncoderClass::BRANCH:
+            return encode_branch(node);
+        
+        case EncoderClass::BRANCH_COND:
+            return encode_branch_cond(node, static_cast<int>(info.bits));
+        
+        case EncoderClass::CBZ:
+            return encode_cbz_cbnz(node, info.bits != 0);
+        
+        case EncoderClass::MOV:
+            return encode_mov(node);
+        
+        case EncoderClass::DATA_PROC:
+            return encode_data_proc(node);
+        
+        case EncoderClass::LOAD_STORE:
+            return encode_load_store(node);
+        
+        case EncoderClass::LOAD_STORE_PAIR:
+            return encode_load_store_pair(node);
+        
+        case EncoderClass::PLOT:
+            // Native plot: write char and color directly to framebuffer
+            // x0 = x, x1 = y, w2 = char, w24 = color (set by setc SVC handler)
+            // x27 = framebuffer base, x25 = fb_colors base
+            //
+            // Generate:
+            //   MOV w9, #81            ; framebuffer row stride
+            //   MADD x9, x1, x9, x0    ; x9 = y * 81 + x (framebuffer offset)
+            //   STRB w2, [x27, x9]     ; store char
+            //   MOV w10, #80           ; color row stride
+            //   MADD x11, x1, x10, x0  ; x11 = y * 80 + x (color offset)
+            //   STRB w24, [x25, x11]   ; store color
+            
+            // MOV w9, #81: MOVZ w9, #81 = 0 10 100101 00 0000000001010001 01001 = 0x52800A29
+            emit_word(0x52800A29);
+            // MADD x9, x1, x9, x0: 1 00 11011 000 01001 0 00000 00001 01001 = 0x9B090029
+            emit_word(0x9B090029);
+            // STRB w2, [x27, x9]: 00 111 0 00 00 1 01001 011 0 10 11011 00010 = 0x38296B62
+            emit_word(0x38296B62);
+            // MOV w10, #80: MOVZ w10, #80 = 0 10 100101 00 0000000001010000 01010 = 0x52800A0A
+            emit_word(0x52800A0A);
+            // MADD x11, x1, x10, x0: 1 00 11011 000 01010 0 00000 00001 01011 = 0x9B0A002B
+            emit_word(0x9B0A002B);
+            // STRB w24, [x25, x11]: 00 111 0 00 00 1 01011 011 0 10 11001 11000 = 0x382B6B38
+            return 0x382B6B38;
+        
+        case EncoderClass::PUTC:
+            // Console ring putc: queue w0 in the ring at x26 without trapping
+            // (layout in casm/console.h); only a full ring takes the flush SVC
+            //
+            // Generate:
+            //   LDR w9, [x26]          ; head
+            //   LDR w10, [x26, #4]     ; tail
+            //   SUB w10, w9, w10       ; bytes queued, at most 4096
+            //   TBZ w10, #12, store    ; below 4096 (leaves NZCV alone)
+            //   SVC #0x106             ; full: kernel drains it (flush)
+            // store:
+            //   AND w10, w9, #0xFFF    ; head % CONSOLE_RING_SIZE
+            //   ADD x10, x26, x10
+            //   STRB w0, [x10, #8]     ; data[head % size] = w0
+            //   ADD w9, w9, #1
+            //   STR w9, [x26]          ; publish the byte
+            static_assert(CONSOLE_RING_SIZE == 4096, "putc encodes the ring size");
+            emit_word(0xB9400349);      // LDR w9, [x26]
+            emit_word(0xB940074A);      // LDR w10, [x26, #4]
+            emit_word(0x4B0A012A);      // SUB w10, w9, w10
+            emit_word(0x3660004A);      // TBZ w10, #12, .+8
+            emit_word(info.bits);       // SVC #0x106
+            emit_word(0x12002D2A);      // AND w10, w9, #0xFFF
+            emit_word(0x8B0A034A);      // ADD x10, x26, x10
+            emit_word(0x39002140);      // STRB w0, [x10, #8]
+            emit_word(0x11000529);      // ADD w9, w9, #1
+            return 0xB9000349;          // STR w9, [x26]
+        
+        case EncoderClass::HALT:
+            // Emit SVC #0x1FF followed by RET for native execution safety
+            // The SVC handler will set halt_requested, and RET ensures clean return
+            emit_word(info.bits);   // SVC #0x1FF
+            return 0xD65F03C0;      // RET (return to caller)
+        
+        case EncoderClass::NONE:
+        case EncoderClass::UNSUPPORTED:
+            break;
     }
     
     error("Unknown instruction");
@@ -1022,9 +1774,7 @@ uint32_t CodeGenerator::encode_data_proc(ASTNode* node) {
     
     bool is_64bit = true;
     int rd = -1, rn = -1, rm = -1;
-    int64_t imm = 0;
     bool has_imm = false;
-    (void)imm;  // May be unused in register form
     
     // Get destination register
     rd = get_register(node->children[0], &is_64bit);
@@ -1034,15 +1784,14 @@ uint32_t CodeGenerator::encode_data_proc(ASTNode* node) {
     }
     
     // Handle CMP, CMN, TST (2 operands, implicit Rd=XZR)
-    if (token_equals(mnemonic, "cmp") || token_equals(mnemonic, "cmn") ||
-        token_equals(mnemonic, "tst")) {
+    if (mnemonic.opcode == Opcode::CMP || mnemonic.opcode == Opcode::CMN ||
+        mnemonic.opcode == Opcode::TST) {
         rn = rd;
         rd = 31;  // XZR
         
         if (node->children[1]->type == NodeType::OPERAND_IMM ||
             node->children[1]->type == NodeType::OPERAND_LABEL) {
             has_imm = true;
-            imm = get_immediate(node->children[1]);
         } else {
             rm = get_register(node->children[1], nullptr);
             if (rm < 0) {
@@ -1052,7 +1801,7 @@ uint32_t CodeGenerator::encode_data_proc(ASTNode* node) {
         }
     }
     // Handle NEG, MVN (2 operands)
-    else if (token_equals(mnemonic, "neg") || token_equals(mnemonic, "mvn")) {
+    else if (mnemonic.opcode == Opcode::NEG || mnemonic.opcode == Opcode::MVN) {
         rn = 31;  // XZR for NEG/MVN
         rm = get_register(node->children[1], nullptr);
         if (rm < 0) {
@@ -1068,7 +1817,6 @@ uint32_t CodeGenerator::encode_data_proc(ASTNode* node) {
             if (node->children[1]->type == NodeType::OPERAND_IMM ||
                 node->children[1]->type == NodeType::OPERAND_LABEL) {
                 has_imm = true;
-                imm = get_immediate(node->children[1]);
             } else {
                 rm = get_register(node->children[1], nullptr);
                 if (rm < 0) {
@@ -1086,7 +1834,6 @@ uint32_t CodeGenerator::encode_data_proc(ASTNode* node) {
             if (node->children[2]->type == NodeType::OPERAND_IMM ||
                 node->children[2]->type == NodeType::OPERAND_LABEL) {
                 has_imm = true;
-                imm = get_immediate(node->children[2]);
             } else {
                 rm = get_register(node->children[2], nullptr);
                 if (rm < 0) {
@@ -1097,97 +1844,26 @@ uint32_t CodeGenerator::encode_data_proc(ASTNode* node) {
         }
     }
     
-    // Use immediate form if applicable
+    // Use immediate form if applicable (it reads the immediate itself)
     if (has_imm) {
         return encode_data_proc_imm(node);
     }
     
-    // Encode register form
+    // Encode register form: the opcode template supplies the operation bits
+    //   ADD/ADDS/SUB/SUBS (shifted register): sf op S 01011 shift 0 Rm imm6 Rn Rd
+    //   AND/ORR/EOR/ANDS/BIC/ORN (shifted register): sf opc 01010 shift N Rm imm6 Rn Rd
+    //   MUL: sf 00 11011 000 Rm 0 11111 Rn Rd (MADD with Ra=XZR)
+    //   UDIV/SDIV/LSLV/LSRV/ASRV/RORV: sf 0 0 11010110 Rm opcode2 Rn Rd
     uint32_t sf = is_64bit ? 1 : 0;
-    uint32_t encoding = 0;
-    
-    // ADD (shifted register): sf 0 0 01011 shift 0 Rm imm6 Rn Rd
-    if (token_equals(mnemonic, "add")) {
-        encoding = (sf << 31) | (0x0B << 24) | (rm << 16) | (rn << 5) | rd;
-    }
-    // ADDS (shifted register): sf 0 1 01011 shift 0 Rm imm6 Rn Rd
-    else if (token_equals(mnemonic, "adds")) {
-        encoding = (sf << 31) | (0x2B << 24) | (rm << 16) | (rn << 5) | rd;
-    }
-    // SUB (shifted register): sf 1 0 01011 shift 0 Rm imm6 Rn Rd
-    else if (token_equals(mnemonic, "sub") || token_equals(mnemonic, "neg")) {
-        encoding = (sf << 31) | (0x4B << 24) | (rm << 16) | (rn << 5) | rd;
-    }
-    // SUBS (shifted register): sf 1 1 01011 shift 0 Rm imm6 Rn Rd
-    else if (token_equals(mnemonic, "subs") || token_equals(mnemonic, "cmp")) {
-        encoding = (sf << 31) | (0x6B << 24) | (rm << 16) | (rn << 5) | rd;
-    }
-    // AND (shifted register): sf 00 01010 shift 0 Rm imm6 Rn Rd
-    else if (token_equals(mnemonic, "and")) {
-        encoding = (sf << 31) | (0x0A << 24) | (rm << 16) | (rn << 5) | rd;
-    }
-    // ANDS (shifted register): sf 11 01010 shift 0 Rm imm6 Rn Rd
-    else if (token_equals(mnemonic, "ands") || token_equals(mnemonic, "tst")) {
-        encoding = (sf << 31) | (0x6A << 24) | (rm << 16) | (rn << 5) | rd;
-    }
-    // ORR (shifted register): sf 01 01010 shift 0 Rm imm6 Rn Rd
-    else if (token_equals(mnemonic, "orr") || token_equals(mnemonic, "mov")) {
-        encoding = (sf << 31) | (0x2A << 24) | (rm << 16) | (rn << 5) | rd;
-    }
-    // EOR (shifted register): sf 10 01010 shift 0 Rm imm6 Rn Rd
-    else if (token_equals(mnemonic, "eor")) {
-        encoding = (sf << 31) | (0x4A << 24) | (rm << 16) | (rn << 5) | rd;
-    }
-    // BIC (shifted register): sf 00 01010 shift 1 Rm imm6 Rn Rd
-    else if (token_equals(mnemonic, "bic")) {
-        encoding = (sf << 31) | (0x0A << 24) | (1 << 21) | (rm << 16) | (rn << 5) | rd;
-    }
-    // ORN (shifted register): sf 01 01010 shift 1 Rm imm6 Rn Rd
-    else if (token_equals(mnemonic, "orn") || token_equals(mnemonic, "mvn")) {
-        encoding = (sf << 31) | (0x2A << 24) | (1 << 21) | (rm << 16) | (rn << 5) | rd;
-    }
-    // MUL: sf 00 11011 000 Rm 0 11111 Rn Rd (MADD with Ra=XZR)
-    else if (token_equals(mnemonic, "mul")) {
-        encoding = (sf << 31) | (0x1B << 24) | (rm << 16) | (0x1F << 10) | (rn << 5) | rd;
-    }
-    // UDIV: sf 0 0 11010110 Rm 00001 0 Rn Rd
-    else if (token_equals(mnemonic, "udiv")) {
-        encoding = (sf << 31) | (0x1AC << 21) | (rm << 16) | (0x02 << 10) | (rn << 5) | rd;
-    }
-    // SDIV: sf 0 0 11010110 Rm 00001 1 Rn Rd
-    else if (token_equals(mnemonic, "sdiv")) {
-        encoding = (sf << 31) | (0x1AC << 21) | (rm << 16) | (0x03 << 10) | (rn << 5) | rd;
-    }
-    // LSL (register): sf 0 0 11010110 Rm 0010 00 Rn Rd
-    else if (token_equals(mnemonic, "lsl")) {
-        encoding = (sf << 31) | (0x1AC << 21) | (rm << 16) | (0x08 << 10) | (rn << 5) | rd;
-    }
-    // LSR (register): sf 0 0 11010110 Rm 0010 01 Rn Rd
-    else if (token_equals(mnemonic, "lsr")) {
-        encoding = (sf << 31) | (0x1AC << 21) | (rm << 16) | (0x09 << 10) | (rn << 5) | rd;
-    }
-    // ASR (register): sf 0 0 11010110 Rm 0010 10 Rn Rd
-    else if (token_equals(mnemonic, "asr")) {
-        encoding = (sf << 31) | (0x1AC << 21) | (rm << 16) | (0x0A << 10) | (rn << 5) | rd;
-    }
-    // ROR (register): sf 0 0 11010110 Rm 0010 11 Rn Rd
-    else if (token_equals(mnemonic, "ror")) {
-        encoding = (sf << 31) | (0x1AC << 21) | (rm << 16) | (0x0B << 10) | (rn << 5) | rd;
-    }
-    else {
-        error("Unsupported data processing instruction");
-        return 0;
-    }
-    
-    return encoding;
+    return (sf << 31) | opcode_info(mnemonic.opcode).bits | (rm << 16) | (rn << 5) | rd;
 }
 
 /*
  * Encode data processing immediate instruction
  * 
  * For native execution compatibility, SUB with data addresses (0x400-0x1FFF)
- * is handled specially: we subtract x28 first to get the offset, then subtract
- * the immediate. This ensures length calculations work correctly.
+ * or labels is handled specially: we subtract x28 first to get the offset,
+ * then subtract the immediate. This ensures length calculations work correctly.
  */
 uint32_t CodeGenerator::encode_data_proc_imm(ASTNode* node) {
     const Token& mnemonic = node->token;
@@ -1196,20 +1872,30 @@ uint32_t CodeGenerator::encode_data_proc_imm(ASTNode* node) {
     int rd = get_register(node->children[0], &is_64bit);
     int rn = -1;
     int64_t imm = 0;
+    ASTNode* imm_node = nullptr;
     
     // Handle CMP, CMN (2 operands)
-    if (token_equals(mnemonic, "cmp") || token_equals(mnemonic, "cmn")) {
+    if (mnemonic.opcode == Opcode::CMP || mnemonic.opcode == Opcode::CMN) {
         rn = rd;
         rd = 31;  // XZR
-        imm = get_immediate(node->children[1]);
+        imm_node = node->children[1];
     }
     // Standard 3-operand or 2-operand form
     else if (node->child_count >= 3) {
         rn = get_register(node->children[1], nullptr);
-        imm = get_immediate(node->children[2]);
+        imm_node = node->children[2];
     } else {
         rn = rd;
-        imm = get_immediate(node->children[1]);
+        imm_node = node->children[1];
+    }
+    
+    // A label whose address is not final yet encodes as #0 plus a fixup
+    bool is_label = is_label_operand(imm_node);
+    bool imm_known = true;
+    if (is_label) {
+        imm_known = symbol_value(imm_node, &imm);
+    } else {
+        imm = get_immediate(imm_node);
     }
     
     if (rd < 0 || rn < 0) {
@@ -1220,16 +1906,28 @@ uint32_t CodeGenerator::encode_data_proc_imm(ASTNode* node) {
     uint32_t sf = is_64bit ? 1 : 0;
     uint32_t encoding = 0;
     
-    // For SUB with data address immediate (0x400-0x1FFF), we need special handling
-    // to work with x28-relative addresses. Generate: SUB Rd, Rn, x28 first,
-    // then the actual SUB with immediate.
-    if (is_64bit && token_equals(mnemonic, "sub") && imm >= 0x400 && imm < 0x2000 && rd != 31) {
+    // For SUB with a data address immediate (0x400-0x1FFF) or a label, we need
+    // special handling to work with x28-relative addresses. Generate:
+    // SUB Rd, Rn, x28 first, then the actual SUB with immediate.
+    if (is_64bit && mnemonic.opcode == Opcode::SUB && rd != 31 &&
+        (is_label || (imm >= DATA_WINDOW_START && imm < DATA_WINDOW_END))) {
         // First emit: SUB Rd, Rn, x28 (to remove the base address)
         // SUB (shifted register, 64-bit): 1 10 01011 00 0 Rm 000000 Rn Rd
-        uint32_t sub_reg = (1 << 31) | (0xCB << 24) | (28 << 16) | (rn << 5) | rd;
+        uint32_t sub_reg = (1U << 31) | (0xCB << 24) | (28 << 16) | (rn << 5) | rd;
         emit_word(sub_reg);
         // Now generate SUB Rd, Rd, #imm (subtract the offset)
         rn = rd;  // Use Rd as source for the second SUB
+        
+        // Offsets past 12 bits, and labels (whose value may only be patched
+        // in later), take a fixed low/high pair: SUB #lo, then SUB #hi, LSL #12
+        if (is_label || imm > 0xFFF) {
+            if (!imm_known) {
+                add_fixup(imm_node, FixupKind::IMM12_PAIR);
+            }
+            emit_word((1U << 31) | (0x51 << 24) | ((imm & 0xFFF) << 10) | (rn << 5) | rd);
+            return (1U << 31) | (0x51 << 24) | (1 << 22) | (((imm >> 12) & 0xFFF) << 10) |
+                   (rn << 5) | rd;
+        }
     }
     
     // Check if immediate fits in 12 bits
@@ -1239,9 +1937,9 @@ uint32_t CodeGenerator::encode_data_proc_imm(ASTNode* node) {
             imm = imm >> 12;
             // Set shift bit
             // ADD/SUB immediate: sf op S 100010 sh imm12 Rn Rd
-            if (token_equals(mnemonic, "add")) {
+            if (mnemonic.opcode == Opcode::ADD) {
                 encoding = (sf << 31) | (0x11 << 24) | (1 << 22) | ((imm & 0xFFF) << 10) | (rn << 5) | rd;
-            } else if (token_equals(mnemonic, "sub") || token_equals(mnemonic, "cmp")) {
+            } else if (mnemonic.opcode == Opcode::SUB || mnemonic.opcode == Opcode::CMP) {
                 encoding = (sf << 31) | (0x51 << 24) | (1 << 22) | ((imm & 0xFFF) << 10) | (rn << 5) | rd;
             } else {
                 error("Immediate value out of range");
@@ -1253,20 +1951,24 @@ uint32_t CodeGenerator::encode_data_proc_imm(ASTNode* node) {
         return 0;
     }
     
+    if (!imm_known) {
+        add_fixup(imm_node, FixupKind::IMM12);
+    }
+    
     // ADD immediate: sf 0 0 100010 sh imm12 Rn Rd
-    if (token_equals(mnemonic, "add")) {
+    if (mnemonic.opcode == Opcode::ADD) {
         encoding = (sf << 31) | (0x11 << 24) | ((imm & 0xFFF) << 10) | (rn << 5) | rd;
     }
     // ADDS immediate: sf 0 1 100010 sh imm12 Rn Rd
-    else if (token_equals(mnemonic, "adds") || token_equals(mnemonic, "cmn")) {
+    else if (mnemonic.opcode == Opcode::ADDS || mnemonic.opcode == Opcode::CMN) {
         encoding = (sf << 31) | (0x31 << 24) | ((imm & 0xFFF) << 10) | (rn << 5) | rd;
     }
     // SUB immediate: sf 1 0 100010 sh imm12 Rn Rd
-    else if (token_equals(mnemonic, "sub")) {
+    else if (mnemonic.opcode == Opcode::SUB) {
         encoding = (sf << 31) | (0x51 << 24) | ((imm & 0xFFF) << 10) | (rn << 5) | rd;
     }
     // SUBS immediate: sf 1 1 100010 sh imm12 Rn Rd
-    else if (token_equals(mnemonic, "subs") || token_equals(mnemonic, "cmp")) {
+    else if (mnemonic.opcode == Opcode::SUBS || mnemonic.opcode == Opcode::CMP) {
         encoding = (sf << 31) | (0x71 << 24) | ((imm & 0xFFF) << 10) | (rn << 5) | rd;
     }
     else {
@@ -1299,8 +2001,10 @@ uint32_t CodeGenerator::encode_load_store(ASTNode* node) {
     
     // Check for label (PC-relative LDR)
     if (node->children[1]->type == NodeType::OPERAND_LABEL) {
-        int64_t target = resolve_label(node->children[1]);
-        int64_t offset = target - code_offset_;
+        int64_t offset = 0;
+        if (!pc_relative_offset(node->children[1], FixupKind::IMM19, &offset)) {
+            return 0;
+        }
         
         // LDR (literal): opc 01 1 V 00 imm19 Rt
         // offset must be within ±1MB and 4-byte aligned
@@ -1335,33 +2039,33 @@ uint32_t CodeGenerator::encode_load_store(ASTNode* node) {
     uint32_t opc = 1;   // Load default
     bool is_signed = false;
     
-    if (token_equals(mnemonic, "ldr")) {
+    if (mnemonic.opcode == Opcode::LDR) {
         size = is_64bit ? 3 : 2;
         opc = 1;
-    } else if (token_equals(mnemonic, "str")) {
+    } else if (mnemonic.opcode == Opcode::STR) {
         size = is_64bit ? 3 : 2;
         opc = 0;
-    } else if (token_equals(mnemonic, "ldrb")) {
+    } else if (mnemonic.opcode == Opcode::LDRB) {
         size = 0;
         opc = 1;
-    } else if (token_equals(mnemonic, "strb")) {
+    } else if (mnemonic.opcode == Opcode::STRB) {
         size = 0;
         opc = 0;
-    } else if (token_equals(mnemonic, "ldrh")) {
+    } else if (mnemonic.opcode == Opcode::LDRH) {
         size = 1;
         opc = 1;
-    } else if (token_equals(mnemonic, "strh")) {
+    } else if (mnemonic.opcode == Opcode::STRH) {
         size = 1;
         opc = 0;
-    } else if (token_equals(mnemonic, "ldrsb")) {
+    } else if (mnemonic.opcode == Opcode::LDRSB) {
         size = 0;
         opc = is_64bit ? 2 : 3;
         is_signed = true;
-    } else if (token_equals(mnemonic, "ldrsh")) {
+    } else if (mnemonic.opcode == Opcode::LDRSH) {
         size = 1;
         opc = is_64bit ? 2 : 3;
         is_signed = true;
-    } else if (token_equals(mnemonic, "ldrsw")) {
+    } else if (mnemonic.opcode == Opcode::LDRSW) {
         size = 2;
         opc = 2;
         is_signed = true;
@@ -1458,22 +2162,22 @@ uint32_t CodeGenerator::encode_load_store_pair(ASTNode* node) {
     }
     
     uint32_t opc = is_64bit ? 2 : 0;
-    uint32_t L = token_equals(mnemonic, "ldp") ? 1 : 0;
+    uint32_t L = opcode_info(mnemonic.opcode).bits;
     uint32_t imm7 = scaled_offset & 0x7F;
     
     uint32_t encoding = 0;
     
     if (post_index) {
-        // opc 0 101 0 001 L imm7 Rt2 Rn Rt
-        encoding = (opc << 30) | (0x28 << 23) | (L << 22) | (imm7 << 15) | 
+        // opc 101 0 001 L imm7 Rt2 Rn Rt
+        encoding = (opc << 30) | (0x51 << 23) | (L << 22) | (imm7 << 15) | 
                    (rt2 << 10) | (base << 5) | rt1;
     } else if (pre_index) {
-        // opc 0 101 0 011 L imm7 Rt2 Rn Rt
-        encoding = (opc << 30) | (0x29 << 23) | (1 << 24) | (L << 22) | (imm7 << 15) | 
+        // opc 101 0 011 L imm7 Rt2 Rn Rt
+        encoding = (opc << 30) | (0x53 << 23) | (L << 22) | (imm7 << 15) | 
                    (rt2 << 10) | (base << 5) | rt1;
     } else {
-        // Signed offset: opc 0 101 0 010 L imm7 Rt2 Rn Rt
-        encoding = (opc << 30) | (0x29 << 23) | (L << 22) | (imm7 << 15) | 
+        // Signed offset: opc 101 0 010 L imm7 Rt2 Rn Rt
+        encoding = (opc << 30) | (0x52 << 23) | (L << 22) | (imm7 << 15) | 
                    (rt2 << 10) | (base << 5) | rt1;
     }
     
@@ -1492,18 +2196,16 @@ uint32_t CodeGenerator::encode_branch(ASTNode* node) {
         return 0;
     }
     
-    int64_t target = 0;
-    
-    if (node->children[0]->type == NodeType::OPERAND_LABEL) {
-        target = resolve_label(node->children[0]);
-    } else if (node->children[0]->type == NodeType::OPERAND_IMM) {
-        target = get_immediate(node->children[0]);
-    } else {
+    ASTNode* target = node->children[0];
+    if (target->type != NodeType::OPERAND_LABEL && target->type != NodeType::OPERAND_IMM) {
         error("Invalid branch target");
         return 0;
     }
     
-    int64_t offset = target - code_offset_;
+    int64_t offset = 0;
+    if (!pc_relative_offset(target, FixupKind::BRANCH26, &offset)) {
+        return 0;
+    }
     
     // Check range: ±128MB for B/BL
     if (offset < -134217728 || offset > 134217724) {
@@ -1521,9 +2223,7 @@ uint32_t CodeGenerator::encode_branch(ASTNode* node) {
     
     // B: 0 00101 imm26
     // BL: 1 00101 imm26
-    uint32_t op = token_equals(mnemonic, "bl") ? 1 : 0;
-    
-    return (op << 31) | (0x05 << 26) | imm26;
+    return opcode_info(mnemonic.opcode).bits | imm26;
 }
 
 /*
@@ -1536,18 +2236,16 @@ uint32_t CodeGenerator::encode_branch_cond(ASTNode* node, int cond) {
         return 0;
     }
     
-    int64_t target = 0;
-    
-    if (node->children[0]->type == NodeType::OPERAND_LABEL) {
-        target = resolve_label(node->children[0]);
-    } else if (node->children[0]->type == NodeType::OPERAND_IMM) {
-        target = get_immediate(node->children[0]);
-    } else {
+    ASTNode* target = node->children[0];
+    if (target->type != NodeType::OPERAND_LABEL && target->type != NodeType::OPERAND_IMM) {
         error("Invalid branch target");
         return 0;
     }
     
-    int64_t offset = target - code_offset_;
+    int64_t offset = 0;
+    if (!pc_relative_offset(target, FixupKind::IMM19, &offset)) {
+        return 0;
+    }
     
     // Check range: ±1MB for conditional branches
     if (offset < -1048576 || offset > 1048572) {
@@ -1584,18 +2282,16 @@ uint32_t CodeGenerator::encode_cbz_cbnz(ASTNode* node, bool is_cbnz) {
         return 0;
     }
     
-    int64_t target = 0;
-    
-    if (node->children[1]->type == NodeType::OPERAND_LABEL) {
-        target = resolve_label(node->children[1]);
-    } else if (node->children[1]->type == NodeType::OPERAND_IMM) {
-        target = get_immediate(node->children[1]);
-    } else {
+    ASTNode* target = node->children[1];
+    if (target->type != NodeType::OPERAND_LABEL && target->type != NodeType::OPERAND_IMM) {
         error("Invalid branch target");
         return 0;
     }
     
-    int64_t offset = target - code_offset_;
+    int64_t offset = 0;
+    if (!pc_relative_offset(target, FixupKind::IMM19, &offset)) {
+        return 0;
+    }
     
     // Check range: ±1MB
     if (offset < -1048576 || offset > 1048572) {
@@ -1625,8 +2321,9 @@ uint32_t CodeGenerator::encode_cbz_cbnz(ASTNode* node, bool is_cbnz) {
  * Requirements: 7.2
  * 
  * For native execution compatibility, addresses in the data area (0x400-0x1FFF)
- * are encoded as x28-relative (ADD Rd, x28, #imm) so they point to the actual
- * code_buffer location. x28 is set to code_buffer base before native execution.
+ * and label addresses are encoded as x28-relative (ADD Rd, x28, #imm) so they
+ * point into the program's memory. x28 is set to the image base before native
+ * execution; the VM starts it at zero, leaving plain image offsets.
  */
 uint32_t CodeGenerator::encode_mov(ASTNode* node) {
     const Token& mnemonic = node->token;
@@ -1657,23 +2354,49 @@ uint32_t CodeGenerator::encode_mov(ASTNode* node) {
     }
     
     // MOV (immediate) variants
+    // For labels and data addresses (0x400-0x1FFF), generate ADD Rd, x28, #imm
+    // This makes native execution work correctly with the program image
+    // x28 is set to the image base before native execution
+    bool image_relative = is_64bit && mnemonic.opcode == Opcode::MOV;
+    if (image_relative && is_label_operand(node->children[1])) {
+        int64_t offset = 0;
+        if (!symbol_value(node->children[1], &offset)) {
+            add_fixup(node->children[1], FixupKind::IMM12_PAIR);
+        }
+        return encode_image_address(rd, offset, true);
+    }
+    
     int64_t imm = get_immediate(node->children[1]);
     uint32_t sf = is_64bit ? 1 : 0;
     
-    // For data addresses (0x400-0x1FFF), generate ADD Rd, x28, #imm
-    // This makes native execution work correctly with the code_buffer
-    // x28 is set to code_buffer base before native execution
-    if (is_64bit && imm >= 0x400 && imm < 0x2000 && 
-        !token_equals(mnemonic, "movz") && !token_equals(mnemonic, "movn") && !token_equals(mnemonic, "movk")) {
-        // ADD (immediate, 64-bit): 1 0 0 100010 0 imm12 Rn Rd
-        // Rn = x28 (data base register), Rd = destination
-        uint32_t imm12 = imm & 0xFFF;
-        return (1 << 31) | (0x91 << 24) | (imm12 << 10) | (28 << 5) | rd;
+    // MOVZ/MOVN/MOVK with an explicit "lsl #n" place imm16 in halfword n/16
+    if (node->child_count > 2 && mnemonic.opcode != Opcode::MOV) {
+        ASTNode* shift = node->children[2];
+        int64_t amount = -1;
+        if (shift->type == NodeType::OPERAND_LABEL && shift->child_count > 0 &&
+            get_shift_type(shift->token.start, shift->token.length) == 0) {
+            amount = shift->children[0]->data.imm_value;
+        }
+        if (amount < 0 || amount % 16 != 0 || amount > (is_64bit ? 48 : 16)) {
+            error("Expected LSL #0, #16, #32 or #48");
+            return 0;
+        }
+        if (imm < 0 || imm > 0xFFFF) {
+            error("Immediate value out of range (0-65535)");
+            return 0;
+        }
+        uint32_t opc = mnemonic.opcode == Opcode::MOVZ ? 0xA5 :
+                       mnemonic.opcode == Opcode::MOVN ? 0x25 : 0xE5;
+        return (sf << 31) | (opc << 23) | ((amount / 16) << 21) | (imm << 5) | rd;
+    }
+    
+    if (image_relative && imm >= DATA_WINDOW_START && imm < DATA_WINDOW_END) {
+        return encode_image_address(rd, imm, false);
     }
     
     // MOVZ - move wide with zero
-    if (token_equals(mnemonic, "movz") || 
-        (token_equals(mnemonic, "mov") && imm >= 0 && imm <= 0xFFFF)) {
+    if (mnemonic.opcode == Opcode::MOVZ || 
+        (mnemonic.opcode == Opcode::MOV && imm >= 0 && imm <= 0xFFFF)) {
         // MOVZ: sf 10 100101 hw imm16 Rd
         uint32_t hw = 0;  // Shift amount (0, 16, 32, 48)
         uint32_t imm16 = imm & 0xFFFF;
@@ -1699,8 +2422,8 @@ uint32_t CodeGenerator::encode_mov(ASTNode* node) {
     }
     
     // MOVN - move wide with NOT
-    if (token_equals(mnemonic, "movn") ||
-        (token_equals(mnemonic, "mov") && imm < 0)) {
+    if (mnemonic.opcode == Opcode::MOVN ||
+        (mnemonic.opcode == Opcode::MOV && imm < 0)) {
         // MOVN: sf 00 100101 hw imm16 Rd
         uint64_t not_imm = ~imm;
         uint32_t hw = 0;
@@ -1720,17 +2443,10 @@ uint32_t CodeGenerator::encode_mov(ASTNode* node) {
     }
     
     // MOVK - move wide with keep
-    if (token_equals(mnemonic, "movk")) {
+    if (mnemonic.opcode == Opcode::MOVK) {
         // MOVK: sf 11 100101 hw imm16 Rd
-        uint32_t hw = 0;
         uint32_t imm16 = imm & 0xFFFF;
-        
-        // Check for shift specifier in operands
-        if (node->child_count > 2) {
-            // TODO: Parse LSL #n
-        }
-        
-        return (sf << 31) | (0xE5 << 23) | (hw << 21) | (imm16 << 5) | rd;
+        return (sf << 31) | (0xE5 << 23) | (imm16 << 5) | rd;
     }
     
     error("Cannot encode MOV instruction");
@@ -1742,80 +2458,24 @@ uint32_t CodeGenerator::encode_mov(ASTNode* node) {
  * Requirements: 7.5
  */
 uint32_t CodeGenerator::encode_system(ASTNode* node) {
-    const Token& mnemonic = node->token;
-    
-    // WFI: Wait for interrupt
-    if (token_equals(mnemonic, "wfi")) {
-        return 0xD503207F;
-    }
-    
-    // WFE: Wait for event
-    if (token_equals(mnemonic, "wfe")) {
-        return 0xD503205F;
-    }
-    
-    // SEV: Send event
-    if (token_equals(mnemonic, "sev")) {
-        return 0xD503209F;
-    }
-    
-    // SEVL: Send event local
-    if (token_equals(mnemonic, "sevl")) {
-        return 0xD50320BF;
-    }
-    
-    // DMB: Data memory barrier
-    if (token_equals(mnemonic, "dmb")) {
-        uint32_t option = 0xF;  // SY (full system)
-        if (node->child_count > 0 && node->children[0]->type == NodeType::OPERAND_IMM) {
-            option = get_immediate(node->children[0]) & 0xF;
-        }
-        return 0xD50330BF | (option << 8);
-    }
-    
-    // DSB: Data synchronization barrier
-    if (token_equals(mnemonic, "dsb")) {
-        uint32_t option = 0xF;  // SY
-        if (node->child_count > 0 && node->children[0]->type == NodeType::OPERAND_IMM) {
-            option = get_immediate(node->children[0]) & 0xF;
-        }
-        return 0xD503309F | (option << 8);
-    }
+    const OpcodeInfo& info = opcode_info(node->token.opcode);
     
-    // ISB: Instruction synchronization barrier
-    if (token_equals(mnemonic, "isb")) {
-        uint32_t option = 0xF;  // SY
+    // DMB/DSB/ISB: barrier option in CRm, default SY (full system)
+    if (info.encoder == EncoderClass::BARRIER) {
+        uint32_t option = 0xF;
         if (node->child_count > 0 && node->children[0]->type == NodeType::OPERAND_IMM) {
             option = get_immediate(node->children[0]) & 0xF;
         }
-        return 0xD50330DF | (option << 8);
-    }
-    
-    // SVC: Supervisor call
-    if (token_equals(mnemonic, "svc")) {
-        uint32_t imm16 = 0;
-        if (node->child_count > 0) {
-            imm16 = get_immediate(node->children[0]) & 0xFFFF;
-        }
-        return 0xD4000001 | (imm16 << 5);
-    }
-    
-    // HVC: Hypervisor call
-    if (token_equals(mnemonic, "hvc")) {
-        uint32_t imm16 = 0;
-        if (node->child_count > 0) {
-            imm16 = get_immediate(node->children[0]) & 0xFFFF;
-        }
-        return 0xD4000002 | (imm16 << 5);
+        return info.bits | (option << 8);
     }
     
-    // SMC: Secure monitor call
-    if (token_equals(mnemonic, "smc")) {
+    // SVC/HVC/SMC: 16-bit immediate
+    if (info.encoder == EncoderClass::EXCEPTION) {
         uint32_t imm16 = 0;
         if (node->child_count > 0) {
             imm16 = get_immediate(node->children[0]) & 0xFFFF;
         }
-        return 0xD4000003 | (imm16 << 5);
+        return info.bits | (imm16 << 5);
     }
     
     error("Unknown system instruction");
@@ -0,0 +1,147 @@
+/*
+ * EmberOS CASM Framebuffer Implementation
+ * Full and dirty-run rendering of the CASM canvas
+ *
+ * A diff render walks each row for cells whose character or color differs
+ * from the shadow, grows the run across gaps of up to FB_RUN_GAP
+ * unchanged cells, and sends it after a cursor move. Color escapes are
+ * only sent when the attribute changes, across runs and rows alike. The
+ * cursor starts and ends at column 0 of the line below the canvas.
+ */
+
+#include "casm/framebuffer.h"
+#include "uart.h"
+
+namespace casm {
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+static inline bool cell_changed(const Framebuffer* fb, int x, int y) {
+    return fb->cells[y][x] != fb->shown[y][x] || fb->colors[y][x] != fb->shown_colors[y][x];
+}
+
+static inline void send_color(int color) {
+    uart::printf("\x1b[3%d;4%dm", color & 0x7, (color >> 4) & 0x7);
+}
+
+// Move the cursor between canvas rows (the line below the canvas is height)
+static void move_to_row(int* row, int y) {
+    if (y < *row) {
+        uart::printf("\x1b[%dA", *row - y);
+    } else if (y > *row) {
+        uart::printf("\x1b[%dB", y - *row);
+    }
+    *row = y;
+}
+
+static void render_full(Framebuffer* fb) {
+    int last_color = -1;
+    for (int y = 0; y < fb->height; y++) {
+        for (int x = 0; x < fb->width; x++) {
+            int color = fb->colors[y][x];
+            if (color != last_color) {
+                send_color(color);
+                last_color = color;
+            }
+            uart::putc(fb->cells[y][x]);
+            fb->shown[y][x] = fb->cells[y][x];
+            fb->shown_colors[y][x] = fb->colors[y][x];
+        }
+        // Reset before the newline so the background does not fill the line
+        uart::puts("\x1b[0m\n");
+        last_color = -1;
+    }
+    fb->presented = true;
+    fb->shown_width = fb->width;
+    fb->shown_height = fb->height;
+}
+
+static void render_diff(Framebuffer* fb) {
+    int row = fb->height;
+    int last_color = -1;
+
+    for (int y = 0; y < fb->height; y++) {
+        int x = 0;
+        while (x < fb->width) {
+            if (!cell_changed(fb, x, y)) {
+                x++;
+                continue;
+            }
+
+            int end = x + 1;
+            for (int i = x + 1, gap = 0; i < fb->width; i++) {
+                if (cell_changed(fb, i, y)) {
+                    end = i + 1;
+                    gap = 0;
+                } else if (++gap > FB_RUN_GAP) {
+                    break;
+                }
+            }
+
+            move_to_row(&row, y);
+            uart::printf("\x1b[%dG", x + 1);
+            for (; x < end; x++) {
+                int color = fb->colors[y][x];
+                if (color != last_color) {
+                    send_color(color);
+                    last_color = color;
+                }
+                uart::putc(fb->cells[y][x]);
+                fb->shown[y][x] = fb->cells[y][x];
+                fb->shown_colors[y][x] = fb->colors[y][x];
+            }
+        }
+    }
+
+    // Nothing changed: nothing was sent
+    if (last_color < 0) return;
+
+    uart::puts("\x1b[0m");
+    move_to_row(&row, fb->height);
+    uart::putc('\r');
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void fb_reset(Framebuffer* fb) {
+    fb->active = false;
+    fb->width = 0;
+    fb->height = 0;
+    fb->fg = 7;
+    fb->bg = 0;
+    fb->presented = false;
+    fb_clear(fb);
+}
+
+void fb_clear(Framebuffer* fb) {
+    for (int y = 0; y < FB_ROWS; y++) {
+        for (int x = 0; x < FB_MAX_WIDTH; x++) {
+            fb->cells[y][x] = ' ';
+            fb->colors[y][x] = 0x70;
+        }
+        fb->cells[y][FB_MAX_WIDTH] = '\0';
+    }
+}
+
+void fb_plot(Framebuffer* fb, int x, int y, char ch) {
+    if (x >= 0 && x < fb->width && y >= 0 && y < fb->height) {
+        fb->cells[y][x] = ch ? ch : ' ';
+        fb->colors[y][x] = (fb->fg & 0x7) | ((fb->bg & 0x7) << 4);
+    }
+}
+
+void fb_render(Framebuffer* fb) {
+    if (!fb->active || fb->height == 0) return;
+
+    if (!fb->presented || fb->shown_width != fb->width || fb->shown_height != fb->height) {
+        render_full(fb);
+    } else {
+        render_diff(fb);
+    }
+}
+
+} // namespace casm
@@ -6,16 +6,10 @@
  */
 
 #include "casm/lexer.h"
+#include "klib.h"
 
 namespace casm {
 
-// String length helper (since we can't use standard library)
-static size_t str_len(const char* s) {
-    size_t len = 0;
-    while (s[len] != '\0') len++;
-    return len;
-}
-
 // Convert character to lowercase
 static char to_lower(char c) {
     if (c >= 'A' && c <= 'Z') return c + ('a' - 'A');
@@ -26,8 +20,17 @@ static char to_lower(char c) {
  * Construct a lexer for the given source code
  */
 Lexer::Lexer(const char* source)
+    : Lexer(source, klib::strlen(source))
+{
+}
+
+/*
+ * Construct a lexer over a length-delimited source buffer
+ */
+Lexer::Lexer(const char* source, size_t length)
     : source_(source)
     , current_(source)
+    , end_(source + length)
     , start_(source)
     , line_(1)
 {
@@ -37,6 +40,7 @@ Lexer::Lexer(const char* source)
  * Advance to next character and return the current one
  */
 char Lexer::advance() {
+    if (current_ >= end_) return '\0';
     return *current_++;
 }
 
@@ -44,6 +48,7 @@ char Lexer::advance() {
  * Peek at current character without advancing
  */
 char Lexer::peek() const {
+    if (current_ >= end_) return '\0';
     return *current_;
 }
 
@@ -51,7 +56,7 @@ char Lexer::peek() const {
  * Peek at next character without advancing
  */
 char Lexer::peek_next() const {
-    if (is_at_end()) return '\0';
+    if (is_at_end() || current_ + 1 >= end_) return '\0';
     return current_[1];
 }
 
@@ -103,6 +108,7 @@ Token Lexer::make_token(TokenType type) {
     token.length = static_cast<size_t>(current_ - start_);
     token.line = line_;
     token.number_value = 0;
+    token.opcode = Opcode::NONE;
     return token;
 }
 
@@ -113,9 +119,10 @@ Token Lexer::make_error_token(const char* message) {
     Token token;
     token.type = TokenType::ERROR;
     token.start = message;
-    token.length = str_len(message);
+    token.length = klib::strlen(message);
     token.line = line_;
     token.number_value = 0;
+    token.opcode = Opcode::NONE;
     return token;
 }
 
@@ -243,7 +250,14 @@ Token Lexer::make_number_token() {
  * Requirements: 8.2, 8.3
  */
 Token Lexer::make_identifier_token() {
-    return make_token(TokenType::IDENTIFIER);
+    Token token = make_token(TokenType::IDENTIFIER);
+    
+    // Resolve the mnemonic once here so later stages dispatch on the Opcode
+    const OpcodeInfo* info = find_opcode(token.start, token.length);
+    if (info) {
+        token.opcode = info->opcode;
+    }
+    return token;
 }
 
 /*
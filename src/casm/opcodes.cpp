@@ -0,0 +1,312 @@
+/*
+ * EmberOS CASM Opcode Table Implementation
+ * Sorted mnemonic, condition code and shift tables with binary search lookup
+ *
+ * The tables are constexpr and checked at compile time: entries must be in
+ * strictly ascending name order, and each opcode entry must sit at the index
+ * of its Opcode value. A lookup is one lowercase copy plus at most eight
+ * short comparisons, done once per identifier by the lexer.
+ *
+ * Requirements: 7.2, 7.3, 7.4, 7.5
+ */
+
+#include "casm/opcodes.h"
+
+namespace casm {
+
+// ============================================================================
+// Tables
+// ============================================================================
+
+constexpr size_t OPCODE_COUNT = static_cast<size_t>(Opcode::COUNT);
+
+static constexpr OpcodeInfo OPCODE_TABLE[OPCODE_COUNT] = {
+    { "",       Opcode::NONE,   EncoderClass::NONE,            0x00000000 },
+    { "abs",    Opcode::ABS,    EncoderClass::FIXED,           0xD4002661 },
+    { "adc",    Opcode::ADC,    EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "adcs",   Opcode::ADCS,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "add",    Opcode::ADD,    EncoderClass::DATA_PROC,       0x0B000000 },
+    { "adds",   Opcode::ADDS,   EncoderClass::DATA_PROC,       0x2B000000 },
+    { "and",    Opcode::AND,    EncoderClass::DATA_PROC,       0x0A000000 },
+    { "ands",   Opcode::ANDS,   EncoderClass::DATA_PROC,       0x6A000000 },
+    { "asr",    Opcode::ASR,    EncoderClass::DATA_PROC,       0x1AC02800 },
+    { "b",      Opcode::B,      EncoderClass::BRANCH,          0x14000000 },
+    { "b.al",   Opcode::B_AL,   EncoderClass::BRANCH_COND,     0x0000000E },
+    { "b.cc",   Opcode::B_CC,   EncoderClass::BRANCH_COND,     0x00000003 },
+    { "b.cs",   Opcode::B_CS,   EncoderClass::BRANCH_COND,     0x00000002 },
+    { "b.eq",   Opcode::B_EQ,   EncoderClass::BRANCH_COND,     0x00000000 },
+    { "b.ge",   Opcode::B_GE,   EncoderClass::BRANCH_COND,     0x0000000A },
+    { "b.gt",   Opcode::B_GT,   EncoderClass::BRANCH_COND,     0x0000000C },
+    { "b.hi",   Opcode::B_HI,   EncoderClass::BRANCH_COND,     0x00000008 },
+    { "b.hs",   Opcode::B_HS,   EncoderClass::BRANCH_COND,     0x00000002 },
+    { "b.le",   Opcode::B_LE,   EncoderClass::BRANCH_COND,     0x0000000D },
+    { "b.lo",   Opcode::B_LO,   EncoderClass::BRANCH_COND,     0x00000003 },
+    { "b.ls",   Opcode::B_LS,   EncoderClass::BRANCH_COND,     0x00000009 },
+    { "b.lt",   Opcode::B_LT,   EncoderClass::BRANCH_COND,     0x0000000B },
+    { "b.mi",   Opcode::B_MI,   EncoderClass::BRANCH_COND,     0x00000004 },
+    { "b.ne",   Opcode::B_NE,   EncoderClass::BRANCH_COND,     0x00000001 },
+    { "b.pl",   Opcode::B_PL,   EncoderClass::BRANCH_COND,     0x00000005 },
+    { "b.vc",   Opcode::B_VC,   EncoderClass::BRANCH_COND,     0x00000007 },
+    { "b.vs",   Opcode::B_VS,   EncoderClass::BRANCH_COND,     0x00000006 },
+    { "bal",    Opcode::BAL,    EncoderClass::BRANCH_COND,     0x0000000E },
+    { "bcc",    Opcode::BCC,    EncoderClass::BRANCH_COND,     0x00000003 },
+    { "bcs",    Opcode::BCS,    EncoderClass::BRANCH_COND,     0x00000002 },
+    { "beq",    Opcode::BEQ,    EncoderClass::BRANCH_COND,     0x00000000 },
+    { "bge",    Opcode::BGE,    EncoderClass::BRANCH_COND,     0x0000000A },
+    { "bgt",    Opcode::BGT,    EncoderClass::BRANCH_COND,     0x0000000C },
+    { "bhi",    Opcode::BHI,    EncoderClass::BRANCH_COND,     0x00000008 },
+    { "bhs",    Opcode::BHS,    EncoderClass::BRANCH_COND,     0x00000002 },
+    { "bic",    Opcode::BIC,    EncoderClass::DATA_PROC,       0x0A200000 },
+    { "bics",   Opcode::BICS,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "bl",     Opcode::BL,     EncoderClass::BRANCH,          0x94000000 },
+    { "ble",    Opcode::BLE,    EncoderClass::BRANCH_COND,     0x0000000D },
+    { "blo",    Opcode::BLO,    EncoderClass::BRANCH_COND,     0x00000003 },
+    { "blr",    Opcode::BLR,    EncoderClass::BRANCH_REG,      0xD63F0000 },
+    { "bls",    Opcode::BLS,    EncoderClass::BRANCH_COND,     0x00000009 },
+    { "blt",    Opcode::BLT,    EncoderClass::BRANCH_COND,     0x0000000B },
+    { "bmi",    Opcode::BMI,    EncoderClass::BRANCH_COND,     0x00000004 },
+    { "bne",    Opcode::BNE,    EncoderClass::BRANCH_COND,     0x00000001 },
+    { "box",    Opcode::BOX,    EncoderClass::FIXED,           0xD4002281 },
+    { "bpl",    Opcode::BPL,    EncoderClass::BRANCH_COND,     0x00000005 },
+    { "br",     Opcode::BR,     EncoderClass::BRANCH_REG,      0xD61F0000 },
+    { "bvc",    Opcode::BVC,    EncoderClass::BRANCH_COND,     0x00000007 },
+    { "bvs",    Opcode::BVS,    EncoderClass::BRANCH_COND,     0x00000006 },
+    { "canvas", Opcode::CANVAS, EncoderClass::FIXED,           0xD40022C1 },
+    { "cbnz",   Opcode::CBNZ,   EncoderClass::CBZ,             0x00000001 },
+    { "cbz",    Opcode::CBZ,    EncoderClass::CBZ,             0x00000000 },
+    { "cls",    Opcode::CLS,    EncoderClass::FIXED,           0xD4002201 },
+    { "cmn",    Opcode::CMN,    EncoderClass::DATA_PROC,       0x2B000000 },
+    { "cmp",    Opcode::CMP,    EncoderClass::DATA_PROC,       0x6B000000 },
+    { "dmb",    Opcode::DMB,    EncoderClass::BARRIER,         0xD50330BF },
+    { "dsb",    Opcode::DSB,    EncoderClass::BARRIER,         0xD503309F },
+    { "eon",    Opcode::EON,    EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "eor",    Opcode::EOR,    EncoderClass::DATA_PROC,       0x4A000000 },
+    { "fadd",   Opcode::FADD,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "fcopy",  Opcode::FCOPY,  EncoderClass::FIXED,           0xD4002481 },
+    { "fcreat", Opcode::FCREAT, EncoderClass::FIXED,           0xD4002401 },
+    { "fdel",   Opcode::FDEL,   EncoderClass::FIXED,           0xD4002461 },
+    { "fdiv",   Opcode::FDIV,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "fexist", Opcode::FEXIST, EncoderClass::FIXED,           0xD40024C1 },
+    { "flush",  Opcode::FLUSH,  EncoderClass::FIXED,           0xD40020C1 },
+    { "fmov",   Opcode::FMOV,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "fmove",  Opcode::FMOVE,  EncoderClass::FIXED,           0xD40024A1 },
+    { "fmul",   Opcode::FMUL,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "fread",  Opcode::FREAD,  EncoderClass::FIXED,           0xD4002441 },
+    { "fsub",   Opcode::FSUB,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "fwrite", Opcode::FWRITE, EncoderClass::FIXED,           0xD4002421 },
+    { "halt",   Opcode::HALT,   EncoderClass::HALT,            0xD4003FE1 },
+    { "hvc",    Opcode::HVC,    EncoderClass::EXCEPTION,       0xD4000002 },
+    { "inp",    Opcode::INP,    EncoderClass::FIXED,           0xD4002061 },
+    { "inps",   Opcode::INPS,   EncoderClass::FIXED,           0xD4002081 },
+    { "isb",    Opcode::ISB,    EncoderClass::BARRIER,         0xD50330DF },
+    { "ldar",   Opcode::LDAR,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "ldaxr",  Opcode::LDAXR,  EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "ldp",    Opcode::LDP,    EncoderClass::LOAD_STORE_PAIR, 0x00000001 },
+    { "ldr",    Opcode::LDR,    EncoderClass::LOAD_STORE,      0x00000000 },
+    { "ldrb",   Opcode::LDRB,   EncoderClass::LOAD_STORE,      0x00000000 },
+    { "ldrh",   Opcode::LDRH,   EncoderClass::LOAD_STORE,      0x00000000 },
+    { "ldrsb",  Opcode::LDRSB,  EncoderClass::LOAD_STORE,      0x00000000 },
+    { "ldrsh",  Opcode::LDRSH,  EncoderClass::LOAD_STORE,      0x00000000 },
+    { "ldrsw",  Opcode::LDRSW,  EncoderClass::LOAD_STORE,      0x00000000 },
+    { "line",   Opcode::LINE,   EncoderClass::FIXED,           0xD4002261 },
+    { "lsl",    Opcode::LSL,    EncoderClass::DATA_PROC,       0x1AC02000 },
+    { "lsr",    Opcode::LSR,    EncoderClass::DATA_PROC,       0x1AC02400 },
+    { "madd",   Opcode::MADD,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "memcpy", Opcode::MEMCPY, EncoderClass::FIXED,           0xD4002621 },
+    { "memset", Opcode::MEMSET, EncoderClass::FIXED,           0xD4002641 },
+    { "mneg",   Opcode::MNEG,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "mov",    Opcode::MOV,    EncoderClass::MOV,             0x00000000 },
+    { "movk",   Opcode::MOVK,   EncoderClass::MOV,             0x00000000 },
+    { "movn",   Opcode::MOVN,   EncoderClass::MOV,             0x00000000 },
+    { "movz",   Opcode::MOVZ,   EncoderClass::MOV,             0x00000000 },
+    { "mrs",    Opcode::MRS,    EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "msr",    Opcode::MSR,    EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "msub",   Opcode::MSUB,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "mul",    Opcode::MUL,    EncoderClass::DATA_PROC,       0x1B007C00 },
+    { "mvn",    Opcode::MVN,    EncoderClass::DATA_PROC,       0x2A200000 },
+    { "neg",    Opcode::NEG,    EncoderClass::DATA_PROC,       0x4B000000 },
+    { "negs",   Opcode::NEGS,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "ngc",    Opcode::NGC,    EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "ngcs",   Opcode::NGCS,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "nop",    Opcode::NOP,    EncoderClass::FIXED,           0xD503201F },
+    { "orn",    Opcode::ORN,    EncoderClass::DATA_PROC,       0x2A200000 },
+    { "orr",    Opcode::ORR,    EncoderClass::DATA_PROC,       0x2A000000 },
+    { "plot",   Opcode::PLOT,   EncoderClass::PLOT,            0x00000000 },
+    { "prt",    Opcode::PRT,    EncoderClass::FIXED,           0xD4002001 },
+    { "prtc",   Opcode::PRTC,   EncoderClass::FIXED,           0xD4002021 },
+    { "prtn",   Opcode::PRTN,   EncoderClass::FIXED,           0xD4002041 },
+    { "prtx",   Opcode::PRTX,   EncoderClass::FIXED,           0xD40020A1 },
+    { "putc",   Opcode::PUTC,   EncoderClass::PUTC,            0xD40020C1 },
+    { "render", Opcode::RENDER, EncoderClass::FIXED,           0xD40022E1 },
+    { "reset",  Opcode::RESET,  EncoderClass::FIXED,           0xD40022A1 },
+    { "ret",    Opcode::RET,    EncoderClass::RET,             0xD65F0000 },
+    { "rnd",    Opcode::RND,    EncoderClass::FIXED,           0xD4003E21 },
+    { "ror",    Opcode::ROR,    EncoderClass::DATA_PROC,       0x1AC02C00 },
+    { "sbc",    Opcode::SBC,    EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "sbcs",   Opcode::SBCS,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "sdiv",   Opcode::SDIV,   EncoderClass::DATA_PROC,       0x1AC00C00 },
+    { "setc",   Opcode::SETC,   EncoderClass::FIXED,           0xD4002221 },
+    { "sev",    Opcode::SEV,    EncoderClass::FIXED,           0xD503209F },
+    { "sevl",   Opcode::SEVL,   EncoderClass::FIXED,           0xD50320BF },
+    { "sleep",  Opcode::SLEEP,  EncoderClass::FIXED,           0xD4003E01 },
+    { "smc",    Opcode::SMC,    EncoderClass::EXCEPTION,       0xD4000003 },
+    { "stlr",   Opcode::STLR,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "stlxr",  Opcode::STLXR,  EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "stp",    Opcode::STP,    EncoderClass::LOAD_STORE_PAIR, 0x00000000 },
+    { "str",    Opcode::STR,    EncoderClass::LOAD_STORE,      0x00000000 },
+    { "strb",   Opcode::STRB,   EncoderClass::LOAD_STORE,      0x00000000 },
+    { "strh",   Opcode::STRH,   EncoderClass::LOAD_STORE,      0x00000000 },
+    { "strlen", Opcode::STRLEN, EncoderClass::FIXED,           0xD4002601 },
+    { "sub",    Opcode::SUB,    EncoderClass::DATA_PROC,       0x4B000000 },
+    { "subs",   Opcode::SUBS,   EncoderClass::DATA_PROC,       0x6B000000 },
+    { "svc",    Opcode::SVC,    EncoderClass::EXCEPTION,       0xD4000001 },
+    { "tbnz",   Opcode::TBNZ,   EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "tbz",    Opcode::TBZ,    EncoderClass::UNSUPPORTED,     0x00000000 },
+    { "tick",   Opcode::TICK,   EncoderClass::FIXED,           0xD4003E41 },
+    { "tst",    Opcode::TST,    EncoderClass::DATA_PROC,       0x6A000000 },
+    { "udiv",   Opcode::UDIV,   EncoderClass::DATA_PROC,       0x1AC00800 },
+    { "wfe",    Opcode::WFE,    EncoderClass::FIXED,           0xD503205F },
+    { "wfi",    Opcode::WFI,    EncoderClass::FIXED,           0xD503207F },
+};
+
+struct NamedValue {
+    char name[4];
+    int value;
+};
+
+// ARM64 condition codes, including the HS/LO aliases of CS/CC
+static constexpr NamedValue CONDITION_TABLE[] = {
+    { "al", 14 },   // Always
+    { "cc", 3 },    // Carry clear
+    { "cs", 2 },    // Carry set
+    { "eq", 0 },    // Equal
+    { "ge", 10 },   // Signed greater or equal
+    { "gt", 12 },   // Signed greater than
+    { "hi", 8 },    // Unsigned higher
+    { "hs", 2 },    // Unsigned higher or same
+    { "le", 13 },   // Signed less or equal
+    { "lo", 3 },    // Unsigned lower
+    { "ls", 9 },    // Unsigned lower or same
+    { "lt", 11 },   // Signed less than
+    { "mi", 4 },    // Minus / negative
+    { "ne", 1 },    // Not equal
+    { "pl", 5 },    // Plus / positive or zero
+    { "vc", 7 },    // No overflow
+    { "vs", 6 },    // Overflow
+};
+
+// Shift types for shifted-register operands
+static constexpr NamedValue SHIFT_TABLE[] = {
+    { "asr", 2 },
+    { "lsl", 0 },
+    { "lsr", 1 },
+    { "ror", 3 },
+};
+
+// ============================================================================
+// Compile-time Table Checks
+// ============================================================================
+
+static constexpr int name_compare(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
+}
+
+static constexpr bool opcode_table_valid() {
+    for (size_t i = 0; i < OPCODE_COUNT; i++) {
+        if (static_cast<size_t>(OPCODE_TABLE[i].opcode) != i) return false;
+        if (i > 0 && name_compare(OPCODE_TABLE[i - 1].name, OPCODE_TABLE[i].name) >= 0) return false;
+    }
+    return true;
+}
+
+template <size_t N>
+static constexpr bool names_sorted(const NamedValue (&table)[N]) {
+    for (size_t i = 1; i < N; i++) {
+        if (name_compare(table[i - 1].name, table[i].name) >= 0) return false;
+    }
+    return true;
+}
+
+static_assert(opcode_table_valid(), "Opcode table must be sorted and match enum Opcode");
+static_assert(names_sorted(CONDITION_TABLE), "Condition table must be sorted");
+static_assert(names_sorted(SHIFT_TABLE), "Shift table must be sorted");
+
+// ============================================================================
+// Lookup Helpers
+// ============================================================================
+
+/*
+ * Lowercase a token into buf; fails if it is empty or longer than max_len
+ */
+static bool to_lower_key(const char* name, size_t length, char* buf, size_t max_len) {
+    if (length == 0 || length > max_len) return false;
+    for (size_t i = 0; i < length; i++) {
+        char c = name[i];
+        buf[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+    buf[length] = '\0';
+    return true;
+}
+
+template <size_t N>
+static int find_value(const NamedValue (&table)[N], const char* name, size_t length) {
+    char key[sizeof(table[0].name)];
+    if (!to_lower_key(name, length, key, sizeof(key) - 1)) return -1;
+
+    size_t lo = 0;
+    size_t hi = N;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = name_compare(key, table[mid].name);
+        if (cmp == 0) return table[mid].value;
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return -1;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+const OpcodeInfo* find_opcode(const char* name, size_t length) {
+    char key[MAX_MNEMONIC_LENGTH + 1];
+    if (!to_lower_key(name, length, key, MAX_MNEMONIC_LENGTH)) return nullptr;
+
+    // Entry 0 is the NONE sentinel
+    size_t lo = 1;
+    size_t hi = OPCODE_COUNT;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = name_compare(key, OPCODE_TABLE[mid].name);
+        if (cmp == 0) return &OPCODE_TABLE[mid];
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return nullptr;
+}
+
+const OpcodeInfo& opcode_info(Opcode opcode) {
+    size_t index = static_cast<size_t>(opcode);
+    return OPCODE_TABLE[index < OPCODE_COUNT ? index : 0];
+}
+
+int find_condition(const char* name, size_t length) {
+    return find_value(CONDITION_TABLE, name, length);
+}
+
+int find_shift(const char* name, size_t length) {
+    return find_value(SHIFT_TABLE, name, length);
+}
+
+} // namespace casm
@@ -6,32 +6,40 @@
  */
 
 #include "casm/parser.h"
+#include "klib.h"
+#include "memory.h"
 
 namespace casm {
 
-// String helper functions (freestanding environment)
-static size_t str_len(const char* s) {
-    size_t len = 0;
-    while (s[len] != '\0') len++;
-    return len;
-}
+/*
+ * Chunk of the AST node pool
+ * Chunks are never moved, so node pointers handed out stay valid
+ */
+struct NodeChunk {
+    NodeChunk* next;
+    int used;
+    
+    // Nodes follow the header
+    ASTNode* nodes() { return reinterpret_cast<ASTNode*>(this + 1); }
+};
 
-static void str_copy(char* dest, const char* src, size_t max_len) {
-    size_t i = 0;
-    while (i < max_len - 1 && src[i] != '\0') {
-        dest[i] = src[i];
-        i++;
-    }
-    dest[i] = '\0';
+static_assert(sizeof(NodeChunk) % alignof(ASTNode) == 0, "NodeChunk breaks node alignment");
+
+constexpr int NODES_PER_CHUNK = static_cast<int>(
+    (AST_CHUNK_PAGES * memory::PAGE_SIZE - sizeof(NodeChunk)) / sizeof(ASTNode));
+
+static size_t pages_for(size_t bytes) {
+    return (bytes + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
 }
 
+// String helper functions (freestanding environment)
 static char to_lower(char c) {
     if (c >= 'A' && c <= 'Z') return c + ('a' - 'A');
     return c;
 }
 
 static bool str_equal_nocase(const char* a, size_t a_len, const char* b) {
-    size_t b_len = str_len(b);
+    size_t b_len = klib::strlen(b);
     if (a_len != b_len) return false;
     for (size_t i = 0; i < a_len; i++) {
         if (to_lower(a[i]) != to_lower(b[i])) return false;
@@ -39,52 +47,6 @@ static bool str_equal_nocase(const char* a, size_t a_len, const char* b) {
     return true;
 }
 
-/*
- * ARM64 instruction mnemonics
- * Requirements: 7.2, 7.3, 7.4, 7.5
- */
-static const char* INSTRUCTION_MNEMONICS[] = {
-    // Data processing
-    "add", "adds", "sub", "subs", "adc", "adcs", "sbc", "sbcs",
-    "and", "ands", "orr", "eor", "bic", "bics", "orn", "eon",
-    "mov", "movz", "movn", "movk", "mvn",
-    "asr", "lsl", "lsr", "ror",
-    "cmp", "cmn", "tst",
-    "neg", "negs", "ngc", "ngcs",
-    "mul", "madd", "msub", "mneg",
-    "udiv", "sdiv",
-    // Load/Store
-    "ldr", "ldrb", "ldrh", "ldrsb", "ldrsh", "ldrsw",
-    "str", "strb", "strh",
-    "ldp", "stp",
-    "ldar", "stlr", "ldaxr", "stlxr",
-    // Branch
-    "b", "bl", "br", "blr", "ret",
-    "cbz", "cbnz", "tbz", "tbnz",
-    "b.eq", "b.ne", "b.cs", "b.cc", "b.mi", "b.pl",
-    "b.vs", "b.vc", "b.hi", "b.ls", "b.ge", "b.lt", "b.gt", "b.le", "b.al",
-    "beq", "bne", "bcs", "bcc", "bmi", "bpl",
-    "bvs", "bvc", "bhi", "bls", "bge", "blt", "bgt", "ble", "bal",
-    // System
-    "nop", "wfi", "wfe", "sev", "sevl",
-    "svc", "hvc", "smc",
-    "mrs", "msr",
-    "dmb", "dsb", "isb",
-    // SIMD (basic)
-    "fmov", "fadd", "fsub", "fmul", "fdiv",
-    // CASM Extended I/O opcodes
-    "prt", "prtc", "prtn", "prtx", "inp", "inps",
-    // CASM Extended Graphics opcodes
-    "cls", "setc", "plot", "line", "box", "reset", "canvas",
-    // CASM Extended File opcodes
-    "fcreat", "fwrite", "fread", "fdel", "fcopy", "fmove", "fexist",
-    // CASM Extended System opcodes
-    "sleep", "rnd", "tick", "halt",
-    // CASM Extended Memory/String opcodes
-    "strlen", "memcpy", "memset", "abs",
-    nullptr
-};
-
 /*
  * Assembler directive names
  * Requirements: 7.8
@@ -108,18 +70,45 @@ Parser::Parser(Lexer& lexer)
     : lexer_(lexer)
     , has_error_(false)
     , error_line_(0)
+    , chunks_(nullptr)
     , node_count_(0)
+    , statements_(nullptr)
+    , statement_capacity_(0)
     , statement_count_(0)
 {
     error_msg_[0] = '\0';
     current_.type = TokenType::END_OF_FILE;
+    current_.opcode = Opcode::NONE;
     previous_.type = TokenType::END_OF_FILE;
+    previous_.opcode = Opcode::NONE;
+}
+
+Parser::~Parser() {
+    release();
+}
+
+/*
+ * Return the node pool and statement array to the page allocator
+ */
+void Parser::release() {
+    while (chunks_) {
+        NodeChunk* next = chunks_->next;
+        memory::free_pages(chunks_, AST_CHUNK_PAGES);
+        chunks_ = next;
+    }
+    if (statements_) {
+        memory::free_pages(statements_, pages_for(statement_capacity_ * sizeof(ASTNode*)));
+        statements_ = nullptr;
+    }
+    statement_capacity_ = 0;
 }
 
 /*
  * Reset parser state
+ * Invalidates any AST returned by an earlier parse()
  */
 void Parser::reset() {
+    release();
     has_error_ = false;
     error_msg_[0] = '\0';
     error_line_ = 0;
@@ -182,7 +171,7 @@ void Parser::error(const char* message) {
     if (has_error_) return; // Only report first error
     has_error_ = true;
     error_line_ = previous_.line;
-    str_copy(error_msg_, message, MAX_ERROR_LEN);
+    klib::strlcpy(error_msg_, message, MAX_ERROR_LEN);
 }
 
 /*
@@ -192,19 +181,26 @@ void Parser::error_at_current(const char* message) {
     if (has_error_) return;
     has_error_ = true;
     error_line_ = current_.line;
-    str_copy(error_msg_, message, MAX_ERROR_LEN);
+    klib::strlcpy(error_msg_, message, MAX_ERROR_LEN);
 }
 
 /*
  * Allocate a new AST node from pool
  */
 ASTNode* Parser::alloc_node(NodeType type) {
-    if (node_count_ >= MAX_AST_NODES) {
-        error("Too many AST nodes");
-        return nullptr;
+    if (!chunks_ || chunks_->used >= NODES_PER_CHUNK) {
+        NodeChunk* chunk = static_cast<NodeChunk*>(memory::alloc_pages(AST_CHUNK_PAGES));
+        if (!chunk) {
+            error("Out of memory for AST nodes");
+            return nullptr;
+        }
+        chunk->next = chunks_;
+        chunk->used = 0;
+        chunks_ = chunk;
     }
     
-    ASTNode* node = &node_pool_[node_count_++];
+    ASTNode* node = &chunks_->nodes()[chunks_->used++];
+    node_count_++;
     node->type = type;
     node->child_count = 0;
     node->statement_count = 0;
@@ -217,6 +213,27 @@ ASTNode* Parser::alloc_node(NodeType type) {
     return node;
 }
 
+/*
+ * Double the statement array, keeping the statements parsed so far
+ */
+bool Parser::grow_statements() {
+    int capacity = statement_capacity_ ? statement_capacity_ * 2 : INITIAL_STATEMENTS;
+    ASTNode** grown = static_cast<ASTNode**>(
+        memory::alloc_pages(pages_for(capacity * sizeof(ASTNode*))));
+    if (!grown) {
+        error("Out of memory for statements");
+        return false;
+    }
+    
+    if (statements_) {
+        klib::memcpy(grown, statements_, statement_count_ * sizeof(ASTNode*));
+        memory::free_pages(statements_, pages_for(statement_capacity_ * sizeof(ASTNode*)));
+    }
+    statements_ = grown;
+    statement_capacity_ = capacity;
+    return true;
+}
+
 /*
  * Create a new AST node with token
  */
@@ -240,14 +257,7 @@ bool Parser::token_equals(const Token& token, const char* str) const {
  * Requirements: 7.2, 7.3, 7.4, 7.5
  */
 bool Parser::is_instruction_mnemonic(const Token& token) const {
-    if (token.type != TokenType::IDENTIFIER) return false;
-    
-    for (int i = 0; INSTRUCTION_MNEMONICS[i] != nullptr; i++) {
-        if (token_equals(token, INSTRUCTION_MNEMONICS[i])) {
-            return true;
-        }
-    }
-    return false;
+    return token.type == TokenType::IDENTIFIER && token.opcode != Opcode::NONE;
 }
 
 /*
@@ -346,12 +356,10 @@ ASTNode* Parser::parse_program() {
     while (!check(TokenType::END_OF_FILE) && !has_error_) {
         ASTNode* stmt = parse_statement();
         if (stmt) {
-            if (statement_count_ < MAX_STATEMENTS) {
-                statements_[statement_count_++] = stmt;
-            } else {
-                error("Too many statements");
+            if (statement_count_ >= statement_capacity_ && !grow_statements()) {
                 break;
             }
+            statements_[statement_count_++] = stmt;
         }
         
         // Expect newline or EOF after statement
@@ -425,6 +433,13 @@ ASTNode* Parser::parse_instruction_with_token(const Token& mnemonic) {
         ASTNode* operand = parse_operand();
         if (!operand) break;
         
+        // Shift modifier ("lsl #16"): the amount hangs off the shift name
+        if (operand->type == NodeType::OPERAND_LABEL && check(TokenType::HASH)) {
+            ASTNode* amount = parse_immediate();
+            if (!amount) break;
+            operand->children[operand->child_count++] = amount;
+        }
+        
         if (instr->child_count < MAX_AST_CHILDREN) {
             instr->children[instr->child_count++] = operand;
         } else {
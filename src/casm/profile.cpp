@@ -0,0 +1,60 @@
+/*
+ * EmberOS CASM Profiler Implementation
+ * Sample counters for casm prof
+ *
+ * The counters come from memory::alloc_pages, one 32-bit word per
+ * instruction, so a profile costs as much memory as the image itself.
+ */
+
+#include "casm/profile.h"
+#include "klib.h"
+#include "memory.h"
+
+namespace casm {
+
+bool profile_init(Profile* prof, size_t image_size) {
+    klib::memset(prof, 0, sizeof(Profile));
+
+    size_t words = (image_size + 3) / 4;
+    size_t pages = (words * sizeof(uint32_t) + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
+    if (pages == 0) pages = 1;
+
+    prof->hits = static_cast<uint32_t*>(memory::alloc_pages(pages));
+    if (!prof->hits) {
+        return false;
+    }
+    klib::memset(prof->hits, 0, pages * memory::PAGE_SIZE);
+    prof->words = words;
+    prof->pages = pages;
+    return true;
+}
+
+void profile_free(Profile* prof) {
+    if (prof->hits) {
+        memory::free_pages(prof->hits, prof->pages);
+    }
+    prof->hits = nullptr;
+    prof->words = 0;
+    prof->pages = 0;
+}
+
+size_t profile_top(const Profile* prof, uint64_t* offsets, size_t max) {
+    // Insertion into a short sorted list; max is small and most words are 0
+    size_t count = 0;
+    if (max == 0) return 0;
+    for (size_t i = 0; i < prof->words; i++) {
+        uint32_t hits = prof->hits[i];
+        if (hits == 0) continue;
+        if (count == max && hits <= prof->hits[offsets[count - 1] / 4]) continue;
+
+        size_t pos = (count < max) ? count++ : count - 1;
+        while (pos > 0 && prof->hits[offsets[pos - 1] / 4] < hits) {
+            offsets[pos] = offsets[pos - 1];
+            pos--;
+        }
+        offsets[pos] = i * 4;
+    }
+    return count;
+}
+
+} // namespace casm
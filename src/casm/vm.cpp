@@ -0,0 +1,969 @@
+/*
+ * EmberOS CASM Virtual Machine Implementation
+ * Predecoded, threaded-dispatch interpreter for CASM binaries
+ *
+ * load() turns each instruction word into a VmOp once. Register 31 is
+ * resolved to SP, the zero register or the write sink at that point, SUB
+ * immediates become negative ADD immediates, logical immediates are
+ * expanded, and PC-relative targets become op indices. A branch that
+ * leaves the image lands on the END op past the last word.
+ */
+
+#include "casm/vm.h"
+#include "klib.h"
+#include "memory.h"
+
+namespace casm {
+
+/*
+ * Decoded operation codes
+ * Must stay in the same order as the label table in Vm::run()
+ */
+enum VmCode : uint8_t {
+    OP_END, OP_UNKNOWN, OP_NOP, OP_HALT, OP_SVC,
+    OP_MOV_IMM, OP_MOVK_X, OP_MOVK_W,
+    OP_ADD_IMM_X, OP_ADD_IMM_W, OP_ADDS_IMM_X, OP_ADDS_IMM_W, OP_SUBS_IMM_X, OP_SUBS_IMM_W,
+    OP_ADD_X, OP_ADD_W, OP_SUB_X, OP_SUB_W,
+    OP_ADDS_X, OP_ADDS_W, OP_SUBS_X, OP_SUBS_W,
+    OP_AND_X, OP_AND_W, OP_ANDS_X, OP_ANDS_W, OP_ORR_X, OP_ORR_W, OP_EOR_X, OP_EOR_W,
+    OP_BIC_X, OP_BIC_W, OP_ORN_X, OP_ORN_W,
+    OP_AND_IMM, OP_ANDS_IMM_X, OP_ANDS_IMM_W, OP_ORR_IMM_X, OP_ORR_IMM_W,
+    OP_EOR_IMM_X, OP_EOR_IMM_W,
+    OP_MADD_X, OP_MADD_W, OP_UDIV_X, OP_UDIV_W, OP_SDIV_X, OP_SDIV_W,
+    OP_LSL_X, OP_LSL_W, OP_LSR_X, OP_LSR_W, OP_ASR_X, OP_ASR_W, OP_ROR_X, OP_ROR_W,
+    OP_B, OP_BL, OP_B_COND, OP_CBZ_X, OP_CBZ_W, OP_CBNZ_X, OP_CBNZ_W, OP_TBZ, OP_TBNZ,
+    OP_BR, OP_BLR,
+    OP_LDR_X, OP_LDR_W, OP_LDRH, OP_LDRB, OP_LDRSW, OP_LDRSH_X, OP_LDRSH_W,
+    OP_LDRSB_X, OP_LDRSB_W,
+    OP_STR_X, OP_STR_W, OP_STRH, OP_STRB,
+    OP_LDP_X, OP_LDP_W, OP_STP_X, OP_STP_W,
+    OP_COUNT
+};
+
+/*
+ * A decoded instruction
+ * Loads and stores access rn + imm, then write that address + wb back to
+ * ra (VM_SINK when the form has no writeback)
+ */
+struct VmOp {
+    uint8_t code;           // VmCode
+    uint8_t rd;             // Destination, or transfer register Rt
+    uint8_t rn;             // First source, or base
+    uint8_t rm;             // Second source, or Rt2
+    uint8_t ra;             // MADD addend, or writeback register
+    uint8_t arg;            // Condition code, or MOVK shift
+    int16_t wb;             // Writeback adjustment
+    int64_t imm;            // Immediate, address offset, branch target index or SVC number
+};
+
+static_assert(sizeof(VmOp) == 16, "VmOp should stay two words");
+
+// Lazy flag kinds
+constexpr uint8_t FLAGS_LOGIC = 0;
+constexpr uint8_t FLAGS_ADD = 1;
+constexpr uint8_t FLAGS_SUB = 2;
+
+constexpr uint32_t SVC_HALT = 0x1FF;
+
+// ============================================================================
+// Decoder
+// ============================================================================
+
+static size_t pages_for(size_t bytes) {
+    return (bytes + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
+}
+
+// Register 31 read as XZR/WZR
+static inline uint8_t zr_src(uint32_t r) {
+    return r == 31 ? VM_ZR : static_cast<uint8_t>(r);
+}
+
+// Register 31 written as XZR/WZR
+static inline uint8_t zr_dst(uint32_t r) {
+    return r == 31 ? VM_SINK : static_cast<uint8_t>(r);
+}
+
+static inline int64_t sign_extend(uint64_t value, int bits) {
+    uint64_t sign = 1ULL << (bits - 1);
+    return static_cast<int64_t>((value ^ sign) - sign);
+}
+
+/*
+ * Expand an N:immr:imms logical immediate (ARM DecodeBitMasks)
+ */
+static bool decode_bitmask(uint32_t n, uint32_t immr, uint32_t imms, bool wide, uint64_t* value) {
+    if (!wide && n) return false;
+
+    uint32_t combined = (n << 6) | (~imms & 0x3F);
+    int len = -1;
+    for (int bit = 6; bit >= 0; bit--) {
+        if (combined & (1U << bit)) {
+            len = bit;
+            break;
+        }
+    }
+    if (len < 1) return false;
+
+    uint32_t size = 1U << len;
+    uint32_t levels = size - 1;
+    uint32_t s = imms & levels;
+    uint32_t r = immr & levels;
+    if (s == levels) return false;
+
+    uint64_t mask = size == 64 ? ~0ULL : (1ULL << size) - 1;
+    uint64_t pattern = (1ULL << (s + 1)) - 1;
+    if (r) {
+        pattern = ((pattern >> r) | (pattern << (size - r))) & mask;
+    }
+    for (uint32_t e = size; e < 64; e *= 2) {
+        pattern |= pattern << e;
+    }
+    *value = wide ? pattern : pattern & 0xFFFFFFFF;
+    return true;
+}
+
+// Single-register load/store codes by [size][opc]
+static const uint8_t LOAD_STORE_CODES[4][4] = {
+    { OP_STRB,  OP_LDRB,  OP_LDRSB_X, OP_LDRSB_W },
+    { OP_STRH,  OP_LDRH,  OP_LDRSH_X, OP_LDRSH_W },
+    { OP_STR_W, OP_LDR_W, OP_LDRSW,   OP_UNKNOWN },
+    { OP_STR_X, OP_LDR_X, OP_NOP,     OP_UNKNOWN },  // opc 2: PRFM
+};
+
+static inline bool is_store(uint8_t code) {
+    return code == OP_STR_X || code == OP_STR_W || code == OP_STRH || code == OP_STRB;
+}
+
+/*
+ * Decode one instruction word at op index `index` of `count`
+ * Unrecognized words decode to OP_UNKNOWN and only fault if executed
+ */
+static void decode(uint32_t w, size_t index, size_t count, VmOp* op) {
+    op->code = OP_UNKNOWN;
+    op->rd = op->rn = op->rm = VM_ZR;
+    op->ra = VM_SINK;
+    op->arg = 0;
+    op->wb = 0;
+    op->imm = 0;
+
+    bool wide = (w >> 31) != 0;
+    uint32_t rd = w & 0x1F;
+    uint32_t rn = (w >> 5) & 0x1F;
+    uint32_t rm = (w >> 16) & 0x1F;
+
+    // PC-relative target as an op index; END when it leaves the image
+    auto target = [index, count](int64_t words) -> int64_t {
+        int64_t t = static_cast<int64_t>(index) + words;
+        return (t < 0 || t >= static_cast<int64_t>(count)) ? static_cast<int64_t>(count) : t;
+    };
+
+    // Hints (NOP, WFI, SEV, ...) and barriers
+    if ((w & 0xFFFFF01F) == 0xD503201F || (w & 0xFFFFF01F) == 0xD503301F) {
+        op->code = OP_NOP;
+        return;
+    }
+
+    // SVC #imm16
+    if ((w & 0xFFE0001F) == 0xD4000001) {
+        op->imm = (w >> 5) & 0xFFFF;
+        op->code = op->imm == SVC_HALT ? OP_HALT : OP_SVC;
+        return;
+    }
+
+    // Move wide: sf opc 100101 hw imm16 Rd
+    if ((w & 0x1F800000) == 0x12800000) {
+        uint32_t opc = (w >> 29) & 3;
+        uint32_t hw = (w >> 21) & 3;
+        uint64_t imm16 = (w >> 5) & 0xFFFF;
+        if (opc == 1 || (!wide && hw > 1)) return;
+
+        op->rd = zr_dst(rd);
+        op->arg = static_cast<uint8_t>(hw * 16);
+        op->imm = static_cast<int64_t>(imm16 << (hw * 16));
+        if (opc == 3) {
+            op->code = wide ? OP_MOVK_X : OP_MOVK_W;
+        } else {
+            uint64_t value = imm16 << (hw * 16);
+            if (opc == 0) value = ~value;
+            op->imm = static_cast<int64_t>(wide ? value : value & 0xFFFFFFFF);
+            op->code = OP_MOV_IMM;
+        }
+        return;
+    }
+
+    // Add/subtract immediate: sf op S 100010 sh imm12 Rn Rd
+    if ((w & 0x1F800000) == 0x11000000) {
+        bool sub = (w >> 30) & 1;
+        bool set_flags = (w >> 29) & 1;
+        int64_t imm = (w >> 10) & 0xFFF;
+        if ((w >> 22) & 1) imm <<= 12;
+
+        op->rn = static_cast<uint8_t>(rn);          // SP
+        if (set_flags) {
+            op->rd = zr_dst(rd);
+            op->imm = imm;
+            op->code = sub ? (wide ? OP_SUBS_IMM_X : OP_SUBS_IMM_W)
+                           : (wide ? OP_ADDS_IMM_X : OP_ADDS_IMM_W);
+        } else {
+            op->rd = static_cast<uint8_t>(rd);      // SP
+            op->imm = sub ? -imm : imm;
+            op->code = wide ? OP_ADD_IMM_X : OP_ADD_IMM_W;
+        }
+        return;
+    }
+
+    // Logical immediate: sf opc 100100 N immr imms Rn Rd
+    if ((w & 0x1F800000) == 0x12000000) {
+        uint32_t opc = (w >> 29) & 3;
+        uint64_t value;
+        if (!decode_bitmask((w >> 22) & 1, (w >> 16) & 0x3F, (w >> 10) & 0x3F, wide, &value)) {
+            return;
+        }
+        op->rn = zr_src(rn);
+        op->rd = opc == 3 ? zr_dst(rd) : static_cast<uint8_t>(rd);  // SP unless ANDS
+        op->imm = static_cast<int64_t>(value);
+        // A 32-bit immediate has a zero upper half, so AND needs no W form
+        static const uint8_t codes[4][2] = {
+            { OP_AND_IMM, OP_AND_IMM }, { OP_ORR_IMM_X, OP_ORR_IMM_W },
+            { OP_EOR_IMM_X, OP_EOR_IMM_W }, { OP_ANDS_IMM_X, OP_ANDS_IMM_W },
+        };
+        op->code = codes[opc][wide ? 0 : 1];
+        return;
+    }
+
+    // Logical (shifted register), shift amount 0: sf opc 01010 shift N Rm imm6 Rn Rd
+    if ((w & 0x1F000000) == 0x0A000000) {
+        if ((w >> 10) & 0x3F) return;
+        uint32_t opc = (w >> 29) & 3;
+        bool invert = (w >> 21) & 1;
+        static const uint8_t plain[4][2] = {
+            { OP_AND_X, OP_AND_W }, { OP_ORR_X, OP_ORR_W },
+            { OP_EOR_X, OP_EOR_W }, { OP_ANDS_X, OP_ANDS_W },
+        };
+        static const uint8_t inverted[4][2] = {
+            { OP_BIC_X, OP_BIC_W }, { OP_ORN_X, OP_ORN_W },
+            { OP_UNKNOWN, OP_UNKNOWN }, { OP_UNKNOWN, OP_UNKNOWN },
+        };
+        op->code = (invert ? inverted : plain)[opc][wide ? 0 : 1];
+        op->rd = zr_dst(rd);
+        op->rn = zr_src(rn);
+        op->rm = zr_src(rm);
+        return;
+    }
+
+    // Add/subtract (shifted register), shift amount 0: sf op S 01011 shift 0 Rm imm6 Rn Rd
+    if ((w & 0x1F200000) == 0x0B000000) {
+        if ((w >> 10) & 0x3F) return;
+        uint32_t kind = (w >> 29) & 3;          // op:S
+        static const uint8_t codes[4][2] = {
+            { OP_ADD_X, OP_ADD_W }, { OP_ADDS_X, OP_ADDS_W },
+            { OP_SUB_X, OP_SUB_W }, { OP_SUBS_X, OP_SUBS_W },
+        };
+        op->code = codes[kind][wide ? 0 : 1];
+        op->rd = zr_dst(rd);
+        op->rn = zr_src(rn);
+        op->rm = zr_src(rm);
+        return;
+    }
+
+    // Data-processing (2 source): sf 0 0 11010110 Rm opcode Rn Rd
+    if ((w & 0x7FE00000) == 0x1AC00000) {
+        uint8_t code = OP_UNKNOWN;
+        switch ((w >> 10) & 0x3F) {
+            case 2:  code = wide ? OP_UDIV_X : OP_UDIV_W; break;
+            case 3:  code = wide ? OP_SDIV_X : OP_SDIV_W; break;
+            case 8:  code = wide ? OP_LSL_X : OP_LSL_W; break;
+            case 9:  code = wide ? OP_LSR_X : OP_LSR_W; break;
+            case 10: code = wide ? OP_ASR_X : OP_ASR_W; break;
+            case 11: code = wide ? OP_ROR_X : OP_ROR_W; break;
+            default: return;
+        }
+        op->code = code;
+        op->rd = zr_dst(rd);
+        op->rn = zr_src(rn);
+        op->rm = zr_src(rm);
+        return;
+    }
+
+    // MADD (MUL when Ra = XZR): sf 00 11011 000 Rm 0 Ra Rn Rd
+    if ((w & 0x7FE08000) == 0x1B000000) {
+        op->code = wide ? OP_MADD_X : OP_MADD_W;
+        op->rd = zr_dst(rd);
+        op->rn = zr_src(rn);
+        op->rm = zr_src(rm);
+        op->ra = zr_src((w >> 10) & 0x1F);
+        return;
+    }
+
+    // B / BL imm26
+    if ((w & 0x7C000000) == 0x14000000) {
+        op->code = (w >> 31) ? OP_BL : OP_B;
+        op->rd = 30;
+        op->imm = target(sign_extend(w & 0x3FFFFFF, 26));
+        return;
+    }
+
+    // B.cond imm19
+    if ((w & 0xFF000010) == 0x54000000) {
+        op->code = OP_B_COND;
+        op->arg = w & 0xF;
+        op->imm = target(sign_extend((w >> 5) & 0x7FFFF, 19));
+        return;
+    }
+
+    // CBZ/CBNZ imm19
+    if ((w & 0x7E000000) == 0x34000000) {
+        bool nonzero = (w >> 24) & 1;
+        op->code = nonzero ? (wide ? OP_CBNZ_X : OP_CBNZ_W) : (wide ? OP_CBZ_X : OP_CBZ_W);
+        op->rn = zr_src(rd);
+        op->imm = target(sign_extend((w >> 5) & 0x7FFFF, 19));
+        return;
+    }
+
+    // TBZ/TBNZ imm14 (putc tests the ring fill with them)
+    if ((w & 0x7E000000) == 0x36000000) {
+        op->code = ((w >> 24) & 1) ? OP_TBNZ : OP_TBZ;
+        op->rn = zr_src(rd);
+        op->arg = static_cast<uint8_t>(((w >> 26) & 0x20) | ((w >> 19) & 0x1F));
+        op->imm = target(sign_extend((w >> 5) & 0x3FFF, 14));
+        return;
+    }
+
+    // BR / BLR / RET
+    if ((w & 0xFFFFFC1F) == 0xD61F0000 || (w & 0xFFFFFC1F) == 0xD65F0000) {
+        op->code = OP_BR;
+        op->rn = zr_src(rn);
+        return;
+    }
+    if ((w & 0xFFFFFC1F) == 0xD63F0000) {
+        op->code = OP_BLR;
+        op->rn = zr_src(rn);
+        op->rd = 30;
+        return;
+    }
+
+    // Load/store (unsigned offset): size 111 0 01 opc imm12 Rn Rt
+    if ((w & 0x3F000000) == 0x39000000) {
+        uint32_t size = w >> 30;
+        uint8_t code = LOAD_STORE_CODES[size][(w >> 22) & 3];
+        op->code = code;
+        op->rd = is_store(code) ? zr_src(rd) : zr_dst(rd);
+        op->rn = static_cast<uint8_t>(rn);          // SP
+        op->imm = static_cast<int64_t>((w >> 10) & 0xFFF) << size;
+        return;
+    }
+
+    // Load/store (imm9: unscaled, post-index, pre-index): size 111 0 00 opc 0 imm9 idx Rn Rt
+    if ((w & 0x3F200000) == 0x38000000) {
+        uint32_t idx = (w >> 10) & 3;
+        int64_t imm9 = sign_extend((w >> 12) & 0x1FF, 9);
+        uint8_t code = LOAD_STORE_CODES[w >> 30][(w >> 22) & 3];
+        op->code = code;
+        op->rd = is_store(code) ? zr_src(rd) : zr_dst(rd);
+        op->rn = static_cast<uint8_t>(rn);
+        if (idx == 1) {                             // Post-index
+            op->ra = static_cast<uint8_t>(rn);
+            op->wb = static_cast<int16_t>(imm9);
+        } else {
+            op->imm = imm9;
+            if (idx == 3) op->ra = static_cast<uint8_t>(rn);   // Pre-index
+        }
+        return;
+    }
+
+    // Load (literal): opc 011 0 00 imm19 Rt
+    if ((w & 0x3F000000) == 0x18000000) {
+        static const uint8_t codes[4] = { OP_LDR_W, OP_LDR_X, OP_LDRSW, OP_NOP };
+        op->code = codes[w >> 30];
+        op->rd = zr_dst(rd);
+        op->rn = VM_ZR;
+        op->imm = (static_cast<int64_t>(index) + sign_extend((w >> 5) & 0x7FFFF, 19)) * 4;
+        return;
+    }
+
+    // Load/store pair: opc 101 0 idx L imm7 Rt2 Rn Rt
+    if ((w & 0x3E000000) == 0x28000000) {
+        uint32_t opc = w >> 30;
+        uint32_t idx = (w >> 23) & 3;
+        bool load = (w >> 22) & 1;
+        if (opc != 0 && opc != 2) return;
+
+        int scale = opc == 2 ? 3 : 2;
+        int64_t offset = sign_extend((w >> 15) & 0x7F, 7) * (1 << scale);
+        op->code = opc == 2 ? (load ? OP_LDP_X : OP_STP_X) : (load ? OP_LDP_W : OP_STP_W);
+        op->rd = load ? zr_dst(rd) : zr_src(rd);
+        op->rm = load ? zr_dst((w >> 10) & 0x1F) : zr_src((w >> 10) & 0x1F);
+        op->rn = static_cast<uint8_t>(rn);
+        if (idx == 1) {                             // Post-index
+            op->ra = static_cast<uint8_t>(rn);
+            op->wb = static_cast<int16_t>(offset);
+        } else {
+            op->imm = offset;
+            if (idx == 3) op->ra = static_cast<uint8_t>(rn);   // Pre-index
+        }
+        return;
+    }
+}
+
+// ============================================================================
+// Memory Access
+// ============================================================================
+
+static inline uint64_t load_bytes(const uint8_t* mem, size_t size, uint64_t addr, int bytes) {
+    if (addr >= size || size - addr < static_cast<uint64_t>(bytes)) {
+        return 0;
+    }
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | mem[addr + i];
+    }
+    return value;
+}
+
+static inline void store_bytes(uint8_t* mem, size_t size, uint64_t addr, uint64_t value, int bytes) {
+    if (addr >= size || size - addr < static_cast<uint64_t>(bytes)) {
+        return;
+    }
+    for (int i = 0; i < bytes; i++) {
+        mem[addr + i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+// ============================================================================
+// Flags
+// ============================================================================
+
+uint32_t Vm::nzcv() const {
+    uint64_t mask = flags_.wide ? ~0ULL : 0xFFFFFFFFULL;
+    uint64_t sign = flags_.wide ? 1ULL << 63 : 1ULL << 31;
+    uint64_t a = flags_.a & mask;
+    uint64_t b = flags_.b & mask;
+    uint64_t result = flags_.result & mask;
+
+    uint32_t n = (result & sign) ? 1 : 0;
+    uint32_t z = result == 0 ? 1 : 0;
+    uint32_t c = 0, v = 0;
+    if (flags_.kind == FLAGS_ADD) {
+        c = result < a ? 1 : 0;
+        v = (~(a ^ b) & (a ^ result) & sign) ? 1 : 0;
+    } else if (flags_.kind == FLAGS_SUB) {
+        c = a >= b ? 1 : 0;
+        v = ((a ^ b) & (a ^ result) & sign) ? 1 : 0;
+    }
+    return (n << 3) | (z << 2) | (c << 1) | v;
+}
+
+static bool condition_holds(uint32_t nzcv, uint32_t cond) {
+    bool n = nzcv & 8, z = nzcv & 4, c = nzcv & 2, v = nzcv & 1;
+    bool result;
+    switch (cond >> 1) {
+        case 0:  result = z; break;                     // EQ / NE
+        case 1:  result = c; break;                     // CS / CC
+        case 2:  result = n; break;                     // MI / PL
+        case 3:  result = v; break;                     // VS / VC
+        case 4:  result = c && !z; break;               // HI / LS
+        case 5:  result = n == v; break;                // GE / LT
+        case 6:  result = !z && n == v; break;          // GT / LE
+        default: return true;                           // AL / NV
+    }
+    return (cond & 1) ? !result : result;
+}
+
+// ============================================================================
+// Vm
+// ============================================================================
+
+Vm::Vm()
+    : memory_(nullptr)
+    , memory_size_(0)
+    , image_size_(0)
+    , ops_(nullptr)
+    , op_count_(0)
+    , op_pages_(0)
+    , pc_(0)
+    , executed_(0)
+    , svc_handler_(nullptr)
+    , svc_context_(nullptr)
+{
+    for (int i = 0; i < VM_REGISTERS; i++) {
+        regs_[i] = 0;
+    }
+    flags_.kind = FLAGS_LOGIC;
+    flags_.wide = true;
+    flags_.a = flags_.b = 0;
+    flags_.result = 1;
+}
+
+Vm::~Vm() {
+    release();
+}
+
+void Vm::release() {
+    if (ops_) {
+        memory::free_pages(ops_, op_pages_);
+        ops_ = nullptr;
+    }
+    op_count_ = 0;
+    op_pages_ = 0;
+}
+
+bool Vm::load(uint8_t* memory, size_t memory_size, size_t image_size) {
+    release();
+
+    size_t words = image_size / 4;
+    op_pages_ = pages_for((words + 1) * sizeof(VmOp));
+    ops_ = static_cast<VmOp*>(memory::alloc_pages(op_pages_));
+    if (!ops_) {
+        op_pages_ = 0;
+        return false;
+    }
+    op_count_ = words + 1;
+
+    for (size_t i = 0; i < words; i++) {
+        const uint8_t* p = memory + i * 4;
+        uint32_t word = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        decode(word, i, words, &ops_[i]);
+    }
+    klib::memset(&ops_[words], 0, sizeof(VmOp));
+    ops_[words].code = OP_END;
+
+    memory_ = memory;
+    memory_size_ = memory_size;
+    image_size_ = words * 4;
+
+    for (int i = 0; i < VM_REGISTERS; i++) {
+        regs_[i] = 0;
+    }
+    regs_[30] = image_size_;                    // RET from the top level ends
+    regs_[VM_SP] = memory_size & ~0xFULL;
+    flags_.kind = FLAGS_LOGIC;
+    flags_.wide = true;
+    flags_.a = flags_.b = 0;
+    flags_.result = 1;
+    pc_ = 0;
+    executed_ = 0;
+    return true;
+}
+
+uint32_t Vm::current_word() const {
+    if (pc_ + 4 > image_size_) return 0;
+    const uint8_t* p = memory_ + pc_;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/*
+ * Execute from pc_ until the budget runs out or the program stops
+ * Each handler ends by jumping straight to the next op's handler
+ */
+VmStatus Vm::run(uint64_t budget) {
+    static void* const handlers[OP_COUNT] = {
+        &&op_end, &&op_unknown, &&op_nop, &&op_halt, &&op_svc,
+        &&op_mov_imm, &&op_movk_x, &&op_movk_w,
+        &&op_add_imm_x, &&op_add_imm_w, &&op_adds_imm_x, &&op_adds_imm_w,
+        &&op_subs_imm_x, &&op_subs_imm_w,
+        &&op_add_x, &&op_add_w, &&op_sub_x, &&op_sub_w,
+        &&op_adds_x, &&op_adds_w, &&op_subs_x, &&op_subs_w,
+        &&op_and_x, &&op_and_w, &&op_ands_x, &&op_ands_w, &&op_orr_x, &&op_orr_w,
+        &&op_eor_x, &&op_eor_w,
+        &&op_bic_x, &&op_bic_w, &&op_orn_x, &&op_orn_w,
+        &&op_and_imm, &&op_ands_imm_x, &&op_ands_imm_w, &&op_orr_imm_x, &&op_orr_imm_w,
+        &&op_eor_imm_x, &&op_eor_imm_w,
+        &&op_madd_x, &&op_madd_w, &&op_udiv_x, &&op_udiv_w, &&op_sdiv_x, &&op_sdiv_w,
+        &&op_lsl_x, &&op_lsl_w, &&op_lsr_x, &&op_lsr_w, &&op_asr_x, &&op_asr_w,
+        &&op_ror_x, &&op_ror_w,
+        &&op_b, &&op_bl, &&op_b_cond, &&op_cbz_x, &&op_cbz_w, &&op_cbnz_x, &&op_cbnz_w,
+        &&op_tbz, &&op_tbnz, &&op_br, &&op_blr,
+        &&op_ldr_x, &&op_ldr_w, &&op_ldrh, &&op_ldrb, &&op_ldrsw, &&op_ldrsh_x, &&op_ldrsh_w,
+        &&op_ldrsb_x, &&op_ldrsb_w,
+        &&op_str_x, &&op_str_w, &&op_strh, &&op_strb,
+        &&op_ldp_x, &&op_ldp_w, &&op_stp_x, &&op_stp_w,
+    };
+
+    if (!ops_) return VmStatus::RETURNED;
+
+    VmOp* const ops = ops_;
+    const VmOp* op = ops + (pc_ < image_size_ ? pc_ / 4 : op_count_ - 1);
+    uint64_t* const r = regs_;
+    uint8_t* const mem = memory_;
+    const size_t mem_size = memory_size_;
+    uint64_t left = budget;
+    VmStatus status;
+    uint64_t addr;
+
+    // Index of the op a register-indirect branch to byte address t lands on
+    #define INDIRECT(t) (((t) < image_size_ && ((t) & 3) == 0) ? (t) / 4 : op_count_ - 1)
+    #define DISPATCH() do { if (left == 0) goto out_of_budget; left--; goto *handlers[op->code]; } while (0)
+    #define NEXT() do { op++; DISPATCH(); } while (0)
+    #define JUMP(index) do { op = ops + (index); DISPATCH(); } while (0)
+    #define W(x) ((x) & 0xFFFFFFFFULL)
+    #define SET_FLAGS(k, wd, x, y, res) \
+        do { flags_.kind = (k); flags_.wide = (wd); flags_.a = (x); flags_.b = (y); flags_.result = (res); } while (0)
+    #define ADDRESS() (addr = r[op->rn] + op->imm, r[op->ra] = addr + op->wb, addr)
+
+    DISPATCH();
+
+op_end:
+    left++;                                     // Leaving the image is not an instruction
+    status = VmStatus::RETURNED;
+    goto done;
+op_unknown:
+    left++;
+    status = VmStatus::UNKNOWN;
+    goto done;
+op_nop:
+    NEXT();
+op_halt:
+    op++;
+    status = VmStatus::HALTED;
+    goto done;
+op_svc:
+    pc_ = static_cast<uint64_t>(op - ops) * 4;
+    if (!svc_handler_ || !svc_handler_(*this, static_cast<uint32_t>(op->imm), svc_context_)) {
+        op++;
+        status = VmStatus::STOPPED;
+        goto done;
+    }
+    NEXT();
+
+    // Moves
+op_mov_imm:
+    r[op->rd] = op->imm;
+    NEXT();
+op_movk_x:
+    r[op->rd] = (r[op->rd] & ~(0xFFFFULL << op->arg)) | op->imm;
+    NEXT();
+op_movk_w:
+    r[op->rd] = W((r[op->rd] & ~(0xFFFFULL << op->arg)) | op->imm);
+    NEXT();
+
+    // Add/subtract immediate
+op_add_imm_x:
+    r[op->rd] = r[op->rn] + op->imm;
+    NEXT();
+op_add_imm_w:
+    r[op->rd] = W(r[op->rn] + op->imm);
+    NEXT();
+op_adds_imm_x: {
+    uint64_t a = r[op->rn], b = op->imm;
+    SET_FLAGS(FLAGS_ADD, true, a, b, a + b);
+    r[op->rd] = a + b;
+    NEXT();
+}
+op_adds_imm_w: {
+    uint64_t a = W(r[op->rn]), b = op->imm;
+    SET_FLAGS(FLAGS_ADD, false, a, b, a + b);
+    r[op->rd] = W(a + b);
+    NEXT();
+}
+op_subs_imm_x: {
+    uint64_t a = r[op->rn], b = op->imm;
+    SET_FLAGS(FLAGS_SUB, true, a, b, a - b);
+    r[op->rd] = a - b;
+    NEXT();
+}
+op_subs_imm_w: {
+    uint64_t a = W(r[op->rn]), b = op->imm;
+    SET_FLAGS(FLAGS_SUB, false, a, b, a - b);
+    r[op->rd] = W(a - b);
+    NEXT();
+}
+
+    // Add/subtract register
+op_add_x:
+    r[op->rd] = r[op->rn] + r[op->rm];
+    NEXT();
+op_add_w:
+    r[op->rd] = W(r[op->rn] + r[op->rm]);
+    NEXT();
+op_sub_x:
+    r[op->rd] = r[op->rn] - r[op->rm];
+    NEXT();
+op_sub_w:
+    r[op->rd] = W(r[op->rn] - r[op->rm]);
+    NEXT();
+op_adds_x: {
+    uint64_t a = r[op->rn], b = r[op->rm];
+    SET_FLAGS(FLAGS_ADD, true, a, b, a + b);
+    r[op->rd] = a + b;
+    NEXT();
+}
+op_adds_w: {
+    uint64_t a = W(r[op->rn]), b = W(r[op->rm]);
+    SET_FLAGS(FLAGS_ADD, false, a, b, a + b);
+    r[op->rd] = W(a + b);
+    NEXT();
+}
+op_subs_x: {
+    uint64_t a = r[op->rn], b = r[op->rm];
+    SET_FLAGS(FLAGS_SUB, true, a, b, a - b);
+    r[op->rd] = a - b;
+    NEXT();
+}
+op_subs_w: {
+    uint64_t a = W(r[op->rn]), b = W(r[op->rm]);
+    SET_FLAGS(FLAGS_SUB, false, a, b, a - b);
+    r[op->rd] = W(a - b);
+    NEXT();
+}
+
+    // Logical register
+op_and_x:
+    r[op->rd] = r[op->rn] & r[op->rm];
+    NEXT();
+op_and_w:
+    r[op->rd] = W(r[op->rn] & r[op->rm]);
+    NEXT();
+op_ands_x: {
+    uint64_t res = r[op->rn] & r[op->rm];
+    SET_FLAGS(FLAGS_LOGIC, true, 0, 0, res);
+    r[op->rd] = res;
+    NEXT();
+}
+op_ands_w: {
+    uint64_t res = W(r[op->rn] & r[op->rm]);
+    SET_FLAGS(FLAGS_LOGIC, false, 0, 0, res);
+    r[op->rd] = res;
+    NEXT();
+}
+op_orr_x:
+    r[op->rd] = r[op->rn] | r[op->rm];
+    NEXT();
+op_orr_w:
+    r[op->rd] = W(r[op->rn] | r[op->rm]);
+    NEXT();
+op_eor_x:
+    r[op->rd] = r[op->rn] ^ r[op->rm];
+    NEXT();
+op_eor_w:
+    r[op->rd] = W(r[op->rn] ^ r[op->rm]);
+    NEXT();
+op_bic_x:
+    r[op->rd] = r[op->rn] & ~r[op->rm];
+    NEXT();
+op_bic_w:
+    r[op->rd] = W(r[op->rn] & ~r[op->rm]);
+    NEXT();
+op_orn_x:
+    r[op->rd] = r[op->rn] | ~r[op->rm];
+    NEXT();
+op_orn_w:
+    r[op->rd] = W(r[op->rn] | ~r[op->rm]);
+    NEXT();
+
+    // Logical immediate (32-bit immediates have a zero upper half)
+op_and_imm:
+    r[op->rd] = r[op->rn] & op->imm;
+    NEXT();
+op_ands_imm_x: {
+    uint64_t res = r[op->rn] & op->imm;
+    SET_FLAGS(FLAGS_LOGIC, true, 0, 0, res);
+    r[op->rd] = res;
+    NEXT();
+}
+op_ands_imm_w: {
+    uint64_t res = r[op->rn] & op->imm;
+    SET_FLAGS(FLAGS_LOGIC, false, 0, 0, res);
+    r[op->rd] = res;
+    NEXT();
+}
+op_orr_imm_x:
+    r[op->rd] = r[op->rn] | op->imm;
+    NEXT();
+op_orr_imm_w:
+    r[op->rd] = W(r[op->rn] | op->imm);
+    NEXT();
+op_eor_imm_x:
+    r[op->rd] = r[op->rn] ^ op->imm;
+    NEXT();
+op_eor_imm_w:
+    r[op->rd] = W(r[op->rn] ^ op->imm);
+    NEXT();
+
+    // Multiply, divide, shift
+op_madd_x:
+    r[op->rd] = r[op->ra] + r[op->rn] * r[op->rm];
+    NEXT();
+op_madd_w:
+    r[op->rd] = W(r[op->ra] + r[op->rn] * r[op->rm]);
+    NEXT();
+op_udiv_x: {
+    uint64_t d = r[op->rm];
+    r[op->rd] = d ? r[op->rn] / d : 0;
+    NEXT();
+}
+op_udiv_w: {
+    uint32_t d = static_cast<uint32_t>(r[op->rm]);
+    r[op->rd] = d ? static_cast<uint32_t>(r[op->rn]) / d : 0;
+    NEXT();
+}
+op_sdiv_x: {
+    int64_t n = static_cast<int64_t>(r[op->rn]);
+    int64_t d = static_cast<int64_t>(r[op->rm]);
+    r[op->rd] = d == 0 ? 0 : (d == -1 ? 0 - r[op->rn] : static_cast<uint64_t>(n / d));
+    NEXT();
+}
+op_sdiv_w: {
+    int32_t n = static_cast<int32_t>(r[op->rn]);
+    int32_t d = static_cast<int32_t>(r[op->rm]);
+    r[op->rd] = d == 0 ? 0 : W(d == -1 ? 0 - static_cast<uint64_t>(n) : static_cast<uint64_t>(n / d));
+    NEXT();
+}
+op_lsl_x:
+    r[op->rd] = r[op->rn] << (r[op->rm] & 63);
+    NEXT();
+op_lsl_w:
+    r[op->rd] = W(r[op->rn] << (r[op->rm] & 31));
+    NEXT();
+op_lsr_x:
+    r[op->rd] = r[op->rn] >> (r[op->rm] & 63);
+    NEXT();
+op_lsr_w:
+    r[op->rd] = W(r[op->rn]) >> (r[op->rm] & 31);
+    NEXT();
+op_asr_x:
+    r[op->rd] = static_cast<uint64_t>(static_cast<int64_t>(r[op->rn]) >> (r[op->rm] & 63));
+    NEXT();
+op_asr_w:
+    r[op->rd] = W(static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(r[op->rn])) >>
+                                        (r[op->rm] & 31)));
+    NEXT();
+op_ror_x: {
+    uint64_t v = r[op->rn];
+    uint32_t s = r[op->rm] & 63;
+    r[op->rd] = s ? (v >> s) | (v << (64 - s)) : v;
+    NEXT();
+}
+op_ror_w: {
+    uint32_t v = static_cast<uint32_t>(r[op->rn]);
+    uint32_t s = r[op->rm] & 31;
+    r[op->rd] = s ? (v >> s) | (v << (32 - s)) : v;
+    NEXT();
+}
+
+    // Branches
+op_b:
+    JUMP(op->imm);
+op_bl:
+    r[30] = static_cast<uint64_t>(op - ops + 1) * 4;
+    JUMP(op->imm);
+op_b_cond:
+    if (condition_holds(nzcv(), op->arg)) JUMP(op->imm);
+    NEXT();
+op_cbz_x:
+    if (r[op->rn] == 0) JUMP(op->imm);
+    NEXT();
+op_cbz_w:
+    if (W(r[op->rn]) == 0) JUMP(op->imm);
+    NEXT();
+op_cbnz_x:
+    if (r[op->rn] != 0) JUMP(op->imm);
+    NEXT();
+op_cbnz_w:
+    if (W(r[op->rn]) != 0) JUMP(op->imm);
+    NEXT();
+op_tbz:
+    if (!((r[op->rn] >> op->arg) & 1)) JUMP(op->imm);
+    NEXT();
+op_tbnz:
+    if ((r[op->rn] >> op->arg) & 1) JUMP(op->imm);
+    NEXT();
+op_br: {
+    uint64_t t = r[op->rn];
+    JUMP(INDIRECT(t));
+}
+op_blr: {
+    uint64_t t = r[op->rn];
+    r[30] = static_cast<uint64_t>(op - ops + 1) * 4;
+    JUMP(INDIRECT(t));
+}
+
+    // Loads and stores
+op_ldr_x:
+    ADDRESS();
+    r[op->rd] = load_bytes(mem, mem_size, addr, 8);
+    NEXT();
+op_ldr_w:
+    ADDRESS();
+    r[op->rd] = load_bytes(mem, mem_size, addr, 4);
+    NEXT();
+op_ldrh:
+    ADDRESS();
+    r[op->rd] = load_bytes(mem, mem_size, addr, 2);
+    NEXT();
+op_ldrb:
+    ADDRESS();
+    r[op->rd] = load_bytes(mem, mem_size, addr, 1);
+    NEXT();
+op_ldrsw:
+    ADDRESS();
+    r[op->rd] = sign_extend(load_bytes(mem, mem_size, addr, 4), 32);
+    NEXT();
+op_ldrsh_x:
+    ADDRESS();
+    r[op->rd] = sign_extend(load_bytes(mem, mem_size, addr, 2), 16);
+    NEXT();
+op_ldrsh_w:
+    ADDRESS();
+    r[op->rd] = W(sign_extend(load_bytes(mem, mem_size, addr, 2), 16));
+    NEXT();
+op_ldrsb_x:
+    ADDRESS();
+    r[op->rd] = sign_extend(load_bytes(mem, mem_size, addr, 1), 8);
+    NEXT();
+op_ldrsb_w:
+    ADDRESS();
+    r[op->rd] = W(sign_extend(load_bytes(mem, mem_size, addr, 1), 8));
+    NEXT();
+op_str_x:
+    ADDRESS();
+    store_bytes(mem, mem_size, addr, r[op->rd], 8);
+    NEXT();
+op_str_w:
+    ADDRESS();
+    store_bytes(mem, mem_size, addr, r[op->rd], 4);
+    NEXT();
+op_strh:
+    ADDRESS();
+    store_bytes(mem, mem_size, addr, r[op->rd], 2);
+    NEXT();
+op_strb:
+    ADDRESS();
+    store_bytes(mem, mem_size, addr, r[op->rd], 1);
+    NEXT();
+op_ldp_x:
+    ADDRESS();
+    r[op->rd] = load_bytes(mem, mem_size, addr, 8);
+    r[op->rm] = load_bytes(mem, mem_size, addr + 8, 8);
+    NEXT();
+op_ldp_w:
+    ADDRESS();
+    r[op->rd] = load_bytes(mem, mem_size, addr, 4);
+    r[op->rm] = load_bytes(mem, mem_size, addr + 4, 4);
+    NEXT();
+op_stp_x:
+    ADDRESS();
+    store_bytes(mem, mem_size, addr, r[op->rd], 8);
+    store_bytes(mem, mem_size, addr + 8, r[op->rm], 8);
+    NEXT();
+op_stp_w:
+    ADDRESS();
+    store_bytes(mem, mem_size, addr, r[op->rd], 4);
+    store_bytes(mem, mem_size, addr + 4, r[op->rm], 4);
+    NEXT();
+
+out_of_budget:
+    status = VmStatus::BUDGET;
+done:
+    #undef INDIRECT
+    #undef DISPATCH
+    #undef NEXT
+    #undef JUMP
+    #undef W
+    #undef SET_FLAGS
+    #undef ADDRESS
+    pc_ = static_cast<uint64_t>(op - ops) * 4;
+    executed_ += budget - left;
+    return status;
+}
+
+} // namespace casm
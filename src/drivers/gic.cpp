@@ -7,6 +7,7 @@
  */
 
 #include "gic.h"
+#include "spinlock.h"
 #include "uart.h"
 
 namespace gic {
@@ -23,6 +24,10 @@ static inline uint32_t read32(uintptr_t addr) {
 // Number of supported IRQs (detected during init)
 static uint32_t num_irqs = 0;
 
+// Serializes read-modify-write of the shared distributor registers; the
+// set/clear-enable and SGI registers are single writes and need no lock
+static spinlock::Lock dist_lock;
+
 /*
  * Initialize GIC Distributor (GICD)
  * The distributor routes interrupts to CPU interfaces
@@ -88,8 +93,16 @@ static void init_cpu_interface() {
     // Set binary point to 0 (all priority bits used for preemption)
     write32(GICC_BASE + GICC_BPR, 0);
     
+    // This CPU's (banked) SGI and PPI priorities get the SPI default too
+    for (uint32_t i = 0; i < 32; i += 4) {
+        write32(GICD_BASE + GICD_IPRIORITYR + i, 0xA0A0A0A0);
+    }
+    
     // Enable CPU interface (Group 0 and Group 1)
     write32(GICC_BASE + GICC_CTLR, 0x3);
+    
+    // Enable this CPU's (banked) SGIs, used for inter-processor interrupts
+    write32(GICD_BASE + GICD_ISENABLER, 0x0000FFFF);
 }
 
 /*
@@ -108,6 +121,13 @@ void init() {
     uart::puts("[gic] GICv2 initialization complete\n");
 }
 
+/*
+ * Initialize a secondary CPU's interface (the distributor is shared)
+ */
+void init_cpu() {
+    init_cpu_interface();
+}
+
 /*
  * Enable a specific IRQ
  */
@@ -149,6 +169,8 @@ void set_priority(uint32_t irq, uint8_t priority) {
     uint32_t reg_index = irq / 4;
     uint32_t byte_offset = irq % 4;
     
+    uint64_t flags = spinlock::lock_irqsave(&dist_lock);
+    
     // Read current register value
     uint32_t reg = read32(GICD_BASE + GICD_IPRIORITYR + reg_index * 4);
     
@@ -157,6 +179,7 @@ void set_priority(uint32_t irq, uint8_t priority) {
     reg |= (priority << (byte_offset * 8));
     
     write32(GICD_BASE + GICD_IPRIORITYR + reg_index * 4, reg);
+    spinlock::unlock_irqrestore(&dist_lock, flags);
 }
 
 /*
@@ -171,6 +194,8 @@ void set_target(uint32_t irq, uint8_t cpu_mask) {
     uint32_t reg_index = irq / 4;
     uint32_t byte_offset = irq % 4;
     
+    uint64_t flags = spinlock::lock_irqsave(&dist_lock);
+    
     // Read current register value
     uint32_t reg = read32(GICD_BASE + GICD_ITARGETSR + reg_index * 4);
     
@@ -179,21 +204,22 @@ void set_target(uint32_t irq, uint8_t cpu_mask) {
     reg |= (cpu_mask << (byte_offset * 8));
     
     write32(GICD_BASE + GICD_ITARGETSR + reg_index * 4, reg);
+    spinlock::unlock_irqrestore(&dist_lock, flags);
 }
 
 /*
  * Acknowledge an interrupt (read IAR)
- * Returns the IRQ number (1023 = spurious)
+ * Returns the interrupt ID and, for SGIs, the source CPU (bits 12:0)
  */
 uint32_t acknowledge_irq() {
-    return read32(GICC_BASE + GICC_IAR) & 0x3FF;
+    return read32(GICC_BASE + GICC_IAR) & 0x1FFF;
 }
 
 /*
  * Signal end of interrupt (write EOIR)
  */
-void end_irq(uint32_t irq) {
-    write32(GICC_BASE + GICC_EOIR, irq);
+void end_irq(uint32_t iar) {
+    write32(GICC_BASE + GICC_EOIR, iar);
 }
 
 /*
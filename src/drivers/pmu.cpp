@@ -0,0 +1,223 @@
+/*
+ * EmberOS PMU Driver
+ * ARMv8 Performance Monitors: counter setup, overflow IRQ and 64-bit
+ * software extension of the 32-bit event counters
+ *
+ * Event counter n counts EVENT_NUMBERS[n]. An event the CPU does not
+ * implement (PMCEID0_EL0) or for which there is no counter (PMCR_EL0.N)
+ * is left unassigned and reads as 0. Only the owning CPU touches its
+ * counters and high halves, with IRQs masked.
+ */
+
+#include "pmu.h"
+#include "interrupts.h"
+#include "smp.h"
+#include "uart.h"
+
+namespace pmu {
+
+// Architectural event numbers, indexed by Event
+static const uint32_t EVENT_NUMBERS[NUM_EVENTS] = {
+    0x08,   // INST_RETIRED
+    0x04,   // L1D_CACHE
+    0x03,   // L1D_CACHE_REFILL
+    0x17,   // L2D_CACHE_REFILL
+    0x10,   // BR_MIS_PRED
+    0x09,   // EXC_TAKEN
+};
+
+static const char* const EVENT_NAMES[NUM_EVENTS] = {
+    "instructions",
+    "L1D accesses",
+    "L1D refills",
+    "L2D refills",
+    "branch misses",
+    "exceptions taken",
+};
+
+// PMCR_EL0 bits
+constexpr uint64_t PMCR_E = 1 << 0;         // Enable all counters
+constexpr uint64_t PMCR_P = 1 << 1;         // Reset event counters
+constexpr uint64_t PMCR_C = 1 << 2;         // Reset cycle counter
+constexpr uint64_t PMCR_LC = 1 << 6;        // Cycle counter overflows at 64 bits
+
+// Cycle counter bit in PMCNTENSET_EL0
+constexpr uint64_t CYCLE_COUNTER = 1u << 31;
+
+// ============================================================================
+// Global State
+// ============================================================================
+
+static bool g_available = false;
+static uint32_t g_supported = 0;            // Bit per Event counted
+
+// Software high halves of the event counters
+static uint64_t g_high[smp::MAX_CPUS][NUM_EVENTS];
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+// Select event counter index for the PMXEV* registers
+static inline void select_counter(uint32_t index) {
+    asm volatile("msr pmselr_el0, %0\n\tisb" :: "r"((uint64_t)index) : "memory");
+}
+
+static inline uint64_t read_overflows() {
+    uint64_t ovs;
+    asm volatile("mrs %0, pmovsset_el0" : "=r"(ovs));
+    return ovs;
+}
+
+static inline uint32_t read_selected() {
+    uint64_t value;
+    asm volatile("mrs %0, pmxevcntr_el0" : "=r"(value));
+    return static_cast<uint32_t>(value);
+}
+
+/*
+ * PMU overflow interrupt: carry each wrapped counter into its high half
+ */
+static void pmu_irq_handler(uint32_t irq) {
+    (void)irq;
+    uint64_t flags = interrupts::save_and_disable();
+    uint64_t ovs = read_overflows() & g_supported;
+    asm volatile("msr pmovsclr_el0, %0\n\tisb" :: "r"(ovs) : "memory");
+    
+    uint64_t* high = g_high[smp::cpu_id()];
+    for (uint32_t i = 0; i < NUM_EVENTS; i++) {
+        if (ovs & (1u << i)) {
+            high[i] += 1ull << 32;
+        }
+    }
+    interrupts::restore(flags);
+}
+
+/*
+ * Program and start the calling CPU's counters
+ */
+static void start_counters() {
+    uint64_t all = CYCLE_COUNTER | g_supported;
+    
+    // Stop and clear everything, then assign the events
+    asm volatile("msr pmcntenclr_el0, %0" :: "r"(~0ull));
+    asm volatile("msr pmintenclr_el1, %0" :: "r"(~0ull));
+    asm volatile("msr pmovsclr_el0, %0" :: "r"(~0ull));
+    asm volatile("msr pmuserenr_el0, xzr");
+    for (uint32_t i = 0; i < NUM_EVENTS; i++) {
+        if (g_supported & (1u << i)) {
+            select_counter(i);
+            // Filter bits clear: count at EL0 and EL1
+            asm volatile("msr pmxevtyper_el0, %0" :: "r"((uint64_t)EVENT_NUMBERS[i]));
+        }
+    }
+    asm volatile("msr pmccfiltr_el0, xzr");
+    
+    uint64_t* high = g_high[smp::cpu_id()];
+    for (uint32_t i = 0; i < NUM_EVENTS; i++) {
+        high[i] = 0;
+    }
+    
+    asm volatile("msr pmcr_el0, %0\n\tisb" :: "r"(PMCR_E | PMCR_P | PMCR_C | PMCR_LC));
+    asm volatile("msr pmintenset_el1, %0" :: "r"((uint64_t)g_supported));
+    asm volatile("msr pmcntenset_el0, %0\n\tisb" :: "r"(all) : "memory");
+    
+    // The overflow PPI is banked: each CPU enables its own
+    interrupts::enable_irq(interrupts::IRQ_PMU);
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void init() {
+    // ID_AA64DFR0_EL1.PMUVer: 0 = none, 0xF = not the architected PMU
+    uint64_t dfr0;
+    asm volatile("mrs %0, id_aa64dfr0_el1" : "=r"(dfr0));
+    uint32_t version = (dfr0 >> 8) & 0xF;
+    if (version == 0 || version == 0xF) {
+        uart::puts("[pmu] No PMU; perf stat is unavailable\n");
+        return;
+    }
+    
+    uint64_t pmcr, ceid0;
+    asm volatile("mrs %0, pmcr_el0" : "=r"(pmcr));
+    asm volatile("mrs %0, pmceid0_el0" : "=r"(ceid0));
+    uint32_t counters = (pmcr >> 11) & 0x1F;
+    
+    // Events the CPU implements, on the counters it has
+    g_supported = 0;
+    for (uint32_t i = 0; i < NUM_EVENTS && i < counters; i++) {
+        if (ceid0 & (1ull << EVENT_NUMBERS[i])) {
+            g_supported |= 1u << i;
+        }
+    }
+    g_available = true;
+    
+    interrupts::register_handler(interrupts::IRQ_PMU, pmu_irq_handler);
+    start_counters();
+    
+    uint32_t events = 0;
+    for (uint32_t i = 0; i < NUM_EVENTS; i++) {
+        if (g_supported & (1u << i)) events++;
+    }
+    uart::printf("[pmu] PMUv3: %d counters, %d of %d events supported\n",
+                 (int)counters, (int)events, (int)NUM_EVENTS);
+}
+
+void init_cpu() {
+    if (g_available) {
+        start_counters();
+    }
+}
+
+bool available() {
+    return g_available;
+}
+
+bool supported(Event event) {
+    uint32_t index = static_cast<uint32_t>(event);
+    return g_available && index < NUM_EVENTS && (g_supported & (1u << index));
+}
+
+const char* event_name(Event event) {
+    uint32_t index = static_cast<uint32_t>(event);
+    return index < NUM_EVENTS ? EVENT_NAMES[index] : "?";
+}
+
+void sample(Counts* counts) {
+    counts->cycles = 0;
+    for (uint32_t i = 0; i < NUM_EVENTS; i++) {
+        counts->events[i] = 0;
+    }
+    if (!g_available) return;
+    
+    uint64_t flags = interrupts::save_and_disable();
+    asm volatile("isb; mrs %0, pmccntr_el0" : "=r"(counts->cycles));
+    
+    const uint64_t* high = g_high[smp::cpu_id()];
+    for (uint32_t i = 0; i < NUM_EVENTS; i++) {
+        if (!(g_supported & (1u << i))) continue;
+        select_counter(i);
+        uint32_t low = read_selected();
+        uint64_t value = high[i] + low;
+        if (read_overflows() & (1u << i)) {
+            // Wrapped, before or just after the read, and not carried yet
+            // by the (masked) IRQ; a second read is past the wrap
+            value = high[i] + (1ull << 32) + read_selected();
+        }
+        counts->events[i] = value;
+    }
+    interrupts::restore(flags);
+}
+
+void since(const Counts* start, Counts* delta) {
+    Counts now;
+    sample(&now);
+    delta->cycles = now.cycles - start->cycles;
+    for (uint32_t i = 0; i < NUM_EVENTS; i++) {
+        delta->events[i] = now.events[i] - start->events[i];
+    }
+}
+
+} // namespace pmu
@@ -10,32 +10,68 @@
  * - CNTP_TVAL_EL0: Timer value (countdown)
  * - CNTP_CTL_EL0: Timer control register
  * - CNTP_CVAL_EL0: Timer compare value
+ * 
+ * Pending timers live in a fixed table and are ordered by a binary
+ * min-heap of table indices, so arming, cancelling and expiring are
+ * O(log n). Every change to the head of the heap reprograms CNTP_CVAL_EL0
+ * with the earliest absolute deadline; the interrupt handler runs every
+ * timer that is due, puts periodic ones back with their next deadline,
+ * and reprograms the comparator once.
+ * 
+ * Each CPU has its own comparator, so each has its own table and heap,
+ * guarded by a spinlock with IRQs masked. A timer is armed on the calling
+ * CPU and fires there; the id records which queue it is on, so any CPU
+ * can cancel it. Cancelling another CPU's earliest timer leaves that
+ * comparator early: it fires, finds nothing due and is reprogrammed.
+ * Handlers run with the lock dropped, so they may arm and cancel timers.
+ * The timer IRQ is preemptible (interrupts.h): its handler and callbacks
+ * run with IRQs unmasked, and the lock masks them while it is held.
  */
 
 #include "timer.h"
 #include "uart.h"
 #include "interrupts.h"
+#include "smp.h"
+#include "spinlock.h"
 
 namespace timer {
 
 // Timer state
 static uint64_t timer_frequency = 0;      // Timer frequency in Hz
 static uint64_t init_ticks = 0;           // Tick count at initialization
-static uint64_t tick_interval = 0;        // Ticks per timer interrupt
-static volatile uint64_t interrupt_count = 0;  // Debug: count timer interrupts
-
-// Default timer interrupt interval (10ms for 100Hz tick rate)
-constexpr uint64_t DEFAULT_INTERVAL_MS = 10;
-
-// Callback registration
-struct CallbackEntry {
-    Callback callback;
-    uint64_t interval_ms;
-    uint64_t last_called_ms;
-    bool active;
+
+// Timer table entry; a slot is free when it is not in the heap
+struct TimerEntry {
+    uint64_t deadline;          // Counter value to fire at
+    uint64_t period;            // Ticks between runs, 0 for a one-shot
+    Handler handler;
+    void* arg;
+    Callback callback;          // Set for register_callback() timers
+    uint32_t generation;        // Bumped on each use so stale ids miss
+    int heap_index;             // Position in heap[], -1 if free
 };
 
-static CallbackEntry callbacks[MAX_CALLBACKS] = {};
+// One CPU's pending timers
+struct TimerQueue {
+    TimerEntry timers[MAX_TIMERS];
+    int heap[MAX_TIMERS];
+    size_t heap_size;
+    spinlock::Lock lock;
+    volatile uint64_t interrupt_count;      // Debug: count timer interrupts
+};
+
+static TimerQueue queues[smp::MAX_CPUS] = {};
+
+// Timer ids are the slot index, the CPU above it, then the slot's generation
+constexpr int ID_SLOT_BITS = 5;
+constexpr int ID_CPU_BITS = 3;
+constexpr uint32_t ID_GENERATION_MASK = (1u << (31 - ID_SLOT_BITS - ID_CPU_BITS)) - 1;
+static_assert(MAX_TIMERS <= (1u << ID_SLOT_BITS), "timer ids need more slot bits");
+static_assert(smp::MAX_CPUS <= (1u << ID_CPU_BITS), "timer ids need more CPU bits");
+
+static inline TimerQueue* local_queue() {
+    return &queues[smp::cpu_id()];
+}
 
 /*
  * ARM Generic Timer Control Register bits (CNTP_CTL_EL0)
@@ -62,15 +98,6 @@ static inline uint64_t read_cntfrq() {
     return val;
 }
 
-/*
- * Read timer control register (CNTP_CTL_EL0)
- */
-static inline uint64_t read_cntp_ctl() {
-    uint64_t val;
-    asm volatile("mrs %0, cntp_ctl_el0" : "=r"(val));
-    return val;
-}
-
 /*
  * Write timer control register (CNTP_CTL_EL0)
  */
@@ -79,22 +106,123 @@ static inline void write_cntp_ctl(uint64_t val) {
 }
 
 /*
- * Write timer value register (CNTP_TVAL_EL0)
- * This sets a countdown value; when it reaches 0, an interrupt fires
+ * Write timer compare value register (CNTP_CVAL_EL0)
+ * The interrupt condition holds while CNTPCT_EL0 >= CVAL
  */
-static inline void write_cntp_tval(uint64_t val) {
-    asm volatile("msr cntp_tval_el0, %0" :: "r"(val));
+static inline void write_cntp_cval(uint64_t val) {
+    asm volatile("msr cntp_cval_el0, %0" :: "r"(val));
 }
 
-/*
- * Read timer value register (CNTP_TVAL_EL0)
- */
-static inline uint64_t read_cntp_tval() {
+static inline uint64_t read_cntp_cval() {
     uint64_t val;
-    asm volatile("mrs %0, cntp_tval_el0" : "=r"(val));
+    asm volatile("mrs %0, cntp_cval_el0" : "=r"(val));
     return val;
 }
 
+// ============================================================================
+// Timer Heap
+// ============================================================================
+
+static inline bool earlier(TimerQueue* q, int a, int b) {
+    return q->timers[q->heap[a]].deadline < q->timers[q->heap[b]].deadline;
+}
+
+static inline void heap_swap(TimerQueue* q, int a, int b) {
+    int slot = q->heap[a];
+    q->heap[a] = q->heap[b];
+    q->heap[b] = slot;
+    q->timers[q->heap[a]].heap_index = a;
+    q->timers[q->heap[b]].heap_index = b;
+}
+
+static void sift_up(TimerQueue* q, int pos) {
+    while (pos > 0 && earlier(q, pos, (pos - 1) / 2)) {
+        heap_swap(q, pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+}
+
+static void sift_down(TimerQueue* q, int pos) {
+    int size = static_cast<int>(q->heap_size);
+    while (true) {
+        int child = 2 * pos + 1;
+        if (child >= size) break;
+        if (child + 1 < size && earlier(q, child + 1, child)) child++;
+        if (!earlier(q, child, pos)) break;
+        heap_swap(q, pos, child);
+        pos = child;
+    }
+}
+
+static void heap_insert(TimerQueue* q, int slot) {
+    int pos = static_cast<int>(q->heap_size++);
+    q->heap[pos] = slot;
+    q->timers[slot].heap_index = pos;
+    sift_up(q, pos);
+}
+
+static void heap_remove(TimerQueue* q, int pos) {
+    int last = static_cast<int>(--q->heap_size);
+    q->timers[q->heap[pos]].heap_index = -1;
+    if (pos != last) {
+        q->heap[pos] = q->heap[last];
+        q->timers[q->heap[pos]].heap_index = pos;
+        sift_up(q, pos);
+        sift_down(q, q->timers[q->heap[pos]].heap_index);
+    }
+}
+
+// Point this CPU's comparator at the earliest deadline, or mask it if none
+static void program_next(TimerQueue* q) {
+    if (q->heap_size == 0) {
+        write_cntp_ctl(CNTP_CTL_ENABLE | CNTP_CTL_IMASK);
+        return;
+    }
+    write_cntp_cval(q->timers[q->heap[0]].deadline);
+    write_cntp_ctl(CNTP_CTL_ENABLE);
+}
+
+static inline uint64_t us_to_ticks(uint64_t us) {
+    return (us / 1000000) * timer_frequency + ((us % 1000000) * timer_frequency) / 1000000;
+}
+
+// Claim a free slot on this CPU's queue and queue it; returns its id or
+// -1 (lock held)
+static int arm(TimerQueue* q, uint64_t deadline, uint64_t period, Handler handler, void* arg,
+               Callback cb) {
+    uint32_t cpu = static_cast<uint32_t>(q - queues);
+    for (size_t i = 0; i < MAX_TIMERS; i++) {
+        TimerEntry* t = &q->timers[i];
+        if (t->heap_index >= 0) continue;
+    
+        t->deadline = deadline;
+        t->period = period;
+        t->handler = handler;
+        t->arg = arg;
+        t->callback = cb;
+        t->generation = (t->generation + 1) & ID_GENERATION_MASK;
+    
+        bool was_first = q->heap_size == 0 || deadline < q->timers[q->heap[0]].deadline;
+        heap_insert(q, static_cast<int>(i));
+        if (was_first) {
+            program_next(q);
+        }
+        return static_cast<int>((t->generation << (ID_SLOT_BITS + ID_CPU_BITS)) |
+                                (cpu << ID_SLOT_BITS) | i);
+    }
+    return -1;
+}
+
+// Dequeue a pending timer, reprogramming if it was the next to fire; only
+// the owning CPU can reprogram its comparator (lock held)
+static void disarm(TimerQueue* q, TimerEntry* t) {
+    bool was_first = t->heap_index == 0;
+    heap_remove(q, t->heap_index);
+    if (was_first && q == local_queue()) {
+        program_next(q);
+    }
+}
+
 /*
  * Timer interrupt handler
  * Called from the interrupt subsystem when timer IRQ fires
@@ -102,27 +230,44 @@ static inline uint64_t read_cntp_tval() {
  */
 static void timer_irq_handler(uint32_t irq) {
     (void)irq;  // IRQ number not needed
+    TimerQueue* q = local_queue();
     
     // Increment interrupt counter for debugging
-    interrupt_count++;
-    
-    // Acknowledge the timer interrupt by setting the next timeout
-    // This clears the interrupt condition
-    write_cntp_tval(tick_interval);
+    q->interrupt_count = q->interrupt_count + 1;
     
-    // Get current uptime for callback scheduling
-    uint64_t current_ms = get_uptime_ms();
+    uint64_t now = read_cntpct();
+    uint64_t flags = spinlock::lock_irqsave(&q->lock);
+    while (q->heap_size > 0 && q->timers[q->heap[0]].deadline <= now) {
+        int slot = q->heap[0];
+        TimerEntry* t = &q->timers[slot];
     
-    // Invoke registered callbacks if their interval has elapsed
-    for (size_t i = 0; i < MAX_CALLBACKS; i++) {
-        if (callbacks[i].active && callbacks[i].callback != nullptr) {
-            uint64_t elapsed = current_ms - callbacks[i].last_called_ms;
-            if (elapsed >= callbacks[i].interval_ms) {
-                callbacks[i].callback();
-                callbacks[i].last_called_ms = current_ms;
+        // Take the entry off (or requeue it) before the call, so a
+        // handler may cancel it or arm new timers in its slot
+        Handler handler = t->handler;
+        void* arg = t->arg;
+        Callback callback = t->callback;
+        heap_remove(q, 0);
+        if (t->period) {
+            // A periodic timer that fell behind skips the missed runs
+            t->deadline += t->period;
+            if (t->deadline <= now) {
+                t->deadline = now + t->period;
             }
+            heap_insert(q, slot);
         }
+    
+        spinlock::unlock_irqrestore(&q->lock, flags);
+        if (callback) {
+            callback();
+        } else {
+            handler(arg);
+        }
+        flags = spinlock::lock_irqsave(&q->lock);
     }
+    
+    // Acknowledge by moving the comparator past now (or masking it)
+    program_next(q);
+    spinlock::unlock_irqrestore(&q->lock, flags);
 }
 
 /*
@@ -139,37 +284,39 @@ void init() {
     // Record initial tick count
     init_ticks = read_cntpct();
     
-    // Calculate tick interval for default interrupt rate
-    tick_interval = (timer_frequency * DEFAULT_INTERVAL_MS) / 1000;
-    uart::printf("[timer] Tick interval: %d ticks (%d ms)\n", 
-                 (uint32_t)tick_interval, (uint32_t)DEFAULT_INTERVAL_MS);
-    
-    // Initialize callback table
-    for (size_t i = 0; i < MAX_CALLBACKS; i++) {
-        callbacks[i].callback = nullptr;
-        callbacks[i].interval_ms = 0;
-        callbacks[i].last_called_ms = 0;
-        callbacks[i].active = false;
+    // Initialize every CPU's timer table
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        TimerQueue* q = &queues[cpu];
+        for (size_t i = 0; i < MAX_TIMERS; i++) {
+            q->timers[i].heap_index = -1;
+            q->timers[i].generation = 0;
+        }
+        q->heap_size = 0;
+        q->interrupt_count = 0;
     }
     
     // Register timer interrupt handler
     // IRQ 30 is the non-secure physical timer (PPI) on QEMU virt
     interrupts::register_handler(interrupts::IRQ_TIMER, timer_irq_handler);
+    interrupts::set_priority(interrupts::IRQ_TIMER, interrupts::PRIORITY_NORMAL);
     
     // Enable timer IRQ in GIC
     interrupts::enable_irq(interrupts::IRQ_TIMER);
     
-    // Configure and enable the timer
-    // First, disable the timer while configuring
-    write_cntp_ctl(0);
-    
-    // Set the timer value (countdown)
-    write_cntp_tval(tick_interval);
+    // Enable the timer with its interrupt masked until a timer is armed
+    write_cntp_ctl(CNTP_CTL_ENABLE | CNTP_CTL_IMASK);
     
-    // Enable the timer with interrupts unmasked
-    write_cntp_ctl(CNTP_CTL_ENABLE);
-    
-    uart::puts("[timer] Timer initialized and running\n");
+    uart::printf("[timer] Tickless: %d timers max per CPU, fired at their deadlines\n",
+                 (int)MAX_TIMERS);
+}
+
+/*
+ * Start the timer on a secondary CPU
+ */
+void init_cpu() {
+    // The timer PPI is banked: each CPU enables its own
+    interrupts::enable_irq(interrupts::IRQ_TIMER);
+    write_cntp_ctl(CNTP_CTL_ENABLE | CNTP_CTL_IMASK);
 }
 
 /*
@@ -180,6 +327,13 @@ uint64_t get_ticks() {
     return read_cntpct();
 }
 
+/*
+ * Get the calling CPU's compare value
+ */
+uint64_t get_compare() {
+    return read_cntp_cval();
+}
+
 /*
  * Get timer frequency in Hz
  */
@@ -211,22 +365,51 @@ uint64_t get_uptime_ms() {
 }
 
 /*
- * Set timer to fire after specified milliseconds
+ * Arm a one-shot timer relative to now
  * Requirements: 9.3
  */
-void set_timeout(uint64_t ms) {
-    if (timer_frequency == 0) {
-        return;
+int add_oneshot(uint64_t delay_us, Handler handler, void* arg) {
+    return add_oneshot_at(read_cntpct() + us_to_ticks(delay_us), handler, arg);
+}
+
+/*
+ * Arm a one-shot timer at an absolute counter value
+ */
+int add_oneshot_at(uint64_t deadline, Handler handler, void* arg) {
+    if (handler == nullptr) {
+        return -1;
     }
     
-    // Calculate ticks for the timeout
-    uint64_t ticks = (timer_frequency * ms) / 1000;
-    
-    // Update the tick interval for future interrupts
-    tick_interval = ticks;
+    TimerQueue* q = local_queue();
+    uint64_t flags = spinlock::lock_irqsave(&q->lock);
+    int id = arm(q, deadline, 0, handler, arg, nullptr);
+    spinlock::unlock_irqrestore(&q->lock, flags);
+    return id;
+}
+
+/*
+ * Cancel a pending timer
+ */
+bool cancel(int id) {
+    if (id < 0) {
+        return false;
+    }
+    size_t slot = static_cast<size_t>(id) & ((1u << ID_SLOT_BITS) - 1);
+    uint32_t cpu = (static_cast<uint32_t>(id) >> ID_SLOT_BITS) & ((1u << ID_CPU_BITS) - 1);
+    uint32_t generation = static_cast<uint32_t>(id) >> (ID_SLOT_BITS + ID_CPU_BITS);
+    if (slot >= MAX_TIMERS || cpu >= smp::MAX_CPUS) {
+        return false;
+    }
     
-    // Set the timer value
-    write_cntp_tval(ticks);
+    TimerQueue* q = &queues[cpu];
+    uint64_t flags = spinlock::lock_irqsave(&q->lock);
+    TimerEntry* t = &q->timers[slot];
+    bool pending = t->heap_index >= 0 && t->generation == generation;
+    if (pending) {
+        disarm(q, t);
+    }
+    spinlock::unlock_irqrestore(&q->lock, flags);
+    return pending;
 }
 
 /*
@@ -238,35 +421,30 @@ bool register_callback(Callback cb, uint64_t interval_ms) {
         return false;
     }
     
-    // Find an empty slot
-    for (size_t i = 0; i < MAX_CALLBACKS; i++) {
-        if (!callbacks[i].active) {
-            callbacks[i].callback = cb;
-            callbacks[i].interval_ms = interval_ms;
-            callbacks[i].last_called_ms = get_uptime_ms();
-            callbacks[i].active = true;
-            return true;
-        }
-    }
-    
-    // No empty slots available
-    return false;
+    uint64_t period = us_to_ticks(interval_ms * 1000);
+    TimerQueue* q = local_queue();
+    uint64_t flags = spinlock::lock_irqsave(&q->lock);
+    int id = arm(q, read_cntpct() + period, period, nullptr, nullptr, cb);
+    spinlock::unlock_irqrestore(&q->lock, flags);
+    return id >= 0;
 }
 
 /*
  * Unregister a timer callback
  */
 bool unregister_callback(Callback cb) {
-    for (size_t i = 0; i < MAX_CALLBACKS; i++) {
-        if (callbacks[i].active && callbacks[i].callback == cb) {
-            callbacks[i].callback = nullptr;
-            callbacks[i].interval_ms = 0;
-            callbacks[i].last_called_ms = 0;
-            callbacks[i].active = false;
-            return true;
+    TimerQueue* q = local_queue();
+    uint64_t flags = spinlock::lock_irqsave(&q->lock);
+    bool found = false;
+    for (size_t i = 0; i < MAX_TIMERS && !found; i++) {
+        TimerEntry* t = &q->timers[i];
+        if (t->heap_index >= 0 && t->callback == cb) {
+            disarm(q, t);
+            found = true;
         }
     }
-    return false;
+    spinlock::unlock_irqrestore(&q->lock, flags);
+    return found;
 }
 
 /*
@@ -284,7 +462,22 @@ void sleep_ms(uint64_t ms) {
  * Get timer interrupt count (for debugging/verification)
  */
 uint64_t get_interrupt_count() {
-    return interrupt_count;
+    uint64_t total = 0;
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        total += queues[cpu].interrupt_count;
+    }
+    return total;
+}
+
+/*
+ * Number of timers currently pending, on all CPUs
+ */
+size_t pending_count() {
+    size_t total = 0;
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        total += queues[cpu].heap_size;
+    }
+    return total;
 }
 
 } // namespace timer
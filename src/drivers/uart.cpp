@@ -3,9 +3,28 @@
  * PL011 UART for QEMU virt machine
  * 
  * Requirements: 4.1, 4.2, 4.3, 4.4
+ * 
+ * The driver starts polled. After enable_interrupts() received bytes are
+ * moved from the RX FIFO into a ring by the IRQ handler, and output is
+ * queued in a TX ring that the handler drains as the FIFO empties.
+ * Ring state is only touched with IRQs masked and the ring lock held.
+ * The UART interrupt is routed to CPU 0 only, so where other CPUs would
+ * wait for it they sleep a millisecond and poll instead.
+ * 
+ * Output coalescing: queued bytes are pushed to the FIFO in bursts when a
+ * newline is written, when a FIFO's worth is queued, from a one-shot
+ * timer armed when a partial line is left queued, or before getc()
+ * blocks. A burst writes up to a full FIFO
+ * after a single FR read. Code running with IRQs masked (SVC handlers,
+ * timer callbacks) still queues; it only spins if the ring is full.
  */
 
 #include "uart.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "sched.h"
+#include "smp.h"
+#include "spinlock.h"
 
 // Signed type definitions
 using int64_t = long long;
@@ -28,7 +47,10 @@ constexpr uint32_t UART_IBRD = 0x24;  // Integer Baud Rate Divisor
 constexpr uint32_t UART_FBRD = 0x28;  // Fractional Baud Rate Divisor
 constexpr uint32_t UART_LCR  = 0x2C;  // Line Control Register
 constexpr uint32_t UART_CR   = 0x30;  // Control Register
+constexpr uint32_t UART_IFLS = 0x34;  // Interrupt FIFO Level Select
 constexpr uint32_t UART_IMSC = 0x38;  // Interrupt Mask Set/Clear
+constexpr uint32_t UART_MIS  = 0x40;  // Masked Interrupt Status
+constexpr uint32_t UART_ICR  = 0x44;  // Interrupt Clear
 
 // Flag Register bits
 constexpr uint32_t FR_RXFE = (1 << 4);  // Receive FIFO empty
@@ -45,6 +67,40 @@ constexpr uint32_t CR_UARTEN = (1 << 0);  // UART enable
 constexpr uint32_t CR_TXE    = (1 << 8);  // Transmit enable
 constexpr uint32_t CR_RXE    = (1 << 9);  // Receive enable
 
+// Data Register error bits
+constexpr uint32_t DR_FE = (1 << 8);   // Framing error
+constexpr uint32_t DR_PE = (1 << 9);   // Parity error
+constexpr uint32_t DR_BE = (1 << 10);  // Break error
+constexpr uint32_t DR_OE = (1 << 11);  // Overrun error
+
+// Interrupt bits (IMSC/MIS/ICR)
+constexpr uint32_t INT_RX  = (1 << 4);   // RX FIFO level
+constexpr uint32_t INT_TX  = (1 << 5);   // TX FIFO level
+constexpr uint32_t INT_RT  = (1 << 6);   // RX timeout
+constexpr uint32_t INT_FE  = (1 << 7);
+constexpr uint32_t INT_PE  = (1 << 8);
+constexpr uint32_t INT_BE  = (1 << 9);
+constexpr uint32_t INT_OE  = (1 << 10);
+constexpr uint32_t INT_ALL = 0x7FF;
+constexpr uint32_t INT_RX_MASK = INT_RX | INT_RT | INT_FE | INT_PE | INT_BE | INT_OE;
+
+// FIFO trigger levels: RX at 1/2 full, TX at 1/8 full
+constexpr uint32_t IFLS_RX_HALF = (2 << 3);
+constexpr uint32_t IFLS_TX_EIGHTH = 0;
+
+static_assert((RX_RING_SIZE & (RX_RING_SIZE - 1)) == 0, "RX_RING_SIZE must be a power of two");
+static_assert((TX_RING_SIZE & (TX_RING_SIZE - 1)) == 0, "TX_RING_SIZE must be a power of two");
+
+// DAIF.I (IRQ mask) bit
+constexpr uint64_t DAIF_I = (1 << 7);
+
+// PL011 FIFO depth, and the queue level that triggers an immediate burst
+constexpr uint32_t TX_FIFO_DEPTH = 32;
+constexpr uint32_t TX_KICK_LEVEL = TX_FIFO_DEPTH;
+
+// Longest a partial line waits in the ring before it is pushed out
+constexpr uint64_t FLUSH_DELAY_US = 10000;
+
 // Helper functions for register access
 static inline void write_reg(uint32_t offset, uint32_t value) {
     volatile uint32_t* reg = reinterpret_cast<volatile uint32_t*>(UART_BASE + offset);
@@ -56,6 +112,165 @@ static inline uint32_t read_reg(uint32_t offset) {
     return *reg;
 }
 
+// ============================================================================
+// Ring Buffers
+// ============================================================================
+
+// Indices are free-running; masked on access
+static char rx_ring[RX_RING_SIZE];
+static char tx_ring[TX_RING_SIZE];
+static volatile uint32_t rx_head = 0;  // Next write (IRQ handler)
+static volatile uint32_t rx_tail = 0;  // Next read (getc)
+static volatile uint32_t tx_head = 0;  // Next write (putc)
+static volatile uint32_t tx_tail = 0;  // Next read (IRQ handler)
+
+static bool irq_mode = false;
+static bool tx_irq_enabled = false;
+static bool coalescing = true;
+static bool flush_armed = false;        // Flush one-shot pending
+static Stats stats = {};
+
+static spinlock::Lock ring_lock;
+
+// Mask IRQs and take the ring lock, returning the previous DAIF value
+static inline uint64_t lock_rings() {
+    return spinlock::lock_irqsave(&ring_lock);
+}
+
+static inline void unlock_rings(uint64_t flags) {
+    spinlock::unlock_irqrestore(&ring_lock, flags);
+}
+
+// Drop the lock until an interrupt may have changed the rings, then
+// retake it. IRQs stay masked up to the wait so none is missed
+static uint64_t wait_unlocked(uint64_t flags) {
+    spinlock::unlock(&ring_lock);
+    if (smp::cpu_id() == 0) {
+        sched::wait_for_interrupt();
+        interrupts::restore(flags);
+    } else {
+        interrupts::restore(flags);
+        sched::sleep_ms(1);
+    }
+    return lock_rings();
+}
+
+static inline uint32_t rx_count() { return rx_head - rx_tail; }
+static inline uint32_t tx_count() { return tx_head - tx_tail; }
+
+// Move everything in the RX FIFO into the RX ring (IRQs masked)
+static void rx_drain_fifo() {
+    while (!(read_reg(UART_FR) & FR_RXFE)) {
+        uint32_t dr = read_reg(UART_DR);
+        stats.rx_bytes++;
+        if (dr & DR_OE) stats.rx_fifo_overruns++;
+        if (dr & (DR_FE | DR_PE | DR_BE)) stats.rx_errors++;
+        
+        if (rx_count() >= RX_RING_SIZE) {
+            stats.rx_overflows++;
+            continue;
+        }
+        rx_ring[rx_head & (RX_RING_SIZE - 1)] = static_cast<char>(dr & 0xFF);
+        rx_head = rx_head + 1;
+        if (rx_count() > stats.rx_peak) stats.rx_peak = rx_count();
+    }
+}
+
+// Move queued output into the TX FIFO until it is full (IRQs masked)
+// An empty FIFO takes a whole burst without re-reading FR per byte
+static void tx_fill_fifo() {
+    while (tx_count() > 0) {
+        uint32_t fr = read_reg(UART_FR);
+        if (fr & FR_TXFF) break;
+        
+        uint32_t burst = (fr & FR_TXFE) ? TX_FIFO_DEPTH : 1;
+        if (burst > tx_count()) burst = tx_count();
+        for (uint32_t i = 0; i < burst; i++) {
+            write_reg(UART_DR, static_cast<uint8_t>(tx_ring[tx_tail & (TX_RING_SIZE - 1)]));
+            tx_tail = tx_tail + 1;
+        }
+        stats.tx_bytes += burst;
+    }
+}
+
+// Write directly to the FIFO without waiting (polled mode)
+static size_t fifo_write(const char* buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        uint32_t fr = read_reg(UART_FR);
+        if (fr & FR_TXFF) break;
+        
+        size_t burst = (fr & FR_TXFE) ? TX_FIFO_DEPTH : 1;
+        if (burst > len - done) burst = len - done;
+        for (size_t i = 0; i < burst; i++) {
+            write_reg(UART_DR, static_cast<uint8_t>(buf[done + i]));
+        }
+        done += burst;
+    }
+    stats.tx_bytes += done;
+    return done;
+}
+
+// Copy as much as fits into the TX ring (IRQs masked)
+static size_t tx_enqueue(const char* buf, size_t len) {
+    size_t space = TX_RING_SIZE - tx_count();
+    size_t n = (len < space) ? len : space;
+    for (size_t i = 0; i < n; i++) {
+        tx_ring[(tx_head + i) & (TX_RING_SIZE - 1)] = buf[i];
+    }
+    tx_head = tx_head + static_cast<uint32_t>(n);
+    if (tx_count() > stats.tx_peak) stats.tx_peak = tx_count();
+    return n;
+}
+
+static void set_tx_irq(bool enable) {
+    if (enable == tx_irq_enabled) return;
+    tx_irq_enabled = enable;
+    uint32_t imsc = read_reg(UART_IMSC);
+    write_reg(UART_IMSC, enable ? (imsc | INT_TX) : (imsc & ~INT_TX));
+}
+
+/*
+ * UART interrupt handler
+ * Drains the RX FIFO into the ring and refills the TX FIFO from the ring
+ */
+static void uart_irq_handler(uint32_t irq) {
+    (void)irq;
+    spinlock::lock(&ring_lock);
+    stats.irq_count++;
+    
+    uint32_t mis = read_reg(UART_MIS);
+    
+    if (mis & INT_RX_MASK) {
+        rx_drain_fifo();
+    }
+    
+    if (mis & INT_TX) {
+        tx_fill_fifo();
+        if (tx_count() == 0) {
+            set_tx_irq(false);
+        }
+    }
+    
+    write_reg(UART_ICR, mis);
+    spinlock::unlock(&ring_lock);
+}
+
+// Start transmitting queued output (IRQs masked)
+static void tx_kick() {
+    tx_fill_fifo();
+    set_tx_irq(tx_count() > 0);
+}
+
+// Coalescing timer: push out a partial line left in the ring
+static void flush_expired(void* arg) {
+    (void)arg;
+    uint64_t flags = lock_rings();
+    flush_armed = false;
+    tx_kick();
+    unlock_rings(flags);
+}
+
 
 /*
  * Initialize UART hardware
@@ -82,17 +297,162 @@ void init() {
 }
 
 /*
- * Write a single character to the console
+ * Switch to interrupt-driven operation
+ */
+void enable_interrupts() {
+    write_reg(UART_ICR, INT_ALL);
+    write_reg(UART_IFLS, IFLS_RX_HALF | IFLS_TX_EIGHTH);
+    
+    interrupts::register_handler(interrupts::IRQ_UART, uart_irq_handler);
+    interrupts::set_priority(interrupts::IRQ_UART, interrupts::PRIORITY_HIGH);
+    interrupts::enable_irq(interrupts::IRQ_UART);
+    
+    uint64_t flags = lock_rings();
+    tx_irq_enabled = false;
+    write_reg(UART_IMSC, INT_RX_MASK);
+    irq_mode = true;
+    unlock_rings(flags);
+    
+    puts("[uart] Interrupt-driven I/O enabled\n");
+}
+
+/*
+ * Get driver statistics
+ */
+Stats get_stats() {
+    uint64_t flags = lock_rings();
+    Stats result = stats;
+    result.rx_pending = rx_count();
+    result.tx_pending = tx_count();
+    result.irq_mode = irq_mode;
+    unlock_rings(flags);
+    return result;
+}
+
+/*
+ * Non-blocking bulk write
  * Requirements: 4.2
  */
-void putc(char c) {
-    // Wait until transmit FIFO is not full
-    while (read_reg(UART_FR) & FR_TXFF) {
-        // Busy wait
+size_t write(const char* buf, size_t len) {
+    if (!buf || len == 0) return 0;
+    
+    uint64_t flags = lock_rings();
+    size_t n;
+    
+    if (!irq_mode) {
+        n = fifo_write(buf, len);
+    } else {
+        n = tx_enqueue(buf, len);
+        
+        bool kick = !coalescing || n < len || tx_count() >= TX_KICK_LEVEL;
+        for (size_t i = 0; i < n && !kick; i++) {
+            if (buf[i] == '\n') kick = true;
+        }
+        if (kick) {
+            tx_kick();
+        } else if (!flush_armed) {
+            // Without a timer slot the bytes go out now rather than late
+            flush_armed = timer::add_oneshot(FLUSH_DELAY_US, flush_expired, nullptr) >= 0;
+            if (!flush_armed) {
+                tx_kick();
+            }
+        }
     }
     
-    // Write character to data register
-    write_reg(UART_DR, static_cast<uint32_t>(c));
+    unlock_rings(flags);
+    return n;
+}
+
+/*
+ * Blocking bulk write
+ */
+void write_all(const char* buf, size_t len) {
+    bool stalled = false;
+    
+    while (len > 0) {
+        size_t n = write(buf, len);
+        buf += n;
+        len -= n;
+        if (len == 0 || !irq_mode) continue;
+        
+        // Ring full: wait for the TX interrupt to make room, or push it out
+        // ourselves if IRQs are masked. WFI with IRQs masked still wakes on
+        // the pending interrupt.
+        if (!stalled) {
+            stats.tx_stalls++;
+            stalled = true;
+        }
+        uint64_t flags = lock_rings();
+        while (tx_count() >= TX_RING_SIZE) {
+            if (flags & DAIF_I) {
+                tx_fill_fifo();
+            } else {
+                set_tx_irq(true);
+                flags = wait_unlocked(flags);
+            }
+        }
+        unlock_rings(flags);
+    }
+}
+
+/*
+ * Blocking text write with newline translation
+ */
+void write_text(const char* buf, size_t len) {
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] == '\n') {
+            write_all(buf + start, i - start);
+            write_all("\r\n", 2);
+            start = i + 1;
+        }
+    }
+    write_all(buf + start, len - start);
+}
+
+/*
+ * Start transmitting any coalesced output
+ */
+void flush() {
+    if (!irq_mode) return;
+    uint64_t flags = lock_rings();
+    tx_kick();
+    unlock_rings(flags);
+}
+
+/*
+ * Wait until all queued output has been handed to the hardware
+ */
+void drain() {
+    if (!irq_mode) return;
+    uint64_t flags = lock_rings();
+    tx_kick();
+    while (tx_count() > 0) {
+        if (flags & DAIF_I) {
+            tx_fill_fifo();
+        } else {
+            flags = wait_unlocked(flags);
+        }
+    }
+    unlock_rings(flags);
+}
+
+/*
+ * Enable or disable output coalescing
+ */
+void set_coalescing(bool enable) {
+    coalescing = enable;
+    if (!enable) {
+        flush();
+    }
+}
+
+/*
+ * Write a single character to the console
+ * Requirements: 4.2
+ */
+void putc(char c) {
+    write_all(&c, 1);
 }
 
 /*
@@ -100,13 +460,30 @@ void putc(char c) {
  * Requirements: 4.3
  */
 char getc() {
-    // Wait until receive FIFO is not empty
-    while (read_reg(UART_FR) & FR_RXFE) {
-        // Busy wait
+    uint64_t flags = lock_rings();
+    
+    // Make sure prompts and echoed input are visible before waiting
+    if (irq_mode && rx_count() == 0) {
+        tx_kick();
+    }
+    
+    while (rx_count() == 0) {
+        // Pick up bytes still below the RX trigger level (or polled mode)
+        rx_drain_fifo();
+        if (rx_count() > 0) break;
+        
+        if (irq_mode && !(flags & DAIF_I)) {
+            // Let other tasks run until an interrupt (RX, RX timeout, or
+            // timer) arrives
+            flags = wait_unlocked(flags);
+        }
     }
     
-    // Read character from data register
-    return static_cast<char>(read_reg(UART_DR) & 0xFF);
+    char c = rx_ring[rx_tail & (RX_RING_SIZE - 1)];
+    rx_tail = rx_tail + 1;
+    
+    unlock_rings(flags);
+    return c;
 }
 
 /*
@@ -114,8 +491,11 @@ char getc() {
  * Requirements: 4.5
  */
 bool has_input() {
-    // Return true if receive FIFO is not empty
-    return !(read_reg(UART_FR) & FR_RXFE);
+    uint64_t flags = lock_rings();
+    rx_drain_fifo();
+    bool available = rx_count() > 0;
+    unlock_rings(flags);
+    return available;
 }
 
 /*
@@ -123,18 +503,52 @@ bool has_input() {
  * Requirements: 4.4
  */
 void puts(const char* str) {
+    size_t len = 0;
+    while (str[len]) len++;
+    write_text(str, len);
+}
+
+// ============================================================================
+// Formatted Output
+// ============================================================================
+
+// printf formats into a small stack buffer and hands it over in bulk, to
+// the console or to the sink given to format()
+struct OutBuf {
+    char data[128];
+    size_t len;
+    Sink sink;                  // nullptr = the console
+    void* context;
+};
+
+static void out_flush(OutBuf* out) {
+    if (out->sink) {
+        out->sink(out->context, out->data, out->len);
+    } else {
+        write_all(out->data, out->len);
+    }
+    out->len = 0;
+}
+
+static void out_putc(OutBuf* out, char c) {
+    // Handle newline by adding carriage return (console only)
+    if (c == '\n' && !out->sink) {
+        if (out->len >= sizeof(out->data) - 1) out_flush(out);
+        out->data[out->len++] = '\r';
+    }
+    if (out->len >= sizeof(out->data)) out_flush(out);
+    out->data[out->len++] = c;
+}
+
+static void out_puts(OutBuf* out, const char* str) {
     while (*str) {
-        // Handle newline by adding carriage return
-        if (*str == '\n') {
-            putc('\r');
-        }
-        putc(*str++);
+        out_putc(out, *str++);
     }
 }
 
 
 // Helper function to print unsigned integer in given base with optional padding
-static void print_unsigned_padded(uint64_t value, int base, bool uppercase, int width, char pad_char) {
+static void print_unsigned_padded(OutBuf* out, uint64_t value, int base, bool uppercase, int width, char pad_char) {
     char buffer[20];  // Enough for 64-bit number in any base
     int i = 0;
     
@@ -143,9 +557,9 @@ static void print_unsigned_padded(uint64_t value, int base, bool uppercase, int
     if (value == 0) {
         // Print padding then zero
         for (int j = 1; j < width; j++) {
-            putc(pad_char);
+            out_putc(out, pad_char);
         }
-        putc('0');
+        out_putc(out, '0');
         return;
     }
     
@@ -156,38 +570,18 @@ static void print_unsigned_padded(uint64_t value, int base, bool uppercase, int
     
     // Print padding
     for (int j = i; j < width; j++) {
-        putc(pad_char);
+        out_putc(out, pad_char);
     }
     
     // Print in reverse order
     while (i > 0) {
-        putc(buffer[--i]);
+        out_putc(out, buffer[--i]);
     }
 }
 
-// Helper function to print unsigned integer in given base
-static void print_unsigned(uint64_t value, int base, bool uppercase) {
-    print_unsigned_padded(value, base, uppercase, 0, ' ');
-}
 
-// Helper function to print signed integer
-static void print_signed(int64_t value) {
-    if (value < 0) {
-        putc('-');
-        value = -value;
-    }
-    print_unsigned(static_cast<uint64_t>(value), 10, false);
-}
-
-/*
- * Formatted print (printf-like)
- * Supports: %d, %x, %s, %c, %p specifiers with optional width (e.g., %04x, %8d)
- * Requirements: 4.4
- */
-void printf(const char* fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    
+// Format fmt into out; the caller flushes
+static void format_into(OutBuf& out, const char* fmt, va_list args) {
     while (*fmt) {
         if (*fmt == '%') {
             fmt++;
@@ -212,40 +606,40 @@ void printf(const char* fmt, ...) {
                     // Signed decimal integer
                     int value = va_arg(args, int);
                     if (value < 0) {
-                        putc('-');
+                        out_putc(&out, '-');
                         value = -value;
                         if (width > 0) width--;
                     }
-                    print_unsigned_padded(static_cast<uint64_t>(value), 10, false, width, pad_char);
+                    print_unsigned_padded(&out, static_cast<uint64_t>(value), 10, false, width, pad_char);
                     break;
                 }
                 
                 case 'u': {
                     // Unsigned decimal integer
                     unsigned int value = va_arg(args, unsigned int);
-                    print_unsigned_padded(value, 10, false, width, pad_char);
+                    print_unsigned_padded(&out, value, 10, false, width, pad_char);
                     break;
                 }
                 
                 case 'x': {
                     // Hexadecimal (lowercase)
                     unsigned int value = va_arg(args, unsigned int);
-                    print_unsigned_padded(value, 16, false, width, pad_char);
+                    print_unsigned_padded(&out, value, 16, false, width, pad_char);
                     break;
                 }
                 
                 case 'X': {
                     // Hexadecimal (uppercase)
                     unsigned int value = va_arg(args, unsigned int);
-                    print_unsigned_padded(value, 16, true, width, pad_char);
+                    print_unsigned_padded(&out, value, 16, true, width, pad_char);
                     break;
                 }
                 
                 case 'p': {
                     // Pointer
                     void* ptr = va_arg(args, void*);
-                    puts("0x");
-                    print_unsigned_padded(reinterpret_cast<uint64_t>(ptr), 16, false, 16, '0');
+                    out_puts(&out, "0x");
+                    print_unsigned_padded(&out, reinterpret_cast<uint64_t>(ptr), 16, false, 16, '0');
                     break;
                 }
                 
@@ -253,9 +647,9 @@ void printf(const char* fmt, ...) {
                     // String
                     const char* str = va_arg(args, const char*);
                     if (str) {
-                        puts(str);
+                        out_puts(&out, str);
                     } else {
-                        puts("(null)");
+                        out_puts(&out, "(null)");
                     }
                     break;
                 }
@@ -263,33 +657,61 @@ void printf(const char* fmt, ...) {
                 case 'c': {
                     // Character
                     char c = static_cast<char>(va_arg(args, int));
-                    putc(c);
+                    out_putc(&out, c);
                     break;
                 }
                 
                 case '%': {
                     // Literal percent
-                    putc('%');
+                    out_putc(&out, '%');
                     break;
                 }
                 
                 default:
                     // Unknown specifier, print as-is
-                    putc('%');
-                    putc(*fmt);
+                    out_putc(&out, '%');
+                    out_putc(&out, *fmt);
                     break;
             }
         } else {
-            // Handle newline by adding carriage return
-            if (*fmt == '\n') {
-                putc('\r');
-            }
-            putc(*fmt);
+            // Newlines get a carriage return in out_putc
+            out_putc(&out, *fmt);
         }
         fmt++;
     }
+}
+
+/*
+ * Formatted print (printf-like)
+ * Supports: %d, %x, %s, %c, %p specifiers with optional width (e.g., %04x, %8d)
+ * Requirements: 4.4
+ */
+void printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    
+    OutBuf out;
+    out.len = 0;
+    out.sink = nullptr;
+    out.context = nullptr;
+    format_into(out, fmt, args);
     
     va_end(args);
+    out_flush(&out);
+}
+
+/*
+ * printf() into a sink
+ */
+void format(Sink sink, void* context, const char* fmt, va_list args) {
+    OutBuf out;
+    out.len = 0;
+    out.sink = sink;
+    out.context = context;
+    format_into(out, fmt, args);
+    if (out.len > 0) {
+        out_flush(&out);
+    }
 }
 
 } // namespace uart
@@ -1,90 +1,239 @@
 /*
  * EmberOS RAM Filesystem Implementation
  * In-memory filesystem for storing files and directories
+ *
+ * Nodes come from a slab cache. File data up to slab::MAX_OBJECT_SIZE
+ * lives in a kmalloc size class; larger files use whole pages.
+ *
+ * File buffers grow geometrically (at least doubling) so repeated appends
+ * are amortized O(1). Bytes between size and capacity are not kept
+ * zeroed; they are cleared only when a write or truncate exposes them.
+ *
+ * Files mounted from the boot image point into it with capacity 0, so
+ * the first write or growing truncate goes through grow_data(), which
+ * copies them into a buffer of their own; image bytes are never freed.
+ *
+ * Directory lookups go through a global dentry hash keyed by (parent,
+ * name). Resolved paths are kept in a small LRU cache keyed by (base
+ * directory, path string); it only holds positive results, so it is
+ * flushed whenever a node is unlinked but not when one is created.
+ *
+ * One lock guards the whole tree, both caches and the cwd. Every public
+ * function holds it for its duration; a returned FSNode stays valid
+ * until it is deleted, which mapped (pinned) files are protected from.
  */
 
 #include "ramfs.h"
+#include "ramfs_image.h"
 #include "uart.h"
 #include "memory.h"
+#include "slab.h"
+#include "klib.h"
+#include "spinlock.h"
+#include "trace.h"
 
 namespace ramfs {
 
 // ============================================================================
-// String Utilities
+// Global State
 // ============================================================================
 
-static size_t str_len(const char* s) {
-    size_t len = 0;
-    while (s[len]) len++;
-    return len;
-}
+static slab::Cache* g_node_cache = nullptr;
+static size_t g_node_count = 0;
+static FSNode* g_root = nullptr;
+static FSNode* g_cwd = nullptr;
+static char g_cwd_path[MAX_PATH];
+static spinlock::Lock g_lock;
+
+// Dentry hash: (parent, name) -> node, chained through FSNode::hash_next
+constexpr size_t DENTRY_BUCKETS = 512;
+static_assert((DENTRY_BUCKETS & (DENTRY_BUCKETS - 1)) == 0, "DENTRY_BUCKETS must be a power of two");
+static FSNode* g_dentry_hash[DENTRY_BUCKETS];
+
+// Path cache: (base directory, path) -> node, least recently used evicted
+constexpr size_t PATH_CACHE_SIZE = 16;
+
+struct PathCacheEntry {
+    FSNode* base;             // g_root for absolute paths, else the cwd
+    FSNode* node;             // nullptr if the slot is empty
+    uint32_t hash;
+    uint32_t len;
+    uint64_t last_used;
+    char path[MAX_PATH];
+};
+
+static PathCacheEntry g_path_cache[PATH_CACHE_SIZE];
+static uint64_t g_path_cache_clock = 0;
+static uint64_t g_path_cache_hits = 0;
+static uint64_t g_path_cache_misses = 0;
 
-static int str_cmp(const char* a, const char* b) {
-    while (*a && *b && *a == *b) {
-        a++;
-        b++;
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+// Allocate a data buffer of at least size bytes, reporting its capacity
+static uint8_t* alloc_data(size_t size, size_t* capacity) {
+    if (size <= slab::MAX_OBJECT_SIZE) {
+        uint8_t* data = static_cast<uint8_t*>(slab::kmalloc(size));
+        *capacity = data ? slab::kmalloc_size(size) : 0;
+        return data;
     }
-    return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
+    
+    size_t pages = (size + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
+    uint8_t* data = static_cast<uint8_t*>(memory::alloc_pages(pages));
+    *capacity = data ? pages * memory::PAGE_SIZE : 0;
+    return data;
 }
 
-static void str_copy(char* dst, const char* src, size_t max_len) {
-    size_t i = 0;
-    while (i < max_len - 1 && src[i]) {
-        dst[i] = src[i];
-        i++;
+static void free_data(uint8_t* data, size_t capacity) {
+    if (!data) return;
+    
+    if (capacity <= slab::MAX_OBJECT_SIZE) {
+        slab::kfree(data, capacity);
+    } else {
+        memory::free_pages(data, capacity / memory::PAGE_SIZE);
     }
-    dst[i] = '\0';
 }
 
-static void mem_set(void* ptr, int value, size_t size) {
-    uint8_t* p = static_cast<uint8_t*>(ptr);
-    for (size_t i = 0; i < size; i++) {
-        p[i] = static_cast<uint8_t>(value);
+// Grow a file's buffer to hold at least needed bytes, keeping its contents
+static bool grow_data(FSNode* node, size_t needed) {
+    // Double the capacity (power-of-two pages once past the slab classes),
+    // but never beyond the file size limit
+    size_t target = node->capacity * 2;
+    if (target < needed) target = needed;
+    if (target > slab::MAX_OBJECT_SIZE) {
+        size_t pages = 1;
+        while (pages * memory::PAGE_SIZE < target) pages <<= 1;
+        target = pages * memory::PAGE_SIZE;
+    }
+    if (target > MAX_FILE_SIZE) target = MAX_FILE_SIZE;
+    if (target < needed) target = needed;
+    
+    size_t new_capacity;
+    uint8_t* new_data = alloc_data(target, &new_capacity);
+    if (!new_data && target > needed) {
+        // Not enough contiguous memory for the headroom; take what is needed
+        new_data = alloc_data(needed, &new_capacity);
+    }
+    if (!new_data) {
+        return false;
     }
+    
+    if (node->data) {
+        klib::memcpy(new_data, node->data, node->size);
+        if (!node->image) {
+            free_data(node->data, node->capacity);
+        }
+    }
+    
+    node->data = new_data;
+    node->capacity = new_capacity;
+    node->image = false;
+    return true;
 }
 
-static void mem_copy(void* dst, const void* src, size_t size) {
-    uint8_t* d = static_cast<uint8_t*>(dst);
-    const uint8_t* s = static_cast<const uint8_t*>(src);
-    for (size_t i = 0; i < size; i++) {
-        d[i] = s[i];
+// FNV-1a hash of a string, also reporting its length
+static uint32_t hash_string(const char* s, size_t* len) {
+    uint32_t hash = 2166136261u;
+    size_t n = 0;
+    while (s[n]) {
+        hash ^= static_cast<uint8_t>(s[n]);
+        hash *= 16777619u;
+        n++;
     }
+    if (len) *len = n;
+    return hash;
 }
 
-// ============================================================================
-// Global State
-// ============================================================================
+static inline size_t dentry_bucket(const FSNode* parent, uint32_t name_hash) {
+    uint64_t key = reinterpret_cast<uintptr_t>(parent) >> 4;
+    key = (key * 0x9E3779B97F4A7C15ULL) >> 32;
+    return (key ^ name_hash) & (DENTRY_BUCKETS - 1);
+}
 
-static FSNode g_nodes[MAX_FILES];
-static FSNode* g_root = nullptr;
-static FSNode* g_cwd = nullptr;
-static char g_cwd_path[MAX_PATH];
+static void dentry_insert(FSNode* node) {
+    size_t bucket = dentry_bucket(node->parent, node->name_hash);
+    node->hash_next = g_dentry_hash[bucket];
+    g_dentry_hash[bucket] = node;
+}
 
-// ============================================================================
-// Internal Helpers
-// ============================================================================
+static void dentry_remove(FSNode* node) {
+    FSNode** link = &g_dentry_hash[dentry_bucket(node->parent, node->name_hash)];
+    while (*link && *link != node) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = node->hash_next;
+    }
+    node->hash_next = nullptr;
+}
 
-static FSNode* alloc_node() {
-    for (size_t i = 0; i < MAX_FILES; i++) {
-        if (!g_nodes[i].in_use) {
-            mem_set(&g_nodes[i], 0, sizeof(FSNode));
-            g_nodes[i].in_use = true;
-            return &g_nodes[i];
+static void path_cache_flush() {
+    for (size_t i = 0; i < PATH_CACHE_SIZE; i++) {
+        g_path_cache[i].node = nullptr;
+    }
+}
+
+static FSNode* path_cache_lookup(FSNode* base, const char* path, uint32_t hash, size_t len) {
+    for (size_t i = 0; i < PATH_CACHE_SIZE; i++) {
+        PathCacheEntry* entry = &g_path_cache[i];
+        if (entry->node && entry->base == base && entry->hash == hash &&
+            entry->len == len && klib::memcmp(entry->path, path, len) == 0) {
+            entry->last_used = ++g_path_cache_clock;
+            return entry->node;
         }
     }
     return nullptr;
 }
 
+static void path_cache_insert(FSNode* base, const char* path, uint32_t hash, size_t len, FSNode* node) {
+    if (len >= MAX_PATH) return;
+    
+    PathCacheEntry* victim = &g_path_cache[0];
+    for (size_t i = 0; i < PATH_CACHE_SIZE; i++) {
+        PathCacheEntry* entry = &g_path_cache[i];
+        if (!entry->node) {
+            victim = entry;
+            break;
+        }
+        if (entry->last_used < victim->last_used) {
+            victim = entry;
+        }
+    }
+    
+    victim->base = base;
+    victim->node = node;
+    victim->hash = hash;
+    victim->len = static_cast<uint32_t>(len);
+    victim->last_used = ++g_path_cache_clock;
+    klib::memcpy(victim->path, path, len + 1);
+}
+
+static FSNode* alloc_node() {
+    if (g_node_count >= MAX_FILES) return nullptr;
+    
+    FSNode* node = static_cast<FSNode*>(slab::cache_alloc(g_node_cache));
+    if (!node) return nullptr;
+    
+    klib::memset(node, 0, sizeof(FSNode));
+    node->in_use = true;
+    g_node_count++;
+    return node;
+}
+
 static void free_node(FSNode* node) {
     if (!node) return;
     
     // Free file data if any
-    if (node->data) {
-        memory::free_pages(node->data, (node->size + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE);
+    if (node->data && !node->image) {
+        free_data(node->data, node->capacity);
         node->data = nullptr;
+        node->capacity = 0;
     }
     
     node->in_use = false;
+    slab::cache_free(g_node_cache, node);
+    g_node_count--;
 }
 
 // Remove node from parent's children list
@@ -105,6 +254,10 @@ static void unlink_node(FSNode* node) {
         }
     }
     
+    dentry_remove(node);
+    path_cache_flush();
+    parent->size--;
+    
     node->parent = nullptr;
     node->next = nullptr;
 }
@@ -116,6 +269,10 @@ static void link_node(FSNode* parent, FSNode* node) {
     node->parent = parent;
     node->next = parent->children;
     parent->children = node;
+    parent->size++;
+    
+    node->name_hash = hash_string(node->name, nullptr);
+    dentry_insert(node);
 }
 
 // Parse next path component
@@ -141,12 +298,14 @@ static const char* next_component(const char* path, char* component, size_t max_
 static FSNode* find_child(FSNode* dir, const char* name) {
     if (!dir || dir->type != FileType::DIRECTORY) return nullptr;
     
-    FSNode* child = dir->children;
-    while (child) {
-        if (str_cmp(child->name, name) == 0) {
-            return child;
+    uint32_t name_hash = hash_string(name, nullptr);
+    FSNode* node = g_dentry_hash[dentry_bucket(dir, name_hash)];
+    while (node) {
+        if (node->parent == dir && node->name_hash == name_hash &&
+            klib::strcmp(node->name, name) == 0) {
+            return node;
         }
-        child = child->next;
+        node = node->hash_next;
     }
     return nullptr;
 }
@@ -156,8 +315,17 @@ static FSNode* find_child(FSNode* dir, const char* name) {
 // ============================================================================
 
 void init() {
-    // Clear all nodes
-    mem_set(g_nodes, 0, sizeof(g_nodes));
+    // Node cache (slab::init must have run)
+    g_node_cache = slab::cache_create("fsnode", sizeof(FSNode));
+    g_node_count = 0;
+    for (size_t i = 0; i < DENTRY_BUCKETS; i++) {
+        g_dentry_hash[i] = nullptr;
+    }
+    path_cache_flush();
+    if (!g_node_cache) {
+        uart::puts("[ramfs] Failed to create node cache!\n");
+        return;
+    }
     
     // Create root directory
     g_root = alloc_node();
@@ -166,17 +334,85 @@ void init() {
         return;
     }
     
-    str_copy(g_root->name, "/", MAX_FILENAME);
+    klib::strlcpy(g_root->name, "/", MAX_FILENAME);
     g_root->type = FileType::DIRECTORY;
     g_root->parent = g_root;  // Root is its own parent
     
     // Set current directory to root
     g_cwd = g_root;
-    str_copy(g_cwd_path, "/", MAX_PATH);
+    klib::strlcpy(g_cwd_path, "/", MAX_PATH);
     
     uart::puts("[ramfs] RAM filesystem initialized\n");
 }
 
+// Length of the NUL-terminated string at offset in the image, or 0 if bad
+static size_t image_string(const uint8_t* image, size_t size, uint32_t offset) {
+    for (size_t n = 0; offset + n < size && n < MAX_PATH - 1; n++) {
+        if (image[offset + n] == '\0') return n;
+    }
+    return 0;
+}
+
+bool mount_image(const uint8_t* image, size_t size) {
+    const ImageHeader* header = reinterpret_cast<const ImageHeader*>(image);
+    if (!image || size < sizeof(ImageHeader) || header->magic != IMAGE_MAGIC ||
+        header->version != IMAGE_VERSION || header->size < sizeof(ImageHeader) ||
+        header->size > size ||
+        header->entry_count > (header->size - sizeof(ImageHeader)) / sizeof(ImageEntry)) {
+        uart::puts("[ramfs] Boot image is not valid\n");
+        return false;
+    }
+    size = header->size;
+    
+    const ImageEntry* entries = reinterpret_cast<const ImageEntry*>(header + 1);
+    size_t files = 0;
+    size_t bytes = 0;
+    char path[MAX_PATH];
+    
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        const ImageEntry* entry = &entries[i];
+        size_t len = image_string(image, size, entry->name_offset);
+        if (len == 0) {
+            uart::printf("[ramfs] Boot image entry %d has a bad name\n", (int)i);
+            return false;
+        }
+        path[0] = '/';
+        klib::memcpy(path + 1, image + entry->name_offset, len + 1);
+        
+        if (entry->type == IMAGE_DIR) {
+            if (!open_dir(path) && !create_dir(path)) {
+                uart::printf("[ramfs] Cannot create %s from boot image\n", path);
+                return false;
+            }
+            continue;
+        }
+        
+        if (entry->type != IMAGE_FILE || entry->size > MAX_FILE_SIZE ||
+            entry->data_offset > size || entry->size > size - entry->data_offset) {
+            uart::printf("[ramfs] Boot image entry %s is not valid\n", path);
+            return false;
+        }
+        FSNode* node = create_file(path);
+        if (!node) {
+            uart::printf("[ramfs] Cannot create %s from boot image\n", path);
+            return false;
+        }
+        
+        // Reference the bytes in place; capacity 0 makes any change copy them
+        spinlock::Guard guard(&g_lock);
+        node->data = entry->size ? const_cast<uint8_t*>(image + entry->data_offset) : nullptr;
+        node->size = entry->size;
+        node->capacity = 0;
+        node->image = entry->size != 0;
+        files++;
+        bytes += entry->size;
+    }
+    
+    uart::printf("[ramfs] Boot image: %d files, %d bytes mounted in place\n",
+                 (int)files, (int)bytes);
+    return true;
+}
+
 FSNode* get_root() {
     return g_root;
 }
@@ -189,65 +425,66 @@ const char* get_cwd_path() {
     return g_cwd_path;
 }
 
-// Update cwd_path based on current g_cwd
-static void update_cwd_path() {
-    if (g_cwd == g_root) {
-        str_copy(g_cwd_path, "/", MAX_PATH);
-        return;
-    }
+// get_full_path() body, called with g_lock held
+static bool full_path_locked(FSNode* node, char* buffer, size_t bufsize) {
+    if (!node || !buffer || bufsize == 0) return false;
     
-    // Build path by traversing up
-    char temp[MAX_PATH];
-    char result[MAX_PATH];
-    result[0] = '\0';
+    if (node == g_root) {
+        klib::strlcpy(buffer, "/", bufsize);
+        return true;
+    }
     
-    FSNode* node = g_cwd;
-    while (node && node != g_root) {
-        str_copy(temp, "/", MAX_PATH);
-        size_t len = str_len(temp);
-        size_t name_len = str_len(node->name);
-        if (len + name_len < MAX_PATH - 1) {
-            for (size_t i = 0; i < name_len; i++) {
-                temp[len + i] = node->name[i];
-            }
-            temp[len + name_len] = '\0';
-        }
-        
-        // Prepend to result
-        size_t result_len = str_len(result);
-        size_t temp_len = str_len(temp);
-        if (temp_len + result_len < MAX_PATH - 1) {
-            // Shift result right
-            for (int i = result_len; i >= 0; i--) {
-                result[temp_len + i] = result[i];
-            }
-            // Copy temp to front
-            for (size_t i = 0; i < temp_len; i++) {
-                result[i] = temp[i];
-            }
-        }
-        
+    // Collect the ancestors once, then emit them root first
+    constexpr size_t MAX_DEPTH = MAX_PATH / 2;
+    FSNode* chain[MAX_DEPTH];
+    size_t depth = 0;
+    while (node && node != g_root && depth < MAX_DEPTH) {
+        chain[depth++] = node;
         node = node->parent;
     }
     
-    if (result[0] == '\0') {
-        str_copy(g_cwd_path, "/", MAX_PATH);
-    } else {
-        str_copy(g_cwd_path, result, MAX_PATH);
+    size_t pos = 0;
+    while (depth > 0) {
+        const char* name = chain[--depth]->name;
+        size_t name_len = klib::strlen(name);
+        if (pos + 1 + name_len >= bufsize) break;
+        buffer[pos++] = '/';
+        klib::memcpy(buffer + pos, name, name_len);
+        pos += name_len;
     }
+    buffer[pos] = '\0';
+    
+    if (pos == 0) {
+        klib::strlcpy(buffer, "/", bufsize);
+    }
+    
+    return true;
 }
 
-FSNode* resolve_path(const char* path) {
+// Update cwd_path based on current g_cwd
+static void update_cwd_path() {
+    full_path_locked(g_cwd, g_cwd_path, MAX_PATH);
+}
+
+// resolve_path() body, called with g_lock held
+static FSNode* resolve_locked(const char* path) {
     if (!path || !*path) return g_cwd;
     
-    FSNode* current;
+    FSNode* base = (path[0] == '/') ? g_root : g_cwd;
+    
+    size_t len;
+    uint32_t hash = hash_string(path, &len);
+    FSNode* cached = path_cache_lookup(base, path, hash, len);
+    if (cached) {
+        g_path_cache_hits++;
+        return cached;
+    }
+    g_path_cache_misses++;
     
-    // Absolute or relative path?
+    const char* full_path = path;
+    FSNode* current = base;
     if (path[0] == '/') {
-        current = g_root;
         path++;
-    } else {
-        current = g_cwd;
     }
     
     char component[MAX_FILENAME];
@@ -257,12 +494,12 @@ FSNode* resolve_path(const char* path) {
         
         if (component[0] == '\0') break;
         
-        if (str_cmp(component, ".") == 0) {
+        if (klib::strcmp(component, ".") == 0) {
             // Current directory, no change
             continue;
         }
         
-        if (str_cmp(component, "..") == 0) {
+        if (klib::strcmp(component, "..") == 0) {
             // Parent directory
             if (current->parent) {
                 current = current->parent;
@@ -278,11 +515,18 @@ FSNode* resolve_path(const char* path) {
         current = child;
     }
     
+    path_cache_insert(base, full_path, hash, len, current);
     return current;
 }
 
+FSNode* resolve_path(const char* path) {
+    spinlock::Guard guard(&g_lock);
+    return resolve_locked(path);
+}
+
 bool set_cwd(const char* path) {
-    FSNode* node = resolve_path(path);
+    spinlock::Guard guard(&g_lock);
+    FSNode* node = resolve_locked(path);
     if (!node || node->type != FileType::DIRECTORY) {
         return false;
     }
@@ -293,6 +537,7 @@ bool set_cwd(const char* path) {
 }
 
 FSNode* create_file(const char* path) {
+    spinlock::Guard guard(&g_lock);
     if (!path || !*path) return nullptr;
     
     // Find parent directory and filename
@@ -312,17 +557,17 @@ FSNode* create_file(const char* path) {
             parent = g_root;
         } else {
             if (parent_len >= MAX_PATH) return nullptr;
-            mem_copy(parent_path, path, parent_len);
+            klib::memcpy(parent_path, path, parent_len);
             parent_path[parent_len] = '\0';
-            parent = resolve_path(parent_path);
+            parent = resolve_locked(parent_path);
         }
-        str_copy(filename, last_slash + 1, MAX_FILENAME);
+        klib::strlcpy(filename, last_slash + 1, MAX_FILENAME);
     } else {
         parent = g_cwd;
-        str_copy(filename, path, MAX_FILENAME);
+        klib::strlcpy(filename, path, MAX_FILENAME);
     }
     
-    if (!parent || parent->type != FileType::DIRECTORY) {
+    if (!parent || parent->type != FileType::DIRECTORY || parent->size >= MAX_DIR_ENTRIES) {
         return nullptr;
     }
     
@@ -335,18 +580,20 @@ FSNode* create_file(const char* path) {
     FSNode* node = alloc_node();
     if (!node) return nullptr;
     
-    str_copy(node->name, filename, MAX_FILENAME);
+    klib::strlcpy(node->name, filename, MAX_FILENAME);
     node->type = FileType::FILE;
     node->size = 0;
     node->data = nullptr;
     
     link_node(parent, node);
+    trace::record(trace::Event::FS, static_cast<uint32_t>(trace::FsOp::CREATE), 0);
     
     return node;
 }
 
 FSNode* open_file(const char* path) {
-    FSNode* node = resolve_path(path);
+    spinlock::Guard guard(&g_lock);
+    FSNode* node = resolve_locked(path);
     if (!node || node->type != FileType::FILE) {
         return nullptr;
     }
@@ -354,17 +601,21 @@ FSNode* open_file(const char* path) {
 }
 
 bool delete_file(const char* path) {
-    FSNode* node = resolve_path(path);
-    if (!node || node->type != FileType::FILE) {
+    spinlock::Guard guard(&g_lock);
+    FSNode* node = resolve_locked(path);
+    if (!node || node->type != FileType::FILE || node->pins) {
         return false;
     }
     
+    trace::record(trace::Event::FS, static_cast<uint32_t>(trace::FsOp::DELETE),
+                  static_cast<uint32_t>(node->size));
     unlink_node(node);
     free_node(node);
     return true;
 }
 
 size_t read_file(FSNode* node, uint8_t* buffer, size_t offset, size_t count) {
+    spinlock::Guard guard(&g_lock);
     if (!node || node->type != FileType::FILE || !buffer) {
         return 0;
     }
@@ -377,15 +628,22 @@ size_t read_file(FSNode* node, uint8_t* buffer, size_t offset, size_t count) {
     size_t to_read = (count < available) ? count : available;
     
     if (node->data) {
-        mem_copy(buffer, node->data + offset, to_read);
+        klib::memcpy(buffer, node->data + offset, to_read);
     }
+    trace::record(trace::Event::FS, static_cast<uint32_t>(trace::FsOp::READ),
+                  static_cast<uint32_t>(to_read));
     
     return to_read;
 }
 
 
 size_t write_file(FSNode* node, const uint8_t* buffer, size_t offset, size_t count) {
-    if (!node || node->type != FileType::FILE || !buffer) {
+    spinlock::Guard guard(&g_lock);
+    if (!node || node->type != FileType::FILE || !buffer || node->pins) {
+        return 0;
+    }
+    
+    if (offset >= MAX_FILE_SIZE) {
         return 0;
     }
     
@@ -395,42 +653,33 @@ size_t write_file(FSNode* node, const uint8_t* buffer, size_t offset, size_t cou
         count = new_size - offset;
     }
     
-    // Allocate or reallocate data buffer if needed
-    if (new_size > 0 && (!node->data || new_size > node->size)) {
-        size_t old_pages = node->data ? (node->size + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE : 0;
-        size_t new_pages = (new_size + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
-        
-        if (new_pages > old_pages) {
-            uint8_t* new_data = static_cast<uint8_t*>(memory::alloc_pages(new_pages));
-            if (!new_data) {
-                return 0;  // Out of memory
-            }
-            
-            mem_set(new_data, 0, new_pages * memory::PAGE_SIZE);
-            
-            if (node->data) {
-                mem_copy(new_data, node->data, node->size);
-                memory::free_pages(node->data, old_pages);
-            }
-            
-            node->data = new_data;
-        }
+    // Grow the buffer if needed; appends within capacity write in place
+    if (new_size > node->capacity && !grow_data(node, new_size)) {
+        return 0;  // Out of memory
+    }
+    
+    // Bytes between the old end and a write past it read back as zero
+    if (node->data && offset > node->size) {
+        klib::memset(node->data + node->size, 0, offset - node->size);
     }
     
     // Write data
     if (node->data && count > 0) {
-        mem_copy(node->data + offset, buffer, count);
+        klib::memcpy(node->data + offset, buffer, count);
     }
     
     if (new_size > node->size) {
         node->size = new_size;
     }
+    trace::record(trace::Event::FS, static_cast<uint32_t>(trace::FsOp::WRITE),
+                  static_cast<uint32_t>(count));
     
     return count;
 }
 
 bool truncate_file(FSNode* node, size_t size) {
-    if (!node || node->type != FileType::FILE) {
+    spinlock::Guard guard(&g_lock);
+    if (!node || node->type != FileType::FILE || node->pins) {
         return false;
     }
     
@@ -440,42 +689,55 @@ bool truncate_file(FSNode* node, size_t size) {
     
     if (size == 0) {
         // Free all data
-        if (node->data) {
-            size_t pages = (node->size + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
-            memory::free_pages(node->data, pages);
-            node->data = nullptr;
+        if (node->data && !node->image) {
+            free_data(node->data, node->capacity);
         }
+        node->data = nullptr;
+        node->capacity = 0;
+        node->image = false;
         node->size = 0;
     } else if (size < node->size) {
-        // Just update size (keep allocated memory)
+        // Just update size (keep allocated memory, or the image bytes)
         node->size = size;
     } else if (size > node->size) {
         // Extend file with zeros
         size_t old_size = node->size;
-        size_t new_pages = (size + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
-        size_t old_pages = node->data ? (old_size + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE : 0;
         
-        if (new_pages > old_pages) {
-            uint8_t* new_data = static_cast<uint8_t*>(memory::alloc_pages(new_pages));
-            if (!new_data) return false;
-            
-            mem_set(new_data, 0, new_pages * memory::PAGE_SIZE);
-            
-            if (node->data) {
-                mem_copy(new_data, node->data, old_size);
-                memory::free_pages(node->data, old_pages);
-            }
-            
-            node->data = new_data;
+        if (size > node->capacity && !grow_data(node, size)) {
+            return false;
         }
         
+        klib::memset(node->data + old_size, 0, size - old_size);
+        
         node->size = size;
     }
+    trace::record(trace::Event::FS, static_cast<uint32_t>(trace::FsOp::TRUNCATE),
+                  static_cast<uint32_t>(size));
+    
+    return true;
+}
+
+bool map_file(FSNode* node, const uint8_t** data, size_t* length) {
+    spinlock::Guard guard(&g_lock);
+    if (!node || node->type != FileType::FILE || !data || !length) {
+        return false;
+    }
     
+    node->pins++;
+    *data = node->size ? node->data : nullptr;
+    *length = node->size;
     return true;
 }
 
+void unmap_file(FSNode* node) {
+    spinlock::Guard guard(&g_lock);
+    if (node && node->pins > 0) {
+        node->pins--;
+    }
+}
+
 FSNode* create_dir(const char* path) {
+    spinlock::Guard guard(&g_lock);
     if (!path || !*path) return nullptr;
     
     // Find parent directory and dirname
@@ -495,17 +757,17 @@ FSNode* create_dir(const char* path) {
             parent = g_root;
         } else {
             if (parent_len >= MAX_PATH) return nullptr;
-            mem_copy(parent_path, path, parent_len);
+            klib::memcpy(parent_path, path, parent_len);
             parent_path[parent_len] = '\0';
-            parent = resolve_path(parent_path);
+            parent = resolve_locked(parent_path);
         }
-        str_copy(dirname, last_slash + 1, MAX_FILENAME);
+        klib::strlcpy(dirname, last_slash + 1, MAX_FILENAME);
     } else {
         parent = g_cwd;
-        str_copy(dirname, path, MAX_FILENAME);
+        klib::strlcpy(dirname, path, MAX_FILENAME);
     }
     
-    if (!parent || parent->type != FileType::DIRECTORY) {
+    if (!parent || parent->type != FileType::DIRECTORY || parent->size >= MAX_DIR_ENTRIES) {
         return nullptr;
     }
     
@@ -518,17 +780,28 @@ FSNode* create_dir(const char* path) {
     FSNode* node = alloc_node();
     if (!node) return nullptr;
     
-    str_copy(node->name, dirname, MAX_FILENAME);
+    klib::strlcpy(node->name, dirname, MAX_FILENAME);
     node->type = FileType::DIRECTORY;
     node->size = 0;
     node->data = nullptr;
     node->children = nullptr;
     
     link_node(parent, node);
+    trace::record(trace::Event::FS, static_cast<uint32_t>(trace::FsOp::MKDIR), 0);
     
     return node;
 }
 
+// Check whether any file below a directory is mapped
+static bool has_pinned(FSNode* dir) {
+    for (FSNode* child = dir->children; child; child = child->next) {
+        if (child->pins || (child->type == FileType::DIRECTORY && has_pinned(child))) {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Recursively delete directory contents
 static void delete_contents(FSNode* dir) {
     if (!dir || dir->type != FileType::DIRECTORY) return;
@@ -541,6 +814,7 @@ static void delete_contents(FSNode* dir) {
             delete_contents(child);
         }
         
+        dentry_remove(child);
         child->parent = nullptr;
         child->next = nullptr;
         free_node(child);
@@ -549,10 +823,13 @@ static void delete_contents(FSNode* dir) {
     }
     
     dir->children = nullptr;
+    dir->size = 0;
+    path_cache_flush();
 }
 
 bool delete_dir(const char* path, bool recursive) {
-    FSNode* node = resolve_path(path);
+    spinlock::Guard guard(&g_lock);
+    FSNode* node = resolve_locked(path);
     if (!node || node->type != FileType::DIRECTORY) {
         return false;
     }
@@ -567,6 +844,11 @@ bool delete_dir(const char* path, bool recursive) {
         return false;  // Directory not empty
     }
     
+    // Mapped files keep the whole tree above them alive
+    if (recursive && has_pinned(node)) {
+        return false;
+    }
+    
     // If recursive, delete all contents first
     if (recursive) {
         delete_contents(node);
@@ -583,13 +865,15 @@ bool delete_dir(const char* path, bool recursive) {
         check = check->parent;
     }
     
+    trace::record(trace::Event::FS, static_cast<uint32_t>(trace::FsOp::RMDIR), 0);
     unlink_node(node);
     free_node(node);
     return true;
 }
 
 FSNode* open_dir(const char* path) {
-    FSNode* node = resolve_path(path);
+    spinlock::Guard guard(&g_lock);
+    FSNode* node = resolve_locked(path);
     if (!node || node->type != FileType::DIRECTORY) {
         return nullptr;
     }
@@ -597,58 +881,15 @@ FSNode* open_dir(const char* path) {
 }
 
 bool get_full_path(FSNode* node, char* buffer, size_t bufsize) {
-    if (!node || !buffer || bufsize == 0) return false;
-    
-    if (node == g_root) {
-        str_copy(buffer, "/", bufsize);
-        return true;
-    }
-    
-    // Build path by traversing up
-    char temp[MAX_PATH];
-    buffer[0] = '\0';
-    
-    while (node && node != g_root) {
-        str_copy(temp, "/", MAX_PATH);
-        size_t len = str_len(temp);
-        size_t name_len = str_len(node->name);
-        
-        if (len + name_len < MAX_PATH - 1) {
-            for (size_t i = 0; i < name_len; i++) {
-                temp[len + i] = node->name[i];
-            }
-            temp[len + name_len] = '\0';
-        }
-        
-        // Prepend to buffer
-        size_t buf_len = str_len(buffer);
-        size_t temp_len = str_len(temp);
-        
-        if (temp_len + buf_len < bufsize - 1) {
-            // Shift buffer right
-            for (int i = buf_len; i >= 0; i--) {
-                buffer[temp_len + i] = buffer[i];
-            }
-            // Copy temp to front
-            for (size_t i = 0; i < temp_len; i++) {
-                buffer[i] = temp[i];
-            }
-        }
-        
-        node = node->parent;
-    }
-    
-    if (buffer[0] == '\0') {
-        str_copy(buffer, "/", bufsize);
-    }
-    
-    return true;
+    spinlock::Guard guard(&g_lock);
+    return full_path_locked(node, buffer, bufsize);
 }
 
 bool dir_open(DirIterator* iter, const char* path) {
+    spinlock::Guard guard(&g_lock);
     if (!iter) return false;
     
-    FSNode* dir = resolve_path(path);
+    FSNode* dir = resolve_locked(path);
     if (!dir || dir->type != FileType::DIRECTORY) {
         return false;
     }
@@ -659,6 +900,7 @@ bool dir_open(DirIterator* iter, const char* path) {
 }
 
 FSNode* dir_next(DirIterator* iter) {
+    spinlock::Guard guard(&g_lock);
     if (!iter || !iter->current) return nullptr;
     
     FSNode* result = iter->current;
@@ -666,20 +908,38 @@ FSNode* dir_next(DirIterator* iter) {
     return result;
 }
 
+// Sum file sizes below a directory
+// Bytes in the files below dir; those still in the boot image go to *image
+static size_t count_bytes(FSNode* dir, size_t* image) {
+    size_t total = 0;
+    for (FSNode* child = dir ? dir->children : nullptr; child; child = child->next) {
+        if (child->type == FileType::FILE) {
+            total += child->size;
+            if (child->image) *image += child->size;
+        } else {
+            total += count_bytes(child, image);
+        }
+    }
+    return total;
+}
+
 FSStats get_stats() {
-    FSStats stats = {0, 0, 0, 0};
+    memory::MemStats mem = memory::get_stats();
+    spinlock::Guard guard(&g_lock);
+    FSStats stats = {0, 0, 0, 0, 0, 0, 0};
     
     stats.total_nodes = MAX_FILES;
-    stats.total_bytes = MAX_FILES * MAX_FILE_SIZE;
+    stats.used_nodes = g_node_count;
+    stats.used_bytes = count_bytes(g_root, &stats.image_bytes);
     
-    for (size_t i = 0; i < MAX_FILES; i++) {
-        if (g_nodes[i].in_use) {
-            stats.used_nodes++;
-            if (g_nodes[i].type == FileType::FILE) {
-                stats.used_bytes += g_nodes[i].size;
-            }
-        }
+    // File data shares the page allocator with everything else, so what
+    // can still be written is bounded by free RAM, not by the file limits
+    stats.total_bytes = stats.used_bytes + mem.free_pages * memory::PAGE_SIZE;
+    if (stats.total_bytes > MAX_FILES * MAX_FILE_SIZE) {
+        stats.total_bytes = MAX_FILES * MAX_FILE_SIZE;
     }
+    stats.path_cache_hits = g_path_cache_hits;
+    stats.path_cache_misses = g_path_cache_misses;
     
     return stats;
 }
@@ -9,164 +9,227 @@
 #include "uart.h"
 #include "timer.h"
 #include "ramfs.h"
+#include "mmu.h"
+#include "klib.h"
+#include "memory.h"
+#include "sched.h"
+#include "smp.h"
+#include "trace.h"
+#include "casm/console.h"
+#include "casm/framebuffer.h"
+#include "casm/profile.h"
 
 // Forward declaration of GIC functions (implemented in gic.cpp)
 namespace gic {
     void init();
+    void init_cpu();
     void enable_irq(uint32_t irq);
     void disable_irq(uint32_t irq);
+    void set_priority(uint32_t irq, uint8_t priority);
     uint32_t acknowledge_irq();
-    void end_irq(uint32_t irq);
+    void end_irq(uint32_t iar);
 }
 
 // CASM native execution state
 namespace casm_native {
-    static uint8_t* code_buffer = nullptr;
-    static size_t mem_size = 0;
-    static uintptr_t base_addr = 0;  // Base address of code_buffer
-    static bool running = false;
-    static bool halt_requested = false;
+    /*
+     * One running program: its arena, the framebuffer its plot stores
+     * write through x25/x27 and the console ring its putc stores write
+     * through x26. Each task running a program has its own session, found
+     * through sched::get_local()
+     */
+    struct Session {
+        uint8_t* code_buffer;
+        size_t mem_size;
+        uintptr_t base_addr;    // Base address of code_buffer
+        bool running;
+        bool halt_requested;
+        
+        // Performance counters (for profiling)
+        uint64_t svc_count;
+        uint64_t start_tick;
+        casm::Profile* profile;     // Sampled by casm prof, else nullptr
+        
+        // Graphics canvas (plot stores write cells via x27, colors via x25)
+        casm::Framebuffer fb;
+        
+        // Output queued by putc without trapping
+        casm::ConsoleRing console;
+    };
     
-    // Performance counters (for profiling)
-    static uint64_t svc_count = 0;
-    static uint64_t start_tick = 0;
+    constexpr size_t SESSION_PAGES = (sizeof(Session) + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
     
-    // Output buffer for batched UART (reduces MMIO overhead)
-    static char out_buffer[256];
-    static int out_pos = 0;
+    static inline Session* session() {
+        return static_cast<Session*>(sched::get_local());
+    }
+    
+    // Program output goes through the UART coalescing layer, which queues
+    // bytes in the TX ring and pushes them out in FIFO-sized bursts on
+    // newline, when enough is queued, or on the timer tick
     
-    // Flush output buffer to UART
+    // Push any queued output to the UART now
     void flush_output() {
-        for (int i = 0; i < out_pos; i++) {
-            uart::putc(out_buffer[i]);
+        uart::flush();
+    }
+    
+    // Write out the bytes putc queued in a console ring. With block false
+    // only what the UART TX ring accepts right now is taken (IRQ context).
+    // Returns true if any bytes were written
+    bool drain_console(casm::ConsoleRing* ring, bool block) {
+        uint32_t head = ring->head;
+        uint32_t tail = ring->tail;
+        uint32_t start = tail;
+        asm volatile("" ::: "memory");  // Read the data only after head
+        
+        // A program that scribbled on head cannot make us read past the ring
+        if (head - tail > casm::CONSOLE_RING_SIZE) {
+            tail = head - casm::CONSOLE_RING_SIZE;
+        }
+        
+        while (tail != head) {
+            uint32_t index = tail & (casm::CONSOLE_RING_SIZE - 1);
+            uint32_t chunk = head - tail;
+            if (chunk > casm::CONSOLE_RING_SIZE - index) {
+                chunk = casm::CONSOLE_RING_SIZE - index;
+            }
+            const char* bytes = reinterpret_cast<const char*>(&ring->data[index]);
+            size_t n = chunk;
+            if (block) {
+                uart::write_all(bytes, chunk);
+            } else {
+                n = uart::write(bytes, chunk);
+            }
+            tail += n;
+            if (n < chunk) break;
         }
-        out_pos = 0;
+        ring->tail = tail;
+        return tail != start;
     }
     
-    // Buffered character output - flushes on newline or when full
-    inline void buffered_putc(char c) {
-        out_buffer[out_pos++] = c;
-        if (c == '\n' || out_pos >= 255) {
-            flush_output();
+    // Timer callback: show what a program still computing has queued
+    static void console_tick() {
+        Session* s = session();
+        if (s && s->running && drain_console(&s->console, false)) {
+            casm::fb_invalidate(&s->fb);
+        }
+    }
+    
+    // Timer callback for casm prof: charge a sample to the instruction
+    // the timer IRQ interrupted. The timer handler is preemptible, so
+    // ELR_EL1 may already hold a nested IRQ's return address; the
+    // interrupted frame has the program's
+    static void profile_tick() {
+        Session* s = session();
+        interrupts::ExceptionContext* ctx = interrupts::irq_context();
+        if (s && s->running && s->profile && ctx) {
+            casm::profile_sample(s->profile, ctx->elr - s->base_addr);
+        }
+    }
+    
+    // The timer is tickless, so these periodic callbacks are only
+    // registered while some running program needs them. Callbacks run on
+    // the CPU that registered them and tasks never migrate, so each CPU
+    // counts the programs running on it
+    static int console_tick_users[smp::MAX_CPUS] = {};
+    static int profile_tick_users[smp::MAX_CPUS] = {};
+    
+    static void retain_tick(int* users, timer::Callback tick, uint64_t interval_ms) {
+        uint64_t flags = interrupts::save_and_disable();
+        if (users[smp::cpu_id()]++ == 0) {
+            timer::register_callback(tick, interval_ms);
+        }
+        interrupts::restore(flags);
+    }
+    
+    static void release_tick(int* users, timer::Callback tick) {
+        uint64_t flags = interrupts::save_and_disable();
+        if (--users[smp::cpu_id()] == 0) {
+            timer::unregister_callback(tick);
         }
+        interrupts::restore(flags);
+    }
+    
+    // Buffered character output
+    inline void buffered_putc(char c) {
+        uart::putc(c);
     }
     
     // Buffered string output
     inline void buffered_puts(const char* s) {
-        while (*s) {
-            buffered_putc(*s++);
-        }
+        size_t len = 0;
+        while (s[len]) len++;
+        uart::write_all(s, len);
     }
     
     // Buffered number output (decimal)
     void buffered_print_num(int64_t value) {
-        if (value < 0) {
-            buffered_putc('-');
-            value = -value;
-        }
-        if (value == 0) {
-            buffered_putc('0');
-            return;
-        }
-        char buf[20];
-        int i = 0;
-        while (value > 0) {
-            buf[i++] = '0' + (value % 10);
-            value /= 10;
-        }
-        while (i > 0) buffered_putc(buf[--i]);
+        char buf[21];
+        int i = sizeof(buf);
+        uint64_t mag = (value < 0) ? 0 - (uint64_t)value : (uint64_t)value;
+        do {
+            buf[--i] = '0' + (mag % 10);
+            mag /= 10;
+        } while (mag > 0);
+        if (value < 0) buf[--i] = '-';
+        uart::write_all(&buf[i], sizeof(buf) - i);
     }
     
     // Buffered hex output
     void buffered_print_hex(uint32_t value) {
         const char* hex = "0123456789abcdef";
-        buffered_putc('0');
-        buffered_putc('x');
+        char buf[10];
+        int n = 0;
+        buf[n++] = '0';
+        buf[n++] = 'x';
         bool started = false;
         for (int i = 28; i >= 0; i -= 4) {
             int digit = (value >> i) & 0xF;
             if (digit || started || i == 0) {
-                buffered_putc(hex[digit]);
+                buf[n++] = hex[digit];
                 started = true;
             }
         }
+        uart::write_all(buf, n);
     }
     
-    // Graphics framebuffer
-    static char framebuffer[25][81];
-    static char fb_colors[25][80];
-    static int fb_width = 0;
-    static int fb_height = 0;
-    static bool fb_active = false;
-    static int fb_fg = 7;
-    static int fb_bg = 0;
-    
     // Better RNG state (xorshift64)
     static uint64_t rng_state = 0x853c49e6748fea9bULL;
     
-    void fb_clear() {
-        for (int y = 0; y < 25; y++) {
-            for (int x = 0; x < 80; x++) {
-                framebuffer[y][x] = ' ';
-                fb_colors[y][x] = 0x70;
-            }
-            framebuffer[y][80] = '\0';
-        }
-    }
-    
-    void fb_plot(int x, int y, char ch) {
-        if (x >= 0 && x < fb_width && y >= 0 && y < fb_height) {
-            framebuffer[y][x] = ch ? ch : ' ';
-            fb_colors[y][x] = (fb_fg & 0x7) | ((fb_bg & 0x7) << 4);
-        }
-    }
-    
-    void fb_render() {
-        if (!fb_active || fb_height == 0) return;
-        int last_fg = -1, last_bg = -1;
-        for (int y = 0; y < fb_height; y++) {
-            for (int x = 0; x < fb_width; x++) {
-                int fg = fb_colors[y][x] & 0x7;
-                int bg = (fb_colors[y][x] >> 4) & 0x7;
-                if (fg != last_fg || bg != last_bg) {
-                    uart::printf("\x1b[3%d;4%dm", fg, bg);
-                    last_fg = fg;
-                    last_bg = bg;
-                }
-                uart::putc(framebuffer[y][x]);
-            }
-            uart::puts("\x1b[0m\n");
-            last_fg = last_bg = -1;
+    void init(uint8_t* buffer, size_t size, casm::Profile* profile) {
+        Session* s = static_cast<Session*>(memory::alloc_pages(SESSION_PAGES));
+        if (!s) {
+            sched::set_local(nullptr);
+            uart::puts("casm: Out of memory for program\n");
+            return;
         }
-    }
-    
-    void init(uint8_t* buffer, size_t size) {
-        code_buffer = buffer;
-        mem_size = size;
-        base_addr = (uintptr_t)buffer;
-        running = true;
-        halt_requested = false;
-        svc_count = 0;
-        start_tick = timer::get_uptime_ms();
-        out_pos = 0;  // Clear output buffer
-        fb_active = false;
-        fb_width = 0;
-        fb_height = 0;
-        fb_fg = 7;
-        fb_bg = 0;
-        fb_clear();
+        s->code_buffer = buffer;
+        s->mem_size = size;
+        s->base_addr = (uintptr_t)buffer;
+        s->running = true;
+        s->halt_requested = false;
+        s->svc_count = 0;
+        s->start_tick = timer::get_uptime_ms();
+        s->profile = profile;
+        casm::fb_reset(&s->fb);
+        s->console.head = 0;
+        s->console.tail = 0;
+        // Publish the session only once the timer tick may look at it
+        sched::set_local(s);
         // Seed RNG with timer
-        rng_state ^= start_tick;
+        rng_state ^= s->start_tick;
         if (rng_state == 0) rng_state = 0x853c49e6748fea9bULL;
     }
     
     void cleanup() {
+        Session* s = session();
+        if (drain_console(&s->console, true)) casm::fb_invalidate(&s->fb);
         flush_output();  // Flush any remaining buffered output
-        if (fb_active) fb_render();
+        // A canvas the program already rendered is only brought up to date
+        if (s->fb.active) casm::fb_render(&s->fb);
         uart::puts("\x1b[0m");
-        running = false;
-        code_buffer = nullptr;
-        base_addr = 0;
+        s->running = false;
+        s->code_buffer = nullptr;
+        s->base_addr = 0;
     }
     
     // Fast xorshift64 RNG
@@ -178,16 +241,283 @@ namespace casm_native {
         rng_state = x;
         return x;
     }
+    
+    // ========================================================================
+    // CASM SVC Handlers
+    // ========================================================================
+    
+    /*
+     * Handler for one CASM opcode; regs holds the program's x0-x30, of
+     * which only x0-x18 and x24 are valid on the fast path
+     */
+    using SvcHandler = void (*)(Session* s, uint64_t* regs);
+    
+    // Indexed by the SVC immediate - 0x100; null entries are unknown opcodes
+    static SvcHandler svc_table[256];
+    
+    // Program address (absolute, or offset into the arena) to pointer
+    static inline uint8_t* safe_ptr(Session* s, uint64_t addr) {
+        if (addr >= s->base_addr && addr < s->base_addr + s->mem_size) return (uint8_t*)addr;
+        if (addr < s->mem_size) return (uint8_t*)(s->base_addr + addr);
+        return nullptr;
+    }
+    
+    // Copy a file name out of program memory (empty if addr is invalid)
+    static void copy_name(Session* s, uint64_t addr, char (&name)[64]) {
+        uint8_t* ptr = safe_ptr(s, addr);
+        int j = 0;
+        if (ptr) while (j < 63 && ptr[j]) { name[j] = ptr[j]; j++; }
+        name[j] = 0;
+    }
+    
+    // Drawing opcodes create a 40x12 canvas on first use
+    static inline void ensure_canvas(Session* s) {
+        if (!s->fb.active) { s->fb.active = true; s->fb.width = 40; s->fb.height = 12; casm::fb_clear(&s->fb); }
+    }
+    
+    // I/O opcodes; output is buffered, input flushes it first
+    // Anything they print moves the cursor off a rendered canvas
+    static void svc_prt(Session* s, uint64_t* regs) {
+        uint8_t* ptr = safe_ptr(s, regs[0]);
+        if (ptr) buffered_puts(reinterpret_cast<const char*>(ptr));
+        casm::fb_invalidate(&s->fb);
+    }
+    static void svc_prtc(Session* s, uint64_t* regs) { buffered_putc(regs[0] & 0xFF); casm::fb_invalidate(&s->fb); }
+    static void svc_prtn(Session* s, uint64_t* regs) { buffered_print_num((int64_t)regs[0]); casm::fb_invalidate(&s->fb); }
+    static void svc_prtx(Session* s, uint64_t* regs) { buffered_print_hex((uint32_t)regs[0]); casm::fb_invalidate(&s->fb); }
+    
+    // SVCs enter with IRQs masked, and uart::getc only sleeps when they
+    // are not: unmask them for a blocking read so the timer, preemption
+    // and other tasks keep running. ELR/SPSR are already on the stack,
+    // and the mask is back on before the exit path reloads them
+    static uint64_t unmask_for_wait() {
+        uint64_t flags = interrupts::save_and_disable();
+        asm volatile("msr daifclr, #2" ::: "memory");
+        return flags;
+    }
+    
+    static void svc_inp(Session* s, uint64_t* regs) {
+        flush_output();
+        casm::fb_invalidate(&s->fb);
+        uint64_t flags = unmask_for_wait();
+        regs[0] = uart::getc();
+        interrupts::restore(flags);
+    }
+    static void svc_inps(Session* s, uint64_t* regs) {
+        flush_output();
+        casm::fb_invalidate(&s->fb);
+        uint8_t* ptr = safe_ptr(s, regs[0]);
+        uint64_t max = regs[1] ? regs[1] : 64;
+        if (max > 256) max = 256;
+        uint64_t i = 0;
+        if (ptr) {
+            uint64_t flags = unmask_for_wait();
+            while (i < max - 1) {
+                char c = uart::getc();
+                if (c == '\r' || c == '\n') { uart::putc('\n'); break; }
+                if (c == 127 || c == 8) { if (i > 0) { i--; uart::puts("\b \b"); } continue; }
+                uart::putc(c);
+                ptr[i++] = c;
+            }
+            interrupts::restore(flags);
+            ptr[i] = 0;
+        }
+        regs[0] = i;
+    }
+    // The console ring was drained on the way in; start sending it
+    static void svc_flush(Session*, uint64_t*) { flush_output(); }
+    
+    // Graphics opcodes; setc/reset/canvas also leave the color in x24 for plot
+    // Present the canvas now: in full the first time, then only what changed
+    static void svc_render(Session* s, uint64_t*) {
+        casm::fb_render(&s->fb);
+        flush_output();
+    }
+    static void svc_cls(Session* s, uint64_t*) {
+        if (!s->fb.active) { s->fb.active = true; s->fb.width = 40; s->fb.height = 12; }
+        casm::fb_clear(&s->fb);
+    }
+    static void svc_setc(Session* s, uint64_t* regs) {
+        ensure_canvas(s);
+        s->fb.fg = regs[0] & 7;
+        s->fb.bg = regs[1] & 7;
+        regs[24] = (s->fb.fg & 0x7) | ((s->fb.bg & 0x7) << 4);
+    }
+    // Kept for old binaries; the plot pseudo-op stores to the framebuffer itself
+    static void svc_plot(Session* s, uint64_t* regs) {
+        ensure_canvas(s);
+        casm::fb_plot(&s->fb, regs[0] & 0xFF, regs[1] & 0xFF, regs[2] & 0xFF);
+    }
+    static void svc_line(Session* s, uint64_t* regs) {
+        ensure_canvas(s);
+        int x1 = regs[0] & 0xFF, y1 = regs[1] & 0xFF, x2 = regs[2] & 0xFF, y2 = regs[3] & 0xFF;
+        char ch = (regs[4] & 0xFF) ? (regs[4] & 0xFF) : '*';
+        if (y1 == y2) { for (int i = (x1<x2?x1:x2); i <= (x1>x2?x1:x2); i++) casm::fb_plot(&s->fb, i, y1, ch); }
+        else if (x1 == x2) { for (int i = (y1<y2?y1:y2); i <= (y1>y2?y1:y2); i++) casm::fb_plot(&s->fb, x1, i, ch); }
+    }
+    static void svc_box(Session* s, uint64_t* regs) {
+        ensure_canvas(s);
+        int x = regs[0] & 0xFF, y = regs[1] & 0xFF, w = regs[2] & 0xFF, h = regs[3] & 0xFF;
+        casm::fb_plot(&s->fb, x, y, '+'); for (int i = 1; i < w-1; i++) casm::fb_plot(&s->fb, x+i, y, '-'); casm::fb_plot(&s->fb, x+w-1, y, '+');
+        for (int i = 1; i < h-1; i++) { casm::fb_plot(&s->fb, x, y+i, '|'); for (int j = 1; j < w-1; j++) casm::fb_plot(&s->fb, x+j, y+i, ' '); casm::fb_plot(&s->fb, x+w-1, y+i, '|'); }
+        casm::fb_plot(&s->fb, x, y+h-1, '+'); for (int i = 1; i < w-1; i++) casm::fb_plot(&s->fb, x+i, y+h-1, '-'); casm::fb_plot(&s->fb, x+w-1, y+h-1, '+');
+    }
+    static void svc_reset(Session* s, uint64_t* regs) {
+        s->fb.fg = 7; s->fb.bg = 0;
+        regs[24] = 0x70;  // white on black
+    }
+    static void svc_canvas(Session* s, uint64_t* regs) {
+        s->fb.width = regs[0] & 0xFF; s->fb.height = regs[1] & 0xFF;
+        if (s->fb.width < 1) s->fb.width = 40;
+        if (s->fb.height < 1) s->fb.height = 10;
+        if (s->fb.width > 80) s->fb.width = 80;
+        if (s->fb.height > 24) s->fb.height = 24;
+        s->fb.active = true; casm::fb_clear(&s->fb);
+        regs[24] = 0x70;
+    }
+    
+    // File opcodes
+    static void svc_fcreat(Session* s, uint64_t* regs) {
+        char fname[64]; copy_name(s, regs[0], fname);
+        regs[0] = ramfs::create_file(fname) ? 1 : 0;
+    }
+    static void svc_fwrite(Session* s, uint64_t* regs) {
+        char fname[64]; copy_name(s, regs[0], fname);
+        uint8_t* data_ptr = safe_ptr(s, regs[1]);
+        uint64_t len = regs[2];
+        ramfs::FSNode* f = ramfs::open_file(fname); if (!f) f = ramfs::create_file(fname);
+        if (f && data_ptr) { ramfs::write_file(f, data_ptr, 0, len); regs[0] = len; } else regs[0] = 0;
+    }
+    static void svc_fread(Session* s, uint64_t* regs) {
+        char fname[64]; copy_name(s, regs[0], fname);
+        uint8_t* buf_ptr = safe_ptr(s, regs[1]);
+        ramfs::FSNode* f = ramfs::open_file(fname);
+        regs[0] = (f && buf_ptr) ? ramfs::read_file(f, buf_ptr, 0, regs[2]) : 0;
+    }
+    static void svc_fdel(Session* s, uint64_t* regs) {
+        char fname[64]; copy_name(s, regs[0], fname);
+        regs[0] = ramfs::delete_file(fname) ? 1 : 0;
+    }
+    static void copy_file(Session* s, uint64_t* regs, bool move) {
+        char src[64], dst[64];
+        copy_name(s, regs[0], src);
+        copy_name(s, regs[1], dst);
+        ramfs::FSNode* sf = ramfs::open_file(src);
+        if (sf) {
+            uint8_t cb[1024]; size_t sz = ramfs::read_file(sf, cb, 0, sizeof(cb));
+            ramfs::FSNode* df = ramfs::create_file(dst);
+            if (df) { ramfs::write_file(df, cb, 0, sz); if (move) ramfs::delete_file(src); regs[0] = 1; }
+            else regs[0] = 0;
+        } else regs[0] = 0;
+    }
+    static void svc_fcopy(Session* s, uint64_t* regs) { copy_file(s, regs, false); }
+    static void svc_fmove(Session* s, uint64_t* regs) { copy_file(s, regs, true); }
+    static void svc_fexist(Session* s, uint64_t* regs) {
+        char fname[64]; copy_name(s, regs[0], fname);
+        regs[0] = ramfs::open_file(fname) ? 1 : 0;
+    }
+    
+    // Memory/String opcodes (word-wide routines from klib)
+    static void svc_strlen(Session* s, uint64_t* regs) {
+        uint8_t* ptr = safe_ptr(s, regs[0]);
+        regs[0] = ptr ? klib::strlen(reinterpret_cast<const char*>(ptr)) : 0;
+    }
+    static void svc_memcpy(Session* s, uint64_t* regs) {
+        uint8_t* dst = safe_ptr(s, regs[0]); uint8_t* src = safe_ptr(s, regs[1]);
+        if (dst && src) klib::memcpy(dst, src, regs[2]);
+    }
+    static void svc_memset(Session* s, uint64_t* regs) {
+        uint8_t* ptr = safe_ptr(s, regs[0]);
+        if (ptr) klib::memset(ptr, regs[1] & 0xFF, regs[2]);
+    }
+    static void svc_abs(Session*, uint64_t* regs) {
+        int64_t v = (int64_t)regs[0]; regs[0] = (v < 0) ? -v : v;
+    }
+    
+    // System opcodes
+    static void svc_sleep(Session*, uint64_t* regs) {
+        flush_output();  // So text appears before the delay
+        sched::sleep_ms(regs[0] & 0xFFFF);
+    }
+    static void svc_rnd(Session*, uint64_t* regs) {
+        uint64_t max = regs[0] ? regs[0] : 1;
+        regs[0] = xorshift64() % max;
+    }
+    static void svc_tick(Session*, uint64_t* regs) { regs[0] = timer::get_uptime_ms(); }
+    static void svc_halt(Session* s, uint64_t*) {
+        s->halt_requested = true;
+        cleanup();
+    }
+    
+    static void set_svc(uint32_t number, SvcHandler handler) {
+        svc_table[number - 0x100] = handler;
+    }
+    
+    // Fill svc_table; called once from interrupts::init()
+    static void install_svc_handlers() {
+        set_svc(0x100, svc_prt);
+        set_svc(0x101, svc_prtc);
+        set_svc(0x102, svc_prtn);
+        set_svc(0x103, svc_inp);
+        set_svc(0x104, svc_inps);
+        set_svc(0x105, svc_prtx);
+        set_svc(0x106, svc_flush);
+        set_svc(0x110, svc_cls);
+        set_svc(0x111, svc_setc);
+        set_svc(0x112, svc_plot);
+        set_svc(0x113, svc_line);
+        set_svc(0x114, svc_box);
+        set_svc(0x115, svc_reset);
+        set_svc(0x116, svc_canvas);
+        set_svc(0x117, svc_render);
+        set_svc(0x120, svc_fcreat);
+        set_svc(0x121, svc_fwrite);
+        set_svc(0x122, svc_fread);
+        set_svc(0x123, svc_fdel);
+        set_svc(0x124, svc_fcopy);
+        set_svc(0x125, svc_fmove);
+        set_svc(0x126, svc_fexist);
+        set_svc(0x130, svc_strlen);
+        set_svc(0x131, svc_memcpy);
+        set_svc(0x132, svc_memset);
+        set_svc(0x133, svc_abs);
+        set_svc(0x1F0, svc_sleep);
+        set_svc(0x1F1, svc_rnd);
+        set_svc(0x1F2, svc_tick);
+        set_svc(0x1FF, svc_halt);
+    }
 }
 
 // External assembly function to install vector table
 extern "C" void install_exception_vectors();
 
+// SVC fast path switch (defined with the C exception handlers)
+extern "C" bool casm_svc_fast_enabled;
+
 namespace interrupts {
 
 // IRQ handler table
 static Handler irq_handlers[MAX_IRQ] = {nullptr};
 
+// GIC priority of each IRQ, kept to set the banked ones on every CPU
+static uint8_t irq_priority[MAX_IRQ];
+
+// IRQ 1020-1023 are special; 1023 means nothing pending above the running priority
+constexpr uint32_t IRQ_SPURIOUS = 1020;
+
+/*
+ * Per-CPU nesting state and statistics, only touched by that CPU with
+ * IRQs masked
+ */
+struct alignas(64) IrqCpu {
+    uint32_t depth;                 // handle_irq() calls in progress
+    ExceptionContext* frame;        // Frame the outermost one interrupted
+    CpuIrqStats stats;
+    IrqStats irqs[MAX_IRQ];
+};
+
+static IrqCpu irq_cpus[smp::MAX_CPUS];
+
 // Interrupt enabled state
 static bool interrupts_enabled = false;
 
@@ -199,10 +529,14 @@ void init() {
     // Install exception vector table
     // Requirements: 3.2
     install_exception_vectors();
+    casm_native::install_svc_handlers();
     
     // Initialize GIC
     // Requirements: 3.1
     gic::init();
+    for (uint32_t irq = 0; irq < MAX_IRQ; irq++) {
+        irq_priority[irq] = PRIORITY_NORMAL;
+    }
     
     uart::puts("[interrupts] Exception vectors installed\n");
     uart::puts("[interrupts] GIC initialized\n");
@@ -227,6 +561,65 @@ void unregister_handler(uint32_t irq) {
     }
 }
 
+/*
+ * Set an IRQ's GIC priority
+ */
+void set_priority(uint32_t irq, uint8_t priority) {
+    if (irq < MAX_IRQ) {
+        irq_priority[irq] = priority;
+        gic::set_priority(irq, priority);
+    }
+}
+
+/*
+ * Set up a secondary CPU's GIC interface and banked SGI/PPI priorities
+ */
+void init_cpu() {
+    gic::init_cpu();
+    for (uint32_t irq = 0; irq < 32; irq++) {
+        gic::set_priority(irq, irq_priority[irq]);
+    }
+}
+
+/*
+ * Frame the current IRQ interrupted
+ */
+ExceptionContext* irq_context() {
+    return irq_cpus[smp::cpu_id()].frame;
+}
+
+/*
+ * IRQ statistics
+ */
+bool get_irq_stats(uint32_t cpu, uint32_t irq, IrqStats* stats) {
+    if (cpu >= smp::MAX_CPUS || irq >= MAX_IRQ) {
+        return false;
+    }
+    uint64_t flags = save_and_disable();
+    *stats = irq_cpus[cpu].irqs[irq];
+    restore(flags);
+    return true;
+}
+
+bool get_cpu_stats(uint32_t cpu, CpuIrqStats* stats) {
+    if (cpu >= smp::MAX_CPUS) {
+        return false;
+    }
+    uint64_t flags = save_and_disable();
+    *stats = irq_cpus[cpu].stats;
+    restore(flags);
+    return true;
+}
+
+void reset_stats() {
+    uint64_t flags = save_and_disable();
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        klib::memset(&irq_cpus[cpu].stats, 0, sizeof(CpuIrqStats));
+        klib::memset(irq_cpus[cpu].irqs, 0, sizeof(irq_cpus[cpu].irqs));
+    }
+    restore(flags);
+}
+
 /*
  * Enable specific IRQ in GIC
  * Requirements: 3.1
@@ -270,14 +663,6 @@ bool is_enabled() {
 
 } // namespace interrupts
 
-// CASM native execution interface
-namespace casm_native {
-    extern void init(uint8_t* buffer, size_t size);
-    extern void cleanup();
-    extern bool halt_requested;
-    extern bool running;
-}
-
 /*
  * C exception handlers called from vectors.S
  * These handle the actual exception processing
@@ -285,227 +670,69 @@ namespace casm_native {
  */
 extern "C" {
 
+// Read by vectors.S; clear to send every SVC down the full path
+bool casm_svc_fast_enabled = true;
+
+/*
+ * Dispatch a CASM SVC through svc_table
+ * Called by the vectors.S fast path with only the caller-saved registers,
+ * x24 and ELR/SPSR saved, or by handle_sync_exception with a full frame
+ * Returns false, having changed nothing, if no program is running
+ */
+bool handle_casm_svc(uint64_t* regs, uint32_t number) {
+    casm_native::Session* s = casm_native::session();
+    if (!s || !s->running) {
+        return false;
+    }
+    s->svc_count++;
+    
+    // Bytes putc queued come before anything this SVC prints
+    if (s->console.head != s->console.tail &&
+        casm_native::drain_console(&s->console, true)) {
+        casm::fb_invalidate(&s->fb);
+    }
+    
+    uint32_t index = number - 0x100;
+    casm_native::SvcHandler handler = index < 256 ? casm_native::svc_table[index] : nullptr;
+    if (!handler) {
+        uart::printf("\n[casm] Unknown SVC #0x%x\n", number);
+        casm::fb_invalidate(&s->fb);
+        s->halt_requested = true;
+        casm_native::cleanup();
+        return true;
+    }
+    if (s->profile || trace::enabled()) {
+        uint64_t start = timer::get_ticks();
+        handler(s, regs);
+        uint64_t ticks = timer::get_ticks() - start;
+        if (s->profile) {
+            s->profile->svc_calls[index]++;
+            s->profile->svc_ticks[index] += ticks;
+        }
+        trace::record_at(start, trace::Event::SVC, number, static_cast<uint32_t>(ticks));
+        return true;
+    }
+    handler(s, regs);
+    return true;
+}
+
 /*
  * Handle synchronous exceptions
  * (syscalls, undefined instructions, data aborts, etc.)
  */
-void handle_sync_exception(interrupts::ExceptionContext* ctx) {
+interrupts::ExceptionContext* handle_sync_exception(interrupts::ExceptionContext* ctx) {
     // Extract exception class from ESR
     uint32_t ec = (ctx->esr >> 26) & 0x3F;
     
-    // Fast path: Handle SVC (syscall) - EC = 0x15
-    if (ec == 0x15 && casm_native::running) {
-        uint16_t svc_num = ctx->esr & 0xFFFF;
-        uint64_t* regs = ctx->x;
-        casm_native::svc_count++;
-        
-        // Pre-compute for address validation
-        const uintptr_t base = casm_native::base_addr;
-        const size_t mem_size = casm_native::mem_size;
-        
-        // Inline address validation macro (faster than lambda)
-        #define SAFE_PTR(addr) \
-            (((addr) >= base && (addr) < base + mem_size) ? (uint8_t*)(addr) : \
-             ((addr) < mem_size) ? (uint8_t*)(base + (addr)) : nullptr)
-        
-        // Most common opcodes first for branch prediction
-        // Using buffered output for better performance
-        switch (svc_num) {
-            case 0x101: // PRTC - most common, use buffered output
-                casm_native::buffered_putc(regs[0] & 0xFF);
-                return;
-            case 0x102: // PRTN - use buffered number output
-                casm_native::buffered_print_num((int64_t)regs[0]);
-                return;
-            case 0x103: // INP - must flush before reading
-                casm_native::flush_output();
-                regs[0] = uart::getc();
-                return;
-            case 0x100: { // PRT - use buffered string output
-                uint8_t* ptr = SAFE_PTR(regs[0]);
-                if (ptr) while (*ptr) casm_native::buffered_putc(*ptr++);
-                return;
-            }
-            case 0x104: { // INPS - must flush before reading
-                casm_native::flush_output();
-                uint8_t* ptr = SAFE_PTR(regs[0]);
-                uint64_t max = regs[1] ? regs[1] : 64;
-                if (max > 256) max = 256;
-                uint64_t i = 0;
-                if (ptr) {
-                    while (i < max - 1) {
-                        char c = uart::getc();
-                        if (c == '\r' || c == '\n') { uart::putc('\n'); break; }
-                        if (c == 127 || c == 8) { if (i > 0) { i--; uart::puts("\b \b"); } continue; }
-                        uart::putc(c);
-                        ptr[i++] = c;
-                    }
-                    ptr[i] = 0;
-                }
-                regs[0] = i;
-                return;
-            }
-            case 0x105: // PRTX - use buffered hex output
-                casm_native::buffered_print_hex((uint32_t)regs[0]);
-                return;
-            
-            // Graphics opcodes
-            case 0x110: // CLS
-                if (!casm_native::fb_active) { casm_native::fb_active = true; casm_native::fb_width = 40; casm_native::fb_height = 12; }
-                casm_native::fb_clear();
-                return;
-            case 0x111: // SETC - also store computed color in x24 for native plot
-                if (!casm_native::fb_active) { casm_native::fb_active = true; casm_native::fb_width = 40; casm_native::fb_height = 12; casm_native::fb_clear(); }
-                casm_native::fb_fg = regs[0] & 7;
-                casm_native::fb_bg = regs[1] & 7;
-                // Store computed color in x24 for native plot to use
-                regs[24] = (casm_native::fb_fg & 0x7) | ((casm_native::fb_bg & 0x7) << 4);
-                return;
-            case 0x112: // PLOT - kept for backward compatibility, native plot bypasses this
-                if (!casm_native::fb_active) { casm_native::fb_active = true; casm_native::fb_width = 40; casm_native::fb_height = 12; casm_native::fb_clear(); }
-                casm_native::fb_plot(regs[0] & 0xFF, regs[1] & 0xFF, regs[2] & 0xFF);
-                return;
-            case 0x113: { // LINE
-                if (!casm_native::fb_active) { casm_native::fb_active = true; casm_native::fb_width = 40; casm_native::fb_height = 12; casm_native::fb_clear(); }
-                int x1 = regs[0] & 0xFF, y1 = regs[1] & 0xFF, x2 = regs[2] & 0xFF, y2 = regs[3] & 0xFF;
-                char ch = (regs[4] & 0xFF) ? (regs[4] & 0xFF) : '*';
-                if (y1 == y2) { for (int i = (x1<x2?x1:x2); i <= (x1>x2?x1:x2); i++) casm_native::fb_plot(i, y1, ch); }
-                else if (x1 == x2) { for (int i = (y1<y2?y1:y2); i <= (y1>y2?y1:y2); i++) casm_native::fb_plot(x1, i, ch); }
-                return;
-            }
-            case 0x114: { // BOX
-                if (!casm_native::fb_active) { casm_native::fb_active = true; casm_native::fb_width = 40; casm_native::fb_height = 12; casm_native::fb_clear(); }
-                int x = regs[0] & 0xFF, y = regs[1] & 0xFF, w = regs[2] & 0xFF, h = regs[3] & 0xFF;
-                casm_native::fb_plot(x, y, '+'); for (int i = 1; i < w-1; i++) casm_native::fb_plot(x+i, y, '-'); casm_native::fb_plot(x+w-1, y, '+');
-                for (int i = 1; i < h-1; i++) { casm_native::fb_plot(x, y+i, '|'); for (int j = 1; j < w-1; j++) casm_native::fb_plot(x+j, y+i, ' '); casm_native::fb_plot(x+w-1, y+i, '|'); }
-                casm_native::fb_plot(x, y+h-1, '+'); for (int i = 1; i < w-1; i++) casm_native::fb_plot(x+i, y+h-1, '-'); casm_native::fb_plot(x+w-1, y+h-1, '+');
-                return;
-            }
-            case 0x115: // RESET - also update x24 with default color
-                casm_native::fb_fg = 7; casm_native::fb_bg = 0;
-                regs[24] = 0x70;  // white on black
-                return;
-            case 0x116: { // CANVAS - also set default color in x24
-                casm_native::fb_width = regs[0] & 0xFF; casm_native::fb_height = regs[1] & 0xFF;
-                if (casm_native::fb_width < 1) casm_native::fb_width = 40; if (casm_native::fb_height < 1) casm_native::fb_height = 10;
-                if (casm_native::fb_width > 80) casm_native::fb_width = 80; if (casm_native::fb_height > 24) casm_native::fb_height = 24;
-                casm_native::fb_active = true; casm_native::fb_clear();
-                // Set default color (white on black) in x24 for native plot
-                regs[24] = 0x70;
-                return;
-            }
-            
-            // File opcodes
-            case 0x120: { // FCREAT
-                char fname[64]; uint8_t* ptr = SAFE_PTR(regs[0]); int j = 0;
-                if (ptr) while (j < 63 && ptr[j]) { fname[j] = ptr[j]; j++; }
-                fname[j] = 0;
-                regs[0] = ramfs::create_file(fname) ? 1 : 0;
-                return;
-            }
-            case 0x121: { // FWRITE
-                char fname[64]; uint8_t* name_ptr = SAFE_PTR(regs[0]); uint8_t* data_ptr = SAFE_PTR(regs[1]);
-                uint64_t len = regs[2]; int j = 0;
-                if (name_ptr) while (j < 63 && name_ptr[j]) { fname[j] = name_ptr[j]; j++; }
-                fname[j] = 0;
-                ramfs::FSNode* f = ramfs::open_file(fname); if (!f) f = ramfs::create_file(fname);
-                if (f && data_ptr) { ramfs::write_file(f, data_ptr, 0, len); regs[0] = len; } else regs[0] = 0;
-                return;
-            }
-            case 0x122: { // FREAD
-                char fname[64]; uint8_t* name_ptr = SAFE_PTR(regs[0]); uint8_t* buf_ptr = SAFE_PTR(regs[1]);
-                uint64_t max_len = regs[2]; int j = 0;
-                if (name_ptr) while (j < 63 && name_ptr[j]) { fname[j] = name_ptr[j]; j++; }
-                fname[j] = 0;
-                ramfs::FSNode* f = ramfs::open_file(fname);
-                regs[0] = (f && buf_ptr) ? ramfs::read_file(f, buf_ptr, 0, max_len) : 0;
-                return;
-            }
-            case 0x123: { // FDEL
-                char fname[64]; uint8_t* ptr = SAFE_PTR(regs[0]); int j = 0;
-                if (ptr) while (j < 63 && ptr[j]) { fname[j] = ptr[j]; j++; }
-                fname[j] = 0;
-                regs[0] = ramfs::delete_file(fname) ? 1 : 0;
-                return;
-            }
-            case 0x124: case 0x125: { // FCOPY / FMOVE
-                char src[64], dst[64]; uint8_t* src_ptr = SAFE_PTR(regs[0]); uint8_t* dst_ptr = SAFE_PTR(regs[1]); int j = 0;
-                if (src_ptr) while (j < 63 && src_ptr[j]) { src[j] = src_ptr[j]; j++; }
-                src[j] = 0; j = 0;
-                if (dst_ptr) while (j < 63 && dst_ptr[j]) { dst[j] = dst_ptr[j]; j++; }
-                dst[j] = 0;
-                ramfs::FSNode* sf = ramfs::open_file(src);
-                if (sf) {
-                    static uint8_t cb[1024]; size_t sz = ramfs::read_file(sf, cb, 0, sizeof(cb));
-                    ramfs::FSNode* df = ramfs::create_file(dst);
-                    if (df) { ramfs::write_file(df, cb, 0, sz); if (svc_num == 0x125) ramfs::delete_file(src); regs[0] = 1; }
-                    else regs[0] = 0;
-                } else regs[0] = 0;
-                return;
-            }
-            case 0x126: { // FEXIST
-                char fname[64]; uint8_t* ptr = SAFE_PTR(regs[0]); int j = 0;
-                if (ptr) while (j < 63 && ptr[j]) { fname[j] = ptr[j]; j++; }
-                fname[j] = 0;
-                regs[0] = ramfs::open_file(fname) ? 1 : 0;
-                return;
-            }
-            
-            // Memory/String opcodes (optimized with word-sized ops)
-            case 0x130: { // STRLEN
-                uint8_t* ptr = SAFE_PTR(regs[0]); uint64_t len = 0;
-                if (ptr) while (ptr[len]) len++;
-                regs[0] = len;
-                return;
-            }
-            case 0x131: { // MEMCPY - optimized with 64-bit copies
-                uint8_t* dst = SAFE_PTR(regs[0]); uint8_t* src = SAFE_PTR(regs[1]); uint64_t len = regs[2];
-                if (dst && src) {
-                    // Word-aligned fast path
-                    while (len >= 8 && !((uintptr_t)dst & 7) && !((uintptr_t)src & 7)) {
-                        *(uint64_t*)dst = *(uint64_t*)src; dst += 8; src += 8; len -= 8;
-                    }
-                    while (len--) *dst++ = *src++;
-                }
-                return;
-            }
-            case 0x132: { // MEMSET - optimized with 64-bit fills
-                uint8_t* ptr = SAFE_PTR(regs[0]); uint8_t val = regs[1] & 0xFF; uint64_t len = regs[2];
-                if (ptr) {
-                    uint64_t val64 = val * 0x0101010101010101ULL;
-                    while (len >= 8 && !((uintptr_t)ptr & 7)) { *(uint64_t*)ptr = val64; ptr += 8; len -= 8; }
-                    while (len--) *ptr++ = val;
-                }
-                return;
-            }
-            case 0x133: { // ABS
-                int64_t v = (int64_t)regs[0]; regs[0] = (v < 0) ? -v : v;
-                return;
-            }
-            
-            // System opcodes
-            case 0x1F0: // SLEEP - flush output first so text appears before delay
-                casm_native::flush_output();
-                timer::sleep_ms(regs[0] & 0xFFFF);
-                return;
-            case 0x1F1: { // RND - xorshift64 (better quality)
-                uint64_t max = regs[0] ? regs[0] : 1;
-                regs[0] = casm_native::xorshift64() % max;
-                return;
-            }
-            case 0x1F2: regs[0] = timer::get_uptime_ms(); return;
-            case 0x1FF: // HALT
-                casm_native::halt_requested = true;
-                casm_native::cleanup();
-                return;
-            
-            default:
-                uart::printf("\n[casm] Unknown SVC #0x%x\n", svc_num);
-                casm_native::halt_requested = true;
-                casm_native::cleanup();
-                return;
-        }
-        #undef SAFE_PTR
+    // Task yield (sched::yield/sleep_ms/exit): return the next task's frame
+    if (ec == 0x15 && (ctx->esr & 0xFFFF) == sched::SVC_YIELD) {
+        return sched::switch_context(ctx);
+    }
+    
+    // CASM SVCs the vectors.S fast path did not take (outside 0x100-0x1FF,
+    // or casm_svc_fast_enabled is clear)
+    if (ec == 0x15 && handle_casm_svc(ctx->x, ctx->esr & 0xFFFF)) {
+        return ctx;
     }
     
     // Not a CASM SVC - handle as before
@@ -543,6 +770,7 @@ void handle_sync_exception(interrupts::ExceptionContext* ctx) {
     
     // For now, halt on unhandled synchronous exceptions
     uart::puts("[exception] System halted\n");
+    uart::drain();
     while (true) {
         asm volatile("wfe");
     }
@@ -551,27 +779,96 @@ void handle_sync_exception(interrupts::ExceptionContext* ctx) {
 /*
  * Handle IRQ interrupts
  * Requirements: 3.3, 3.4
+ *
+ * Acknowledges interrupts until none is pending, so a burst is handled
+ * in one exception. While a PRIORITY_NORMAL handler runs with IRQs
+ * unmasked, the GIC's running priority is that IRQ's, so only
+ * higher-priority ones reach this CPU; they come back in here nested and
+ * return to the handler they preempted. Only the outermost call may
+ * switch tasks.
  */
-void handle_irq(interrupts::ExceptionContext* ctx) {
-    (void)ctx;  // Context available if needed
+interrupts::ExceptionContext* handle_irq(interrupts::ExceptionContext* ctx) {
+    uint64_t entry = timer::get_ticks();
+    interrupts::IrqCpu* state = &interrupts::irq_cpus[smp::cpu_id()];
+    if (state->depth++ == 0) {
+        state->frame = ctx;
+    } else {
+        state->stats.nested++;
+    }
+    state->stats.entries++;
     
-    // Acknowledge the interrupt and get IRQ number
-    uint32_t irq = gic::acknowledge_irq();
+    smp::PerCpu* cpu = smp::this_cpu();
+    uint32_t batch = 0;
+    while (true) {
+        // Acknowledge the interrupt and get IRQ number
+        uint32_t iar = gic::acknowledge_irq();
+        uint32_t irq = iar & 0x3FF;
+        if (irq >= interrupts::IRQ_SPURIOUS) {
+            break;
+        }
+        
+        uint64_t start = timer::get_ticks();
+        trace::record_at(start, trace::Event::IRQ_ENTER, irq, 0);
+        
+        // Only the timer PPI says when it was raised: at its compare value,
+        // which the handler is about to move
+        uint64_t asserted = irq == interrupts::IRQ_TIMER ? timer::get_compare() : start;
+        cpu->irqs++;
+        if (irq < 16) {
+            cpu->ipis++;
+        }
+        batch++;
+        
+        // Call registered handler if present
+        if (irq < interrupts::MAX_IRQ && interrupts::irq_handlers[irq] != nullptr) {
+            bool preemptible = interrupts::irq_priority[irq] >= interrupts::PRIORITY_NORMAL;
+            if (preemptible) {
+                asm volatile("msr daifclr, #2" ::: "memory");
+            }
+            interrupts::irq_handlers[irq](irq);
+            if (preemptible) {
+                asm volatile("msr daifset, #2" ::: "memory");
+            }
+        } else {
+            uart::printf("[irq] Unhandled IRQ %d\n", irq);
+        }
+        
+        // Signal end of interrupt to GIC (an SGI needs its source CPU too)
+        gic::end_irq(iar);
+        uint64_t end = timer::get_ticks();
+        trace::record_at(end, trace::Event::IRQ_EXIT, irq, 0);
+        
+        if (irq < interrupts::MAX_IRQ) {
+            interrupts::IrqStats* stats = &state->irqs[irq];
+            uint64_t latency = asserted < start ? start - asserted : 0;
+            uint64_t queue = start - entry;
+            uint64_t time = end - start;
+            stats->count++;
+            if (latency > stats->max_latency) {
+                stats->max_latency = latency > 0xFFFFFFFF ? 0xFFFFFFFF : static_cast<uint32_t>(latency);
+            }
+            if (queue > stats->max_queue) {
+                stats->max_queue = queue > 0xFFFFFFFF ? 0xFFFFFFFF : static_cast<uint32_t>(queue);
+            }
+            if (time > stats->max_time) {
+                stats->max_time = time > 0xFFFFFFFF ? 0xFFFFFFFF : static_cast<uint32_t>(time);
+            }
+        }
+    }
     
-    // Check for spurious interrupt (IRQ 1023)
-    if (irq == 1023) {
-        return;
+    state->stats.handled += batch;
+    if (batch > state->stats.max_batch) {
+        state->stats.max_batch = batch;
     }
     
-    // Call registered handler if present
-    if (irq < interrupts::MAX_IRQ && interrupts::irq_handlers[irq] != nullptr) {
-        interrupts::irq_handlers[irq](irq);
-    } else {
-        uart::printf("[irq] Unhandled IRQ %d\n", irq);
+    // A nested call returns to the handler it preempted
+    if (--state->depth > 0) {
+        return ctx;
     }
+    state->frame = nullptr;
     
-    // Signal end of interrupt to GIC
-    gic::end_irq(irq);
+    // Preempt the interrupted task if its time slice is up
+    return sched::switch_context(ctx);
 }
 
 /*
@@ -593,6 +890,7 @@ void handle_serror(interrupts::ExceptionContext* ctx) {
     
     // System errors are typically fatal
     uart::puts("[exception] System halted due to SError\n");
+    uart::drain();
     while (true) {
         asm volatile("wfe");
     }
@@ -603,11 +901,18 @@ void handle_serror(interrupts::ExceptionContext* ctx) {
 // CASM native execution - run function
 namespace casm_native {
     bool is_halted() {
-        return halt_requested;
+        Session* s = session();
+        return s && s->halt_requested;
     }
     
-    void run(void* code_start) {
-        if (!code_buffer || !running) return;
+    uint64_t run(void* code_start) {
+        Session* s = session();
+        if (!s) return 0;
+        if (!s->code_buffer || !s->running) {
+            sched::set_local(nullptr);
+            memory::free_pages(s, SESSION_PAGES);
+            return 0;
+        }
         
         // Jump to the code - it will execute until it hits an SVC
         // The SVC handler will process opcodes and return
@@ -616,7 +921,7 @@ namespace casm_native {
         // Register allocation for native CASM execution:
         // x28 = code_buffer base address (for data area access)
         // x27 = framebuffer base pointer (for direct plot access)
-        // x26 = framebuffer row stride (81 bytes per row)
+        // x26 = console ring (for putc without SVC, see casm/console.h)
         // x25 = fb_colors base pointer (for direct color access)
         //
         // This allows plot to write directly without SVC:
@@ -625,11 +930,20 @@ namespace casm_native {
         //   strb char, [fb_addr]
         //   strb color, [color_addr]  (color from fb_fg/fb_bg)
         
+        // The code was just written through the D-cache; make it visible
+        // to instruction fetch before branching to it
+        mmu::sync_icache(s->code_buffer, s->mem_size);
+        
+        retain_tick(console_tick_users, console_tick, 1);
+        if (s->profile) {
+            retain_tick(profile_tick_users, profile_tick, casm::PROF_INTERVAL_MS);
+        }
+        
         // Call the native code with reserved registers set up
-        register uint64_t x28_val asm("x28") = (uint64_t)code_buffer;
-        register uint64_t x27_val asm("x27") = (uint64_t)&framebuffer[0][0];
-        register uint64_t x26_val asm("x26") = 81;  // Row stride for framebuffer
-        register uint64_t x25_val asm("x25") = (uint64_t)&fb_colors[0][0];
+        register uint64_t x28_val asm("x28") = (uint64_t)s->code_buffer;
+        register uint64_t x27_val asm("x27") = (uint64_t)&s->fb.cells[0][0];
+        register uint64_t x26_val asm("x26") = (uint64_t)&s->console;
+        register uint64_t x25_val asm("x25") = (uint64_t)&s->fb.colors[0][0];
         asm volatile(
             "blr %[func]"
             : "+r"(x28_val), "+r"(x27_val), "+r"(x26_val), "+r"(x25_val)
@@ -642,8 +956,44 @@ namespace casm_native {
         
         // If we get here via RET (not halt), cleanup
         // halt already called cleanup in the SVC handler
-        if (!halt_requested) {
+        if (!s->halt_requested) {
             cleanup();
         }
+        if (s->profile) {
+            release_tick(profile_tick_users, profile_tick);
+        }
+        release_tick(console_tick_users, console_tick);
+        uint64_t svcs = s->svc_count;
+        sched::set_local(nullptr);
+        memory::free_pages(s, SESSION_PAGES);
+        return svcs;
+    }
+    
+    uint64_t bench_svc(uint32_t count, bool fast_path) {
+        // A session over a one-page arena so the CASM SVC handlers run
+        uint8_t* arena = static_cast<uint8_t*>(memory::alloc_pages(1));
+        if (!arena) return 0;
+        init(arena, memory::PAGE_SIZE);
+        Session* s = session();
+        if (!s) {
+            memory::free_pages(arena, 1);
+            return 0;
+        }
+        
+        bool saved = casm_svc_fast_enabled;
+        casm_svc_fast_enabled = fast_path;
+        uint64_t start = timer::get_ticks();
+        for (uint32_t i = 0; i < count; i++) {
+            // TICK touches only x0, like most CASM opcodes
+            register uint64_t x0 asm("x0");
+            asm volatile("svc #0x1F2" : "=r"(x0) :: "memory");
+        }
+        uint64_t elapsed = timer::get_ticks() - start;
+        casm_svc_fast_enabled = saved;
+        
+        sched::set_local(nullptr);
+        memory::free_pages(s, SESSION_PAGES);
+        memory::free_pages(arena, 1);
+        return elapsed;
     }
 }
@@ -8,11 +8,16 @@
 
 #include "uart.h"
 #include "memory.h"
+#include "mmu.h"
+#include "slab.h"
 #include "interrupts.h"
 #include "timer.h"
+#include "pmu.h"
 #include "shell.h"
 #include "commands.h"
 #include "ramfs.h"
+#include "sched.h"
+#include "smp.h"
 
 // Freestanding type definitions (no standard library)
 using uint8_t = unsigned char;
@@ -27,6 +32,8 @@ extern "C" {
     extern uint8_t __bss_end[];
     extern uint8_t __stack_top[];
     extern uint8_t __kernel_end[];
+    extern uint8_t __ramfs_image_start[];
+    extern uint8_t __ramfs_image_end[];
 }
 
 // Kernel version
@@ -51,6 +58,14 @@ static KernelState g_kernel = {
     .version_patch = VERSION_PATCH
 };
 
+// One-shot timers seen by the boot-time timer check
+static volatile uint32_t oneshots_fired = 0;
+
+static void count_oneshot(void* arg) {
+    (void)arg;
+    oneshots_fired = oneshots_fired + 1;
+}
+
 /*
  * Kernel main entry point
  * Called from boot.S after basic CPU initialization
@@ -76,6 +91,9 @@ extern "C" void kernel_main() {
     uart::puts("=======================================\n");
     uart::puts("\n");
     
+    // boot.S has already enabled the MMU and caches
+    mmu::print_info();
+    
     /*
      * Initialize interrupt controller (GIC)
      * Requirements: 3.1, 3.2
@@ -92,17 +110,38 @@ extern "C" void kernel_main() {
     uintptr_t heap_end = RAM_BASE + RAM_SIZE;
     memory::init(heap_start, heap_end);
     
+    // Object caches for small kernel allocations (used by ramfs)
+    slab::init();
+    
     /*
      * Initialize timer
      * Requirements: 9.1
      */
     timer::init();
     
+    /*
+     * Start the PMU counters (perf stat, casm run -p)
+     */
+    pmu::init();
+    
+    /*
+     * Switch UART to interrupt-driven RX/TX rings
+     */
+    uart::enable_interrupts();
+    
     /*
      * Initialize RAM filesystem
      */
     ramfs::init();
     
+    /*
+     * Mount the boot image linked in by src/fs/image.S, if any
+     */
+    size_t image_size = static_cast<size_t>(__ramfs_image_end - __ramfs_image_start);
+    if (image_size > 0) {
+        ramfs::mount_image(__ramfs_image_start, image_size);
+    }
+    
     /*
      * Enable global interrupts
      * Requirements: 3.5
@@ -112,16 +151,19 @@ extern "C" void kernel_main() {
     
     /*
      * Verify timer interrupts are working
-     * Wait a short time and check interrupt count
+     * The timer is tickless, so arm a few one-shots and wait for them
      */
     uart::puts("[kernel] Verifying timer interrupts...\n");
     uint64_t start_count = timer::get_interrupt_count();
-    timer::sleep_ms(100);  // Wait 100ms (should get ~10 interrupts at 10ms interval)
-    uint64_t end_count = timer::get_interrupt_count();
-    uint64_t interrupts_fired = end_count - start_count;
-    uart::printf("[kernel] Timer interrupts in 100ms: %d (expected ~10)\n", (uint32_t)interrupts_fired);
+    for (uint64_t delay_ms = 10; delay_ms <= 50; delay_ms += 10) {
+        timer::add_oneshot(delay_ms * 1000, count_oneshot, nullptr);
+    }
+    timer::sleep_ms(100);
+    uint64_t interrupts_fired = timer::get_interrupt_count() - start_count;
+    uart::printf("[kernel] One-shot timers fired in 100ms: %d of 5 (%d interrupts)\n",
+                 (uint32_t)oneshots_fired, (uint32_t)interrupts_fired);
     
-    if (interrupts_fired > 0) {
+    if (oneshots_fired == 5) {
         uart::puts("[kernel] Timer interrupts: WORKING\n");
     } else {
         uart::puts("[kernel] Timer interrupts: FAILED - no interrupts detected!\n");
@@ -130,6 +172,16 @@ extern "C" void kernel_main() {
     // Display uptime to verify timer is tracking time
     uart::printf("[kernel] Current uptime: %d ms\n", (uint32_t)timer::get_uptime_ms());
     
+    /*
+     * Start preemptive scheduling; this thread becomes the shell task
+     */
+    sched::init();
+    
+    /*
+     * Start the other CPUs; each becomes its own scheduler's idle task
+     */
+    smp::init();
+    
     /*
      * Initialize and run shell
      * Requirements: 5.1
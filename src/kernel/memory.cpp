@@ -1,12 +1,20 @@
 /*
  * EmberOS Memory Manager Implementation
- * Physical page allocator using bitmap-based tracking
- * 
+ * Physical page allocator: buddy system with per-order free lists
+ *
+ * Free blocks of 2^k pages are kept on doubly linked lists, one per order,
+ * with the list links stored in the first bytes of the free block itself.
+ * A bitmap of allocated pages is kept alongside so frees can be validated
+ * and partial frees of an allocation are handled page-exactly.
+ *
  * Requirements: 2.1, 2.2, 2.3, 2.4
  */
 
 #include "memory.h"
 #include "uart.h"
+#include "interrupts.h"
+#include "spinlock.h"
+#include "trace.h"
 
 namespace memory {
 
@@ -14,27 +22,61 @@ namespace memory {
 // Bitmap: 32768 bits = 512 uint64_t entries
 constexpr size_t MAX_PAGES = 32768;
 constexpr size_t BITMAP_SIZE = MAX_PAGES / 64;
+constexpr size_t NUM_ORDERS = MAX_ORDER + 1;
+
+static_assert((1UL << MAX_ORDER) == MAX_PAGES, "MAX_ORDER must cover MAX_PAGES");
+
+// Marker in block_order[] for pages that are not the head of a free block
+constexpr uint8_t NOT_FREE_HEAD = 0xFF;
+
+// Free list links, stored in the first page of each free block
+struct FreeBlock {
+    FreeBlock* next;
+    FreeBlock* prev;
+};
 
 // Page allocation bitmap (1 = used, 0 = free)
 static uint64_t page_bitmap[BITMAP_SIZE];
 
+// Order of the free block starting at each page, or NOT_FREE_HEAD
+static uint8_t block_order[MAX_PAGES];
+
+// Per-order free lists and their lengths
+static FreeBlock* free_lists[NUM_ORDERS];
+static size_t free_counts[NUM_ORDERS];
+
 // Memory range tracking
 static uintptr_t mem_start = 0;
 static uintptr_t mem_end = 0;
 static size_t total_pages = 0;
 static size_t used_pages = 0;
 
-// Helper: Set a bit in the bitmap (mark page as used)
-static inline void bitmap_set(size_t page_index) {
-    if (page_index < MAX_PAGES) {
-        page_bitmap[page_index / 64] |= (1ULL << (page_index % 64));
+// Guards all of the above; IRQ handlers allocate too, so taken IRQs-masked
+static spinlock::Lock g_lock;
+
+// Helper: Set a run of bits in the bitmap (mark pages as used)
+static void bitmap_set_range(size_t start, size_t n) {
+    while (n > 0) {
+        size_t word = start / 64;
+        size_t bit = start % 64;
+        size_t count = (64 - bit < n) ? 64 - bit : n;
+        uint64_t mask = (count == 64) ? ~0ULL : (((1ULL << count) - 1) << bit);
+        page_bitmap[word] |= mask;
+        start += count;
+        n -= count;
     }
 }
 
-// Helper: Clear a bit in the bitmap (mark page as free)
-static inline void bitmap_clear(size_t page_index) {
-    if (page_index < MAX_PAGES) {
-        page_bitmap[page_index / 64] &= ~(1ULL << (page_index % 64));
+// Helper: Clear a run of bits in the bitmap (mark pages as free)
+static void bitmap_clear_range(size_t start, size_t n) {
+    while (n > 0) {
+        size_t word = start / 64;
+        size_t bit = start % 64;
+        size_t count = (64 - bit < n) ? 64 - bit : n;
+        uint64_t mask = (count == 64) ? ~0ULL : (((1ULL << count) - 1) << bit);
+        page_bitmap[word] &= ~mask;
+        start += count;
+        n -= count;
     }
 }
 
@@ -56,6 +98,76 @@ static inline uintptr_t page_to_addr(size_t page_index) {
     return mem_start + (page_index * PAGE_SIZE);
 }
 
+// Helper: Smallest order whose block holds n pages
+static inline size_t order_for(size_t n) {
+    size_t order = 0;
+    while ((1UL << order) < n) {
+        order++;
+    }
+    return order;
+}
+
+// Helper: Push a free block onto its order's list
+static void list_push(size_t page, size_t order) {
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(page_to_addr(page));
+    block->prev = nullptr;
+    block->next = free_lists[order];
+    if (free_lists[order]) {
+        free_lists[order]->prev = block;
+    }
+    free_lists[order] = block;
+    free_counts[order]++;
+    block_order[page] = static_cast<uint8_t>(order);
+}
+
+// Helper: Unlink a free block from its order's list
+static void list_remove(size_t page, size_t order) {
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(page_to_addr(page));
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        free_lists[order] = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+    block->next = nullptr;
+    block->prev = nullptr;
+    free_counts[order]--;
+    block_order[page] = NOT_FREE_HEAD;
+}
+
+// Helper: Free one aligned block, merging with free buddies
+static void free_block(size_t page, size_t order) {
+    while (order < MAX_ORDER) {
+        size_t buddy = page ^ (1UL << order);
+        if (buddy + (1UL << order) > total_pages || block_order[buddy] != order) {
+            break;
+        }
+        list_remove(buddy, order);
+        if (buddy < page) {
+            page = buddy;
+        }
+        order++;
+    }
+    list_push(page, order);
+}
+
+// Helper: Free an arbitrary run of pages as maximal aligned blocks
+static void free_range(size_t page, size_t n) {
+    while (n > 0) {
+        size_t order = 0;
+        while (order < MAX_ORDER &&
+               (page & ((1UL << (order + 1)) - 1)) == 0 &&
+               (1UL << (order + 1)) <= n) {
+            order++;
+        }
+        free_block(page, order);
+        page += 1UL << order;
+        n -= 1UL << order;
+    }
+}
+
 /*
  * Initialize memory manager with available RAM range
  * Requirements: 2.1
@@ -63,35 +175,46 @@ static inline uintptr_t page_to_addr(size_t page_index) {
 void init(uintptr_t start, uintptr_t end) {
     // Align start up to page boundary
     mem_start = (start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-    
+
     // Align end down to page boundary
     mem_end = end & ~(PAGE_SIZE - 1);
-    
+
     // Calculate total pages
     if (mem_end > mem_start) {
         total_pages = (mem_end - mem_start) / PAGE_SIZE;
     } else {
         total_pages = 0;
     }
-    
+
     // Cap at maximum supported pages
     if (total_pages > MAX_PAGES) {
         total_pages = MAX_PAGES;
         mem_end = mem_start + (total_pages * PAGE_SIZE);
     }
-    
+
     // Initialize bitmap: all pages free (0)
     for (size_t i = 0; i < BITMAP_SIZE; i++) {
         page_bitmap[i] = 0;
     }
-    
+
     // Mark pages beyond our range as used
-    for (size_t i = total_pages; i < MAX_PAGES; i++) {
-        bitmap_set(i);
+    if (total_pages < MAX_PAGES) {
+        bitmap_set_range(total_pages, MAX_PAGES - total_pages);
+    }
+
+    for (size_t i = 0; i < MAX_PAGES; i++) {
+        block_order[i] = NOT_FREE_HEAD;
     }
-    
+    for (size_t i = 0; i < NUM_ORDERS; i++) {
+        free_lists[i] = nullptr;
+        free_counts[i] = 0;
+    }
+
+    // Seed the free lists with the largest aligned blocks that fit
+    free_range(0, total_pages);
+
     used_pages = 0;
-    
+
     uart::printf("Memory: Initialized %d pages (%d KB) from 0x%x to 0x%x\n",
                  static_cast<unsigned int>(total_pages),
                  static_cast<unsigned int>((total_pages * PAGE_SIZE) / 1024),
@@ -99,86 +222,128 @@ void init(uintptr_t start, uintptr_t end) {
                  static_cast<unsigned int>(mem_end));
 }
 
-/*
- * Allocate n contiguous pages
- * Returns physical address of allocated pages, or nullptr on failure
- * Requirements: 2.2, 2.3
- */
-void* alloc_pages(size_t n) {
+// alloc_pages() body, called with g_lock held so other CPUs, preempted
+// tasks and IRQ-context frees cannot interleave on the free lists
+static void* alloc_pages_masked(size_t n) {
     if (n == 0 || n > total_pages) {
         return nullptr;
     }
-    
-    // Search for n contiguous free pages
-    size_t consecutive = 0;
-    size_t start_page = 0;
-    
-    for (size_t i = 0; i < total_pages; i++) {
-        if (!bitmap_test(i)) {
-            // Page is free
-            if (consecutive == 0) {
-                start_page = i;
-            }
-            consecutive++;
-            
-            if (consecutive == n) {
-                // Found enough contiguous pages, mark them as used
-                for (size_t j = start_page; j < start_page + n; j++) {
-                    bitmap_set(j);
-                }
-                used_pages += n;
-                
-                return reinterpret_cast<void*>(page_to_addr(start_page));
-            }
-        } else {
-            // Page is used, reset counter
-            consecutive = 0;
-        }
+
+    size_t want = order_for(n);
+
+    // Find the smallest order with a free block
+    size_t order = want;
+    while (order <= MAX_ORDER && free_lists[order] == nullptr) {
+        order++;
+    }
+    if (order > MAX_ORDER) {
+        // Requirements: 2.6 - return null pointer on failure
+        return nullptr;
     }
-    
-    // Not enough contiguous pages found
-    // Requirements: 2.6 - return null pointer on failure
-    return nullptr;
+
+    size_t page = addr_to_page(reinterpret_cast<uintptr_t>(free_lists[order]));
+    list_remove(page, order);
+
+    // Split down to the requested order, keeping the lower half
+    while (order > want) {
+        order--;
+        list_push(page + (1UL << order), order);
+    }
+
+    // Give back the tail beyond n pages
+    size_t block_pages = 1UL << want;
+    if (block_pages > n) {
+        free_range(page + n, block_pages - n);
+    }
+
+    bitmap_set_range(page, n);
+    used_pages += n;
+
+    return reinterpret_cast<void*>(page_to_addr(page));
 }
 
-/*
- * Free previously allocated pages
- * Marks pages as available for reuse
- * Requirements: 2.4
- */
-void free_pages(void* addr, size_t n) {
+// free_pages() body, called with g_lock held
+static void free_pages_masked(void* addr, size_t n) {
     if (addr == nullptr || n == 0) {
         return;
     }
-    
+
     uintptr_t phys_addr = reinterpret_cast<uintptr_t>(addr);
-    
+
     // Validate address is within our managed range
     if (phys_addr < mem_start || phys_addr >= mem_end) {
         return;
     }
-    
+
     // Validate address is page-aligned
     if (phys_addr % PAGE_SIZE != 0) {
         return;
     }
-    
+
     size_t start_page = addr_to_page(phys_addr);
-    
+
     // Validate we won't go beyond our range
     if (start_page + n > total_pages) {
         return;
     }
-    
-    // Mark pages as free
-    for (size_t i = start_page; i < start_page + n; i++) {
-        if (bitmap_test(i)) {
-            bitmap_clear(i);
-            if (used_pages > 0) {
-                used_pages--;
-            }
+
+    // Free each run of allocated pages; already-free pages are skipped
+    size_t i = start_page;
+    size_t end_page = start_page + n;
+    while (i < end_page) {
+        if (!bitmap_test(i)) {
+            i++;
+            continue;
+        }
+        size_t run = i;
+        while (i < end_page && bitmap_test(i)) {
+            i++;
         }
+        bitmap_clear_range(run, i - run);
+        free_range(run, i - run);
+        used_pages -= (used_pages >= i - run) ? i - run : used_pages;
+    }
+}
+
+/*
+ * Allocate n contiguous pages
+ * Returns physical address of allocated pages, or nullptr on failure
+ * Requirements: 2.2, 2.3
+ */
+void* alloc_pages(size_t n) {
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+    void* addr = alloc_pages_masked(n);
+    spinlock::unlock_irqrestore(&g_lock, flags);
+    trace::record(trace::Event::PAGE_ALLOC, static_cast<uint32_t>(n),
+                  static_cast<uint32_t>(reinterpret_cast<uintptr_t>(addr) >> 12));
+    return addr;
+}
+
+/*
+ * Free previously allocated pages
+ * Marks pages as available for reuse
+ * Requirements: 2.4
+ */
+void free_pages(void* addr, size_t n) {
+    if (addr) {
+        trace::record(trace::Event::PAGE_FREE, static_cast<uint32_t>(n),
+                      static_cast<uint32_t>(reinterpret_cast<uintptr_t>(addr) >> 12));
     }
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+    free_pages_masked(addr, n);
+    spinlock::unlock_irqrestore(&g_lock, flags);
+}
+
+/*
+ * Get the start of the aligned 2^order page block containing addr
+ */
+void* block_base(void* addr, size_t order) {
+    uintptr_t phys_addr = reinterpret_cast<uintptr_t>(addr);
+    if (phys_addr < mem_start || phys_addr >= mem_end || order > MAX_ORDER) {
+        return nullptr;
+    }
+    size_t page = addr_to_page(phys_addr) & ~((1UL << order) - 1);
+    return reinterpret_cast<void*>(page_to_addr(page));
 }
 
 /*
@@ -190,6 +355,23 @@ MemStats get_stats() {
     stats.total_pages = total_pages;
     stats.used_pages = used_pages;
     stats.free_pages = total_pages - used_pages;
+    stats.largest_free_block = 0;
+
+    for (size_t i = 0; i < NUM_ORDERS; i++) {
+        stats.free_blocks[i] = free_counts[i];
+        if (free_counts[i] > 0) {
+            stats.largest_free_block = 1UL << i;
+        }
+    }
+
+    // External fragmentation: free pages not reachable by one allocation
+    if (stats.free_pages > 0) {
+        stats.fragmentation = static_cast<uint32_t>(
+            100 - (stats.largest_free_block * 100) / stats.free_pages);
+    } else {
+        stats.fragmentation = 0;
+    }
+
     return stats;
 }
 
@@ -0,0 +1,69 @@
+/*
+ * EmberOS MMU and Cache Implementation
+ * Cache maintenance helpers for the identity map set up in boot.S
+ */
+
+#include "mmu.h"
+#include "uart.h"
+
+namespace mmu {
+
+// SCTLR_EL1 bits
+constexpr uint64_t SCTLR_M = 1ULL << 0;
+constexpr uint64_t SCTLR_C = 1ULL << 2;
+constexpr uint64_t SCTLR_I = 1ULL << 12;
+
+static inline uint64_t read_sctlr() {
+    uint64_t value;
+    asm volatile("mrs %0, sctlr_el1" : "=r"(value));
+    return value;
+}
+
+// Cache line sizes in bytes from CTR_EL0 (DminLine/IminLine are log2 words)
+static inline void cache_line_sizes(size_t* dline, size_t* iline) {
+    uint64_t ctr;
+    asm volatile("mrs %0, ctr_el0" : "=r"(ctr));
+    *dline = 4UL << ((ctr >> 16) & 0xF);
+    *iline = 4UL << (ctr & 0xF);
+}
+
+bool caches_enabled() {
+    uint64_t mask = SCTLR_M | SCTLR_C | SCTLR_I;
+    return (read_sctlr() & mask) == mask;
+}
+
+void sync_icache(const void* addr, size_t len) {
+    if (len == 0) return;
+
+    size_t dline, iline;
+    cache_line_sizes(&dline, &iline);
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(addr);
+    uintptr_t end = start + len;
+
+    // Push the new instructions out of the D-cache
+    for (uintptr_t p = start & ~(dline - 1); p < end; p += dline) {
+        asm volatile("dc cvau, %0" : : "r"(p) : "memory");
+    }
+    asm volatile("dsb ish" : : : "memory");
+
+    // Drop any stale copies from the I-cache
+    for (uintptr_t p = start & ~(iline - 1); p < end; p += iline) {
+        asm volatile("ic ivau, %0" : : "r"(p) : "memory");
+    }
+    asm volatile("dsb ish\n\tisb" : : : "memory");
+}
+
+void print_info() {
+    uint64_t sctlr = read_sctlr();
+    size_t dline, iline;
+    cache_line_sizes(&dline, &iline);
+
+    uart::printf("[mmu] MMU %s, D-cache %s, I-cache %s (lines: D %d, I %d bytes)\n",
+                 (sctlr & SCTLR_M) ? "on" : "off",
+                 (sctlr & SCTLR_C) ? "on" : "off",
+                 (sctlr & SCTLR_I) ? "on" : "off",
+                 (int)dline, (int)iline);
+}
+
+} // namespace mmu
@@ -0,0 +1,598 @@
+/*
+ * EmberOS Scheduler Implementation
+ * Preemptive round-robin scheduling of kernel tasks
+ *
+ * The run queue is the task table itself: switch_context() scans it
+ * circularly from the current task for the next READY task, so each
+ * ready task gets one quantum per round. There is no periodic tick: a
+ * sleeping task arms a one-shot timer for its wake time, and a slice
+ * timer is armed only while another task is ready to take the CPU, so a
+ * task running alone is never interrupted. CPU time is measured in
+ * counter ticks at every switch.
+ *
+ * With several CPUs each one runs its own queue: the tasks in the table
+ * whose cpu is that CPU. spawn() places a task on the CPU with the fewest
+ * tasks and it stays there, so a task's stack and saved frame are only
+ * ever used by one CPU, and its timers fire where it runs. Each CPU has
+ * its own current task, idle task and slice. The table is shared and
+ * guarded by g_lock; a CPU only changes its own CpuSched, and asks
+ * another CPU to reschedule with SGI_RESCHED.
+ */
+
+#include "sched.h"
+#include "timer.h"
+#include "memory.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "trace.h"
+#include "uart.h"
+#include "klib.h"
+
+// Linker-provided boot stack (task 1 keeps running on it)
+extern "C" {
+    extern uint8_t __stack_bottom[];
+    extern uint8_t __stack_top[];
+}
+
+namespace sched {
+
+// SPSR for a new task: EL1h, IRQs unmasked, D/A/F masked as at boot
+constexpr uint64_t TASK_SPSR = 0x345;
+
+constexpr int IDLE_PID = 0;
+constexpr int SHELL_PID = 1;
+
+struct Task {
+    int pid;
+    TaskState state;
+    char name[MAX_TASK_NAME];
+    interrupts::ExceptionContext* context;  // Saved frame while switched out
+    uint8_t* stack;                         // nullptr for the boot threads
+    size_t stack_bytes;
+    uint32_t cpu;                           // The CPU whose queue it is on
+    uint64_t wake_tick;                     // Counter value to wake at
+    int wake_timer;                         // Pending wake one-shot, or -1
+    uint64_t cpu_ticks;
+    uint64_t start_ms;
+    uint64_t switches;
+    void* local;
+    void* io;
+};
+
+// ============================================================================
+// Global State
+// ============================================================================
+
+// One CPU's scheduling state, only changed by that CPU
+struct CpuSched {
+    Task* current;
+    Task* idle;
+    volatile bool need_resched;
+    uint64_t slice_start;                   // Counter value when current was switched in
+    int slice_timer;                        // Pending end-of-slice one-shot, or -1
+};
+
+static spinlock::Lock g_lock;               // Task table and every CPU's current
+static Task g_tasks[MAX_TASKS];
+static CpuSched g_cpus[smp::MAX_CPUS];
+static int g_next_pid = 2;
+static bool g_started = false;
+static uint64_t g_quantum_ticks = 0;
+static uint64_t g_switches = 0;
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+static inline uint64_t ms_to_ticks(uint64_t ms) {
+    return (timer::get_frequency() * ms) / 1000;
+}
+
+static inline CpuSched* local() {
+    return &g_cpus[smp::cpu_id()];
+}
+
+static Task* alloc_task(int pid, const char* name, uint32_t cpu) {
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        Task* task = &g_tasks[i];
+        if (task->state == TaskState::FREE) {
+            task->pid = pid;
+            task->state = TaskState::READY;
+            klib::strlcpy(task->name, name, MAX_TASK_NAME);
+            task->context = nullptr;
+            task->stack = nullptr;
+            task->stack_bytes = 0;
+            task->cpu = cpu;
+            task->wake_tick = 0;
+            task->wake_timer = -1;
+            task->cpu_ticks = 0;
+            task->start_ms = timer::get_uptime_ms();
+            task->switches = 0;
+            task->local = nullptr;
+            task->io = nullptr;
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+// Free the stacks of finished tasks (never one still running on its stack)
+static void reap() {
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        Task* task = &g_tasks[i];
+        if (task->state == TaskState::EXITED && task != g_cpus[task->cpu].current) {
+            memory::free_pages(task->stack, task->stack_bytes / memory::PAGE_SIZE);
+            task->stack = nullptr;
+            task->state = TaskState::FREE;
+        }
+    }
+}
+
+// Next READY task on this CPU after the current one; the current task if
+// it can keep running and nothing else is ready; otherwise the idle task
+static Task* pick_next(CpuSched* c, uint32_t cpu) {
+    size_t start = static_cast<size_t>(c->current - g_tasks);
+    for (size_t n = 1; n <= MAX_TASKS; n++) {
+        Task* task = &g_tasks[(start + n) % MAX_TASKS];
+        if (task->state == TaskState::READY && task->cpu == cpu && task != c->idle) {
+            return task;
+        }
+    }
+    if (c->current->state == TaskState::RUNNING && c->current != c->idle) {
+        return c->current;
+    }
+    return c->idle;
+}
+
+static bool other_task_ready(const CpuSched* c, uint32_t cpu) {
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        const Task* task = &g_tasks[i];
+        if (task->state == TaskState::READY && task->cpu == cpu && task != c->idle) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tasks queued on a CPU, its idle task not counted (g_lock held)
+static size_t cpu_load(uint32_t cpu) {
+    size_t load = 0;
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        const Task* task = &g_tasks[i];
+        if (task->cpu == cpu && task != g_cpus[cpu].idle &&
+            task->state != TaskState::FREE && task->state != TaskState::EXITED) {
+            load++;
+        }
+    }
+    return load;
+}
+
+// CPU for a new task: the least loaded online one, the caller's on a tie
+static uint32_t pick_cpu() {
+    uint32_t best = smp::cpu_id();
+    size_t best_load = cpu_load(best);
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        if (cpu == best || !smp::get_cpu(cpu)->online || !g_cpus[cpu].idle) continue;
+        size_t load = cpu_load(cpu);
+        if (load < best_load) {
+            best = cpu;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+// End-of-slice one-shot (IRQ context, on the CPU that armed it)
+static void slice_expired(void* arg) {
+    (void)arg;
+    CpuSched* c = local();
+    c->slice_timer = -1;
+    c->need_resched = true;
+}
+
+// Make sure the current slice ends on time if another task can run
+// (g_lock held, on the CPU c belongs to). The idle task has no slice: a
+// wakeup ends its turn
+static void arm_slice(CpuSched* c, uint32_t cpu) {
+    if (!g_started || c->slice_timer >= 0 || c->current == c->idle || !other_task_ready(c, cpu)) {
+        return;
+    }
+    c->slice_timer = timer::add_oneshot_at(c->slice_start + g_quantum_ticks, slice_expired, nullptr);
+    if (c->slice_timer < 0) {
+        // No timer slot: give up the CPU at the next exception return
+        c->need_resched = true;
+    }
+}
+
+// A task became READY or had its state changed under it (g_lock held);
+// another CPU's queue is that CPU's business, so it gets an IPI
+static void made_ready(Task* task) {
+    uint32_t cpu = smp::cpu_id();
+    if (task->cpu != cpu) {
+        smp::send_ipi(task->cpu, smp::SGI_RESCHED);
+        return;
+    }
+    CpuSched* c = &g_cpus[cpu];
+    if (c->current == c->idle || c->current->state != TaskState::RUNNING) {
+        c->need_resched = true;
+    } else {
+        arm_slice(c, cpu);
+    }
+}
+
+// SGI_RESCHED: another CPU changed a task on this CPU's queue
+static void resched_ipi(uint32_t irq) {
+    (void)irq;
+    spinlock::lock(&g_lock);
+    CpuSched* c = local();
+    if (c->current) {
+        made_ready(c->current);
+    }
+    spinlock::unlock(&g_lock);
+}
+
+// Wake one-shot of a sleeping task (IRQ context, on the task's CPU; the
+// timer handler is preemptible, so the lock masks IRQs)
+static void wake_expired(void* arg) {
+    Task* task = static_cast<Task*>(arg);
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+    task->wake_timer = -1;
+    if (task->state == TaskState::SLEEPING) {
+        task->state = TaskState::READY;
+        made_ready(task);
+    }
+    spinlock::unlock_irqrestore(&g_lock, flags);
+}
+
+// First code a spawned task runs (ERET target, entry/arg in x0/x1)
+static void task_start(TaskEntry entry, void* arg) {
+    entry(arg);
+    exit();
+}
+
+[[noreturn]] static void idle_loop(void* arg) {
+    (void)arg;
+    while (true) {
+        asm volatile("wfi");
+    }
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void init() {
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        g_tasks[i].state = TaskState::FREE;
+        g_tasks[i].pid = 0;
+    }
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        g_cpus[cpu].current = nullptr;
+        g_cpus[cpu].idle = nullptr;
+        g_cpus[cpu].need_resched = false;
+        g_cpus[cpu].slice_timer = -1;
+    }
+    CpuSched* c = &g_cpus[0];
+
+    // The boot thread is already running; its frame is saved at its first switch
+    c->current = alloc_task(SHELL_PID, "[shell]", 0);
+    c->current->state = TaskState::RUNNING;
+    c->current->stack_bytes = static_cast<size_t>(__stack_top - __stack_bottom);
+    c->current->switches = 1;
+
+    g_quantum_ticks = ms_to_ticks(DEFAULT_QUANTUM_MS);
+    c->slice_start = timer::get_ticks();
+
+    // The idle task stays READY but pick_next() only falls back to it
+    int idle = spawn("[idle/0]", idle_loop, nullptr);
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        if (idle >= 0 && g_tasks[i].pid == idle && g_tasks[i].state != TaskState::FREE) {
+            c->idle = &g_tasks[i];
+            c->idle->pid = IDLE_PID;
+        }
+    }
+    g_next_pid = SHELL_PID + 1;
+
+    if (!c->idle) {
+        uart::puts("[sched] Cannot start scheduler\n");
+        return;
+    }
+    interrupts::register_handler(smp::SGI_RESCHED, resched_ipi);
+    interrupts::set_priority(smp::SGI_RESCHED, interrupts::PRIORITY_IPI);
+    g_started = true;
+
+    uart::printf("[sched] Preemptive scheduler: %d tasks max, %d ms quantum\n",
+                 (int)MAX_TASKS, (int)DEFAULT_QUANTUM_MS);
+}
+
+bool init_cpu(uint8_t* stack, size_t stack_bytes) {
+    uint32_t cpu = smp::cpu_id();
+    char name[] = "[idle/0]";
+    name[6] = static_cast<char>('0' + cpu);
+
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+    Task* idle = g_started ? alloc_task(IDLE_PID, name, cpu) : nullptr;
+    if (idle) {
+        idle->stack_bytes = stack_bytes;
+        (void)stack;    // Owned by smp, like the boot stack; never freed
+
+        CpuSched* c = &g_cpus[cpu];
+        c->current = idle;
+        c->idle = idle;
+        c->need_resched = false;
+        c->slice_start = timer::get_ticks();
+        c->slice_timer = -1;
+    }
+    spinlock::unlock_irqrestore(&g_lock, flags);
+
+    if (!idle) {
+        uart::printf("[sched] CPU %d: no task slot for its idle task\n", (int)cpu);
+    }
+    return idle != nullptr;
+}
+
+int spawn(const char* name, TaskEntry entry, void* arg) {
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+
+    reap();
+    size_t bytes = TASK_STACK_PAGES * memory::PAGE_SIZE;
+    uint8_t* stack = static_cast<uint8_t*>(memory::alloc_pages(TASK_STACK_PAGES));
+    Task* task = stack ? alloc_task(g_next_pid, name, pick_cpu()) : nullptr;
+    if (!task) {
+        memory::free_pages(stack, TASK_STACK_PAGES);
+        spinlock::unlock_irqrestore(&g_lock, flags);
+        return -1;
+    }
+    g_next_pid++;
+    task->stack = stack;
+    task->stack_bytes = bytes;
+
+    // Build the frame restore_context/eret would pop to start task_start()
+    interrupts::ExceptionContext* ctx =
+        reinterpret_cast<interrupts::ExceptionContext*>(stack + bytes - interrupts::FRAME_SIZE);
+    klib::memset(ctx, 0, interrupts::FRAME_SIZE);
+    ctx->x[0] = reinterpret_cast<uint64_t>(entry);
+    ctx->x[1] = reinterpret_cast<uint64_t>(arg);
+    ctx->sp = reinterpret_cast<uint64_t>(stack + bytes);
+    ctx->elr = reinterpret_cast<uint64_t>(&task_start);
+    ctx->spsr = TASK_SPSR;
+    task->context = ctx;
+
+    int pid = task->pid;
+    made_ready(task);
+    spinlock::unlock_irqrestore(&g_lock, flags);
+    return pid;
+}
+
+void exit() {
+    spinlock::lock_irqsave(&g_lock);
+    CpuSched* c = local();
+    c->current->state = TaskState::EXITED;
+    c->need_resched = true;
+    spinlock::unlock(&g_lock);
+    asm volatile("svc %0" :: "i"(SVC_YIELD) : "memory");
+
+    // An exited task is never switched back in
+    while (true) {
+        asm volatile("wfe");
+    }
+}
+
+void yield() {
+    if (!g_started) return;
+    local()->need_resched = true;
+    asm volatile("svc %0" :: "i"(SVC_YIELD) : "memory");
+}
+
+void sleep_ms(uint64_t ms) {
+    if (!g_started) {
+        timer::sleep_ms(ms);
+        return;
+    }
+
+    uint64_t wake = timer::get_ticks() + ms_to_ticks(ms);
+    while (timer::get_ticks() < wake) {
+        // Mark and switch out with IRQs masked so the wake timer, which
+        // fires on this CPU, cannot see a half-updated task; the task
+        // resumes with them still masked
+        uint64_t flags = spinlock::lock_irqsave(&g_lock);
+        CpuSched* c = local();
+        Task* self = c->current;
+        self->wake_tick = wake;
+        self->wake_timer = timer::add_oneshot_at(wake, wake_expired, self);
+        if (self->wake_timer >= 0) {
+            self->state = TaskState::SLEEPING;
+        }
+        // Without a timer slot this just yields and the loop polls
+        c->need_resched = true;
+        spinlock::unlock(&g_lock);
+        asm volatile("svc %0" :: "i"(SVC_YIELD) : "memory");
+        interrupts::restore(flags);
+    }
+}
+
+void wait_for_interrupt() {
+    if (g_started && other_task_ready(local(), smp::cpu_id())) {
+        yield();
+    } else {
+        asm volatile("wfi");
+    }
+}
+
+bool kill(int pid) {
+    if (pid == IDLE_PID || pid == SHELL_PID) {
+        return false;
+    }
+
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+    bool killed = false;
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        Task* task = &g_tasks[i];
+        if (task->pid == pid && task->state != TaskState::FREE &&
+            task->state != TaskState::EXITED) {
+            // The wake timer points at the task slot, which may be reused
+            timer::cancel(task->wake_timer);
+            task->wake_timer = -1;
+            task->state = TaskState::EXITED;
+            killed = true;
+            // Running elsewhere: that CPU has to switch it out
+            if (task->cpu != smp::cpu_id() && task == g_cpus[task->cpu].current) {
+                made_ready(task);
+            }
+            break;
+        }
+    }
+    bool self = killed && local()->current->state == TaskState::EXITED;
+    spinlock::unlock_irqrestore(&g_lock, flags);
+
+    if (self) {
+        exit();
+    }
+    return killed;
+}
+
+int current_pid() {
+    Task* current = local()->current;
+    return current ? current->pid : SHELL_PID;
+}
+
+void* get_local() {
+    Task* current = local()->current;
+    return current ? current->local : nullptr;
+}
+
+void set_local(void* local_state) {
+    Task* current = local()->current;
+    if (current) {
+        current->local = local_state;
+    }
+}
+
+void* get_io() {
+    Task* current = local()->current;
+    return current ? current->io : nullptr;
+}
+
+void set_io(void* io) {
+    Task* current = local()->current;
+    if (current) {
+        current->io = io;
+    }
+}
+
+void set_quantum_ms(uint64_t ms) {
+    if (ms == 0) return;
+    g_quantum_ticks = ms_to_ticks(ms);
+}
+
+uint64_t get_quantum_ms() {
+    uint64_t frequency = timer::get_frequency();
+    return frequency ? (g_quantum_ticks * 1000) / frequency : 0;
+}
+
+interrupts::ExceptionContext* switch_context(interrupts::ExceptionContext* ctx) {
+    if (!g_started) {
+        return ctx;
+    }
+    CpuSched* c = local();
+    if (!c->need_resched) {
+        return ctx;
+    }
+    uint32_t cpu = smp::cpu_id();
+
+    // IRQs are masked on the exception path
+    spinlock::lock(&g_lock);
+    c->need_resched = false;
+
+    uint64_t now = timer::get_ticks();
+    c->current->cpu_ticks += now - c->slice_start;
+    c->slice_start = now;
+
+    // Whoever runs next starts a fresh slice
+    timer::cancel(c->slice_timer);
+    c->slice_timer = -1;
+
+    reap();
+    Task* next = pick_next(c, cpu);
+    if (next == c->current) {
+        arm_slice(c, cpu);
+        spinlock::unlock(&g_lock);
+        return ctx;
+    }
+
+    c->current->context = ctx;
+    if (c->current->state == TaskState::RUNNING) {
+        c->current->state = TaskState::READY;
+    }
+    if (next != c->idle) {
+        next->state = TaskState::RUNNING;
+    }
+    next->switches++;
+    g_switches++;
+    trace::record(trace::Event::SWITCH, static_cast<uint32_t>(c->current->pid),
+                  static_cast<uint32_t>(next->pid));
+    c->current = next;
+    arm_slice(c, cpu);
+    spinlock::unlock(&g_lock);
+    return next->context;
+}
+
+size_t task_count() {
+    size_t count = 0;
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        if (g_tasks[i].state != TaskState::FREE) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// The idle tasks, in CPU order, come before all other tasks
+static const Task* task_at(size_t index) {
+    size_t n = 0;
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        if (g_cpus[cpu].idle && n++ == index) return g_cpus[cpu].idle;
+    }
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        const Task* task = &g_tasks[i];
+        if (task->state == TaskState::FREE || task == g_cpus[task->cpu].idle) continue;
+        if (n++ == index) return task;
+    }
+    return nullptr;
+}
+
+bool get_task_info(size_t index, TaskInfo* info) {
+    if (!info) return false;
+
+    uint64_t flags = spinlock::lock_irqsave(&g_lock);
+    const Task* found = task_at(index);
+    if (!found) {
+        spinlock::unlock_irqrestore(&g_lock, flags);
+        return false;
+    }
+
+    const CpuSched* c = &g_cpus[found->cpu];
+    uint64_t ticks = found->cpu_ticks;
+    if (found == c->current) {
+        ticks += timer::get_ticks() - c->slice_start;
+    }
+    uint64_t frequency = timer::get_frequency();
+
+    info->pid = found->pid;
+    info->state = (found == c->current) ? TaskState::RUNNING
+                : (found == c->idle) ? TaskState::READY : found->state;
+    info->name = found->name;
+    info->cpu = found->cpu;
+    info->start_ms = found->start_ms;
+    info->cpu_ms = frequency ? (ticks * 1000) / frequency : 0;
+    info->stack_bytes = found->stack_bytes;
+    info->switches = found->switches;
+    spinlock::unlock_irqrestore(&g_lock, flags);
+    return true;
+}
+
+uint64_t get_switch_count() {
+    return g_switches;
+}
+
+} // namespace sched
@@ -0,0 +1,317 @@
+/*
+ * EmberOS Slab Allocator Implementation
+ * Object caches for small kernel allocations, layered on memory::alloc_pages
+ *
+ * A slab is a naturally aligned block of 2^order pages obtained from the
+ * buddy allocator. Its header sits at the start of the block and free
+ * objects are chained through their first word, so freeing an object
+ * finds its slab with memory::block_base() and no search.
+ */
+
+#include "slab.h"
+#include "memory.h"
+#include "uart.h"
+#include "interrupts.h"
+#include "spinlock.h"
+
+namespace slab {
+
+// Slabs are sized so each holds at least this many objects
+constexpr size_t MIN_OBJECTS_PER_SLAB = 4;
+constexpr size_t MAX_SLAB_ORDER = 3;
+constexpr size_t OBJECT_ALIGN = 16;
+constexpr uint32_t SLAB_MAGIC = 0x51AB51AB;
+
+// Free object link
+struct FreeObject {
+    FreeObject* next;
+};
+
+// Slab header, stored at the start of each slab
+struct Slab {
+    uint32_t magic;
+    uint32_t in_use;
+    Cache* cache;
+    Slab* next;
+    Slab* prev;
+    FreeObject* free_list;
+};
+
+struct Cache {
+    char name[MAX_CACHE_NAME];
+    size_t object_size;
+    size_t order;               // Slab size is 2^order pages
+    size_t objects_per_slab;
+    size_t first_offset;        // Offset of the first object in a slab
+    Slab* partial;              // Slabs with some free objects
+    Slab* full;                 // Slabs with no free objects
+    Slab* empty;                // At most one fully free slab kept for reuse
+    size_t slabs;
+    size_t objects_in_use;
+    uint64_t hits;
+    uint64_t misses;
+    spinlock::Lock lock;        // Guards the lists and counters
+};
+
+// ============================================================================
+// Global State
+// ============================================================================
+
+static Cache g_caches[MAX_CACHES];
+static size_t g_cache_count = 0;
+static Cache* g_size_classes[NUM_SIZE_CLASSES];
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+static inline size_t align_up(size_t value, size_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+static void list_push(Slab** head, Slab* slab) {
+    slab->prev = nullptr;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void list_remove(Slab** head, Slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = nullptr;
+    slab->prev = nullptr;
+}
+
+// Allocate a fresh slab and thread all its objects onto the free list
+static Slab* new_slab(Cache* cache) {
+    void* block = memory::alloc_pages(1UL << cache->order);
+    if (!block) {
+        return nullptr;
+    }
+
+    Slab* slab = static_cast<Slab*>(block);
+    slab->magic = SLAB_MAGIC;
+    slab->in_use = 0;
+    slab->cache = cache;
+    slab->next = nullptr;
+    slab->prev = nullptr;
+    slab->free_list = nullptr;
+
+    uint8_t* base = static_cast<uint8_t*>(block) + cache->first_offset;
+    for (size_t i = cache->objects_per_slab; i > 0; i--) {
+        FreeObject* obj = reinterpret_cast<FreeObject*>(base + (i - 1) * cache->object_size);
+        obj->next = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    cache->slabs++;
+    return slab;
+}
+
+static void release_slab(Cache* cache, Slab* slab) {
+    slab->magic = 0;
+    memory::free_pages(slab, 1UL << cache->order);
+    cache->slabs--;
+}
+
+static int size_class_index(size_t size) {
+    if (size == 0 || size > MAX_OBJECT_SIZE) {
+        return -1;
+    }
+    size_t class_size = MIN_OBJECT_SIZE;
+    int index = 0;
+    while (class_size < size) {
+        class_size <<= 1;
+        index++;
+    }
+    return index;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void init() {
+    g_cache_count = 0;
+
+    static const char* class_names[NUM_SIZE_CLASSES] = {
+        "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+        "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+    };
+
+    size_t size = MIN_OBJECT_SIZE;
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        g_size_classes[i] = cache_create(class_names[i], size);
+        size <<= 1;
+    }
+
+    uart::printf("[slab] %d size classes (%d-%d bytes)\n",
+                 (int)NUM_SIZE_CLASSES, (int)MIN_OBJECT_SIZE, (int)MAX_OBJECT_SIZE);
+}
+
+Cache* cache_create(const char* name, size_t object_size) {
+    if (g_cache_count >= MAX_CACHES || object_size == 0 || object_size > MAX_OBJECT_SIZE) {
+        return nullptr;
+    }
+
+    Cache* cache = &g_caches[g_cache_count++];
+
+    size_t i = 0;
+    while (i < MAX_CACHE_NAME - 1 && name[i]) {
+        cache->name[i] = name[i];
+        i++;
+    }
+    cache->name[i] = '\0';
+
+    cache->object_size = align_up(object_size < sizeof(FreeObject) ? sizeof(FreeObject) : object_size,
+                                  OBJECT_ALIGN);
+    cache->first_offset = align_up(sizeof(Slab), OBJECT_ALIGN);
+
+    // Pick the smallest slab that fits MIN_OBJECTS_PER_SLAB objects
+    cache->order = 0;
+    while (cache->order < MAX_SLAB_ORDER &&
+           ((memory::PAGE_SIZE << cache->order) - cache->first_offset) / cache->object_size
+               < MIN_OBJECTS_PER_SLAB) {
+        cache->order++;
+    }
+    cache->objects_per_slab =
+        ((memory::PAGE_SIZE << cache->order) - cache->first_offset) / cache->object_size;
+
+    cache->partial = nullptr;
+    cache->full = nullptr;
+    cache->empty = nullptr;
+    cache->slabs = 0;
+    cache->objects_in_use = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->lock.value = 0;
+
+    return cache;
+}
+
+// cache_alloc() body, called with the cache lock held
+static void* cache_alloc_masked(Cache* cache) {
+    Slab* slab = cache->partial;
+    if (slab) {
+        cache->hits++;
+    } else if (cache->empty) {
+        slab = cache->empty;
+        cache->empty = nullptr;
+        list_push(&cache->partial, slab);
+        cache->hits++;
+    } else {
+        slab = new_slab(cache);
+        if (!slab) {
+            return nullptr;
+        }
+        list_push(&cache->partial, slab);
+        cache->misses++;
+    }
+
+    FreeObject* obj = slab->free_list;
+    slab->free_list = obj->next;
+    slab->in_use++;
+    cache->objects_in_use++;
+
+    if (slab->in_use == cache->objects_per_slab) {
+        list_remove(&cache->partial, slab);
+        list_push(&cache->full, slab);
+    }
+
+    return obj;
+}
+
+// cache_free() body, called with the cache lock held
+static void cache_free_masked(Cache* cache, void* obj) {
+    Slab* slab = static_cast<Slab*>(memory::block_base(obj, cache->order));
+    if (!slab || slab->magic != SLAB_MAGIC || slab->cache != cache) {
+        uart::printf("[slab] %s: bad free of 0x%x\n", cache->name, (uint32_t)(uintptr_t)obj);
+        return;
+    }
+
+    if (slab->in_use == cache->objects_per_slab) {
+        list_remove(&cache->full, slab);
+        list_push(&cache->partial, slab);
+    }
+
+    FreeObject* free_obj = static_cast<FreeObject*>(obj);
+    free_obj->next = slab->free_list;
+    slab->free_list = free_obj;
+    slab->in_use--;
+    cache->objects_in_use--;
+
+    // Keep one empty slab around; return the rest to the page allocator
+    if (slab->in_use == 0) {
+        list_remove(&cache->partial, slab);
+        if (!cache->empty) {
+            cache->empty = slab;
+        } else {
+            release_slab(cache, slab);
+        }
+    }
+}
+
+void* cache_alloc(Cache* cache) {
+    if (!cache) return nullptr;
+
+    uint64_t flags = spinlock::lock_irqsave(&cache->lock);
+    void* obj = cache_alloc_masked(cache);
+    spinlock::unlock_irqrestore(&cache->lock, flags);
+    return obj;
+}
+
+void cache_free(Cache* cache, void* obj) {
+    if (!cache || !obj) return;
+
+    uint64_t flags = spinlock::lock_irqsave(&cache->lock);
+    cache_free_masked(cache, obj);
+    spinlock::unlock_irqrestore(&cache->lock, flags);
+}
+
+void* kmalloc(size_t size) {
+    int index = size_class_index(size);
+    if (index < 0) return nullptr;
+    return cache_alloc(g_size_classes[index]);
+}
+
+void kfree(void* ptr, size_t size) {
+    int index = size_class_index(size);
+    if (index < 0 || !ptr) return;
+    cache_free(g_size_classes[index], ptr);
+}
+
+size_t kmalloc_size(size_t size) {
+    int index = size_class_index(size);
+    if (index < 0) return 0;
+    return MIN_OBJECT_SIZE << index;
+}
+
+size_t cache_count() {
+    return g_cache_count;
+}
+
+bool get_cache_stats(size_t index, CacheStats* stats) {
+    if (index >= g_cache_count || !stats) return false;
+
+    const Cache* cache = &g_caches[index];
+    stats->name = cache->name;
+    stats->object_size = cache->object_size;
+    stats->slab_pages = 1UL << cache->order;
+    stats->slabs = cache->slabs;
+    stats->objects_in_use = cache->objects_in_use;
+    stats->objects_total = cache->slabs * cache->objects_per_slab;
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    return true;
+}
+
+} // namespace slab
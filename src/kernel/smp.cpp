@@ -0,0 +1,202 @@
+/*
+ * EmberOS SMP Implementation
+ * PSCI CPU_ON bring-up of the secondary CPUs and SGI helpers
+ *
+ * PSCI is reached through HVC when the kernel was entered at EL1 and
+ * through SMC when it was entered at EL2 (QEMU virt with virtualization
+ * on), matching where QEMU implements it. QEMU's virt board numbers its
+ * CPUs in MPIDR affinity 0 (clusters of 8 with GICv2), so CPU n is
+ * started with target MPIDR n.
+ *
+ * No cross-CPU TLB or I-cache IPI is needed: the translation tables are
+ * static after boot, and mmu::sync_icache() uses ic ivau and dsb ish,
+ * which reach every CPU in the inner shareable domain.
+ */
+
+#include "smp.h"
+#include "gic.h"
+#include "interrupts.h"
+#include "memory.h"
+#include "pmu.h"
+#include "sched.h"
+#include "timer.h"
+#include "uart.h"
+
+extern "C" {
+    // Entry point of a started CPU (boot.S)
+    void secondary_entry();
+    void install_exception_vectors();
+
+    // Initial stack of each secondary, read by secondary_entry
+    uint64_t smp_stack_tops[smp::MAX_CPUS];
+
+    // Exception level _start was entered at (stored by boot.S)
+    uint32_t boot_el = 1;
+}
+
+namespace smp {
+
+// PSCI 0.2 function ids and return codes
+constexpr uint64_t PSCI_CPU_ON = 0xC4000003;    // SMC64 calling convention
+constexpr int64_t PSCI_SUCCESS = 0;
+constexpr int64_t PSCI_INVALID_PARAMETERS = -2;
+
+// ============================================================================
+// Global State
+// ============================================================================
+
+static PerCpu g_cpus[MAX_CPUS];
+static uint8_t* g_stacks[MAX_CPUS];
+static uint32_t g_online_count = 1;
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+static inline uint64_t read_mpidr() {
+    uint64_t mpidr;
+    asm volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+    return mpidr;
+}
+
+// SMC Calling Convention: arguments in x1-x3, result in x0, x4-x17 clobbered
+static int64_t psci_call(uint64_t function, uint64_t arg1, uint64_t arg2, uint64_t arg3) {
+    register uint64_t x0 asm("x0") = function;
+    register uint64_t x1 asm("x1") = arg1;
+    register uint64_t x2 asm("x2") = arg2;
+    register uint64_t x3 asm("x3") = arg3;
+    if (boot_el >= 2) {
+        asm volatile("smc #0"
+                     : "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3)
+                     :
+                     : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                       "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    } else {
+        asm volatile("hvc #0"
+                     : "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3)
+                     :
+                     : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                       "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    }
+    return static_cast<int64_t>(x0);
+}
+
+// Start one CPU and wait for it to report in; false ends the scan
+static bool start_cpu(uint32_t cpu) {
+    uint8_t* stack = static_cast<uint8_t*>(memory::alloc_pages(CPU_STACK_PAGES));
+    if (!stack) {
+        uart::printf("[smp] CPU %d: out of memory for its stack\n", cpu);
+        return false;
+    }
+    g_stacks[cpu] = stack;
+    smp_stack_tops[cpu] = reinterpret_cast<uint64_t>(stack + CPU_STACK_PAGES * memory::PAGE_SIZE);
+
+    // The new CPU reads these once its MMU (and so coherency) is on
+    asm volatile("dsb ish" ::: "memory");
+
+    int64_t ret = psci_call(PSCI_CPU_ON, cpu, reinterpret_cast<uint64_t>(&secondary_entry), cpu);
+    if (ret != PSCI_SUCCESS) {
+        memory::free_pages(stack, CPU_STACK_PAGES);
+        g_stacks[cpu] = nullptr;
+        // INVALID_PARAMETERS: no such CPU, so all of them are up
+        if (ret != PSCI_INVALID_PARAMETERS) {
+            uart::printf("[smp] CPU %d: PSCI CPU_ON failed (%d)\n", cpu, (int)ret);
+        }
+        return false;
+    }
+
+    uint64_t start = timer::get_uptime_ms();
+    while (!g_cpus[cpu].online) {
+        if (timer::get_uptime_ms() - start >= CPU_ON_TIMEOUT_MS) {
+            // Its stack stays allocated in case it turns up late
+            uart::printf("[smp] CPU %d did not come online\n", cpu);
+            return false;
+        }
+        asm volatile("yield");
+    }
+    g_online_count++;
+    return true;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void init() {
+    g_cpus[0].online = true;
+    g_cpus[0].mpidr = read_mpidr();
+
+    for (uint32_t cpu = 1; cpu < MAX_CPUS; cpu++) {
+        if (!start_cpu(cpu)) break;
+    }
+
+    uart::printf("[smp] %d CPU%s online\n", (int)g_online_count, g_online_count == 1 ? "" : "s");
+}
+
+PerCpu* this_cpu() {
+    return &g_cpus[cpu_id()];
+}
+
+PerCpu* get_cpu(uint32_t cpu) {
+    return cpu < MAX_CPUS ? &g_cpus[cpu] : nullptr;
+}
+
+uint32_t online_count() {
+    return g_online_count;
+}
+
+uint8_t online_mask() {
+    uint8_t mask = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (g_cpus[cpu].online) {
+            mask |= static_cast<uint8_t>(1u << cpu);
+        }
+    }
+    return mask;
+}
+
+void send_ipi(uint32_t cpu, uint32_t sgi) {
+    if (cpu < MAX_CPUS && g_cpus[cpu].online) {
+        gic::send_sgi(sgi, static_cast<uint8_t>(1u << cpu));
+    }
+}
+
+void send_ipi_others(uint32_t sgi) {
+    uint8_t mask = online_mask() & static_cast<uint8_t>(~(1u << cpu_id()));
+    if (mask) {
+        gic::send_sgi(sgi, mask);
+    }
+}
+
+} // namespace smp
+
+/*
+ * First C++ code a secondary CPU runs (boot.S secondary_entry), on the
+ * stack start_cpu() allocated for it, MMU and caches on, IRQs masked.
+ * It becomes this CPU's idle task and never returns.
+ */
+extern "C" [[noreturn]] void secondary_main(uint64_t cpu) {
+    smp::PerCpu* self = &smp::g_cpus[cpu];
+    self->mpidr = smp::read_mpidr();
+
+    install_exception_vectors();
+    interrupts::init_cpu();
+    timer::init_cpu();
+    pmu::init_cpu();
+    if (!sched::init_cpu(smp::g_stacks[cpu], smp::CPU_STACK_PAGES * memory::PAGE_SIZE)) {
+        // Never online, so nothing is placed here; CPU 0 times out on it
+        while (true) {
+            asm volatile("wfe");
+        }
+    }
+
+    // Publish only once this CPU can take tasks and IPIs
+    asm volatile("dsb ish" ::: "memory");
+    self->online = true;
+    asm volatile("sev");
+
+    interrupts::enable();
+    while (true) {
+        asm volatile("wfi");
+    }
+}
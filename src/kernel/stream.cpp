@@ -0,0 +1,240 @@
+/*
+ * EmberOS Stream Implementation
+ * Console, pipe and file streams behind each task's Io
+ *
+ * Pipe head and tail are free-running counters, so head - tail is the
+ * number of buffered bytes. The two ends may be on different CPUs, so
+ * each pipe has a lock; it is never held while waiting.
+ */
+
+#include "stream.h"
+#include "memory.h"
+#include "ramfs.h"
+#include "sched.h"
+#include "slab.h"
+#include "spinlock.h"
+#include "uart.h"
+
+using va_list = __builtin_va_list;
+#define va_start(ap, param) __builtin_va_start(ap, param)
+#define va_end(ap) __builtin_va_end(ap)
+
+namespace stream {
+
+static_assert(PIPE_SIZE == memory::PAGE_SIZE, "a pipe buffer is one page");
+
+struct Pipe {
+    spinlock::Lock lock;
+    char* data;                 // PIPE_SIZE bytes
+    uint32_t head;              // Next write
+    uint32_t tail;              // Next read
+    bool reader_open;
+    bool writer_open;
+};
+
+// How long a blocked end sleeps before looking again
+constexpr uint64_t PIPE_WAIT_MS = 1;
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+static Io* current_io() {
+    return static_cast<Io*>(sched::get_io());
+}
+
+// Close one end of a pipe, freeing it once both are closed
+static void release_end(Pipe* p, bool reader) {
+    uint64_t flags = spinlock::lock_irqsave(&p->lock);
+    if (reader) {
+        p->reader_open = false;
+    } else {
+        p->writer_open = false;
+    }
+    bool unused = !p->reader_open && !p->writer_open;
+    spinlock::unlock_irqrestore(&p->lock, flags);
+
+    if (unused) {
+        memory::free_pages(p->data, 1);
+        slab::kfree(p, sizeof(Pipe));
+    }
+}
+
+static size_t pipe_read(Pipe* p, char* buf, size_t len) {
+    while (true) {
+        uint64_t flags = spinlock::lock_irqsave(&p->lock);
+        uint32_t available = p->head - p->tail;
+        if (available > 0) {
+            size_t n = len < available ? len : available;
+            for (size_t i = 0; i < n; i++) {
+                buf[i] = p->data[(p->tail + i) & (PIPE_SIZE - 1)];
+            }
+            p->tail += static_cast<uint32_t>(n);
+            spinlock::unlock_irqrestore(&p->lock, flags);
+            return n;
+        }
+        bool eof = !p->writer_open;
+        spinlock::unlock_irqrestore(&p->lock, flags);
+        if (eof) {
+            return 0;
+        }
+        sched::sleep_ms(PIPE_WAIT_MS);
+    }
+}
+
+static void pipe_write(Pipe* p, const char* data, size_t len) {
+    while (len > 0) {
+        uint64_t flags = spinlock::lock_irqsave(&p->lock);
+        if (!p->reader_open) {
+            // Nobody will read it
+            spinlock::unlock_irqrestore(&p->lock, flags);
+            return;
+        }
+        uint32_t space = static_cast<uint32_t>(PIPE_SIZE) - (p->head - p->tail);
+        size_t n = len < space ? len : space;
+        for (size_t i = 0; i < n; i++) {
+            p->data[(p->head + i) & (PIPE_SIZE - 1)] = data[i];
+        }
+        p->head += static_cast<uint32_t>(n);
+        spinlock::unlock_irqrestore(&p->lock, flags);
+
+        data += n;
+        len -= n;
+        if (len > 0) {
+            sched::sleep_ms(PIPE_WAIT_MS);
+        }
+    }
+}
+
+static void stream_write(Stream* s, const char* data, size_t len) {
+    switch (s->kind) {
+        case Kind::PIPE_WRITE:
+            pipe_write(s->pipe, data, len);
+            break;
+        case Kind::FILE:
+            s->offset += ramfs::write_file(s->file, reinterpret_cast<const uint8_t*>(data),
+                                           s->offset, len);
+            break;
+        default:
+            uart::write_text(data, len);
+            break;
+    }
+}
+
+// uart::format() sink for printf
+static void format_sink(void* context, const char* data, size_t len) {
+    stream_write(static_cast<Stream*>(context), data, len);
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+Stream console() {
+    Stream s;
+    s.kind = Kind::CONSOLE;
+    s.pipe = nullptr;
+    s.file = nullptr;
+    s.offset = 0;
+    return s;
+}
+
+bool pipe(Stream* read_end, Stream* write_end) {
+    Pipe* p = static_cast<Pipe*>(slab::kmalloc(sizeof(Pipe)));
+    char* data = static_cast<char*>(memory::alloc_pages(1));
+    if (!p || !data) {
+        if (p) slab::kfree(p, sizeof(Pipe));
+        if (data) memory::free_pages(data, 1);
+        return false;
+    }
+    p->lock.value = 0;
+    p->data = data;
+    p->head = 0;
+    p->tail = 0;
+    p->reader_open = true;
+    p->writer_open = true;
+
+    *read_end = console();
+    read_end->kind = Kind::PIPE_READ;
+    read_end->pipe = p;
+    *write_end = console();
+    write_end->kind = Kind::PIPE_WRITE;
+    write_end->pipe = p;
+    return true;
+}
+
+bool open_output(const char* path, bool append, Stream* out) {
+    ramfs::FSNode* file = ramfs::open_file(path);
+    if (!file) {
+        // open_file() also fails on directories; create_file() then does too
+        file = ramfs::create_file(path);
+        if (!file) return false;
+    } else if (!append && !ramfs::truncate_file(file, 0)) {
+        return false;
+    }
+
+    *out = console();
+    out->kind = Kind::FILE;
+    out->file = file;
+    out->offset = append ? file->size : 0;
+    return true;
+}
+
+void close(Stream* s) {
+    if (s->kind == Kind::PIPE_READ || s->kind == Kind::PIPE_WRITE) {
+        release_end(s->pipe, s->kind == Kind::PIPE_READ);
+    }
+    *s = console();
+}
+
+size_t read(char* buf, size_t len) {
+    Io* io = current_io();
+    if (!io || io->in.kind != Kind::PIPE_READ || len == 0) {
+        return 0;
+    }
+    return pipe_read(io->in.pipe, buf, len);
+}
+
+void write(const char* data, size_t len) {
+    Io* io = current_io();
+    if (!io) {
+        uart::write_text(data, len);
+        return;
+    }
+    stream_write(&io->out, data, len);
+}
+
+void puts(const char* str) {
+    size_t len = 0;
+    while (str[len]) len++;
+    write(str, len);
+}
+
+void putc(char c) {
+    write(&c, 1);
+}
+
+void printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    Io* io = current_io();
+    if (io && io->out.kind != Kind::CONSOLE) {
+        uart::format(format_sink, &io->out, fmt, args);
+    } else {
+        Stream s = console();
+        uart::format(format_sink, &s, fmt, args);
+    }
+    va_end(args);
+}
+
+bool input_is_console() {
+    Io* io = current_io();
+    return !io || io->in.kind == Kind::CONSOLE;
+}
+
+bool output_is_console() {
+    Io* io = current_io();
+    return !io || io->out.kind == Kind::CONSOLE;
+}
+
+} // namespace stream
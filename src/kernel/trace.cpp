@@ -0,0 +1,249 @@
+/*
+ * EmberOS Trace Implementation
+ * Capture control and the offline decoder for the per-CPU trace rings
+ *
+ * The rings are only read by dump(), after g_enabled is cleared. A CPU
+ * that was inside record_at() at that moment finishes its few stores
+ * with IRQs masked long before the first line is printed.
+ */
+
+#include "trace.h"
+#include "timer.h"
+#include "uart.h"
+#include "klib.h"
+
+namespace trace {
+
+// ============================================================================
+// Global State
+// ============================================================================
+
+volatile bool g_enabled = false;
+Ring g_rings[smp::MAX_CPUS];
+
+static uint64_t g_start_ticks = 0;
+
+// Entry times of the IRQs a CPU is inside while dump() replays its ring.
+// Handlers at PRIORITY_NORMAL run unmasked, so IRQ_ENTER records nest,
+// one level per GIC priority; a deeper entry is counted but not timed
+constexpr uint32_t MAX_IRQ_NEST = 4;
+
+struct IrqNest {
+    uint64_t enter[MAX_IRQ_NEST];
+    uint32_t depth;
+};
+
+// Entry time of the innermost open IRQ, or 0 if unknown
+static uint64_t nest_top(const IrqNest* nest) {
+    if (nest->depth == 0 || nest->depth > MAX_IRQ_NEST) return 0;
+    return nest->enter[nest->depth - 1];
+}
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+static uint32_t event_class(uint16_t event) {
+    switch (static_cast<Event>(event)) {
+        case Event::IRQ_ENTER:
+        case Event::IRQ_EXIT: return CLASS_IRQ;
+        case Event::SVC: return CLASS_SVC;
+        case Event::PAGE_ALLOC:
+        case Event::PAGE_FREE: return CLASS_MEM;
+        case Event::FS: return CLASS_FS;
+        case Event::SWITCH: return CLASS_SCHED;
+        default: return 0;
+    }
+}
+
+static const char* fs_op_name(uint16_t op) {
+    switch (static_cast<FsOp>(op)) {
+        case FsOp::CREATE: return "create";
+        case FsOp::DELETE: return "delete";
+        case FsOp::READ: return "read";
+        case FsOp::WRITE: return "write";
+        case FsOp::TRUNCATE: return "truncate";
+        case FsOp::MKDIR: return "mkdir";
+        case FsOp::RMDIR: return "rmdir";
+        default: return "?";
+    }
+}
+
+// Counter ticks to tenths of a microsecond
+static uint64_t ticks_to_tenth_us(uint64_t ticks) {
+    uint64_t frequency = timer::get_frequency();
+    return frequency ? (ticks * 10000000) / frequency : 0;
+}
+
+static void print_tenth_us(uint64_t tenths) {
+    uart::printf("%u.%u us", (uint32_t)(tenths / 10), (uint32_t)(tenths % 10));
+}
+
+// Print one record; nest[] holds each CPU's open IRQ entry times
+static void print_record(uint32_t cpu, const Record* rec, const IrqNest* nest) {
+    uint64_t us = ticks_to_tenth_us(rec->time - g_start_ticks) / 10;
+    uart::printf("%10u  %d  ", (uint32_t)us, (int)cpu);
+
+    switch (static_cast<Event>(rec->event)) {
+        case Event::IRQ_ENTER:
+            uart::printf("irq     %d enter\n", (int)rec->arg16);
+            break;
+        case Event::IRQ_EXIT:
+            uart::printf("irq     %d exit", (int)rec->arg16);
+            if (nest_top(&nest[cpu])) {
+                uart::puts(" after ");
+                print_tenth_us(ticks_to_tenth_us(rec->time - nest_top(&nest[cpu])));
+            }
+            uart::putc('\n');
+            break;
+        case Event::SVC:
+            uart::printf("svc     0x%x ", (uint32_t)rec->arg16);
+            print_tenth_us(ticks_to_tenth_us(rec->arg32));
+            uart::putc('\n');
+            break;
+        case Event::PAGE_ALLOC:
+            if (rec->arg32) {
+                uart::printf("alloc   %d pages at 0x%x\n", (int)rec->arg16,
+                             (uint32_t)(rec->arg32 << 12));
+            } else {
+                uart::printf("alloc   %d pages FAILED\n", (int)rec->arg16);
+            }
+            break;
+        case Event::PAGE_FREE:
+            uart::printf("free    %d pages at 0x%x\n", (int)rec->arg16,
+                         (uint32_t)(rec->arg32 << 12));
+            break;
+        case Event::FS:
+            uart::printf("fs      %s %u\n", fs_op_name(rec->arg16), rec->arg32);
+            break;
+        case Event::SWITCH:
+            uart::printf("switch  %d -> %d\n", (int)rec->arg16, (int)rec->arg32);
+            break;
+        default:
+            uart::printf("?       event %d\n", (int)rec->event);
+            break;
+    }
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void start() {
+    g_enabled = false;
+    asm volatile("dsb ish" ::: "memory");
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        g_rings[cpu].head = 0;
+    }
+    g_start_ticks = timer::get_ticks();
+    asm volatile("dsb ish" ::: "memory");
+    g_enabled = true;
+}
+
+void stop() {
+    g_enabled = false;
+    asm volatile("dsb ish" ::: "memory");
+}
+
+uint32_t recorded(uint32_t cpu) {
+    return cpu < smp::MAX_CPUS ? g_rings[cpu].head : 0;
+}
+
+uint32_t retained(uint32_t cpu) {
+    uint32_t head = recorded(cpu);
+    return head < RING_RECORDS ? head : RING_RECORDS;
+}
+
+void dump(uint32_t classes) {
+    stop();
+
+    // Merge the rings: each cursor walks one CPU's retained records in order
+    uint32_t next[smp::MAX_CPUS];
+    uint32_t end[smp::MAX_CPUS];
+    IrqNest nest[smp::MAX_CPUS];
+    uint32_t lost = 0;
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        end[cpu] = g_rings[cpu].head;
+        next[cpu] = end[cpu] - retained(cpu);
+        nest[cpu].depth = 0;
+        lost += next[cpu];
+    }
+
+    uint64_t worst_irq = 0, worst_svc = 0;
+    uint32_t worst_irq_num = 0, worst_irq_cpu = 0, worst_svc_num = 0, worst_svc_cpu = 0;
+    uint32_t shown = 0;
+
+    uart::puts("   time(us) CPU event\n");
+    while (true) {
+        int pick = -1;
+        for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+            if (next[cpu] == end[cpu]) continue;
+            const Record* rec = &g_rings[cpu].records[next[cpu] & (RING_RECORDS - 1)];
+            if (pick < 0 ||
+                rec->time < g_rings[pick].records[next[pick] & (RING_RECORDS - 1)].time) {
+                pick = static_cast<int>(cpu);
+            }
+        }
+        if (pick < 0) break;
+
+        uint32_t cpu = static_cast<uint32_t>(pick);
+        const Record* rec = &g_rings[cpu].records[next[cpu] & (RING_RECORDS - 1)];
+        next[cpu]++;
+
+        // Durations are tracked for all records, shown or not
+        if (classes & event_class(rec->event)) {
+            print_record(cpu, rec, nest);
+            shown++;
+        }
+        IrqNest* open = &nest[cpu];
+        if (rec->event == static_cast<uint16_t>(Event::IRQ_ENTER)) {
+            if (open->depth < MAX_IRQ_NEST) {
+                open->enter[open->depth] = rec->time;
+            }
+            open->depth++;
+        } else if (rec->event == static_cast<uint16_t>(Event::IRQ_EXIT)) {
+            // An exit with nothing open entered before the ring's oldest record
+            uint64_t enter = nest_top(open);
+            if (enter && rec->time - enter > worst_irq) {
+                worst_irq = rec->time - enter;
+                worst_irq_num = rec->arg16;
+                worst_irq_cpu = cpu;
+            }
+            if (open->depth > 0) {
+                open->depth--;
+            }
+        } else if (rec->event == static_cast<uint16_t>(Event::SVC) && rec->arg32 > worst_svc) {
+            worst_svc = rec->arg32;
+            worst_svc_num = rec->arg16;
+            worst_svc_cpu = cpu;
+        }
+    }
+
+    uart::printf("%u records shown", shown);
+    if (lost) {
+        uart::printf(", %u older ones overwritten", lost);
+    }
+    uart::putc('\n');
+    if (worst_irq) {
+        uart::printf("Longest IRQ: %d on CPU %d, ", (int)worst_irq_num, (int)worst_irq_cpu);
+        print_tenth_us(ticks_to_tenth_us(worst_irq));
+        uart::putc('\n');
+    }
+    if (worst_svc) {
+        uart::printf("Longest SVC: 0x%x on CPU %d, ", worst_svc_num, (int)worst_svc_cpu);
+        print_tenth_us(ticks_to_tenth_us(worst_svc));
+        uart::putc('\n');
+    }
+}
+
+uint32_t class_for_name(const char* name) {
+    if (klib::strcmp(name, "irq") == 0) return CLASS_IRQ;
+    if (klib::strcmp(name, "svc") == 0) return CLASS_SVC;
+    if (klib::strcmp(name, "mem") == 0) return CLASS_MEM;
+    if (klib::strcmp(name, "fs") == 0) return CLASS_FS;
+    if (klib::strcmp(name, "sched") == 0) return CLASS_SCHED;
+    if (klib::strcmp(name, "all") == 0) return CLASS_ALL;
+    return 0;
+}
+
+} // namespace trace
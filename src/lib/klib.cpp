@@ -0,0 +1,265 @@
+/*
+ * EmberOS Kernel Library Implementation
+ * Word-wide memory and string routines
+ *
+ * The destination is aligned to 8 bytes first; the source may stay
+ * unaligned, which the Cortex-A53 handles for Normal memory at little
+ * cost. Blocks of 64 bytes are loaded completely before any of them is
+ * stored, so a forward copy is safe whenever dst is below src and a
+ * backward copy whenever dst is above it.
+ *
+ * This file is built with -fno-tree-loop-distribute-patterns so the
+ * compiler does not turn the byte loops below back into calls to
+ * memcpy/memset (see the Makefile).
+ */
+
+#include "klib.h"
+
+namespace klib {
+
+// Unaligned, aliasing-safe 64-bit word
+typedef uint64_t __attribute__((may_alias, aligned(1))) uword_t;
+
+constexpr size_t BLOCK = 64;
+constexpr uint64_t ONES = 0x0101010101010101ULL;
+constexpr uint64_t HIGHS = 0x8080808080808080ULL;
+
+// Nonzero iff some byte of v is zero
+static inline uint64_t has_zero_byte(uint64_t v) {
+    return (v - ONES) & ~v & HIGHS;
+}
+
+// ============================================================================
+// Block Helpers
+// ============================================================================
+
+#ifdef KLIB_NEON
+
+// Exception entry and task switches do not save q0-q3, and memcpy/memset
+// also run in IRQ handlers, so each block masks IRQs and FIQs while its
+// SIMD registers are live. Nothing is live between blocks.
+static inline void copy_block(uint8_t* d, const uint8_t* s) {
+    uint64_t flags;
+    asm volatile(
+        "mrs %0, daif\n\t"
+        "msr daifset, #3\n\t"
+        "ldp q0, q1, [%2]\n\t"
+        "ldp q2, q3, [%2, #32]\n\t"
+        "stp q0, q1, [%1]\n\t"
+        "stp q2, q3, [%1, #32]\n\t"
+        "msr daif, %0"
+        : "=&r"(flags) : "r"(d), "r"(s) : "v0", "v1", "v2", "v3", "memory");
+}
+
+static inline void fill_block(uint8_t* d, uint64_t pattern) {
+    uint64_t flags;
+    asm volatile(
+        "mrs %0, daif\n\t"
+        "msr daifset, #3\n\t"
+        "dup v0.2d, %2\n\t"
+        "stp q0, q0, [%1]\n\t"
+        "stp q0, q0, [%1, #32]\n\t"
+        "msr daif, %0"
+        : "=&r"(flags) : "r"(d), "r"(pattern) : "v0", "memory");
+}
+
+#else
+
+// Four LDP then four STP
+static inline void copy_block(uint8_t* d, const uint8_t* s) {
+    const uword_t* sw = reinterpret_cast<const uword_t*>(s);
+    uint64_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+    uint64_t w4 = sw[4], w5 = sw[5], w6 = sw[6], w7 = sw[7];
+    uint64_t* dw = reinterpret_cast<uint64_t*>(d);
+    dw[0] = w0; dw[1] = w1; dw[2] = w2; dw[3] = w3;
+    dw[4] = w4; dw[5] = w5; dw[6] = w6; dw[7] = w7;
+}
+
+static inline void fill_block(uint8_t* d, uint64_t pattern) {
+    uint64_t* dw = reinterpret_cast<uint64_t*>(d);
+    dw[0] = pattern; dw[1] = pattern; dw[2] = pattern; dw[3] = pattern;
+    dw[4] = pattern; dw[5] = pattern; dw[6] = pattern; dw[7] = pattern;
+}
+
+#endif
+
+// ============================================================================
+// Memory Routines
+// ============================================================================
+
+void* memcpy(void* dst, const void* src, size_t n) {
+    uint8_t* d = static_cast<uint8_t*>(dst);
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+
+    if (n >= 16) {
+        while (reinterpret_cast<uintptr_t>(d) & 7) {
+            *d++ = *s++;
+            n--;
+        }
+        while (n >= BLOCK) {
+            copy_block(d, s);
+            d += BLOCK;
+            s += BLOCK;
+            n -= BLOCK;
+        }
+        while (n >= 8) {
+            *reinterpret_cast<uint64_t*>(d) = *reinterpret_cast<const uword_t*>(s);
+            d += 8;
+            s += 8;
+            n -= 8;
+        }
+    }
+    while (n--) {
+        *d++ = *s++;
+    }
+    return dst;
+}
+
+void* memmove(void* dst, const void* src, size_t n) {
+    uint8_t* d = static_cast<uint8_t*>(dst);
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+
+    if (d <= s || d >= s + n) {
+        return memcpy(dst, src, n);
+    }
+
+    // Overlapping with dst above src: copy backward from the end
+    d += n;
+    s += n;
+    if (n >= 16) {
+        while (reinterpret_cast<uintptr_t>(d) & 7) {
+            *--d = *--s;
+            n--;
+        }
+        while (n >= BLOCK) {
+            d -= BLOCK;
+            s -= BLOCK;
+            copy_block(d, s);
+            n -= BLOCK;
+        }
+        while (n >= 8) {
+            d -= 8;
+            s -= 8;
+            *reinterpret_cast<uint64_t*>(d) = *reinterpret_cast<const uword_t*>(s);
+            n -= 8;
+        }
+    }
+    while (n--) {
+        *--d = *--s;
+    }
+    return dst;
+}
+
+void* memset(void* dst, int value, size_t n) {
+    uint8_t* d = static_cast<uint8_t*>(dst);
+    uint8_t byte = static_cast<uint8_t>(value);
+
+    if (n >= 16) {
+        uint64_t pattern = byte * ONES;
+        while (reinterpret_cast<uintptr_t>(d) & 7) {
+            *d++ = byte;
+            n--;
+        }
+        while (n >= BLOCK) {
+            fill_block(d, pattern);
+            d += BLOCK;
+            n -= BLOCK;
+        }
+        while (n >= 8) {
+            *reinterpret_cast<uint64_t*>(d) = pattern;
+            d += 8;
+            n -= 8;
+        }
+    }
+    while (n--) {
+        *d++ = byte;
+    }
+    return dst;
+}
+
+int memcmp(const void* a, const void* b, size_t n) {
+    const uint8_t* p = static_cast<const uint8_t*>(a);
+    const uint8_t* q = static_cast<const uint8_t*>(b);
+
+    // Skip equal words, then locate the differing byte
+    while (n >= 8 && *reinterpret_cast<const uword_t*>(p) == *reinterpret_cast<const uword_t*>(q)) {
+        p += 8;
+        q += 8;
+        n -= 8;
+    }
+    while (n--) {
+        if (*p != *q) {
+            return *p - *q;
+        }
+        p++;
+        q++;
+    }
+    return 0;
+}
+
+// ============================================================================
+// String Routines
+// ============================================================================
+
+size_t strlen(const char* s) {
+    const char* p = s;
+
+    // Aligned word reads never cross into a page past the terminator
+    while (reinterpret_cast<uintptr_t>(p) & 7) {
+        if (!*p) return p - s;
+        p++;
+    }
+    const uword_t* w = reinterpret_cast<const uword_t*>(p);
+    while (!has_zero_byte(*w)) {
+        w++;
+    }
+    p = reinterpret_cast<const char*>(w);
+    while (*p) {
+        p++;
+    }
+    return p - s;
+}
+
+int strcmp(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
+}
+
+void strlcpy(char* dst, const char* src, size_t size) {
+    if (size == 0) return;
+    size_t i = 0;
+    while (i < size - 1 && src[i]) {
+        dst[i] = src[i];
+        i++;
+    }
+    dst[i] = '\0';
+}
+
+} // namespace klib
+
+// ============================================================================
+// C Library Symbols
+// ============================================================================
+
+extern "C" {
+
+void* memcpy(void* dst, const void* src, size_t n) {
+    return klib::memcpy(dst, src, n);
+}
+
+void* memmove(void* dst, const void* src, size_t n) {
+    return klib::memmove(dst, src, n);
+}
+
+void* memset(void* dst, int value, size_t n) {
+    return klib::memset(dst, value, n);
+}
+
+int memcmp(const void* a, const void* b, size_t n) {
+    return klib::memcmp(a, b, n);
+}
+
+} // extern "C"
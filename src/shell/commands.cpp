@@ -8,13 +8,25 @@
 #include "shell.h"
 #include "uart.h"
 #include "memory.h"
+#include "slab.h"
 #include "timer.h"
 #include "ramfs.h"
+#include "klib.h"
 #include "editor.h"
 #include "interrupts.h"
+#include "sched.h"
+#include "smp.h"
+#include "stream.h"
+#include "trace.h"
+#include "pmu.h"
 #include "casm/lexer.h"
 #include "casm/parser.h"
 #include "casm/codegen.h"
+#include "casm/vm.h"
+#include "casm/cache.h"
+#include "casm/console.h"
+#include "casm/framebuffer.h"
+#include "casm/profile.h"
 
 // Freestanding type definitions
 using uint8_t = unsigned char;
@@ -107,6 +119,8 @@ void cmd_help(int argc, char* argv[]) {
             uart::puts("  ps         - List processes\n");
             uart::puts("  top        - Interactive process viewer\n");
             uart::puts("  df         - Display filesystem usage\n");
+            uart::puts("  uartstat   - Display UART statistics\n");
+            uart::puts("  irqstat    - Display IRQ counts and latencies\n");
             return;
         }
         
@@ -153,6 +167,7 @@ void cmd_help(int argc, char* argv[]) {
             uart::puts("  env        - Environment variables\n");
             uart::puts("  export     - Set variable\n");
             uart::puts("  time       - Time a command\n");
+            uart::puts("  perf       - PMU counters of a command\n");
             uart::puts("  whoami     - Current user\n");
             uart::puts("  hostname   - System hostname\n");
             return;
@@ -192,11 +207,11 @@ void cmd_clear(int argc, char* argv[]) {
 void cmd_echo(int argc, char* argv[]) {
     for (int i = 1; i < argc; i++) {
         if (i > 1) {
-            uart::putc(' ');
+            stream::putc(' ');
         }
-        uart::puts(argv[i]);
+        stream::puts(argv[i]);
     }
-    uart::putc('\n');
+    stream::putc('\n');
 }
 
 /*
@@ -320,6 +335,137 @@ void cmd_meminfo(int argc, char* argv[]) {
         uint32_t used_percent = (uint32_t)((stats.used_pages * 100) / stats.total_pages);
         uart::printf("Usage:        %d%%\n", used_percent);
     }
+
+    // Buddy allocator fragmentation
+    uart::puts("\n");
+    uart::printf("Largest free: %d pages (%d KB)\n", (uint32_t)stats.largest_free_block,
+                 (uint32_t)((stats.largest_free_block * memory::PAGE_SIZE) / 1024));
+    uart::printf("Fragmentation: %d%%\n", stats.fragmentation);
+    uart::puts("Free blocks:  ");
+    for (size_t order = 0; order <= memory::MAX_ORDER; order++) {
+        if (stats.free_blocks[order] > 0) {
+            uart::printf("%dx%dp ", (uint32_t)stats.free_blocks[order], 1U << order);
+        }
+    }
+    uart::puts("\n");
+    
+    // Slab caches
+    uart::puts("\nSlab cache      Size  Slabs   In use      Hits    Misses\n");
+    for (size_t i = 0; i < slab::cache_count(); i++) {
+        slab::CacheStats cs;
+        if (!slab::get_cache_stats(i, &cs) || cs.slabs == 0) continue;
+        uart::puts(cs.name);
+        size_t name_len = 0;
+        while (cs.name[name_len]) name_len++;
+        for (size_t pad = name_len; pad < 14; pad++) uart::putc(' ');
+        uart::printf("%6u %6u %4u/%4u %9u %9u\n",
+                     (uint32_t)cs.object_size, (uint32_t)cs.slabs,
+                     (uint32_t)cs.objects_in_use, (uint32_t)cs.objects_total,
+                     (uint32_t)cs.hits, (uint32_t)cs.misses);
+    }
+    uart::puts("\n");
+}
+
+/*
+ * uartstat - Display UART driver statistics
+ */
+void cmd_uartstat(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+    
+    uart::Stats stats = uart::get_stats();
+    
+    uart::puts("\nUART Statistics:\n");
+    uart::puts("----------------\n");
+    uart::printf("Mode:          %s\n", stats.irq_mode ? "interrupt-driven" : "polled");
+    uart::printf("Interrupts:    %u\n", (uint32_t)stats.irq_count);
+    uart::printf("RX bytes:      %u\n", (uint32_t)stats.rx_bytes);
+    uart::printf("TX bytes:      %u\n", (uint32_t)stats.tx_bytes);
+    uart::printf("RX ring:       %u/%u queued, peak %u\n", stats.rx_pending,
+                 (uint32_t)uart::RX_RING_SIZE, stats.rx_peak);
+    uart::printf("TX ring:       %u/%u queued, peak %u\n", stats.tx_pending,
+                 (uint32_t)uart::TX_RING_SIZE, stats.tx_peak);
+    uart::printf("RX overflows:  %u (ring full, bytes dropped)\n", (uint32_t)stats.rx_overflows);
+    uart::printf("FIFO overruns: %u\n", (uint32_t)stats.rx_fifo_overruns);
+    uart::printf("RX errors:     %u (framing/parity/break)\n", (uint32_t)stats.rx_errors);
+    uart::printf("TX stalls:     %u (ring full, writer waited)\n", (uint32_t)stats.tx_stalls);
+    uart::puts("\n");
+}
+
+// Name of an IRQ for irqstat
+static const char* irq_name(uint32_t irq) {
+    switch (irq) {
+        case smp::SGI_RESCHED: return "resched";
+        case interrupts::IRQ_TIMER: return "timer";
+        case interrupts::IRQ_UART: return "uart";
+        default: return "";
+    }
+}
+
+// Print counter ticks as microseconds with one decimal
+static void print_ticks_us(uint64_t ticks, uint64_t frequency) {
+    uint64_t tenths = frequency ? (ticks * 10000000) / frequency : 0;
+    uart::printf("%6u.%u us", (uint32_t)(tenths / 10), (uint32_t)(tenths % 10));
+}
+
+/*
+ * irqstat - Display per-IRQ counts and worst-case latencies
+ */
+void cmd_irqstat(int argc, char* argv[]) {
+    if (argc >= 2) {
+        if (klib::strcmp(argv[1], "reset") != 0) {
+            uart::puts("Usage: irqstat [reset]\n");
+            return;
+        }
+        interrupts::reset_stats();
+        uart::puts("IRQ statistics cleared\n");
+        return;
+    }
+    
+    uint64_t frequency = timer::get_frequency();
+    
+    uart::puts("\nIRQ Statistics (all CPUs):\n");
+    uart::puts("  IRQ  Name         Count  Max latency   Max queued     Max time\n");
+    for (uint32_t irq = 0; irq < interrupts::MAX_IRQ; irq++) {
+        uint64_t count = 0;
+        uint32_t max_latency = 0, max_queue = 0, max_time = 0;
+        for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+            interrupts::IrqStats stats;
+            if (!interrupts::get_irq_stats(cpu, irq, &stats)) continue;
+            count += stats.count;
+            if (stats.max_latency > max_latency) max_latency = stats.max_latency;
+            if (stats.max_queue > max_queue) max_queue = stats.max_queue;
+            if (stats.max_time > max_time) max_time = stats.max_time;
+        }
+        if (count == 0) continue;
+        
+        uart::printf("  %3u  ", irq);
+        print_padded(irq_name(irq), 8);
+        uart::printf(" %9u  ", (uint32_t)count);
+        if (irq == interrupts::IRQ_TIMER) {
+            print_ticks_us(max_latency, frequency);
+        } else {
+            uart::puts("          -");
+        }
+        uart::puts("  ");
+        print_ticks_us(max_queue, frequency);
+        uart::puts("  ");
+        print_ticks_us(max_time, frequency);
+        uart::putc('\n');
+    }
+    
+    uart::puts("\nLatency: timer deadline (CVAL) to handler start; other IRQs\n");
+    uart::puts("         do not record when they were raised\n");
+    uart::puts("Queued:  IRQ exception entry to handler start, i.e. waiting\n");
+    uart::puts("         behind earlier IRQs of the same batch\n");
+    uart::puts("Time:    handler start to end of interrupt\n\n");
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        interrupts::CpuIrqStats stats;
+        if (!smp::get_cpu(cpu)->online || !interrupts::get_cpu_stats(cpu, &stats)) continue;
+        uart::printf("CPU %d: %u exceptions, %u IRQs (up to %u per exception), %u nested\n",
+                     (int)cpu, (uint32_t)stats.entries, (uint32_t)stats.handled,
+                     stats.max_batch, (uint32_t)stats.nested);
+    }
     uart::puts("\n");
 }
 
@@ -385,6 +531,15 @@ void cmd_cpuinfo(int argc, char* argv[]) {
     uart::printf("  Aff3.Aff2.Aff1.Aff0 = %d.%d.%d.%d\n", aff3, aff2, aff1, aff0);
     uart::puts("\n");
     
+    uart::printf("CPUs online: %d (this is CPU %d)\n", (int)smp::online_count(), (int)smp::cpu_id());
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        const smp::PerCpu* pc = smp::get_cpu(cpu);
+        if (pc->online) {
+            uart::printf("  CPU %d: MPIDR 0x%x\n", (int)cpu, (uint32_t)pc->mpidr);
+        }
+    }
+    uart::puts("\n");
+    
     uart::puts("Cache Information:\n");
     uart::printf("  I-Cache line size: %d bytes\n", icache_line);
     uart::printf("  D-Cache line size: %d bytes\n", dcache_line);
@@ -441,6 +596,7 @@ void cmd_reboot(int argc, char* argv[]) {
     // PSCI SYSTEM_RESET function ID: 0x84000009
     
     // Give time for message to be displayed
+    uart::drain();
     timer::sleep_ms(100);
     
     // PSCI SYSTEM_RESET via HVC
@@ -464,6 +620,7 @@ void cmd_reboot(int argc, char* argv[]) {
     
     // If we get here, PSCI failed - just hang
     uart::puts("Reboot failed - halting\n");
+    uart::drain();
     while (true) {
         asm volatile("wfe");
     }
@@ -480,6 +637,7 @@ void cmd_shutdown(int argc, char* argv[]) {
     uart::puts("Shutting down system...\n");
     
     // Give time for message to be displayed
+    uart::drain();
     timer::sleep_ms(100);
     
     // PSCI SYSTEM_OFF function ID: 0x84000008
@@ -503,6 +661,7 @@ void cmd_shutdown(int argc, char* argv[]) {
     
     // If we get here, PSCI failed - just halt
     uart::puts("Shutdown failed - halting\n");
+    uart::drain();
     while (true) {
         asm volatile("wfe");
     }
@@ -512,11 +671,13 @@ void cmd_shutdown(int argc, char* argv[]) {
 // Utility Commands (Requirements: 6.13)
 // ============================================================================
 
-// Helper to print a byte as two hex digits
-static void print_hex_byte(uint8_t value) {
+// Helper to append a value as hex digits to a line buffer
+static size_t put_hex(char* line, size_t pos, uint64_t value, int digits) {
     const char* hex = "0123456789abcdef";
-    uart::putc(hex[(value >> 4) & 0xF]);
-    uart::putc(hex[value & 0xF]);
+    for (int i = digits - 1; i >= 0; i--) {
+        line[pos++] = hex[(value >> (i * 4)) & 0xF];
+    }
+    return pos;
 }
 
 /*
@@ -566,37 +727,45 @@ void cmd_hexdump(int argc, char* argv[]) {
     
     const uint8_t* ptr = reinterpret_cast<const uint8_t*>(address);
     
+    // Each row is formatted into a line buffer and written in one call
+    char line[96];
     for (uint64_t offset = 0; offset < length; offset += 16) {
-        // Print address
-        uart::printf("%p", (void*)(address + offset));
-        uart::puts(": ");
+        size_t pos = 0;
         
-        // Print hex bytes
+        // Address
+        line[pos++] = '0';
+        line[pos++] = 'x';
+        pos = put_hex(line, pos, address + offset, 16);
+        line[pos++] = ':';
+        line[pos++] = ' ';
+        
+        // Hex bytes
         for (int i = 0; i < 16; i++) {
             if (offset + i < length) {
-                print_hex_byte(ptr[offset + i]);
-                uart::putc(' ');
+                pos = put_hex(line, pos, ptr[offset + i], 2);
+                line[pos++] = ' ';
             } else {
-                uart::puts("   ");
+                line[pos++] = ' ';
+                line[pos++] = ' ';
+                line[pos++] = ' ';
             }
-            if (i == 7) uart::putc(' ');  // Extra space in middle
+            if (i == 7) line[pos++] = ' ';  // Extra space in middle
         }
         
-        uart::puts(" |");
+        line[pos++] = ' ';
+        line[pos++] = '|';
         
-        // Print ASCII representation
+        // ASCII representation
         for (int i = 0; i < 16; i++) {
             if (offset + i < length) {
                 uint8_t c = ptr[offset + i];
-                if (c >= 0x20 && c < 0x7f) {
-                    uart::putc(static_cast<char>(c));
-                } else {
-                    uart::putc('.');
-                }
+                line[pos++] = (c >= 0x20 && c < 0x7f) ? static_cast<char>(c) : '.';
             }
         }
         
-        uart::puts("|\n");
+        line[pos++] = '|';
+        line[pos++] = '\n';
+        uart::write_text(line, pos);
     }
     uart::puts("\n");
 }
@@ -605,6 +774,53 @@ void cmd_hexdump(int argc, char* argv[]) {
 // Filesystem Commands
 // ============================================================================
 
+// Piped input tail keeps, and grep searches at a time
+constexpr size_t TAIL_WINDOW = 4096;
+constexpr size_t GREP_CHUNK = 4096;
+
+/*
+ * Input of a filter command: a file, or the pipe feeding the command
+ */
+struct Input {
+    ramfs::FSNode* file;        // nullptr: standard input
+    size_t offset;
+};
+
+/*
+ * Open filename, or standard input when filename is nullptr and a pipe
+ * feeds it; otherwise print usage (or the error) and return false
+ */
+static bool open_input(const char* cmd, const char* filename, const char* usage, Input* in) {
+    in->offset = 0;
+    if (!filename) {
+        if (stream::input_is_console()) {
+            uart::puts(usage);
+            return false;
+        }
+        in->file = nullptr;
+        return true;
+    }
+    
+    in->file = ramfs::open_file(filename);
+    if (!in->file) {
+        uart::printf("%s: %s: No such file\n", cmd, filename);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Read the next chunk of an input; 0 at its end
+ */
+static size_t read_input(Input* in, char* buf, size_t len) {
+    if (!in->file) {
+        return stream::read(buf, len);
+    }
+    size_t n = ramfs::read_file(in->file, reinterpret_cast<uint8_t*>(buf), in->offset, len);
+    in->offset += n;
+    return n;
+}
+
 /*
  * ls - List directory contents
  */
@@ -625,12 +841,12 @@ void cmd_ls(int argc, char* argv[]) {
     ramfs::FSNode* node;
     while ((node = ramfs::dir_next(&iter)) != nullptr) {
         if (node->type == ramfs::FileType::DIRECTORY) {
-            uart::puts("\x1b[34m");  // Blue for directories
-            uart::puts(node->name);
-            uart::puts("/\x1b[0m\n");
+            stream::puts("\x1b[34m");  // Blue for directories
+            stream::puts(node->name);
+            stream::puts("/\x1b[0m\n");
         } else {
-            uart::puts(node->name);
-            uart::printf("  (%d bytes)\n", (int)node->size);
+            stream::puts(node->name);
+            stream::printf("  (%d bytes)\n", (int)node->size);
         }
     }
 }
@@ -758,35 +974,26 @@ void cmd_touch(int argc, char* argv[]) {
 }
 
 /*
- * cat - Display file contents
+ * cat - Display file contents, or copy piped input through
  */
 void cmd_cat(int argc, char* argv[]) {
-    if (argc < 2) {
-        uart::puts("Usage: cat <filename>\n");
+    Input in;
+    if (!open_input("cat", argc > 1 ? argv[1] : nullptr, "Usage: cat <filename>\n", &in)) {
         return;
     }
     
-    ramfs::FSNode* file = ramfs::open_file(argv[1]);
-    if (!file) {
-        uart::puts("cat: ");
-        uart::puts(argv[1]);
-        uart::puts(": No such file\n");
-        return;
-    }
-    
-    uint8_t buffer[256];
-    size_t offset = 0;
+    char buffer[1024];
+    size_t total = 0;
     size_t bytes_read;
     
-    while ((bytes_read = ramfs::read_file(file, buffer, offset, sizeof(buffer) - 1)) > 0) {
-        buffer[bytes_read] = '\0';
-        uart::puts(reinterpret_cast<const char*>(buffer));
-        offset += bytes_read;
+    while ((bytes_read = read_input(&in, buffer, sizeof(buffer))) > 0) {
+        stream::write(buffer, bytes_read);
+        total += bytes_read;
     }
     
-    // Ensure newline at end
-    if (offset > 0) {
-        uart::putc('\n');
+    // Ensure newline at end, on the console only so copies stay exact
+    if (total > 0 && stream::output_is_console()) {
+        stream::putc('\n');
     }
 }
 
@@ -907,175 +1114,102 @@ void cmd_write(int argc, char* argv[]) {
 // CASM Assembler Command (Requirements: 7.11)
 // ============================================================================
 
-// Global source buffer for CASM (in BSS, zero-initialized)
-static char g_casm_source[5120];  // 5KB
-
-// Virtual framebuffer for graphics (used by VM)
-static char g_framebuffer[25][81];  // 25 rows x 80 cols + null
-static char g_fb_colors[25][80];    // Color attributes
-static int g_fb_width = 0;
-static int g_fb_height = 0;
-static bool g_fb_active = false;
-static int g_fb_fg = 7;  // Current foreground color
-static int g_fb_bg = 0;  // Current background color
+// Forward declarations for casm subcommands
+static void cmd_casm_run_native(const char* filename, bool perf);
+static void print_perf_counts(const char* what, const pmu::Counts* counts);
+static void print_perf_line(uint64_t value, const char* name);
+static void cmd_casm_run_vm(const char* filename, bool debug, uint64_t budget);
+static void cmd_casm_disasm(const char* filename);
+static void cmd_casm_prof(const char* filename, bool optimize);
 
-static void fb_clear() {
-    for (int y = 0; y < 25; y++) {
-        for (int x = 0; x < 80; x++) {
-            g_framebuffer[y][x] = ' ';
-            g_fb_colors[y][x] = 0x70;  // white on black
-        }
-        g_framebuffer[y][80] = '\0';
-    }
+/*
+ * Allocate the memory a CASM program runs in: its image followed by zeroed
+ * memory, reaching at least the end of the fixed data window so numeric
+ * addresses up to 0x1FFF stay inside it, plus reserve bytes on top
+ * Returns nullptr if there are not enough free pages
+ */
+static uint8_t* casm_alloc_arena(const uint8_t* image, size_t image_size, size_t* arena_size,
+                                 size_t reserve = 0) {
+    size_t size = image_size > static_cast<size_t>(casm::DATA_WINDOW_END)
+                      ? image_size : static_cast<size_t>(casm::DATA_WINDOW_END);
+    size += reserve;
+    size_t pages = (size + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
+    
+    uint8_t* arena = static_cast<uint8_t*>(memory::alloc_pages(pages));
+    if (!arena) {
+        return nullptr;
+    }
+    klib::memcpy(arena, image, image_size);
+    klib::memset(arena + image_size, 0, pages * memory::PAGE_SIZE - image_size);
+    
+    *arena_size = pages * memory::PAGE_SIZE;
+    return arena;
 }
 
-static void fb_plot(int x, int y, char ch) {
-    if (x >= 0 && x < g_fb_width && y >= 0 && y < g_fb_height) {
-        g_framebuffer[y][x] = ch ? ch : ' ';
-        g_fb_colors[y][x] = (g_fb_fg & 0x7) | ((g_fb_bg & 0x7) << 4);
-    }
+static void casm_free_arena(uint8_t* arena, size_t arena_size) {
+    memory::free_pages(arena, arena_size / memory::PAGE_SIZE);
 }
 
-static void fb_render() {
-    if (!g_fb_active || g_fb_height == 0) return;
-    
-    int last_fg = -1, last_bg = -1;
-    for (int y = 0; y < g_fb_height; y++) {
-        for (int x = 0; x < g_fb_width; x++) {
-            int fg = g_fb_colors[y][x] & 0x7;
-            int bg = (g_fb_colors[y][x] >> 4) & 0x7;
-            if (fg != last_fg || bg != last_bg) {
-                uart::printf("\x1b[3%d;4%dm", fg, bg);
-                last_fg = fg;
-                last_bg = bg;
-            }
-            uart::putc(g_framebuffer[y][x]);
-        }
-        uart::puts("\x1b[0m\n");
-        last_fg = last_bg = -1;
-    }
+/*
+ * State of one VM run, the context casm_vm_svc() gets. Each run draws on
+ * its own canvas, so VM programs on different shells stay apart; it lives
+ * outside the arena where the program cannot overwrite it
+ */
+struct VmSession {
+    casm::ConsoleRing* console;
+    casm::Framebuffer fb;
+};
+
+constexpr size_t VM_SESSION_PAGES = (sizeof(VmSession) + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
+
+static VmSession* casm_alloc_session(casm::ConsoleRing* console) {
+    VmSession* session = static_cast<VmSession*>(memory::alloc_pages(VM_SESSION_PAGES));
+    if (!session) {
+        return nullptr;
+    }
+    session->console = console;
+    casm::fb_reset(&session->fb);
+    return session;
 }
 
-// Forward declarations for casm subcommands
-static void cmd_casm_run(const char* filename);
-static void cmd_casm_run_native(const char* filename);
-static void cmd_casm_disasm(const char* filename);
-static void cmd_casm_run_debug(const char* filename);
+static void casm_free_session(VmSession* session) {
+    memory::free_pages(session, VM_SESSION_PAGES);
+}
 
 /*
- * casm - Assemble a C.ASM source file or run a binary
- * Usage: casm <filename.asm> [-o <output>]
- *        casm run <filename.bin>       (native execution - fast!)
- *        casm run -v <filename.bin>    (VM mode - slower but safer)
- *        casm run -d <filename.bin>    (debug mode)
- *        casm disasm <filename.bin>
- * Requirements: 7.11
+ * Copy an assembled image into a program arena and run it natively
+ * A pinned cache image is unpinned as soon as it has been copied
  */
-void cmd_casm(int argc, char* argv[]) {
-    if (argc < 2) {
-        uart::puts("CASM - C.ASM Assembler v1.0\n\n");
-        uart::puts("Usage: casm <source.asm> [-o <output.bin>]\n");
-        uart::puts("       casm -r <source.asm>   (compile & run)\n");
-        uart::puts("       casm run <file.bin>    (run binary - native)\n");
-        uart::puts("       casm run -v <file.bin> (VM mode - slower)\n");
-        uart::puts("       casm run -d <file.bin> (debug mode)\n");
-        uart::puts("       casm disasm <file.bin>\n");
-        return;
-    }
-    
-    // Check for '-r' flag (compile and run)
-    bool run_after_compile = false;
-    const char* source_file = nullptr;
-    
-    if (argv[1][0] == '-' && argv[1][1] == 'r' && argv[1][2] == '\0') {
-        if (argc < 3) {
-            uart::puts("Usage: casm -r <source.asm>\n");
-            return;
-        }
-        run_after_compile = true;
-        source_file = argv[2];
-    }
-    
-    // Check for 'run' subcommand
-    if (argv[1][0] == 'r' && argv[1][1] == 'u' && argv[1][2] == 'n' && argv[1][3] == '\0') {
-        if (argc < 3) {
-            uart::puts("Usage: casm run [-v|-d] <filename.bin>\n");
-            return;
-        }
-        // Check for flags
-        if (argc >= 4 && argv[2][0] == '-') {
-            if (argv[2][1] == 'd') {
-                cmd_casm_run_debug(argv[3]);
-            } else if (argv[2][1] == 'v') {
-                cmd_casm_run(argv[3]);  // VM mode (fallback)
-            } else {
-                uart::puts("Unknown flag. Use -v (VM) or -d (debug)\n");
-            }
-        } else {
-            cmd_casm_run_native(argv[2]);  // Native mode is default (fast!)
-        }
-        return;
-    }
-    
-    // Check for 'disasm' subcommand
-    if (argv[1][0] == 'd' && argv[1][1] == 'i' && argv[1][2] == 's') {
-        if (argc < 3) {
-            uart::puts("Usage: casm disasm <filename.bin>\n");
-            return;
-        }
-        cmd_casm_disasm(argv[2]);
-        return;
-    }
-    
-    const char* input_file = run_after_compile ? source_file : argv[1];
-    const char* output_file = nullptr;
-    
-    // Parse optional -o flag (only if not using -r)
-    if (!run_after_compile) {
-        for (int i = 2; i < argc - 1; i++) {
-            if (argv[i][0] == '-' && argv[i][1] == 'o' && argv[i][2] == '\0') {
-                output_file = argv[i + 1];
-                break;
-            }
-        }
+static void casm_run_image(const uint8_t* image, size_t image_size, bool cached = false) {
+    size_t arena_size;
+    uint8_t* arena = casm_alloc_arena(image, image_size, &arena_size);
+    if (cached) {
+        casm::cache_unpin(image);
     }
     
-    // Open and read the source file
-    ramfs::FSNode* file = ramfs::open_file(input_file);
-    if (!file) {
-        uart::puts("casm: cannot open '");
-        uart::puts(input_file);
-        uart::puts("': No such file\n");
-        return;
-    }
-    
-    // Check file size
-    if (file->size == 0) {
-        uart::puts("casm: '");
-        uart::puts(input_file);
-        uart::puts("': Empty file\n");
-        return;
-    }
-    
-    if (file->size > sizeof(g_casm_source) - 1) {
-        uart::puts("casm: '");
-        uart::puts(input_file);
-        uart::puts("': File too large (max 5KB)\n");
+    uart::puts("\nRunning...\n");
+    if (!arena) {
+        uart::puts("casm: Out of memory for program\n");
         return;
     }
     
-    // Read file contents into global buffer
-    size_t bytes_read = ramfs::read_file(file, reinterpret_cast<uint8_t*>(g_casm_source), 0, file->size);
-    g_casm_source[bytes_read] = '\0';  // Null-terminate
-    
-    uart::puts("Assembling '");
-    uart::puts(input_file);
-    uart::puts("'...\n");
+    casm_native::init(arena, arena_size);
+    casm_native::run(arena);
+    casm_free_arena(arena, arena_size);
     
+    uart::puts("\x1b[0m");
+}
+
+/*
+ * Parse and assemble length bytes of C.ASM source into codegen
+ * Returns false, after printing the error, if either step fails
+ */
+static bool casm_generate(const char* source, size_t length, bool optimize,
+                          casm::CodeGenerator& codegen) {
     // Create lexer (small, stays on stack)
-    casm::Lexer lexer(g_casm_source);
+    casm::Lexer lexer(source, length);
     
-    // Create parser (now smaller with reduced node pool)
+    // Create parser (node pool is allocated from pages as it grows)
     casm::Parser parser(lexer);
     
     // Parse the source
@@ -1087,16 +1221,16 @@ void cmd_casm(int argc, char* argv[]) {
         uart::puts(": ");
         uart::puts(parser.get_error());
         uart::putc('\n');
-        return;
+        return false;
     }
     
     if (!ast) {
         uart::puts("casm: Failed to parse source\n");
-        return;
+        return false;
     }
     
-    // Create code generator (now smaller with reduced buffers)
-    casm::CodeGenerator codegen;
+    // Section buffers grow as code is emitted
+    codegen.set_optimize(optimize);
     
     if (!codegen.generate(ast)) {
         uart::puts("casm: Code generation error at line ");
@@ -1104,6 +1238,25 @@ void cmd_casm(int argc, char* argv[]) {
         uart::puts(": ");
         uart::puts(codegen.get_error());
         uart::putc('\n');
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Assemble length bytes of C.ASM source, then report, write or run the result
+ * With run_after_compile the image is also stored in the build cache under
+ * cache_key
+ */
+static void casm_assemble(const char* input_file, const char* source, size_t length,
+                          const char* output_file, bool run_after_compile, bool optimize,
+                          uint64_t cache_key) {
+    uart::puts("Assembling '");
+    uart::puts(input_file);
+    uart::puts("'...\n");
+    
+    casm::CodeGenerator codegen;
+    if (!casm_generate(source, length, optimize, codegen)) {
         return;
     }
     
@@ -1112,9 +1265,24 @@ void cmd_casm(int argc, char* argv[]) {
     int symbol_count = codegen.get_symbol_count();
     
     uart::puts("\nAssembly successful!\n");
-    uart::printf("  Code size: %d bytes\n", (int)code_size);
+    uart::printf("  Code size: %d bytes (text %d, data %d, bss %d)\n", (int)code_size,
+                 (int)codegen.get_section_size(casm::Section::TEXT),
+                 (int)codegen.get_section_size(casm::Section::DATA),
+                 (int)codegen.get_section_size(casm::Section::BSS));
     uart::printf("  Symbols:   %d\n", symbol_count);
     
+    if (optimize) {
+        const casm::OptimizerStats& stats = codegen.get_optimizer_stats();
+        uart::puts("\nOptimizer (-O):\n");
+        uart::printf("  Pairs merged:        %d\n", stats.pairs_merged);
+        uart::printf("  Constants folded:    %d\n", stats.constants_folded);
+        uart::printf("  Constants shortened: %d\n", stats.constants_shortened);
+        uart::printf("  CBZ/CBNZ formed:     %d\n", stats.cbz_formed);
+        uart::printf("  Branches removed:    %d\n", stats.branches_removed);
+        uart::printf("  No-ops removed:      %d\n", stats.nops_removed);
+        uart::printf("  Bytes saved:         %d\n", (int)stats.bytes_saved);
+    }
+    
     // List symbols if any
     if (symbol_count > 0) {
         uart::puts("\nSymbol table:\n");
@@ -1153,22 +1321,8 @@ void cmd_casm(int argc, char* argv[]) {
     
     // If -r flag, run directly from memory using native execution
     if (run_after_compile) {
-        uart::puts("\nRunning...\n");
-        
-        // Copy code to buffer
-        static uint8_t code_buffer[5120];
-        for (size_t i = 0; i < sizeof(code_buffer); i++) code_buffer[i] = 0;
-        
-        const uint8_t* code = codegen.get_code();
-        for (size_t i = 0; i < code_size && i < sizeof(code_buffer); i++) {
-            code_buffer[i] = code[i];
-        }
-        
-        // Initialize and run native execution
-        casm_native::init(code_buffer, sizeof(code_buffer));
-        casm_native::run(code_buffer);
-        
-        uart::puts("\x1b[0m");
+        casm::cache_insert(cache_key, codegen.get_code(), code_size);
+        casm_run_image(codegen.get_code(), code_size);
         return;
     }
     
@@ -1197,58 +1351,217 @@ void cmd_casm(int argc, char* argv[]) {
 }
 
 /*
- * Native execution for CASM binaries
- * Runs ARM64 code directly on CPU, traps SVC for extended opcodes
- * Much faster than VM interpretation!
+ * casm - Assemble a C.ASM source file or run a binary
+ * Usage: casm [-O] <filename.asm> [-o <output>]
+ *        casm [-O] -r <filename.asm>   (compile & run)
+ *        casm run <filename.bin>       (native execution - fast!)
+ *        casm run -v <filename.bin>    (VM mode - slower but safer)
+ *        casm run -d <filename.bin>    (debug mode)
+ *        casm disasm <filename.bin>
+ *        casm prof <filename.asm|filename.bin>
+ *        casm cache [clear]
+ * Requirements: 7.11
  */
-static void cmd_casm_run_native(const char* filename) {
-    // Open the binary file
-    ramfs::FSNode* file = ramfs::open_file(filename);
-    if (!file) {
-        uart::puts("casm run: cannot open '");
-        uart::puts(filename);
-        uart::puts("': No such file\n");
-        return;
-    }
-    
-    if (file->size == 0) {
-        uart::puts("casm run: '");
-        uart::puts(filename);
-        uart::puts("': Empty file\n");
-        return;
+void cmd_casm(int argc, char* argv[]) {
+    // '-O' (peephole optimizer) may appear anywhere; drop it from argv
+    bool optimize = false;
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] == '\0') {
+            optimize = true;
+        } else {
+            argv[kept++] = argv[i];
+        }
     }
+    argc = kept;
     
-    if (file->size > 5120) {
-        uart::puts("casm run: '");
-        uart::puts(filename);
-        uart::puts("': File too large (max 5KB)\n");
+    if (argc < 2) {
+        uart::puts("CASM - C.ASM Assembler v1.0\n\n");
+        uart::puts("Usage: casm [-O] <source.asm> [-o <output.bin>]\n");
+        uart::puts("       casm [-O] -r <source.asm> (compile & run)\n");
+        uart::puts("       casm run <file.bin>    (run binary - native)\n");
+        uart::puts("       casm run -v <file.bin> (VM mode - slower)\n");
+        uart::puts("       casm run -d <file.bin> (debug mode)\n");
+        uart::puts("       casm run -v -b <count> <file.bin> (VM instruction budget)\n");
+        uart::puts("       casm run -p <file.bin> (native, with PMU counters)\n");
+        uart::puts("       casm disasm <file.bin>\n");
+        uart::puts("       casm [-O] prof <file.asm|file.bin> (sampling profile)\n");
+        uart::puts("       casm cache [clear]     (casm -r build cache)\n");
         return;
     }
     
-    // Read binary into buffer
-    static uint8_t code_buffer[5120];
-    for (size_t i = 0; i < sizeof(code_buffer); i++) code_buffer[i] = 0;
-    ramfs::read_file(file, code_buffer, 0, file->size);
+    // Check for '-r' flag (compile and run)
+    bool run_after_compile = false;
+    const char* source_file = nullptr;
     
-    // Initialize native execution environment
-    casm_native::init(code_buffer, sizeof(code_buffer));
+    if (argv[1][0] == '-' && argv[1][1] == 'r' && argv[1][2] == '\0') {
+        if (argc < 3) {
+            uart::puts("Usage: casm -r <source.asm>\n");
+            return;
+        }
+        run_after_compile = true;
+        source_file = argv[2];
+    }
     
-    // Run natively - CPU executes ARM64 directly, SVC traps to kernel
-    casm_native::run(code_buffer);
+    // Check for 'run' subcommand
+    if (argv[1][0] == 'r' && argv[1][1] == 'u' && argv[1][2] == 'n' && argv[1][3] == '\0') {
+        // Flags: -v (VM), -d (debug), -b <count> (VM instruction budget),
+        // -p (native, PMU counters)
+        bool vm_mode = false;
+        bool debug = false;
+        bool perf = false;
+        uint64_t budget = casm::DEFAULT_VM_BUDGET;
+        const char* filename = nullptr;
+        for (int i = 2; i < argc; i++) {
+            if (argv[i][0] != '-') {
+                filename = argv[i];
+            } else if (argv[i][1] == 'v' && argv[i][2] == '\0') {
+                vm_mode = true;
+            } else if (argv[i][1] == 'd' && argv[i][2] == '\0') {
+                vm_mode = true;
+                debug = true;
+            } else if (argv[i][1] == 'b' && argv[i][2] == '\0' && i + 1 < argc) {
+                bool ok;
+                budget = parse_uint64(argv[++i], &ok);
+                if (!ok || budget == 0) {
+                    uart::printf("casm run: invalid budget '%s'\n", argv[i]);
+                    return;
+                }
+                vm_mode = true;
+            } else if (argv[i][1] == 'p' && argv[i][2] == '\0') {
+                perf = true;
+            } else {
+                uart::puts("Unknown flag. Use -v (VM), -d (debug), -b <count> or -p (perf)\n");
+                return;
+            }
+        }
+        if (!filename) {
+            uart::puts("Usage: casm run [-v|-d] [-b <count>] [-p] <filename.bin>\n");
+            return;
+        }
+        if (perf && vm_mode) {
+            uart::puts("casm run: -p counts native runs only\n");
+            return;
+        }
+        if (perf && !pmu::available()) {
+            uart::puts("casm run: -p: no PMU\n");
+            return;
+        }
+        if (vm_mode) {
+            cmd_casm_run_vm(filename, debug, budget);
+        } else {
+            cmd_casm_run_native(filename, perf);  // Native mode is default (fast!)
+        }
+        return;
+    }
     
-    // Cleanup handled by run() or SVC handler
-    uart::puts("\x1b[0m");
+    // Check for 'cache' subcommand
+    if (klib::strcmp(argv[1], "cache") == 0) {
+        if (argc >= 3 && klib::strcmp(argv[2], "clear") == 0) {
+            casm::cache_clear();
+            uart::puts("casm: build cache cleared\n");
+            return;
+        }
+        casm::CacheStats stats;
+        casm::get_cache_stats(&stats);
+        uart::puts("CASM build cache (casm -r):\n");
+        uart::printf("  Entries: %d / %d\n", (int)stats.entries, (int)casm::CACHE_ENTRIES);
+        uart::printf("  Bytes:   %d / %d\n", (int)stats.bytes, (int)casm::CACHE_MAX_BYTES);
+        uart::printf("  Hits:    %d\n", (int)stats.hits);
+        uart::printf("  Misses:  %d\n", (int)stats.misses);
+        return;
+    }
+    
+    // Check for 'prof' subcommand
+    if (klib::strcmp(argv[1], "prof") == 0) {
+        if (argc < 3) {
+            uart::puts("Usage: casm [-O] prof <file.asm|file.bin>\n");
+            return;
+        }
+        cmd_casm_prof(argv[2], optimize);
+        return;
+    }
+    
+    // Check for 'disasm' subcommand
+    if (argv[1][0] == 'd' && argv[1][1] == 'i' && argv[1][2] == 's') {
+        if (argc < 3) {
+            uart::puts("Usage: casm disasm <filename.bin>\n");
+            return;
+        }
+        cmd_casm_disasm(argv[2]);
+        return;
+    }
+    
+    const char* input_file = run_after_compile ? source_file : argv[1];
+    const char* output_file = nullptr;
+    
+    // Parse optional -o flag (only if not using -r)
+    if (!run_after_compile) {
+        for (int i = 2; i < argc - 1; i++) {
+            if (argv[i][0] == '-' && argv[i][1] == 'o' && argv[i][2] == '\0') {
+                output_file = argv[i + 1];
+                break;
+            }
+        }
+    }
+    
+    // Open and read the source file
+    ramfs::FSNode* file = ramfs::open_file(input_file);
+    if (!file) {
+        uart::puts("casm: cannot open '");
+        uart::puts(input_file);
+        uart::puts("': No such file\n");
+        return;
+    }
+    
+    // Check file size
+    if (file->size == 0) {
+        uart::puts("casm: '");
+        uart::puts(input_file);
+        uart::puts("': Empty file\n");
+        return;
+    }
+    
+    // Assemble straight from the file's pages; the pin keeps them valid
+    const uint8_t* source;
+    size_t length;
+    if (!ramfs::map_file(file, &source, &length)) {
+        uart::puts("casm: cannot read '");
+        uart::puts(input_file);
+        uart::puts("'\n");
+        return;
+    }
+    
+    // casm -r of unchanged source reuses the image from the last build
+    uint64_t cache_key = 0;
+    if (run_after_compile) {
+        cache_key = casm::cache_key(reinterpret_cast<const char*>(source), length,
+                                    optimize ? casm::CACHE_OPT_OPTIMIZE : 0);
+        size_t image_size;
+        const uint8_t* image = casm::cache_lookup(cache_key, &image_size);
+        if (image) {
+            ramfs::unmap_file(file);
+            casm::CacheStats stats;
+            casm::get_cache_stats(&stats);
+            uart::printf("Using cached build of '%s' (%d bytes; %d hits, %d misses)\n",
+                         input_file, (int)image_size, (int)stats.hits, (int)stats.misses);
+            casm_run_image(image, image_size, true);
+            return;
+        }
+    }
+    
+    casm_assemble(input_file, reinterpret_cast<const char*>(source), length,
+                  output_file, run_after_compile, optimize, cache_key);
+    
+    ramfs::unmap_file(file);
 }
 
 /*
- * Simple VM for executing CASM binaries (fallback mode)
- * Interprets ARM64 instructions with extended I/O opcodes
- * 
- * Graphics use a virtual framebuffer that's rendered at the end
- * to avoid terminal scrolling issues.
+ * Native execution for CASM binaries
+ * Runs ARM64 code directly on CPU, traps SVC for extended opcodes
+ * Much faster than VM interpretation!
  */
-
-static void cmd_casm_run(const char* filename) {
+static void cmd_casm_run_native(const char* filename, bool perf) {
     // Open the binary file
     ramfs::FSNode* file = ramfs::open_file(filename);
     if (!file) {
@@ -1265,877 +1578,458 @@ static void cmd_casm_run(const char* filename) {
         return;
     }
     
-    if (file->size > 5120) {
-        uart::puts("casm run: '");
-        uart::puts(filename);
-        uart::puts("': File too large (max 5KB)\n");
+    // Copy the image out of the file's pages into the program arena; the
+    // zeroed rest of the arena is the program's data area
+    const uint8_t* image;
+    size_t image_size;
+    if (!ramfs::map_file(file, &image, &image_size)) {
+        uart::printf("casm run: %s: Cannot read\n", filename);
+        return;
+    }
+    size_t arena_size;
+    uint8_t* arena = casm_alloc_arena(image, image_size, &arena_size);
+    ramfs::unmap_file(file);
+    if (!arena) {
+        uart::printf("casm run: %s: Out of memory\n", filename);
         return;
     }
     
-    // Read binary into buffer - use full buffer as working memory
-    static uint8_t code_buffer[5120];  // 5KB
-    // Clear buffer first (for data area)
-    for (size_t i = 0; i < sizeof(code_buffer); i++) code_buffer[i] = 0;
-    size_t actual_code_size = ramfs::read_file(file, code_buffer, 0, file->size);
-    size_t mem_size = sizeof(code_buffer);  // Full memory for data operations
+    // Initialize native execution environment
+    casm_native::init(arena, arena_size);
     
-    // VM state: 31 general purpose registers + SP
-    uint64_t regs[32];
-    for (int i = 0; i < 32; i++) regs[i] = 0;
+    // Run natively - CPU executes ARM64 directly, SVC traps to kernel.
+    // With -p the counts include the kernel's share: SVCs and IRQs
+    pmu::Counts start;
+    pmu::sample(&start);
+    uint64_t svcs = casm_native::run(arena);
+    pmu::Counts counts;
+    pmu::since(&start, &counts);
     
-    // Condition flags (NZCV)
-    bool flag_n = false;  // Negative
-    bool flag_z = false;  // Zero
-    bool flag_c = false;  // Carry
-    bool flag_v = false;  // Overflow
+    // Cleanup handled by run() or SVC handler
+    casm_free_arena(arena, arena_size);
+    uart::puts("\x1b[0m");
     
-    uint64_t pc = 0;
-    bool running = true;
-    int max_instructions = 10000;
-    int instr_count = 0;
-    
-    // Reset framebuffer state
-    g_fb_active = false;
-    g_fb_width = 0;
-    g_fb_height = 0;
-    g_fb_fg = 7;
-    g_fb_bg = 0;
-    fb_clear();
-    
-    while (running && pc < actual_code_size && instr_count < max_instructions) {
-        uint32_t instr = code_buffer[pc] | (code_buffer[pc+1] << 8) |
-                        (code_buffer[pc+2] << 16) | (code_buffer[pc+3] << 24);
-        
-        instr_count++;
-        
-        // Check for SVC (extended opcodes)
-        if ((instr & 0xFFE0001F) == 0xD4000001) {
-            uint16_t imm16 = (instr >> 5) & 0xFFFF;
-            
-            switch (imm16) {
-                case 0x100: {
-                    // PRT: print string
-                    uint64_t addr = regs[0];
-                    while (addr < mem_size && code_buffer[addr] != 0) {
-                        uart::putc(static_cast<char>(code_buffer[addr]));
-                        addr++;
-                    }
-                    break;
-                }
-                case 0x101:
-                    // PRTC: print character
-                    uart::putc(static_cast<char>(regs[0] & 0xFF));
-                    break;
-                case 0x102:
-                    // PRTN: print number
-                    uart::printf("%d", static_cast<int>(regs[0]));
-                    break;
-                case 0x103:
-                    // INP: input character
-                    regs[0] = uart::getc();
-                    break;
-                    
-                // Graphics opcodes - draw to framebuffer
-                case 0x110: {
-                    // CLS: clear framebuffer (auto-init if needed)
-                    if (!g_fb_active) { g_fb_active = true; g_fb_width = 40; g_fb_height = 12; }
-                    fb_clear();
-                    break;
-                }
-                case 0x111: {
-                    // SETC: set colors (auto-init if needed)
-                    if (!g_fb_active) { g_fb_active = true; g_fb_width = 40; g_fb_height = 12; fb_clear(); }
-                    g_fb_fg = regs[0] & 7;
-                    g_fb_bg = regs[1] & 7;
-                    break;
-                }
-                case 0x112: {
-                    // PLOT: plot character (auto-init if needed)
-                    if (!g_fb_active) { g_fb_active = true; g_fb_width = 40; g_fb_height = 12; fb_clear(); }
-                    fb_plot(regs[0] & 0xFF, regs[1] & 0xFF, regs[2] & 0xFF);
-                    break;
-                }
-                case 0x113: {
-                    // LINE: draw line (auto-init if needed)
-                    if (!g_fb_active) { g_fb_active = true; g_fb_width = 40; g_fb_height = 12; fb_clear(); }
-                    int x1 = regs[0] & 0xFF;
-                    int y1 = regs[1] & 0xFF;
-                    int x2 = regs[2] & 0xFF;
-                    int y2 = regs[3] & 0xFF;
-                    char ch = (regs[4] & 0xFF) ? (regs[4] & 0xFF) : '*';
-                    
-                    if (y1 == y2) {
-                        int start = (x1 < x2) ? x1 : x2;
-                        int end = (x1 > x2) ? x1 : x2;
-                        for (int i = start; i <= end; i++) fb_plot(i, y1, ch);
-                    } else if (x1 == x2) {
-                        int start = (y1 < y2) ? y1 : y2;
-                        int end = (y1 > y2) ? y1 : y2;
-                        for (int i = start; i <= end; i++) fb_plot(x1, i, ch);
-                    }
-                    break;
-                }
-                case 0x114: {
-                    // BOX: draw box (auto-init if needed)
-                    if (!g_fb_active) { g_fb_active = true; g_fb_width = 40; g_fb_height = 12; fb_clear(); }
-                    int x = regs[0] & 0xFF;
-                    int y = regs[1] & 0xFF;
-                    int w = regs[2] & 0xFF;
-                    int h = regs[3] & 0xFF;
-                    
-                    // Top border
-                    fb_plot(x, y, '+');
-                    for (int i = 1; i < w - 1; i++) fb_plot(x + i, y, '-');
-                    fb_plot(x + w - 1, y, '+');
-                    
-                    // Sides with fill
-                    for (int i = 1; i < h - 1; i++) {
-                        fb_plot(x, y + i, '|');
-                        for (int j = 1; j < w - 1; j++) fb_plot(x + j, y + i, ' ');
-                        fb_plot(x + w - 1, y + i, '|');
-                    }
-                    
-                    // Bottom border
-                    fb_plot(x, y + h - 1, '+');
-                    for (int i = 1; i < w - 1; i++) fb_plot(x + i, y + h - 1, '-');
-                    fb_plot(x + w - 1, y + h - 1, '+');
-                    break;
-                }
-                case 0x115: {
-                    // RESET: reset colors
-                    g_fb_fg = 7;
-                    g_fb_bg = 0;
-                    break;
-                }
-                case 0x116: {
-                    // CANVAS: set up framebuffer
-                    g_fb_width = regs[0] & 0xFF;
-                    g_fb_height = regs[1] & 0xFF;
-                    if (g_fb_width < 1) g_fb_width = 40;
-                    if (g_fb_height < 1) g_fb_height = 10;
-                    if (g_fb_width > 80) g_fb_width = 80;
-                    if (g_fb_height > 24) g_fb_height = 24;
-                    g_fb_active = true;
-                    fb_clear();
-                    break;
-                }
-                
-                // System opcodes
-                case 0x1F0:
-                    timer::sleep_ms(regs[0] & 0xFFFF);
-                    break;
-                case 0x1F1: {
-                    static uint32_t seed = 12345;
-                    seed = seed * 1103515245 + 12345;
-                    uint32_t max = regs[0] ? regs[0] : 1;
-                    regs[0] = (seed >> 16) % max;
-                    break;
-                }
-                case 0x1F2:
-                    // TICK: get current time in ms
-                    regs[0] = timer::get_uptime_ms();
-                    break;
-                    
-                // Extended I/O opcodes
-                case 0x104: {
-                    // INPS: input string into buffer at x0, max length x1
-                    // Returns actual length in x0
-                    uint64_t buf_addr = regs[0];
-                    uint64_t max_len = regs[1];
-                    if (max_len == 0) max_len = 64;
-                    if (max_len > 256) max_len = 256;
-                    
-                    uint64_t i = 0;
-                    while (i < max_len - 1) {
-                        char c = uart::getc();
-                        if (c == '\r' || c == '\n') {
-                            uart::putc('\n');
-                            break;
-                        }
-                        if (c == 127 || c == 8) {  // Backspace
-                            if (i > 0) {
-                                i--;
-                                uart::puts("\b \b");
-                            }
-                            continue;
-                        }
-                        uart::putc(c);  // Echo
-                        if (buf_addr + i < mem_size) {
-                            code_buffer[buf_addr + i] = c;
-                        }
-                        i++;
-                    }
-                    // Null terminate
-                    if (buf_addr + i < mem_size) {
-                        code_buffer[buf_addr + i] = 0;
-                    }
-                    regs[0] = i;
-                    break;
-                }
-                
-                // File opcodes (0x120-0x12F)
-                case 0x120: {
-                    // FCREAT: create file (x0=name_ptr)
-                    char filename[64];
-                    uint64_t name_addr = regs[0];
-                    int j = 0;
-                    while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
-                        filename[j] = code_buffer[name_addr + j];
-                        j++;
-                    }
-                    filename[j] = 0;
-                    
-                    ramfs::FSNode* f = ramfs::create_file(filename);
-                    regs[0] = f ? 1 : 0;
-                    break;
-                }
-                case 0x121: {
-                    // FWRITE: write to file (x0=name_ptr, x1=data_ptr, x2=len)
-                    char filename[64];
-                    uint64_t name_addr = regs[0];
-                    uint64_t data_addr = regs[1];
-                    uint64_t len = regs[2];
-                    
-                    int j = 0;
-                    while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
-                        filename[j] = code_buffer[name_addr + j];
-                        j++;
-                    }
-                    filename[j] = 0;
-                    
-                    // Get or create file
-                    ramfs::FSNode* f = ramfs::open_file(filename);
-                    if (!f) {
-                        f = ramfs::create_file(filename);
-                    }
-                    if (f && data_addr + len <= mem_size) {
-                        ramfs::write_file(f, &code_buffer[data_addr], 0, len);
-                        regs[0] = len;
-                    } else {
-                        regs[0] = 0;
-                    }
-                    break;
-                }
-                case 0x122: {
-                    // FREAD: read file (x0=name_ptr, x1=buf_ptr, x2=max_len) -> x0=bytes_read
-                    char filename[64];
-                    uint64_t name_addr = regs[0];
-                    uint64_t buf_addr = regs[1];
-                    uint64_t max_len = regs[2];
-                    
-                    int j = 0;
-                    while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
-                        filename[j] = code_buffer[name_addr + j];
-                        j++;
-                    }
-                    filename[j] = 0;
-                    
-                    ramfs::FSNode* f = ramfs::open_file(filename);
-                    if (f && buf_addr + max_len <= mem_size) {
-                        size_t bytes = ramfs::read_file(f, &code_buffer[buf_addr], 0, max_len);
-                        regs[0] = bytes;
-                    } else {
-                        regs[0] = 0;
-                    }
-                    break;
-                }
-                case 0x123: {
-                    // FDEL: delete file (x0=name_ptr)
-                    char filename[64];
-                    uint64_t name_addr = regs[0];
-                    int j = 0;
-                    while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
-                        filename[j] = code_buffer[name_addr + j];
-                        j++;
-                    }
-                    filename[j] = 0;
-                    
-                    regs[0] = ramfs::delete_file(filename) ? 1 : 0;
-                    break;
-                }
-                case 0x124: {
-                    // FCOPY: copy file (x0=src_ptr, x1=dst_ptr)
-                    char src[64], dst[64];
-                    uint64_t src_addr = regs[0];
-                    uint64_t dst_addr = regs[1];
-                    
-                    int j = 0;
-                    while (j < 63 && src_addr + j < mem_size && code_buffer[src_addr + j] != 0) {
-                        src[j] = code_buffer[src_addr + j];
-                        j++;
-                    }
-                    src[j] = 0;
-                    
-                    j = 0;
-                    while (j < 63 && dst_addr + j < mem_size && code_buffer[dst_addr + j] != 0) {
-                        dst[j] = code_buffer[dst_addr + j];
-                        j++;
-                    }
-                    dst[j] = 0;
-                    
-                    // Read source file
-                    ramfs::FSNode* sf = ramfs::open_file(src);
-                    if (sf) {
-                        static uint8_t copy_buf[1024];
-                        size_t sz = ramfs::read_file(sf, copy_buf, 0, sizeof(copy_buf));
-                        ramfs::FSNode* df = ramfs::create_file(dst);
-                        if (df) {
-                            ramfs::write_file(df, copy_buf, 0, sz);
-                            regs[0] = 1;
-                        } else {
-                            regs[0] = 0;
-                        }
-                    } else {
-                        regs[0] = 0;
-                    }
-                    break;
-                }
-                case 0x125: {
-                    // FMOVE: move/rename file (x0=src_ptr, x1=dst_ptr)
-                    // Implemented as copy + delete
-                    char src[64], dst[64];
-                    uint64_t src_addr = regs[0];
-                    uint64_t dst_addr = regs[1];
-                    
-                    int j = 0;
-                    while (j < 63 && src_addr + j < mem_size && code_buffer[src_addr + j] != 0) {
-                        src[j] = code_buffer[src_addr + j];
-                        j++;
-                    }
-                    src[j] = 0;
-                    
-                    j = 0;
-                    while (j < 63 && dst_addr + j < mem_size && code_buffer[dst_addr + j] != 0) {
-                        dst[j] = code_buffer[dst_addr + j];
-                        j++;
-                    }
-                    dst[j] = 0;
-                    
-                    // Copy then delete
-                    ramfs::FSNode* sf = ramfs::open_file(src);
-                    if (sf) {
-                        static uint8_t move_buf[1024];
-                        size_t sz = ramfs::read_file(sf, move_buf, 0, sizeof(move_buf));
-                        ramfs::FSNode* df = ramfs::create_file(dst);
-                        if (df) {
-                            ramfs::write_file(df, move_buf, 0, sz);
-                            ramfs::delete_file(src);
-                            regs[0] = 1;
-                        } else {
-                            regs[0] = 0;
-                        }
-                    } else {
-                        regs[0] = 0;
-                    }
-                    break;
-                }
-                case 0x126: {
-                    // FEXIST: check if file exists (x0=name_ptr) -> x0=1 if exists
-                    char filename[64];
-                    uint64_t name_addr = regs[0];
-                    int j = 0;
-                    while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
-                        filename[j] = code_buffer[name_addr + j];
-                        j++;
-                    }
-                    filename[j] = 0;
-                    
-                    ramfs::FSNode* f = ramfs::open_file(filename);
-                    regs[0] = f ? 1 : 0;
-                    break;
-                }
-                
-                // Memory/String opcodes (0x130-0x13F)
-                case 0x105: {
-                    // PRTX: print hex
-                    uint64_t v = regs[0];
-                    uart::printf("0x%x", (uint32_t)v);
-                    break;
-                }
-                case 0x130: {
-                    // STRLEN: get string length (x0=addr -> x0=len)
-                    uint64_t addr = regs[0];
-                    uint64_t len = 0;
-                    while (addr + len < mem_size && code_buffer[addr + len] != 0) {
-                        len++;
-                    }
-                    regs[0] = len;
-                    break;
-                }
-                case 0x131: {
-                    // MEMCPY: copy memory (x0=dst, x1=src, x2=len)
-                    uint64_t dst = regs[0];
-                    uint64_t src = regs[1];
-                    uint64_t len = regs[2];
-                    for (uint64_t i = 0; i < len && dst + i < mem_size && src + i < mem_size; i++) {
-                        code_buffer[dst + i] = code_buffer[src + i];
-                    }
-                    break;
-                }
-                case 0x132: {
-                    // MEMSET: fill memory (x0=addr, x1=byte, x2=len)
-                    uint64_t addr = regs[0];
-                    uint8_t val = regs[1] & 0xFF;
-                    uint64_t len = regs[2];
-                    for (uint64_t i = 0; i < len && addr + i < mem_size; i++) {
-                        code_buffer[addr + i] = val;
-                    }
-                    break;
-                }
-                case 0x133: {
-                    // ABS: absolute value (x0=val -> x0=|val|)
-                    int64_t v = (int64_t)regs[0];
-                    regs[0] = (v < 0) ? -v : v;
-                    break;
-                }
-                
-                case 0x1FF:
-                    running = false;
-                    break;
-                default:
-                    uart::printf("\nUnknown SVC #0x%x at PC=0x%x\n", imm16, (uint32_t)pc);
-                    running = false;
-                    break;
+    if (perf) {
+        print_perf_counts(filename, &counts);
+        print_perf_line(svcs, "SVCs");
+        uart::puts("\n\n");
+    }
+}
+
+/*
+ * Extended opcodes for casm run -v and -d (SVC #0x100-0x1F2)
+ * halt (SVC #0x1FF) is handled by the VM itself
+ * Returns false to stop the program
+ */
+static bool casm_vm_svc(casm::Vm& vm, uint32_t number, void* context) {
+    uint64_t* regs = &vm.reg(0);
+    uint8_t* code_buffer = vm.memory();
+    size_t mem_size = vm.memory_size();
+    
+    // Bytes putc queued come before anything this SVC prints
+    VmSession* session = static_cast<VmSession*>(context);
+    casm::Framebuffer* fb = &session->fb;
+    if (casm_native::drain_console(session->console, true)) {
+        casm::fb_invalidate(fb);
+    }
+    
+    switch (number) {
+        case 0x100: {
+            // PRT: print string
+            uint64_t addr = regs[0];
+            while (addr < mem_size && code_buffer[addr] != 0) {
+                uart::putc(static_cast<char>(code_buffer[addr]));
+                addr++;
             }
-            pc += 4;
+            casm::fb_invalidate(fb);
+            break;
         }
-        // NOP
-        else if (instr == 0xD503201F) {
-            pc += 4;
+        case 0x101:
+            // PRTC: print character
+            uart::putc(static_cast<char>(regs[0] & 0xFF));
+            casm::fb_invalidate(fb);
+            break;
+        case 0x102:
+            // PRTN: print number
+            uart::printf("%d", static_cast<int>(regs[0]));
+            casm::fb_invalidate(fb);
+            break;
+        case 0x103:
+            // INP: input character
+            regs[0] = uart::getc();
+            casm::fb_invalidate(fb);
+            break;
+        case casm::SVC_FLUSH:
+            // FLUSH: the console ring was drained above
+            uart::flush();
+            break;
+            
+        // Graphics opcodes - draw to framebuffer
+        case 0x110: {
+            // CLS: clear framebuffer (auto-init if needed)
+            if (!fb->active) { fb->active = true; fb->width = 40; fb->height = 12; }
+            casm::fb_clear(fb);
+            break;
         }
-        // RET (stop execution)
-        else if ((instr & 0xFFFFFC1F) == 0xD65F0000) {
-            running = false;
+        case 0x111: {
+            // SETC: set colors (auto-init if needed)
+            if (!fb->active) { fb->active = true; fb->width = 40; fb->height = 12; casm::fb_clear(fb); }
+            fb->fg = regs[0] & 7;
+            fb->bg = regs[1] & 7;
+            break;
         }
-        // MOVZ (64-bit): 1 10 100101 hw imm16 Rd
-        else if ((instr & 0xFF800000) == 0xD2800000) {
-            int rd = instr & 0x1F;
-            uint16_t imm16 = (instr >> 5) & 0xFFFF;
-            int hw = (instr >> 21) & 0x3;
-            
-            uint64_t value = static_cast<uint64_t>(imm16) << (hw * 16);
-            if (rd != 31) {
-                regs[rd] = value;
-            }
-            pc += 4;
+        case 0x112: {
+            // PLOT: plot character (auto-init if needed)
+            if (!fb->active) { fb->active = true; fb->width = 40; fb->height = 12; casm::fb_clear(fb); }
+            casm::fb_plot(fb, regs[0] & 0xFF, regs[1] & 0xFF, regs[2] & 0xFF);
+            break;
         }
-        // MOVZ (32-bit): 0 10 100101 hw imm16 Rd
-        else if ((instr & 0xFF800000) == 0x52800000) {
-            int rd = instr & 0x1F;
-            uint16_t imm16 = (instr >> 5) & 0xFFFF;
-            int hw = (instr >> 21) & 0x3;
+        case 0x113: {
+            // LINE: draw line (auto-init if needed)
+            if (!fb->active) { fb->active = true; fb->width = 40; fb->height = 12; casm::fb_clear(fb); }
+            int x1 = regs[0] & 0xFF;
+            int y1 = regs[1] & 0xFF;
+            int x2 = regs[2] & 0xFF;
+            int y2 = regs[3] & 0xFF;
+            char ch = (regs[4] & 0xFF) ? (regs[4] & 0xFF) : '*';
             
-            uint64_t value = static_cast<uint64_t>(imm16) << (hw * 16);
-            if (rd != 31) {
-                regs[rd] = value & 0xFFFFFFFF;
+            if (y1 == y2) {
+                int start = (x1 < x2) ? x1 : x2;
+                int end = (x1 > x2) ? x1 : x2;
+                for (int i = start; i <= end; i++) casm::fb_plot(fb, i, y1, ch);
+            } else if (x1 == x2) {
+                int start = (y1 < y2) ? y1 : y2;
+                int end = (y1 > y2) ? y1 : y2;
+                for (int i = start; i <= end; i++) casm::fb_plot(fb, x1, i, ch);
             }
-            pc += 4;
+            break;
         }
-        // MOVN (64-bit): 1 00 100101 hw imm16 Rd
-        else if ((instr & 0xFF800000) == 0x92800000) {
-            int rd = instr & 0x1F;
-            uint16_t imm16 = (instr >> 5) & 0xFFFF;
-            int hw = (instr >> 21) & 0x3;
-            
-            uint64_t value = ~(static_cast<uint64_t>(imm16) << (hw * 16));
-            if (rd != 31) {
-                regs[rd] = value;
-            }
-            pc += 4;
-        }
-        // ADD immediate (64-bit): 1 0 0 100010 sh imm12 Rn Rd
-        else if ((instr & 0xFF000000) == 0x91000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
-            int sh = (instr >> 22) & 1;
-            
-            uint64_t operand = sh ? (imm12 << 12) : imm12;
-            uint64_t result = regs[rn] + operand;
-            
-            if (rd != 31) {
-                regs[rd] = result;
-            }
-            pc += 4;
-        }
-        // ADD immediate (32-bit): 0 0 0 100010 sh imm12 Rn Rd
-        else if ((instr & 0xFF000000) == 0x11000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
-            int sh = (instr >> 22) & 1;
+        case 0x114: {
+            // BOX: draw box (auto-init if needed)
+            if (!fb->active) { fb->active = true; fb->width = 40; fb->height = 12; casm::fb_clear(fb); }
+            int x = regs[0] & 0xFF;
+            int y = regs[1] & 0xFF;
+            int w = regs[2] & 0xFF;
+            int h = regs[3] & 0xFF;
             
-            uint64_t operand = sh ? (imm12 << 12) : imm12;
-            uint64_t result = (regs[rn] + operand) & 0xFFFFFFFF;
+            // Top border
+            casm::fb_plot(fb, x, y, '+');
+            for (int i = 1; i < w - 1; i++) casm::fb_plot(fb, x + i, y, '-');
+            casm::fb_plot(fb, x + w - 1, y, '+');
             
-            if (rd != 31) {
-                regs[rd] = result;
+            // Sides with fill
+            for (int i = 1; i < h - 1; i++) {
+                casm::fb_plot(fb, x, y + i, '|');
+                for (int j = 1; j < w - 1; j++) casm::fb_plot(fb, x + j, y + i, ' ');
+                casm::fb_plot(fb, x + w - 1, y + i, '|');
             }
-            pc += 4;
-        }
-        // SUB immediate (64-bit): 1 1 0 100010 sh imm12 Rn Rd
-        else if ((instr & 0xFF000000) == 0xD1000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
-            int sh = (instr >> 22) & 1;
-            
-            uint64_t operand = sh ? (imm12 << 12) : imm12;
-            uint64_t result = regs[rn] - operand;
             
-            if (rd != 31) {
-                regs[rd] = result;
-            }
-            pc += 4;
-        }
-        // SUB immediate (32-bit): 0 1 0 100010 sh imm12 Rn Rd
-        else if ((instr & 0xFF000000) == 0x51000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
-            int sh = (instr >> 22) & 1;
+            // Bottom border
+            casm::fb_plot(fb, x, y + h - 1, '+');
+            for (int i = 1; i < w - 1; i++) casm::fb_plot(fb, x + i, y + h - 1, '-');
+            casm::fb_plot(fb, x + w - 1, y + h - 1, '+');
+            break;
+        }
+        case 0x115: {
+            // RESET: reset colors
+            fb->fg = 7;
+            fb->bg = 0;
+            break;
+        }
+        case 0x116: {
+            // CANVAS: set up framebuffer
+            fb->width = regs[0] & 0xFF;
+            fb->height = regs[1] & 0xFF;
+            if (fb->width < 1) fb->width = 40;
+            if (fb->height < 1) fb->height = 10;
+            if (fb->width > 80) fb->width = 80;
+            if (fb->height > 24) fb->height = 24;
+            fb->active = true;
+            casm::fb_clear(fb);
+            break;
+        }
+        case 0x117:
+            // RENDER: show the canvas, redrawing only changed cells
+            casm::fb_render(fb);
+            uart::flush();
+            break;
+        
+        // System opcodes
+        case 0x1F0:
+            sched::sleep_ms(regs[0] & 0xFFFF);
+            break;
+        case 0x1F1: {
+            static uint32_t seed = 12345;
+            seed = seed * 1103515245 + 12345;
+            uint32_t max = regs[0] ? regs[0] : 1;
+            regs[0] = (seed >> 16) % max;
+            break;
+        }
+        case 0x1F2:
+            // TICK: get current time in ms
+            regs[0] = timer::get_uptime_ms();
+            break;
             
-            uint64_t operand = sh ? (imm12 << 12) : imm12;
-            uint64_t result = (regs[rn] - operand) & 0xFFFFFFFF;
+        // Extended I/O opcodes
+        case 0x104: {
+            // INPS: input string into buffer at x0, max length x1
+            // Returns actual length in x0
+            uint64_t buf_addr = regs[0];
+            uint64_t max_len = regs[1];
+            if (max_len == 0) max_len = 64;
+            if (max_len > 256) max_len = 256;
             
-            if (rd != 31) {
-                regs[rd] = result;
+            uint64_t i = 0;
+            while (i < max_len - 1) {
+                char c = uart::getc();
+                if (c == '\r' || c == '\n') {
+                    uart::putc('\n');
+                    break;
+                }
+                if (c == 127 || c == 8) {  // Backspace
+                    if (i > 0) {
+                        i--;
+                        uart::puts("\b \b");
+                    }
+                    continue;
+                }
+                uart::putc(c);  // Echo
+                if (buf_addr + i < mem_size) {
+                    code_buffer[buf_addr + i] = c;
+                }
+                i++;
             }
-            pc += 4;
-        }
-        // B (unconditional branch): 0 00101 imm26
-        else if ((instr & 0xFC000000) == 0x14000000) {
-            int32_t imm26 = instr & 0x3FFFFFF;
-            // Sign extend
-            if (imm26 & 0x2000000) {
-                imm26 |= 0xFC000000;
+            // Null terminate
+            if (buf_addr + i < mem_size) {
+                code_buffer[buf_addr + i] = 0;
             }
-            pc = pc + (imm26 << 2);
+            regs[0] = i;
+            casm::fb_invalidate(fb);
+            break;
         }
-        // BL (branch with link): 1 00101 imm26
-        else if ((instr & 0xFC000000) == 0x94000000) {
-            int32_t imm26 = instr & 0x3FFFFFF;
-            if (imm26 & 0x2000000) {
-                imm26 |= 0xFC000000;
+        
+        // File opcodes (0x120-0x12F)
+        case 0x120: {
+            // FCREAT: create file (x0=name_ptr)
+            char filename[64];
+            uint64_t name_addr = regs[0];
+            int j = 0;
+            while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
+                filename[j] = code_buffer[name_addr + j];
+                j++;
             }
-            regs[30] = pc + 4;  // Save return address in LR
-            pc = pc + (imm26 << 2);
-        }
-        // ORR (register, 64-bit): 1 01 01010 00 0 Rm 000000 Rn Rd
-        else if ((instr & 0xFF200000) == 0xAA000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
+            filename[j] = 0;
             
-            uint64_t result = regs[rn] | regs[rm];
-            if (rd != 31) {
-                regs[rd] = result;
-            }
-            pc += 4;
+            ramfs::FSNode* f = ramfs::create_file(filename);
+            regs[0] = f ? 1 : 0;
+            break;
         }
-        // ORR (register, 32-bit): 0 01 01010 00 0 Rm 000000 Rn Rd
-        else if ((instr & 0xFF200000) == 0x2A000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
+        case 0x121: {
+            // FWRITE: write to file (x0=name_ptr, x1=data_ptr, x2=len)
+            char filename[64];
+            uint64_t name_addr = regs[0];
+            uint64_t data_addr = regs[1];
+            uint64_t len = regs[2];
             
-            uint64_t result = (regs[rn] | regs[rm]) & 0xFFFFFFFF;
-            if (rd != 31) {
-                regs[rd] = result;
+            int j = 0;
+            while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
+                filename[j] = code_buffer[name_addr + j];
+                j++;
             }
-            pc += 4;
-        }
-        // ADD (register, 64-bit): 1 00 01011 00 0 Rm 000000 Rn Rd
-        else if ((instr & 0xFF200000) == 0x8B000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
+            filename[j] = 0;
             
-            uint64_t result = regs[rn] + regs[rm];
-            if (rd != 31) {
-                regs[rd] = result;
+            // Get or create file
+            ramfs::FSNode* f = ramfs::open_file(filename);
+            if (!f) {
+                f = ramfs::create_file(filename);
             }
-            pc += 4;
-        }
-        // ADD (register, 32-bit): 0 00 01011 00 0 Rm 000000 Rn Rd
-        else if ((instr & 0xFF200000) == 0x0B000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
-            
-            uint64_t result = (regs[rn] + regs[rm]) & 0xFFFFFFFF;
-            if (rd != 31) {
-                regs[rd] = result;
+            if (f && data_addr + len <= mem_size) {
+                ramfs::write_file(f, &code_buffer[data_addr], 0, len);
+                regs[0] = len;
+            } else {
+                regs[0] = 0;
             }
-            pc += 4;
+            break;
         }
-        // SUB (register, 64-bit): 1 10 01011 00 0 Rm 000000 Rn Rd
-        else if ((instr & 0xFF200000) == 0xCB000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
+        case 0x122: {
+            // FREAD: read file (x0=name_ptr, x1=buf_ptr, x2=max_len) -> x0=bytes_read
+            char filename[64];
+            uint64_t name_addr = regs[0];
+            uint64_t buf_addr = regs[1];
+            uint64_t max_len = regs[2];
             
-            uint64_t result = regs[rn] - regs[rm];
-            if (rd != 31) {
-                regs[rd] = result;
+            int j = 0;
+            while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
+                filename[j] = code_buffer[name_addr + j];
+                j++;
             }
-            pc += 4;
-        }
-        // SUB (register, 32-bit): 0 10 01011 00 0 Rm 000000 Rn Rd
-        else if ((instr & 0xFF200000) == 0x4B000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
+            filename[j] = 0;
             
-            uint64_t result = (regs[rn] - regs[rm]) & 0xFFFFFFFF;
-            if (rd != 31) {
-                regs[rd] = result;
-            }
-            pc += 4;
-        }
-        // SUBS (register, 64-bit) / CMP: 1 11 01011 00 0 Rm 000000 Rn Rd
-        else if ((instr & 0xFF200000) == 0xEB000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
-            
-            uint64_t op1 = regs[rn];
-            uint64_t op2 = regs[rm];
-            uint64_t result = op1 - op2;
-            
-            // Set flags
-            flag_n = (result >> 63) & 1;
-            flag_z = (result == 0);
-            flag_c = (op1 >= op2);  // No borrow = carry set
-            flag_v = ((op1 ^ op2) & (op1 ^ result)) >> 63;
-            
-            if (rd != 31) {
-                regs[rd] = result;
+            ramfs::FSNode* f = ramfs::open_file(filename);
+            if (f && buf_addr + max_len <= mem_size) {
+                size_t bytes = ramfs::read_file(f, &code_buffer[buf_addr], 0, max_len);
+                regs[0] = bytes;
+            } else {
+                regs[0] = 0;
             }
-            pc += 4;
+            break;
         }
-        // SUBS (register, 32-bit): 0 11 01011 00 0 Rm 000000 Rn Rd
-        else if ((instr & 0xFF200000) == 0x6B000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
-            
-            uint32_t op1 = regs[rn] & 0xFFFFFFFF;
-            uint32_t op2 = regs[rm] & 0xFFFFFFFF;
-            uint32_t result = op1 - op2;
-            
-            // Set flags
-            flag_n = (result >> 31) & 1;
-            flag_z = (result == 0);
-            flag_c = (op1 >= op2);
-            flag_v = ((op1 ^ op2) & (op1 ^ result)) >> 31;
-            
-            if (rd != 31) {
-                regs[rd] = result;
+        case 0x123: {
+            // FDEL: delete file (x0=name_ptr)
+            char filename[64];
+            uint64_t name_addr = regs[0];
+            int j = 0;
+            while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
+                filename[j] = code_buffer[name_addr + j];
+                j++;
             }
-            pc += 4;
-        }
-        // SUBS immediate (64-bit) / CMP: 1 11 100010 sh imm12 Rn Rd
-        else if ((instr & 0xFF000000) == 0xF1000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
-            int sh = (instr >> 22) & 1;
-            
-            uint64_t op1 = regs[rn];
-            uint64_t op2 = sh ? (imm12 << 12) : imm12;
-            uint64_t result = op1 - op2;
+            filename[j] = 0;
             
-            // Set flags
-            flag_n = (result >> 63) & 1;
-            flag_z = (result == 0);
-            flag_c = (op1 >= op2);
-            flag_v = ((op1 ^ op2) & (op1 ^ result)) >> 63;
-            
-            if (rd != 31) {
-                regs[rd] = result;
-            }
-            pc += 4;
-        }
-        // SUBS immediate (32-bit): 0 11 100010 sh imm12 Rn Rd
-        else if ((instr & 0xFF000000) == 0x71000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
-            int sh = (instr >> 22) & 1;
-            
-            uint32_t op1 = regs[rn] & 0xFFFFFFFF;
-            uint32_t op2 = sh ? (imm12 << 12) : imm12;
-            uint32_t result = op1 - op2;
-            
-            // Set flags
-            flag_n = (result >> 31) & 1;
-            flag_z = (result == 0);
-            flag_c = (op1 >= op2);
-            flag_v = ((op1 ^ op2) & (op1 ^ result)) >> 31;
+            regs[0] = ramfs::delete_file(filename) ? 1 : 0;
+            break;
+        }
+        case 0x124: {
+            // FCOPY: copy file (x0=src_ptr, x1=dst_ptr)
+            char src[64], dst[64];
+            uint64_t src_addr = regs[0];
+            uint64_t dst_addr = regs[1];
             
-            if (rd != 31) {
-                regs[rd] = result;
-            }
-            pc += 4;
-        }
-        // B.cond (conditional branch): 0101010 0 imm19 0 cond
-        else if ((instr & 0xFF000010) == 0x54000000) {
-            int cond = instr & 0xF;
-            int32_t imm19 = (instr >> 5) & 0x7FFFF;
-            // Sign extend
-            if (imm19 & 0x40000) {
-                imm19 |= 0xFFF80000;
+            int j = 0;
+            while (j < 63 && src_addr + j < mem_size && code_buffer[src_addr + j] != 0) {
+                src[j] = code_buffer[src_addr + j];
+                j++;
             }
+            src[j] = 0;
             
-            // Evaluate condition
-            bool take_branch = false;
-            switch (cond) {
-                case 0:  take_branch = flag_z; break;                    // EQ: Z==1
-                case 1:  take_branch = !flag_z; break;                   // NE: Z==0
-                case 2:  take_branch = flag_c; break;                    // CS/HS: C==1
-                case 3:  take_branch = !flag_c; break;                   // CC/LO: C==0
-                case 4:  take_branch = flag_n; break;                    // MI: N==1
-                case 5:  take_branch = !flag_n; break;                   // PL: N==0
-                case 6:  take_branch = flag_v; break;                    // VS: V==1
-                case 7:  take_branch = !flag_v; break;                   // VC: V==0
-                case 8:  take_branch = flag_c && !flag_z; break;         // HI: C==1 && Z==0
-                case 9:  take_branch = !flag_c || flag_z; break;         // LS: C==0 || Z==1
-                case 10: take_branch = (flag_n == flag_v); break;        // GE: N==V
-                case 11: take_branch = (flag_n != flag_v); break;        // LT: N!=V
-                case 12: take_branch = !flag_z && (flag_n == flag_v); break; // GT: Z==0 && N==V
-                case 13: take_branch = flag_z || (flag_n != flag_v); break;  // LE: Z==1 || N!=V
-                case 14: take_branch = true; break;                      // AL: always
-                case 15: take_branch = true; break;                      // NV: always (same as AL)
+            j = 0;
+            while (j < 63 && dst_addr + j < mem_size && code_buffer[dst_addr + j] != 0) {
+                dst[j] = code_buffer[dst_addr + j];
+                j++;
             }
+            dst[j] = 0;
             
-            if (take_branch) {
-                pc = pc + (imm19 << 2);
+            // Read source file
+            ramfs::FSNode* sf = ramfs::open_file(src);
+            if (sf) {
+                static uint8_t copy_buf[1024];
+                size_t sz = ramfs::read_file(sf, copy_buf, 0, sizeof(copy_buf));
+                ramfs::FSNode* df = ramfs::create_file(dst);
+                if (df) {
+                    ramfs::write_file(df, copy_buf, 0, sz);
+                    regs[0] = 1;
+                } else {
+                    regs[0] = 0;
+                }
             } else {
-                pc += 4;
+                regs[0] = 0;
             }
+            break;
         }
-        // LDR (unsigned offset, 64-bit): 11 111 0 01 01 imm12 Rn Rt
-        else if ((instr & 0xFFC00000) == 0xF9400000) {
-            int rt = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
+        case 0x125: {
+            // FMOVE: move/rename file (x0=src_ptr, x1=dst_ptr)
+            // Implemented as copy + delete
+            char src[64], dst[64];
+            uint64_t src_addr = regs[0];
+            uint64_t dst_addr = regs[1];
             
-            uint64_t addr = regs[rn] + (imm12 << 3);
-            if (addr + 7 < mem_size) {
-                uint64_t value = 0;
-                for (int i = 0; i < 8; i++) {
-                    value |= static_cast<uint64_t>(code_buffer[addr + i]) << (i * 8);
-                }
-                if (rt != 31) {
-                    regs[rt] = value;
-                }
+            int j = 0;
+            while (j < 63 && src_addr + j < mem_size && code_buffer[src_addr + j] != 0) {
+                src[j] = code_buffer[src_addr + j];
+                j++;
             }
-            pc += 4;
-        }
-        // LDR (unsigned offset, 32-bit): 10 111 0 01 01 imm12 Rn Rt
-        else if ((instr & 0xFFC00000) == 0xB9400000) {
-            int rt = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
+            src[j] = 0;
             
-            uint64_t addr = regs[rn] + (imm12 << 2);
-            if (addr + 3 < mem_size) {
-                uint32_t value = 0;
-                for (int i = 0; i < 4; i++) {
-                    value |= static_cast<uint32_t>(code_buffer[addr + i]) << (i * 8);
-                }
-                if (rt != 31) {
-                    regs[rt] = value;
-                }
+            j = 0;
+            while (j < 63 && dst_addr + j < mem_size && code_buffer[dst_addr + j] != 0) {
+                dst[j] = code_buffer[dst_addr + j];
+                j++;
             }
-            pc += 4;
-        }
-        // LDRB (unsigned offset): 00 111 0 01 01 imm12 Rn Rt
-        else if ((instr & 0xFFC00000) == 0x39400000) {
-            int rt = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
+            dst[j] = 0;
             
-            uint64_t addr = regs[rn] + imm12;
-            if (addr < mem_size) {
-                if (rt != 31) {
-                    regs[rt] = code_buffer[addr];
+            // Copy then delete
+            ramfs::FSNode* sf = ramfs::open_file(src);
+            if (sf) {
+                static uint8_t move_buf[1024];
+                size_t sz = ramfs::read_file(sf, move_buf, 0, sizeof(move_buf));
+                ramfs::FSNode* df = ramfs::create_file(dst);
+                if (df) {
+                    ramfs::write_file(df, move_buf, 0, sz);
+                    ramfs::delete_file(src);
+                    regs[0] = 1;
+                } else {
+                    regs[0] = 0;
                 }
+            } else {
+                regs[0] = 0;
             }
-            pc += 4;
+            break;
         }
-        // STR (unsigned offset, 64-bit): 11 111 0 01 00 imm12 Rn Rt
-        else if ((instr & 0xFFC00000) == 0xF9000000) {
-            int rt = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
-            
-            uint64_t addr = regs[rn] + (imm12 << 3);
-            uint64_t value = regs[rt];
-            if (addr + 7 < mem_size) {
-                for (int i = 0; i < 8; i++) {
-                    code_buffer[addr + i] = (value >> (i * 8)) & 0xFF;
-                }
+        case 0x126: {
+            // FEXIST: check if file exists (x0=name_ptr) -> x0=1 if exists
+            char filename[64];
+            uint64_t name_addr = regs[0];
+            int j = 0;
+            while (j < 63 && name_addr + j < mem_size && code_buffer[name_addr + j] != 0) {
+                filename[j] = code_buffer[name_addr + j];
+                j++;
             }
-            pc += 4;
-        }
-        // STRB (unsigned offset): 00 111 0 01 00 imm12 Rn Rt
-        else if ((instr & 0xFFC00000) == 0x39000000) {
-            int rt = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            uint32_t imm12 = (instr >> 10) & 0xFFF;
+            filename[j] = 0;
             
-            uint64_t addr = regs[rn] + imm12;
-            if (addr < mem_size) {
-                code_buffer[addr] = regs[rt] & 0xFF;
+            ramfs::FSNode* f = ramfs::open_file(filename);
+            regs[0] = f ? 1 : 0;
+            break;
+        }
+        
+        // Memory/String opcodes (0x130-0x13F)
+        case 0x105: {
+            // PRTX: print hex
+            uint64_t v = regs[0];
+            uart::printf("0x%x", (uint32_t)v);
+            casm::fb_invalidate(fb);
+            break;
+        }
+        case 0x130: {
+            // STRLEN: get string length (x0=addr -> x0=len)
+            uint64_t addr = regs[0];
+            uint64_t len = 0;
+            while (addr + len < mem_size && code_buffer[addr + len] != 0) {
+                len++;
             }
-            pc += 4;
+            regs[0] = len;
+            break;
         }
-        // MUL (64-bit): 1 00 11011 000 Rm 0 11111 Rn Rd (MADD with Ra=XZR)
-        else if ((instr & 0xFFE0FC00) == 0x9B007C00) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
-            
-            uint64_t result = regs[rn] * regs[rm];
-            if (rd != 31) {
-                regs[rd] = result;
+        case 0x131: {
+            // MEMCPY: copy memory (x0=dst, x1=src, x2=len)
+            uint64_t dst = regs[0];
+            uint64_t src = regs[1];
+            uint64_t len = regs[2];
+            for (uint64_t i = 0; i < len && dst + i < mem_size && src + i < mem_size; i++) {
+                code_buffer[dst + i] = code_buffer[src + i];
             }
-            pc += 4;
+            break;
         }
-        // MUL (32-bit): 0 00 11011 000 Rm 0 11111 Rn Rd
-        else if ((instr & 0xFFE0FC00) == 0x1B007C00) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
-            
-            uint64_t result = (regs[rn] * regs[rm]) & 0xFFFFFFFF;
-            if (rd != 31) {
-                regs[rd] = result;
+        case 0x132: {
+            // MEMSET: fill memory (x0=addr, x1=byte, x2=len)
+            uint64_t addr = regs[0];
+            uint8_t val = regs[1] & 0xFF;
+            uint64_t len = regs[2];
+            for (uint64_t i = 0; i < len && addr + i < mem_size; i++) {
+                code_buffer[addr + i] = val;
             }
-            pc += 4;
+            break;
         }
-        // Unknown instruction
-        else {
-            uart::printf("\nUnknown instruction 0x%08x at PC=0x%x\n", instr, (uint32_t)pc);
-            running = false;
+        case 0x133: {
+            // ABS: absolute value (x0=val -> x0=|val|)
+            int64_t v = (int64_t)regs[0];
+            regs[0] = (v < 0) ? -v : v;
+            break;
         }
+        
+        default:
+            uart::printf("\nUnknown SVC #0x%x at PC=0x%x\n", number, (uint32_t)vm.pc());
+            return false;
     }
-    
-    // Render framebuffer if graphics were used
-    if (g_fb_active) {
-        fb_render();
-    }
-    
-    // Reset terminal
-    uart::puts("\x1b[0m");
-    
-    if (instr_count >= max_instructions) {
-        uart::puts("Execution limit reached (possible infinite loop)\n");
-    }
-    
-    uart::printf("Executed %d instructions\n", instr_count);
+    return true;
 }
 
 // ============================================================================
@@ -2158,7 +2052,7 @@ void cmd_history(int argc, char* argv[]) {
     for (int i = 0; i < count; i++) {
         const char* entry = shell::get_history_entry(i);
         if (entry) {
-            uart::printf("  %d  %s\n", i + 1, entry);
+            stream::printf("  %d  %s\n", i + 1, entry);
         }
     }
 }
@@ -2234,7 +2128,7 @@ void cmd_env(int argc, char* argv[]) {
         const char* name = shell::get_env_name(i);
         const char* value = shell::get_env_value(i);
         if (name && value) {
-            uart::printf("%s=%s\n", name, value);
+            stream::printf("%s=%s\n", name, value);
         }
     }
 }
@@ -2296,22 +2190,15 @@ void cmd_unset(int argc, char* argv[]) {
 }
 
 /*
- * time - Time command execution
+ * Run the command in argv[first..argc-1] for a wrapper such as time;
+ * who names the wrapper in the not-found message
  */
-void cmd_time(int argc, char* argv[]) {
-    if (argc < 2) {
-        uart::puts("Usage: time <command> [args...]\n");
-        return;
-    }
-    
-    // Get start time
-    uint64_t start = timer::get_uptime_ms();
-    
+static void run_wrapped_command(int argc, char* argv[], int first, const char* who) {
     // Build command line
-    static char cmdline[256];
+    char cmdline[256];
     size_t pos = 0;
-    for (int i = 1; i < argc && pos < sizeof(cmdline) - 2; i++) {
-        if (i > 1) cmdline[pos++] = ' ';
+    for (int i = first; i < argc && pos < sizeof(cmdline) - 2; i++) {
+        if (i > first) cmdline[pos++] = ' ';
         const char* arg = argv[i];
         while (*arg && pos < sizeof(cmdline) - 1) {
             cmdline[pos++] = *arg++;
@@ -2328,15 +2215,139 @@ void cmd_time(int argc, char* argv[]) {
         if (handler) {
             handler(sub_argc, sub_argv);
         } else {
-            uart::printf("time: %s: command not found\n", sub_argv[0]);
+            uart::printf("%s: %s: command not found\n", who, sub_argv[0]);
+        }
+    }
+}
+
+/*
+ * time - Time command execution
+ */
+void cmd_time(int argc, char* argv[]) {
+    if (argc < 2) {
+        uart::puts("Usage: time <command> [args...]\n");
+        return;
+    }
+    
+    // Get start time
+    uint64_t start = timer::get_uptime_ms();
+    
+    run_wrapped_command(argc, argv, 1, "time");
+    
+    // Get end time
+    uint64_t end = timer::get_uptime_ms();
+    uint64_t elapsed = end - start;
+    
+    uart::printf("\nreal\t%d.%03ds\n", (int)(elapsed / 1000), (int)(elapsed % 1000));
+}
+
+// Print a 64-bit count right-aligned in width columns (uart::printf
+// formats 32 bits)
+static void print_count(uint64_t value, int width) {
+    char buf[21];
+    int i = sizeof(buf);
+    do {
+        buf[--i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    for (int n = sizeof(buf) - i; n < width; n++) {
+        uart::putc(' ');
+    }
+    uart::write_all(&buf[i], sizeof(buf) - i);
+}
+
+// Print num / den to two decimals, with a suffix, after a "# " comment mark
+static void print_ratio(uint64_t num, uint64_t den, const char* suffix) {
+    uint64_t hundredths = (num * 100 + den / 2) / den;
+    uart::printf("  # %d.%02d%s", (int)(hundredths / 100), (int)(hundredths % 100), suffix);
+}
+
+// One perf stat line: the count and what was counted
+static void print_perf_line(uint64_t value, const char* name) {
+    print_count(value, 16);
+    uart::puts("  ");
+    print_padded(name, 17);
+}
+
+/*
+ * Print the PMU counts of a measurement, with IPC and cache miss rates
+ * where both sides were counted
+ */
+static void print_perf_counts(const char* what, const pmu::Counts* counts) {
+    uart::printf("\nPerformance counter stats for '%s' (CPU %d):\n\n", what, (int)smp::cpu_id());
+    print_perf_line(counts->cycles, "cycles");
+    uart::putc('\n');
+    
+    const uint64_t* events = counts->events;
+    for (uint32_t i = 0; i < pmu::NUM_EVENTS; i++) {
+        pmu::Event event = static_cast<pmu::Event>(i);
+        if (!pmu::supported(event)) {
+            uart::puts("     <not counted>  ");
+            uart::puts(pmu::event_name(event));
+            uart::putc('\n');
+            continue;
+        }
+        print_perf_line(events[i], pmu::event_name(event));
+        
+        uint32_t l1d_accesses = static_cast<uint32_t>(pmu::Event::L1D_ACCESSES);
+        uint32_t l1d_refills = static_cast<uint32_t>(pmu::Event::L1D_REFILLS);
+        if (event == pmu::Event::INSTRUCTIONS && counts->cycles) {
+            print_ratio(events[i], counts->cycles, " insn per cycle");
+        } else if (event == pmu::Event::L1D_REFILLS && events[l1d_accesses] &&
+                   pmu::supported(pmu::Event::L1D_ACCESSES)) {
+            print_ratio(events[i] * 100, events[l1d_accesses], "% of L1D accesses");
+        } else if (event == pmu::Event::L2D_REFILLS && events[l1d_refills] &&
+                   pmu::supported(pmu::Event::L1D_REFILLS)) {
+            print_ratio(events[i] * 100, events[l1d_refills], "% of L1D refills");
+        }
+        uart::putc('\n');
+    }
+}
+
+/*
+ * perf - PMU counters for a command (perf stat) or the events (perf list)
+ */
+void cmd_perf(int argc, char* argv[]) {
+    if (argc >= 2 && klib::strcmp(argv[1], "list") == 0) {
+        uart::printf("PMU: %s\n", pmu::available() ? "PMUv3" : "not present");
+        uart::puts("  cycles            counted\n");
+        for (uint32_t i = 0; i < pmu::NUM_EVENTS; i++) {
+            pmu::Event event = static_cast<pmu::Event>(i);
+            uart::puts("  ");
+            print_padded(pmu::event_name(event), 18);
+            uart::puts(pmu::supported(event) ? "counted\n" : "not supported\n");
         }
+        return;
     }
     
-    // Get end time
-    uint64_t end = timer::get_uptime_ms();
-    uint64_t elapsed = end - start;
+    if (argc < 3 || klib::strcmp(argv[1], "stat") != 0) {
+        uart::puts("Usage: perf stat <command> [args...]\n");
+        uart::puts("       perf list\n");
+        return;
+    }
+    if (!pmu::available()) {
+        uart::puts("perf: no PMU\n");
+        return;
+    }
     
-    uart::printf("\nreal\t%d.%03ds\n", (int)(elapsed / 1000), (int)(elapsed % 1000));
+    // Counters are per CPU, and tasks never migrate
+    const smp::PerCpu* cpu = smp::this_cpu();
+    uint64_t irqs = cpu->irqs;
+    uint64_t start_ms = timer::get_uptime_ms();
+    pmu::Counts start;
+    pmu::sample(&start);
+    
+    run_wrapped_command(argc, argv, 2, "perf");
+    
+    pmu::Counts counts;
+    pmu::since(&start, &counts);
+    uint64_t elapsed = timer::get_uptime_ms() - start_ms;
+    irqs = cpu->irqs - irqs;
+    
+    print_perf_counts(argv[2], &counts);
+    print_perf_line(irqs, "IRQs");
+    uart::putc('\n');
+    uart::printf("\n%10d.%03d s elapsed\n\n", (int)(elapsed / 1000), (int)(elapsed % 1000));
 }
 
 /*
@@ -2364,216 +2375,457 @@ void cmd_hostname(int argc, char* argv[]) {
     uart::putc('\n');
 }
 
+// Parse -n N or -N, leaving the line count in num_lines
+static bool parse_line_count(int argc, char* argv[], int* i, int* num_lines) {
+    if (argv[*i][0] != '-') return false;
+    const char* digits = argv[*i] + 1;
+    if (digits[0] == 'n' && digits[1] == '\0') {
+        if (*i + 1 >= argc) return true;
+        digits = argv[++*i];
+    }
+    *num_lines = 0;
+    for (const char* p = digits; *p >= '0' && *p <= '9'; p++) {
+        *num_lines = *num_lines * 10 + (*p - '0');
+    }
+    return true;
+}
+
 /*
- * head - Display first lines of a file
+ * head - Display first lines of a file or of piped input
  */
 void cmd_head(int argc, char* argv[]) {
     int num_lines = 10;
     const char* filename = nullptr;
     
     for (int i = 1; i < argc; i++) {
-        if (argv[i][0] == '-' && argv[i][1] == 'n' && argv[i][2] == '\0') {
-            if (i + 1 < argc) {
-                num_lines = 0;
-                for (const char* p = argv[++i]; *p >= '0' && *p <= '9'; p++) {
-                    num_lines = num_lines * 10 + (*p - '0');
-                }
-            }
-        } else if (argv[i][0] == '-') {
-            // -N format
-            num_lines = 0;
-            for (const char* p = argv[i] + 1; *p >= '0' && *p <= '9'; p++) {
-                num_lines = num_lines * 10 + (*p - '0');
-            }
-        } else {
+        if (!parse_line_count(argc, argv, &i, &num_lines)) {
             filename = argv[i];
         }
     }
     
-    if (!filename) {
-        uart::puts("Usage: head [-n lines] <file>\n");
-        return;
-    }
-    
-    ramfs::FSNode* file = ramfs::open_file(filename);
-    if (!file) {
-        uart::printf("head: %s: No such file\n", filename);
+    Input in;
+    if (!open_input("head", filename, "Usage: head [-n lines] [file]\n", &in)) {
         return;
     }
     
-    uint8_t buffer[256];
-    size_t offset = 0;
+    char buffer[256];
     int lines_printed = 0;
     
     while (lines_printed < num_lines) {
-        size_t bytes_read = ramfs::read_file(file, buffer, offset, sizeof(buffer) - 1);
+        size_t bytes_read = read_input(&in, buffer, sizeof(buffer));
         if (bytes_read == 0) break;
         
-        buffer[bytes_read] = '\0';
-        
-        for (size_t i = 0; i < bytes_read && lines_printed < num_lines; i++) {
-            uart::putc(buffer[i]);
-            if (buffer[i] == '\n') {
+        // Write up to and including the last newline wanted
+        size_t end = 0;
+        while (end < bytes_read && lines_printed < num_lines) {
+            if (buffer[end++] == '\n') {
                 lines_printed++;
             }
         }
-        
-        offset += bytes_read;
+        stream::write(buffer, end);
     }
 }
 
 /*
- * tail - Display last lines of a file
+ * tail - Display last lines of a file or of piped input
+ * A file is read twice, counting lines and then printing; piped input
+ * keeps only its last TAIL_WINDOW bytes, which bounds what it can show
  */
 void cmd_tail(int argc, char* argv[]) {
     int num_lines = 10;
     const char* filename = nullptr;
     
     for (int i = 1; i < argc; i++) {
-        if (argv[i][0] == '-' && argv[i][1] == 'n' && argv[i][2] == '\0') {
-            if (i + 1 < argc) {
-                num_lines = 0;
-                for (const char* p = argv[++i]; *p >= '0' && *p <= '9'; p++) {
-                    num_lines = num_lines * 10 + (*p - '0');
-                }
-            }
-        } else if (argv[i][0] == '-') {
-            num_lines = 0;
-            for (const char* p = argv[i] + 1; *p >= '0' && *p <= '9'; p++) {
-                num_lines = num_lines * 10 + (*p - '0');
-            }
-        } else {
+        if (!parse_line_count(argc, argv, &i, &num_lines)) {
             filename = argv[i];
         }
     }
     
-    if (!filename) {
-        uart::puts("Usage: tail [-n lines] <file>\n");
+    Input in;
+    if (!open_input("tail", filename, "Usage: tail [-n lines] [file]\n", &in)) {
         return;
     }
-    
-    ramfs::FSNode* file = ramfs::open_file(filename);
-    if (!file) {
-        uart::printf("tail: %s: No such file\n", filename);
+    if (num_lines <= 0) {
         return;
     }
     
-    // Read entire file and count lines
-    static uint8_t buffer[8192];
-    size_t size = ramfs::read_file(file, buffer, 0, sizeof(buffer) - 1);
-    buffer[size] = '\0';
+    char buffer[256];
+    size_t n;
     
-    // Count total lines
-    int total_lines = 0;
-    for (size_t i = 0; i < size; i++) {
-        if (buffer[i] == '\n') total_lines++;
+    if (in.file) {
+        // Count total lines
+        int total_lines = 0;
+        char last = '\n';
+        while ((n = read_input(&in, buffer, sizeof(buffer))) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                if (buffer[i] == '\n') total_lines++;
+            }
+            last = buffer[n - 1];
+        }
+        if (last != '\n') total_lines++;  // Unterminated last line
+        
+        // Skip to the start position and print the rest
+        int skip_lines = total_lines - num_lines;
+        int current_line = 0;
+        in.offset = 0;
+        while ((n = read_input(&in, buffer, sizeof(buffer))) > 0) {
+            size_t i = 0;
+            while (i < n && current_line < skip_lines) {
+                if (buffer[i++] == '\n') current_line++;
+            }
+            stream::write(buffer + i, n - i);
+        }
+        return;
     }
     
-    // Find start position
-    int skip_lines = total_lines - num_lines;
-    if (skip_lines < 0) skip_lines = 0;
-    
-    int current_line = 0;
-    for (size_t i = 0; i < size; i++) {
-        if (current_line >= skip_lines) {
-            uart::putc(buffer[i]);
-        }
-        if (buffer[i] == '\n') {
-            current_line++;
+    // The window is a ring indexed by total bytes read
+    char window[TAIL_WINDOW];
+    size_t total = 0;
+    while ((n = read_input(&in, buffer, sizeof(buffer))) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            window[(total + i) % TAIL_WINDOW] = buffer[i];
         }
+        total += n;
+    }
+    
+    size_t first = total > TAIL_WINDOW ? total - TAIL_WINDOW : 0;
+    size_t start = total;
+    if (start > first && window[(start - 1) % TAIL_WINDOW] == '\n') {
+        start--;  // The final newline does not begin a line
+    }
+    int found = 0;
+    while (start > first) {
+        if (window[(start - 1) % TAIL_WINDOW] == '\n' && ++found == num_lines) break;
+        start--;
+    }
+    
+    // At most two runs: up to the end of the ring, then from its start
+    while (start < total) {
+        size_t index = start % TAIL_WINDOW;
+        size_t run = TAIL_WINDOW - index;
+        if (run > total - start) run = total - start;
+        stream::write(window + index, run);
+        start += run;
     }
 }
 
 /*
- * wc - Word, line, character count
+ * wc - Line, word and byte count of a file or of piped input
+ * -l, -w and -c select which counts are printed
  */
 void cmd_wc(int argc, char* argv[]) {
-    if (argc < 2) {
-        uart::puts("Usage: wc <file>\n");
-        return;
+    bool show_lines = false, show_words = false, show_chars = false;
+    const char* filename = nullptr;
+    
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            for (const char* p = argv[i] + 1; *p; p++) {
+                if (*p == 'l') show_lines = true;
+                else if (*p == 'w') show_words = true;
+                else if (*p == 'c') show_chars = true;
+            }
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (!show_lines && !show_words && !show_chars) {
+        show_lines = show_words = show_chars = true;
     }
     
-    ramfs::FSNode* file = ramfs::open_file(argv[1]);
-    if (!file) {
-        uart::printf("wc: %s: No such file\n", argv[1]);
+    Input in;
+    if (!open_input("wc", filename, "Usage: wc [-l] [-w] [-c] [file]\n", &in)) {
         return;
     }
     
-    static uint8_t buffer[4096];
-    size_t size = ramfs::read_file(file, buffer, 0, sizeof(buffer));
-    
-    int lines = 0, words = 0, chars = (int)size;
+    char buffer[512];
+    int lines = 0, words = 0, chars = 0;
     bool in_word = false;
+    size_t n;
     
-    for (size_t i = 0; i < size; i++) {
-        if (buffer[i] == '\n') lines++;
-        
-        bool is_space = (buffer[i] == ' ' || buffer[i] == '\t' || 
-                        buffer[i] == '\n' || buffer[i] == '\r');
-        if (is_space) {
-            in_word = false;
-        } else if (!in_word) {
-            in_word = true;
-            words++;
+    while ((n = read_input(&in, buffer, sizeof(buffer))) > 0) {
+        chars += (int)n;
+        for (size_t i = 0; i < n; i++) {
+            if (buffer[i] == '\n') lines++;
+            
+            bool is_space = (buffer[i] == ' ' || buffer[i] == '\t' || 
+                            buffer[i] == '\n' || buffer[i] == '\r');
+            if (is_space) {
+                in_word = false;
+            } else if (!in_word) {
+                in_word = true;
+                words++;
+            }
         }
     }
     
-    uart::printf("  %d  %d  %d %s\n", lines, words, chars, argv[1]);
+    if (show_lines) stream::printf("  %d", lines);
+    if (show_words) stream::printf("  %d", words);
+    if (show_chars) stream::printf("  %d", chars);
+    if (filename) stream::printf(" %s", filename);
+    stream::putc('\n');
+}
+
+// ============================================================================
+// grep: whole-buffer search, then the enclosing line
+// ============================================================================
+
+// Patterns this long or longer use Horspool; shorter ones a first-byte scan
+constexpr size_t HORSPOOL_MIN = 4;
+
+constexpr uint64_t ONES = 0x0101010101010101ULL;
+constexpr uint64_t LOW7 = 0x7F7F7F7F7F7F7F7FULL;
+
+struct GrepState {
+    const char* pattern;
+    size_t len;
+    bool ignore_case;
+    bool count_only;            // -c
+    bool numbers;               // -n
+    uint8_t first;              // pattern[0], and its other case with -i
+    uint8_t first_alt;
+    uint8_t skip[256];          // Horspool shift for each (folded) text byte
+    int line;                   // Line number at the start of the next region
+    int matches;
+};
+
+static inline uint8_t fold(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + 32) : c;
+}
+
+// 0x80 in each byte of word equal to the byte in pattern (exact: no
+// borrow between bytes, unlike the cheaper has-zero test)
+static inline uint64_t byte_mask(uint64_t word, uint64_t pattern) {
+    uint64_t v = word ^ pattern;
+    return ~(((v & LOW7) + LOW7) | v | LOW7);
+}
+
+/*
+ * First byte in [p, end) equal to a or b (a == b for one byte), 8 bytes
+ * at a time once aligned; end if there is none
+ */
+static const char* find_byte2(const char* p, const char* end, uint8_t a, uint8_t b) {
+    while (p < end && (reinterpret_cast<uintptr_t>(p) & 7)) {
+        if (static_cast<uint8_t>(*p) == a || static_cast<uint8_t>(*p) == b) return p;
+        p++;
+    }
+    uint64_t wa = a * ONES, wb = b * ONES;
+    while (end - p >= 8) {
+        uint64_t word;
+        __builtin_memcpy(&word, p, 8);
+        uint64_t hits = byte_mask(word, wa) | byte_mask(word, wb);
+        if (hits) {
+            return p + (__builtin_ctzll(hits) >> 3);
+        }
+        p += 8;
+    }
+    while (p < end) {
+        if (static_cast<uint8_t>(*p) == a || static_cast<uint8_t>(*p) == b) return p;
+        p++;
+    }
+    return end;
+}
+
+/*
+ * Newlines in [p, end), 8 bytes at a time once aligned
+ */
+static int count_newlines(const char* p, const char* end) {
+    int count = 0;
+    while (p < end && (reinterpret_cast<uintptr_t>(p) & 7)) {
+        count += *p++ == '\n';
+    }
+    uint64_t nl = '\n' * ONES;
+    while (end - p >= 8) {
+        uint64_t word;
+        __builtin_memcpy(&word, p, 8);
+        uint64_t hits = byte_mask(word, nl) >> 7;
+        count += static_cast<int>((hits * ONES) >> 56);
+        p += 8;
+    }
+    while (p < end) {
+        count += *p++ == '\n';
+    }
+    return count;
+}
+
+static bool equal_at(const GrepState* g, const char* text, size_t n) {
+    if (!g->ignore_case) {
+        return klib::memcmp(text, g->pattern, n) == 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (fold(static_cast<uint8_t>(text[i])) != static_cast<uint8_t>(g->pattern[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void grep_init(GrepState* g, const char* pattern, bool ignore_case) {
+    g->pattern = pattern;
+    g->len = klib::strlen(pattern);
+    g->ignore_case = ignore_case;
+    g->line = 1;
+    g->matches = 0;
+    if (g->len == 0) return;
+
+    // With -i the pattern is folded in place (it is our argv copy)
+    if (ignore_case) {
+        char* p = const_cast<char*>(pattern);
+        for (size_t i = 0; i < g->len; i++) {
+            p[i] = static_cast<char>(fold(static_cast<uint8_t>(p[i])));
+        }
+    }
+    g->first = static_cast<uint8_t>(pattern[0]);
+    g->first_alt = g->first;
+    if (ignore_case && g->first >= 'a' && g->first <= 'z') {
+        g->first_alt = static_cast<uint8_t>(g->first - 32);
+    }
+
+    if (g->len >= HORSPOOL_MIN) {
+        size_t shift = g->len < 255 ? g->len : 255;
+        klib::memset(g->skip, static_cast<int>(shift), sizeof(g->skip));
+        for (size_t i = 0; i + 1 < g->len; i++) {
+            size_t d = g->len - 1 - i;
+            uint8_t c = static_cast<uint8_t>(pattern[i]);
+            g->skip[c] = static_cast<uint8_t>(d < 255 ? d : 255);
+            if (ignore_case && c >= 'a' && c <= 'z') {
+                g->skip[c - 32] = g->skip[c];
+            }
+        }
+    }
+}
+
+/*
+ * First match of the pattern in [p, end), or nullptr
+ */
+static const char* grep_find(const GrepState* g, const char* p, const char* end) {
+    if (g->len == 0) return p;
+    if (static_cast<size_t>(end - p) < g->len) return nullptr;
+
+    if (g->len < HORSPOOL_MIN) {
+        const char* last = end - g->len + 1;
+        while ((p = find_byte2(p, last, g->first, g->first_alt)) < last) {
+            if (equal_at(g, p, g->len)) {
+                return p;
+            }
+            p++;
+        }
+        return nullptr;
+    }
+
+    // Horspool: compare the window's last byte, shift by the table
+    uint8_t last = static_cast<uint8_t>(g->pattern[g->len - 1]);
+    while (static_cast<size_t>(end - p) >= g->len) {
+        uint8_t c = static_cast<uint8_t>(p[g->len - 1]);
+        uint8_t fc = g->ignore_case ? fold(c) : c;
+        if (fc == last && equal_at(g, p, g->len - 1)) {
+            return p;
+        }
+        p += g->skip[c];
+    }
+    return nullptr;
+}
+
+/*
+ * Search a region made of whole lines (the last one may lack its newline)
+ */
+static void grep_region(GrepState* g, const char* text, size_t size) {
+    const char* end = text + size;
+    const char* counted = text;     // Newlines before this are in g->line
+    const char* p = text;
+
+    while (p < end) {
+        const char* match = grep_find(g, p, end);
+        if (!match) break;
+
+        // Widen the match to its line
+        const char* line_start = match;
+        while (line_start > p && line_start[-1] != '\n') line_start--;
+        const char* line_end = find_byte2(match, end, '\n', '\n');
+
+        g->matches++;
+        if (!g->count_only) {
+            if (g->numbers) {
+                g->line += count_newlines(counted, line_start);
+                counted = line_start;
+                stream::printf("%d: ", g->line);
+            }
+            stream::write(line_start, line_end - line_start);
+            stream::putc('\n');
+        }
+        p = line_end + 1;
+    }
+
+    if (g->numbers) {
+        g->line += count_newlines(counted, end);
+    }
 }
 
 /*
- * grep - Search for pattern in file
+ * grep - Search for a fixed string in a file or in piped input
+ * A file is searched in place through map_file(); piped input in chunks
+ * cut at the last newline
  */
 void cmd_grep(int argc, char* argv[]) {
-    if (argc < 3) {
-        uart::puts("Usage: grep <pattern> <file>\n");
+    bool ignore_case = false, count_only = false, numbers = false;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        for (const char* f = argv[i] + 1; *f; f++) {
+            if (*f == 'i') ignore_case = true;
+            else if (*f == 'c') count_only = true;
+            else if (*f == 'n') numbers = true;
+            else {
+                uart::printf("grep: unknown option -%c\n", *f);
+                return;
+            }
+        }
+    }
+    if (i >= argc) {
+        uart::puts("Usage: grep [-c] [-i] [-n] <pattern> [file]\n");
         return;
     }
-    
-    const char* pattern = argv[1];
-    const char* filename = argv[2];
-    
-    ramfs::FSNode* file = ramfs::open_file(filename);
-    if (!file) {
-        uart::printf("grep: %s: No such file\n", filename);
+
+    GrepState g;
+    g.count_only = count_only;
+    g.numbers = numbers;
+    grep_init(&g, argv[i], ignore_case);
+    const char* filename = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    Input in;
+    if (!open_input("grep", filename, "Usage: grep [-c] [-i] [-n] <pattern> [file]\n", &in)) {
         return;
     }
-    
-    static uint8_t buffer[8192];
-    size_t size = ramfs::read_file(file, buffer, 0, sizeof(buffer) - 1);
-    buffer[size] = '\0';
-    
-    // Simple line-by-line search
-    char* line_start = reinterpret_cast<char*>(buffer);
-    int line_num = 1;
-    
-    while (*line_start) {
-        // Find end of line
-        char* line_end = line_start;
-        while (*line_end && *line_end != '\n') line_end++;
-        
-        char saved = *line_end;
-        *line_end = '\0';
-        
-        // Simple substring search
-        bool found = false;
-        for (char* p = line_start; *p && !found; p++) {
-            const char* pp = p;
-            const char* pat = pattern;
-            while (*pp && *pat && *pp == *pat) {
-                pp++;
-                pat++;
-            }
-            if (*pat == '\0') found = true;
+
+    if (in.file) {
+        const uint8_t* data;
+        size_t size;
+        if (!ramfs::map_file(in.file, &data, &size)) {
+            uart::printf("grep: %s: Cannot read\n", filename);
+            return;
         }
-        
-        if (found) {
-            uart::printf("%d: %s\n", line_num, line_start);
+        grep_region(&g, reinterpret_cast<const char*>(data), size);
+        ramfs::unmap_file(in.file);
+    } else {
+        char buffer[GREP_CHUNK];
+        size_t held = 0;
+        size_t n;
+        while ((n = read_input(&in, buffer + held, sizeof(buffer) - held)) > 0) {
+            held += n;
+
+            // Search up to the last newline and keep the partial line; a
+            // line longer than the buffer is searched in pieces
+            size_t cut = held;
+            while (cut > 0 && buffer[cut - 1] != '\n') cut--;
+            if (cut == 0 && held < sizeof(buffer)) continue;
+            if (cut == 0) cut = held;
+            grep_region(&g, buffer, cut);
+            klib::memmove(buffer, buffer + cut, held - cut);
+            held -= cut;
         }
-        
-        *line_end = saved;
-        line_start = (*line_end) ? line_end + 1 : line_end;
-        line_num++;
+        grep_region(&g, buffer, held);
+    }
+
+    if (count_only) {
+        stream::printf("%d\n", g.matches);
     }
 }
 
@@ -2592,9 +2844,13 @@ void cmd_cp(int argc, char* argv[]) {
         return;
     }
     
-    // Read source
-    static uint8_t buffer[8192];
-    size_t size = ramfs::read_file(src, buffer, 0, sizeof(buffer));
+    // Copy straight out of the source's pages
+    const uint8_t* data;
+    size_t size;
+    if (!ramfs::map_file(src, &data, &size)) {
+        uart::printf("%s: %s: Cannot read\n", "cp", argv[1]);
+        return;
+    }
     
     // Create/open destination
     ramfs::FSNode* dst = ramfs::open_file(argv[2]);
@@ -2602,13 +2858,15 @@ void cmd_cp(int argc, char* argv[]) {
         dst = ramfs::create_file(argv[2]);
     }
     
-    if (!dst) {
+    if (!dst || dst == src) {
+        ramfs::unmap_file(src);
         uart::printf("cp: cannot create '%s'\n", argv[2]);
         return;
     }
     
     ramfs::truncate_file(dst, 0);
-    ramfs::write_file(dst, buffer, 0, size);
+    ramfs::write_file(dst, data, 0, size);
+    ramfs::unmap_file(src);
     
     uart::printf("'%s' -> '%s'\n", argv[1], argv[2]);
 }
@@ -2629,21 +2887,28 @@ void cmd_mv(int argc, char* argv[]) {
         return;
     }
     
-    static uint8_t buffer[8192];
-    size_t size = ramfs::read_file(src, buffer, 0, sizeof(buffer));
+    // Copy straight out of the source's pages
+    const uint8_t* data;
+    size_t size;
+    if (!ramfs::map_file(src, &data, &size)) {
+        uart::printf("%s: %s: Cannot read\n", "mv", argv[1]);
+        return;
+    }
     
     ramfs::FSNode* dst = ramfs::open_file(argv[2]);
     if (!dst) {
         dst = ramfs::create_file(argv[2]);
     }
     
-    if (!dst) {
+    if (!dst || dst == src) {
+        ramfs::unmap_file(src);
         uart::printf("mv: cannot create '%s'\n", argv[2]);
         return;
     }
     
     ramfs::truncate_file(dst, 0);
-    ramfs::write_file(dst, buffer, 0, size);
+    ramfs::write_file(dst, data, 0, size);
+    ramfs::unmap_file(src);
     ramfs::delete_file(argv[1]);
     
     uart::printf("'%s' -> '%s'\n", argv[1], argv[2]);
@@ -2665,6 +2930,9 @@ void cmd_df(int argc, char* argv[]) {
         (int)((stats.total_bytes - stats.used_bytes) / 1024),
         stats.total_bytes ? (int)(stats.used_bytes * 100 / stats.total_bytes) : 0);
     uart::printf("Files: %d/%d\n", (int)stats.used_nodes, (int)stats.total_nodes);
+    uart::printf("Boot image: %dK still shared\n", (int)(stats.image_bytes / 1024));
+    uart::printf("Path cache: %d hits, %d misses\n",
+        (int)stats.path_cache_hits, (int)stats.path_cache_misses);
 }
 
 /*
@@ -2727,9 +2995,9 @@ static void find_recursive(ramfs::FSNode* dir, const char* pattern, const char*
         full_path[fp_len] = '\0';
         
         if (match) {
-            uart::puts(full_path);
-            if (node->type == ramfs::FileType::DIRECTORY) uart::putc('/');
-            uart::putc('\n');
+            stream::puts(full_path);
+            if (node->type == ramfs::FileType::DIRECTORY) stream::putc('/');
+            stream::putc('\n');
         }
         
         // Recurse into directories
@@ -2761,8 +3029,8 @@ void cmd_find(int argc, char* argv[]) {
     
     if (start->type != ramfs::FileType::DIRECTORY) {
         // Single file - check if matches
-        uart::puts(path);
-        uart::putc('\n');
+        stream::puts(path);
+        stream::putc('\n');
         return;
     }
     
@@ -2787,31 +3055,36 @@ void cmd_xxd(int argc, char* argv[]) {
     static uint8_t buffer[512];
     size_t size = ramfs::read_file(file, buffer, 0, sizeof(buffer));
     
+    char line[80];
     for (size_t i = 0; i < size; i += 16) {
-        uart::printf("%08x: ", (uint32_t)i);
+        size_t pos = put_hex(line, 0, i, 8);
+        line[pos++] = ':';
+        line[pos++] = ' ';
         
         // Hex bytes
         for (size_t j = 0; j < 16; j++) {
             if (i + j < size) {
-                uart::printf("%02x", buffer[i + j]);
+                pos = put_hex(line, pos, buffer[i + j], 2);
             } else {
-                uart::puts("  ");
+                line[pos++] = ' ';
+                line[pos++] = ' ';
             }
-            if (j == 7) uart::putc(' ');
-            uart::putc(' ');
+            if (j == 7) line[pos++] = ' ';
+            line[pos++] = ' ';
         }
         
         // ASCII
-        uart::puts(" ");
+        line[pos++] = ' ';
         for (size_t j = 0; j < 16 && i + j < size; j++) {
             char c = buffer[i + j];
-            uart::putc((c >= 32 && c < 127) ? c : '.');
+            line[pos++] = (c >= 32 && c < 127) ? c : '.';
         }
-        uart::putc('\n');
+        line[pos++] = '\n';
+        stream::write(line, pos);
     }
     
     if (file->size > sizeof(buffer)) {
-        uart::printf("... (%d more bytes)\n", (int)(file->size - sizeof(buffer)));
+        stream::printf("... (%d more bytes)\n", (int)(file->size - sizeof(buffer)));
     }
 }
 
@@ -2846,6 +3119,82 @@ void cmd_regs(int argc, char* argv[]) {
     uart::printf("  Part: 0x%03x r%dp%d\n", partnum, variant, rev);
 }
 
+/*
+ * svcbench - Compare CASM SVC round trips through the full exception
+ * path and the vectors.S fast path
+ */
+void cmd_svcbench(int argc, char* argv[]) {
+    uint64_t count = 100000;
+    if (argc >= 2) {
+        bool ok;
+        count = parse_uint64(argv[1], &ok);
+        if (!ok || count == 0 || count > 0xFFFFFFFF) {
+            uart::puts("Usage: svcbench [count]\n");
+            return;
+        }
+    }
+    
+    uint64_t frequency = timer::get_frequency();
+    uint64_t full = casm_native::bench_svc((uint32_t)count, false);
+    uint64_t fast = casm_native::bench_svc((uint32_t)count, true);
+    if (full == 0 || fast == 0 || frequency == 0) {
+        uart::puts("svcbench: out of memory\n");
+        return;
+    }
+    
+    // Nanoseconds per call, to one decimal place (via ticks per call x 10^4)
+    uint64_t full_ns10 = ((full * 10000) / count) * 1000000 / frequency;
+    uint64_t fast_ns10 = ((fast * 10000) / count) * 1000000 / frequency;
+    uint64_t speedup = (full * 100) / fast;
+    
+    uart::printf("SVC round trip (svc #0x1F2, %d calls, %d MHz counter):\n",
+                 (int)count, (int)(frequency / 1000000));
+    uart::printf("  Full path: %8d ticks  %d.%d ns/call\n",
+                 (int)full, (int)(full_ns10 / 10), (int)(full_ns10 % 10));
+    uart::printf("  Fast path: %8d ticks  %d.%d ns/call\n",
+                 (int)fast, (int)(fast_ns10 / 10), (int)(fast_ns10 % 10));
+    uart::printf("  Speedup:   %d.%02dx\n", (int)(speedup / 100), (int)(speedup % 100));
+}
+
+/*
+ * trace - Capture kernel events on every CPU and decode them afterwards
+ */
+void cmd_trace(int argc, char* argv[]) {
+    if (argc >= 2 && klib::strcmp(argv[1], "start") == 0) {
+        trace::start();
+        uart::printf("Tracing on %d CPU%s (%d records each)\n", (int)smp::online_count(),
+                     smp::online_count() == 1 ? "" : "s", (int)trace::RING_RECORDS);
+        return;
+    }
+    if (argc >= 2 && klib::strcmp(argv[1], "stop") == 0) {
+        trace::stop();
+        for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+            if (smp::get_cpu(cpu)->online) {
+                uart::printf("CPU %d: %u records, %u kept\n", (int)cpu,
+                             trace::recorded(cpu), trace::retained(cpu));
+            }
+        }
+        return;
+    }
+    if (argc >= 2 && klib::strcmp(argv[1], "dump") == 0) {
+        uint32_t classes = 0;
+        for (int i = 2; i < argc; i++) {
+            uint32_t bits = trace::class_for_name(argv[i]);
+            if (!bits) {
+                uart::printf("trace: unknown filter '%s' (irq, svc, mem, fs, sched, all)\n", argv[i]);
+                return;
+            }
+            classes |= bits;
+        }
+        trace::dump(classes ? classes : trace::CLASS_ALL);
+        return;
+    }
+    if (argc == 1) {
+        uart::printf("Tracing is %s\n", trace::enabled() ? "on" : "off");
+    }
+    uart::puts("Usage: trace start|stop|dump [irq|svc|mem|fs|sched ...]\n");
+}
+
 // ============================================================================
 // CASM Disassembler
 // ============================================================================
@@ -2874,6 +3223,7 @@ static const char* disasm_instruction(uint32_t instr, char* buf, size_t buf_size
             case 0x103: return "inp";
             case 0x104: return "inps";
             case 0x105: return "prtx";
+            case 0x106: return "flush";
             case 0x110: return "cls";
             case 0x111: return "setc";
             case 0x112: return "plot";
@@ -2881,6 +3231,7 @@ static const char* disasm_instruction(uint32_t instr, char* buf, size_t buf_size
             case 0x114: return "box";
             case 0x115: return "reset";
             case 0x116: return "canvas";
+            case 0x117: return "render";
             case 0x120: return "fcreat";
             case 0x121: return "fwrite";
             case 0x122: return "fread";
@@ -3203,170 +3554,372 @@ static const char* disasm_instruction(uint32_t instr, char* buf, size_t buf_size
         } else {
             uart::printf("orr w%d, w%d, w%d", rd, rn, rm);
         }
-        return "";
+        return "";
+    }
+    
+    // MOVN 64-bit
+    if ((instr & 0xFF800000) == 0x92800000) {
+        int rd = instr & 0x1F;
+        uint16_t imm16 = (instr >> 5) & 0xFFFF;
+        int hw = (instr >> 21) & 0x3;
+        int64_t value = ~((uint64_t)imm16 << (hw * 16));
+        uart::printf("mov x%d, #%d", rd, (int)value);
+        return "";
+    }
+    
+    return "???";
+}
+
+/*
+ * casm disasm - Disassemble a binary file
+ */
+static void cmd_casm_disasm(const char* filename) {
+    ramfs::FSNode* file = ramfs::open_file(filename);
+    if (!file) {
+        uart::printf("casm disasm: %s: No such file\n", filename);
+        return;
+    }
+    
+    const uint8_t* buffer;
+    size_t size;
+    if (!ramfs::map_file(file, &buffer, &size)) {
+        uart::printf("casm disasm: %s: Cannot read\n", filename);
+        return;
+    }
+    
+    uart::printf("Disassembly of '%s' (%d bytes):\n\n", filename, (int)size);
+    
+    char instr_buf[64];
+    for (size_t i = 0; i + 3 < size; i += 4) {
+        uint32_t instr = buffer[i] | (buffer[i+1] << 8) | 
+                        (buffer[i+2] << 16) | (buffer[i+3] << 24);
+        
+        uart::printf("%04x:  %08x  ", (uint32_t)i, instr);
+        const char* dis = disasm_instruction(instr, instr_buf, sizeof(instr_buf));
+        if (dis && dis[0]) {
+            uart::puts(dis);
+        }
+        uart::putc('\n');
+    }
+    ramfs::unmap_file(file);
+}
+
+/*
+ * Nearest label at or before an image offset (casm prof annotations)
+ */
+static const casm::Symbol* casm_label_at(const casm::CodeGenerator* codegen, uint64_t offset) {
+    const casm::Symbol* best = nullptr;
+    for (int i = 0; codegen && i < codegen->get_symbol_count(); i++) {
+        const casm::Symbol* sym = codegen->get_symbol(i);
+        if (sym && sym->defined && sym->is_label && sym->address <= offset &&
+            (!best || sym->address > best->address)) {
+            best = sym;
+        }
+    }
+    return best;
+}
+
+/*
+ * Run an image natively under the sampling profiler, then report the
+ * hottest instructions and the time spent in each SVC
+ * codegen, when the image was assembled here, names the hot PCs
+ */
+static void casm_profile_image(const uint8_t* image, size_t image_size,
+                               const casm::CodeGenerator* codegen) {
+    casm::Profile prof;
+    if (!casm::profile_init(&prof, image_size)) {
+        uart::puts("casm prof: Out of memory for the profile\n");
+        return;
+    }
+    size_t arena_size;
+    uint8_t* arena = casm_alloc_arena(image, image_size, &arena_size);
+    if (!arena) {
+        casm::profile_free(&prof);
+        uart::puts("casm prof: Out of memory for program\n");
+        return;
+    }
+    
+    uart::puts("\nRunning under the profiler...\n");
+    uint64_t start = timer::get_ticks();
+    casm_native::init(arena, arena_size, &prof);
+    casm_native::run(arena);
+    uint64_t elapsed = timer::get_ticks() - start;
+    casm_free_arena(arena, arena_size);
+    uart::puts("\x1b[0m");
+    
+    uint64_t frequency = timer::get_frequency();
+    uint64_t in_image = prof.samples - prof.outside;
+    uart::printf("\nProfile: %d samples in %d ms (one per %d ms)\n", (int)prof.samples,
+                 frequency ? (int)((elapsed * 1000) / frequency) : 0,
+                 (int)casm::PROF_INTERVAL_MS);
+    uart::printf("  In program: %d  In kernel: %d\n", (int)in_image, (int)prof.outside);
+    
+    if (in_image > 0) {
+        uint64_t top[casm::PROF_TOP];
+        size_t count = casm::profile_top(&prof, top, casm::PROF_TOP);
+        
+        uart::puts("\nHottest instructions:\n");
+        uart::puts("Samples      %  Offset  Instruction                 Label\n");
+        for (size_t i = 0; i < count; i++) {
+            uint64_t offset = top[i];
+            uint32_t hits = prof.hits[offset / 4];
+            int permille = (int)((static_cast<uint64_t>(hits) * 1000) / prof.samples);
+            uart::printf("%7d  %3d.%d  %06x  ", (int)hits, permille / 10, permille % 10,
+                         (uint32_t)offset);
+            
+            uint32_t instr = 0;
+            if (offset + 3 < image_size) {
+                instr = image[offset] | (image[offset + 1] << 8) |
+                        (image[offset + 2] << 16) | (image[offset + 3] << 24);
+            }
+            char buf[64];
+            const char* dis = disasm_instruction(instr, buf, sizeof(buf));
+            print_padded(dis ? dis : "", 28);
+            
+            const casm::Symbol* label = casm_label_at(codegen, offset);
+            if (label) {
+                uart::puts(label->name);
+                if (offset > label->address) {
+                    uart::printf("+0x%x", (uint32_t)(offset - label->address));
+                }
+            }
+            uart::putc('\n');
+        }
+        if (!codegen) {
+            uart::puts("(Profile the .asm source to see label names)\n");
+        }
+        uart::puts("Samples taken inside an SVC are charged to the instruction after it\n");
     }
     
-    // MOVN 64-bit
-    if ((instr & 0xFF800000) == 0x92800000) {
-        int rd = instr & 0x1F;
-        uint16_t imm16 = (instr >> 5) & 0xFFFF;
-        int hw = (instr >> 21) & 0x3;
-        int64_t value = ~((uint64_t)imm16 << (hw * 16));
-        uart::printf("mov x%d, #%d", rd, (int)value);
-        return "";
+    bool any_svc = false;
+    for (size_t i = 0; i < casm::PROF_SVC_SLOTS; i++) {
+        if (prof.svc_calls[i] == 0) continue;
+        if (!any_svc) {
+            uart::puts("\nSVCs:\n");
+            uart::puts("Opcode       Calls   Total(us)    Avg(us)\n");
+            any_svc = true;
+        }
+        uint32_t number = casm::PROF_SVC_BASE + static_cast<uint32_t>(i);
+        char buf[64];
+        const char* name = disasm_instruction(0xD4000001 | (number << 5), buf, sizeof(buf));
+        uint64_t total_us = frequency ? (prof.svc_ticks[i] * 1000000) / frequency : 0;
+        uint64_t avg_tenths = (total_us * 10) / prof.svc_calls[i];
+        print_padded(name ? name : "?", 8);
+        uart::printf("%10d  %10d  %7d.%d\n", (int)prof.svc_calls[i], (int)total_us,
+                     (int)(avg_tenths / 10), (int)(avg_tenths % 10));
     }
     
-    return "???";
+    casm::profile_free(&prof);
 }
 
 /*
- * casm disasm - Disassemble a binary file
+ * casm prof - Run a program natively under the sampling profiler
+ * A .asm file is assembled first so the report can name labels; any
+ * other file is run as a binary image
  */
-static void cmd_casm_disasm(const char* filename) {
+static void cmd_casm_prof(const char* filename, bool optimize) {
     ramfs::FSNode* file = ramfs::open_file(filename);
     if (!file) {
-        uart::printf("casm disasm: %s: No such file\n", filename);
+        uart::puts("casm prof: cannot open '");
+        uart::puts(filename);
+        uart::puts("': No such file\n");
         return;
     }
     
-    static uint8_t buffer[4096];
-    size_t size = ramfs::read_file(file, buffer, 0, sizeof(buffer));
+    if (file->size == 0) {
+        uart::puts("casm prof: '");
+        uart::puts(filename);
+        uart::puts("': Empty file\n");
+        return;
+    }
     
-    uart::printf("Disassembly of '%s' (%d bytes):\n\n", filename, (int)size);
+    const uint8_t* data;
+    size_t length;
+    if (!ramfs::map_file(file, &data, &length)) {
+        uart::printf("casm prof: %s: Cannot read\n", filename);
+        return;
+    }
     
-    char instr_buf[64];
-    for (size_t i = 0; i + 3 < size; i += 4) {
-        uint32_t instr = buffer[i] | (buffer[i+1] << 8) | 
-                        (buffer[i+2] << 16) | (buffer[i+3] << 24);
-        
-        uart::printf("%04x:  %08x  ", (uint32_t)i, instr);
-        const char* dis = disasm_instruction(instr, instr_buf, sizeof(instr_buf));
-        if (dis && dis[0]) {
-            uart::puts(dis);
+    size_t name_len = klib::strlen(filename);
+    bool source = name_len > 4 && klib::strcmp(filename + name_len - 4, ".asm") == 0;
+    if (source) {
+        casm::CodeGenerator codegen;
+        bool ok = casm_generate(reinterpret_cast<const char*>(data), length, optimize, codegen);
+        ramfs::unmap_file(file);
+        if (ok) {
+            casm_profile_image(codegen.get_code(), codegen.get_code_size(), &codegen);
         }
-        uart::putc('\n');
+        return;
     }
+    
+    // The report disassembles from the image, so keep it mapped until then
+    casm_profile_image(data, length, nullptr);
+    ramfs::unmap_file(file);
 }
 
 /*
- * casm run with debug mode
+ * Run a CASM binary on the safe-mode VM (casm run -v / -d)
+ * In debug mode each instruction is shown and single-stepped; 'r' runs
+ * the rest of the budget and 'q' quits
+ * 
+ * Graphics use a virtual framebuffer that's rendered at the end
+ * to avoid terminal scrolling issues.
  */
-static void cmd_casm_run_debug(const char* filename) {
+static void cmd_casm_run_vm(const char* filename, bool debug, uint64_t budget) {
     ramfs::FSNode* file = ramfs::open_file(filename);
     if (!file) {
-        uart::printf("casm run: %s: No such file\n", filename);
+        uart::puts("casm run: cannot open '");
+        uart::puts(filename);
+        uart::puts("': No such file\n");
         return;
     }
     
-    static uint8_t code_buffer[5120];
-    for (size_t i = 0; i < sizeof(code_buffer); i++) code_buffer[i] = 0;
-    size_t actual_code_size = ramfs::read_file(file, code_buffer, 0, file->size);
-    size_t mem_size = sizeof(code_buffer);
+    if (file->size == 0) {
+        uart::puts("casm run: '");
+        uart::puts(filename);
+        uart::puts("': Empty file\n");
+        return;
+    }
     
-    uint64_t regs[32];
-    for (int i = 0; i < 32; i++) regs[i] = 0;
+    // Load the binary into the program arena - use it all as working memory
+    const uint8_t* image;
+    size_t image_size;
+    if (!ramfs::map_file(file, &image, &image_size)) {
+        uart::printf("casm run: %s: Cannot read\n", filename);
+        return;
+    }
+    size_t mem_size;
+    uint8_t* code_buffer = casm_alloc_arena(image, image_size, &mem_size,
+                                            sizeof(casm::ConsoleRing) + 16);
+    ramfs::unmap_file(file);
+    if (!code_buffer) {
+        uart::printf("casm run: %s: Out of memory\n", filename);
+        return;
+    }
     
-    uint64_t pc = 0;
-    bool running = true;
+    casm::Vm vm;
+    if (!vm.load(code_buffer, mem_size, image_size)) {
+        uart::printf("casm run: %s: Out of memory\n", filename);
+        casm_free_arena(code_buffer, mem_size);
+        return;
+    }
     
-    uart::puts("Debug mode: Press ENTER to step, 'r' to run, 'q' to quit\n\n");
+    // The console ring sits at the top of the arena, the stack below it;
+    // x26 holds its arena offset as the native runner's holds its address
+    size_t ring_offset = (mem_size - sizeof(casm::ConsoleRing)) & ~static_cast<size_t>(0xF);
+    casm::ConsoleRing* console = reinterpret_cast<casm::ConsoleRing*>(code_buffer + ring_offset);
+    vm.reg(26) = ring_offset;
+    vm.reg(casm::VM_SP) = ring_offset;
+    VmSession* session = casm_alloc_session(console);
+    if (!session) {
+        uart::printf("casm run: %s: Out of memory\n", filename);
+        casm_free_arena(code_buffer, mem_size);
+        return;
+    }
+    vm.set_svc_handler(casm_vm_svc, session);
     
-    while (running && pc < actual_code_size) {
-        uint32_t instr = code_buffer[pc] | (code_buffer[pc+1] << 8) |
-                        (code_buffer[pc+2] << 16) | (code_buffer[pc+3] << 24);
-        
-        // Show current instruction
-        uart::printf("PC=%04x: %08x  ", (uint32_t)pc, instr);
-        char buf[64];
-        const char* dis = disasm_instruction(instr, buf, sizeof(buf));
-        if (dis && dis[0]) uart::puts(dis);
-        uart::putc('\n');
-        
-        // Show registers
-        uart::puts("  x0-x3: ");
-        for (int i = 0; i < 4; i++) {
-            uart::printf("%08x ", (uint32_t)regs[i]);
-        }
-        uart::putc('\n');
-        
-        // Wait for input
-        char c = uart::getc();
-        if (c == 'q' || c == 'Q') {
-            uart::puts("Quit\n");
-            return;
-        }
+    casm::VmStatus status = casm::VmStatus::BUDGET;
+    if (!debug) {
+        status = vm.run(budget);
+    } else {
+        uart::puts("Debug mode: Press ENTER to step, 'r' to run, 'q' to quit\n\n");
         
-        // Execute instruction (simplified - reuse VM logic)
-        // For brevity, just step through
-        if ((instr & 0xFFE0001F) == 0xD4000001) {
-            uint16_t imm16 = (instr >> 5) & 0xFFFF;
-            if (imm16 == 0x1FF) running = false;
-            else if (imm16 == 0x101) uart::putc(regs[0] & 0xFF);
-            else if (imm16 == 0x102) uart::printf("%d", (int)regs[0]);
-        }
-        else if ((instr & 0xFF800000) == 0x52800000) {
-            int rd = instr & 0x1F;
-            uint16_t imm16 = (instr >> 5) & 0xFFFF;
-            if (rd != 31) regs[rd] = imm16;
-        }
-        else if ((instr & 0xFF800000) == 0xD2800000) {
-            int rd = instr & 0x1F;
-            uint16_t imm16 = (instr >> 5) & 0xFFFF;
-            int hw = (instr >> 21) & 0x3;
-            if (rd != 31) regs[rd] = static_cast<uint64_t>(imm16) << (hw * 16);
-        }
-        else if ((instr & 0xFF200000) == 0x8B000000) {
-            int rd = instr & 0x1F;
-            int rn = (instr >> 5) & 0x1F;
-            int rm = (instr >> 16) & 0x1F;
-            if (rd != 31) regs[rd] = regs[rn] + regs[rm];
-        }
-        else if ((instr & 0xFFFFFC1F) == 0xD65F0000) {
-            running = false;
+        while (status == casm::VmStatus::BUDGET && vm.executed() < budget) {
+            uint32_t instr = vm.current_word();
+            
+            // Show current instruction
+            uart::printf("PC=%04x: %08x  ", (uint32_t)vm.pc(), instr);
+            char buf[64];
+            const char* dis = disasm_instruction(instr, buf, sizeof(buf));
+            if (dis && dis[0]) uart::puts(dis);
+            uart::putc('\n');
+            
+            // Show registers and flags
+            uart::puts("  x0-x3: ");
+            for (int i = 0; i < 4; i++) {
+                uart::printf("%08x ", (uint32_t)vm.reg(i));
+            }
+            uart::putc('\n');
+            uint32_t nzcv = vm.nzcv();
+            uart::printf("  Flags: N=%d Z=%d C=%d V=%d\n",
+                         (int)((nzcv >> 3) & 1), (int)((nzcv >> 2) & 1),
+                         (int)((nzcv >> 1) & 1), (int)(nzcv & 1));
+            
+            // Wait for input
+            char c = uart::getc();
+            if (c == 'q' || c == 'Q') {
+                uart::puts("Quit\n");
+                casm_free_session(session);
+                casm_free_arena(code_buffer, mem_size);
+                return;
+            }
+            if (c == 'r' || c == 'R') {
+                status = vm.run(budget - vm.executed());
+                break;
+            }
+            status = vm.run(1);
+            casm_native::drain_console(console, true);
+            // The step listing scrolled any rendered canvas away
+            casm::fb_invalidate(&session->fb);
         }
-        
-        pc += 4;
     }
+    if (casm_native::drain_console(console, true)) {
+        casm::fb_invalidate(&session->fb);
+    }
+    
+    // Render framebuffer if graphics were used
+    if (session->fb.active) {
+        casm::fb_render(&session->fb);
+    }
+    casm_free_session(session);
     
-    uart::puts("\nExecution complete\n");
+    // Reset terminal
+    uart::puts("\x1b[0m");
+    
+    if (status == casm::VmStatus::UNKNOWN) {
+        uart::printf("\nUnknown instruction 0x%08x at PC=0x%x\n",
+                     vm.current_word(), (uint32_t)vm.pc());
+    } else if (status == casm::VmStatus::BUDGET) {
+        uart::puts("Execution limit reached (possible infinite loop)\n");
+    }
+    
+    uart::printf("Executed %d instructions\n", (int)vm.executed());
+    casm_free_arena(code_buffer, mem_size);
 }
 
 // ============================================================================
-// Process Commands: ps and top
+// Process Commands: ps, top, kill, sleep, nohup and sched
 // ============================================================================
 
+static const char* task_state_name(sched::TaskState state) {
+    switch (state) {
+        case sched::TaskState::READY: return "ready   ";
+        case sched::TaskState::RUNNING: return "running ";
+        case sched::TaskState::SLEEPING: return "sleeping";
+        case sched::TaskState::EXITED: return "exited  ";
+        default: return "unknown ";
+    }
+}
+
+static void print_task_table() {
+    stream::puts("  PID  CPU  STATE     CPU(ms)  MEM(KB)  NAME\n");
+    stream::puts("-----  ---  --------  -------  -------  ----------------\n");
+
+    sched::TaskInfo info;
+    for (size_t i = 0; sched::get_task_info(i, &info); i++) {
+        stream::printf("%5d  %3d  %s  %7d  %7d  %s\n",
+            info.pid, (int)info.cpu, task_state_name(info.state), (int)info.cpu_ms,
+            (int)(info.stack_bytes / 1024), info.name);
+    }
+}
+
 /*
- * ps - List processes
+ * ps - List tasks with their measured CPU time and stack size
  */
 void cmd_ps(int argc, char* argv[]) {
     (void)argc;
     (void)argv;
-    
-    uart::puts("  PID  STATE     CPU(ms)  MEM(KB)  NAME\n");
-    uart::puts("-----  --------  -------  -------  ----------------\n");
-    
-    // Always show kernel and shell as "processes"
-    uint64_t uptime = timer::get_uptime_ms();
-    uart::printf("%5d  running   %7d  %7d  %s\n", 0, (int)uptime, 128, "[kernel]");
-    uart::printf("%5d  running   %7d  %7d  %s\n", 1, (int)(uptime/2), 64, "[shell]");
-    
-    // Show any tracked processes
-    int count = shell::get_process_count();
-    for (int i = 0; i < count; i++) {
-        shell::ProcessInfo* proc = shell::get_process_by_index(i);
-        if (proc) {
-            const char* state_str = "unknown ";
-            switch (proc->state) {
-                case shell::ProcessState::RUNNING: state_str = "running "; break;
-                case shell::ProcessState::SLEEPING: state_str = "sleeping"; break;
-                case shell::ProcessState::STOPPED: state_str = "stopped "; break;
-                default: break;
-            }
-            uart::printf("%5d  %s  %7d  %7d  %s\n", 
-                proc->pid, state_str, (int)proc->cpu_time, 
-                (int)(proc->memory / 1024), proc->name);
-        }
-    }
+    print_task_table();
 }
 
 /*
@@ -3391,71 +3944,24 @@ void cmd_top(int argc, char* argv[]) {
         uint32_t mem_used_kb = (mem.used_pages * memory::PAGE_SIZE) / 1024;
         uint32_t mem_total_kb = (mem.total_pages * memory::PAGE_SIZE) / 1024;
         
-        uart::printf("Uptime: %d.%03ds  Memory: %dKB / %dKB (%d%%)\n\n",
+        uart::printf("Uptime: %d.%03ds  Memory: %dKB / %dKB (%d%%)\n",
             (int)(uptime / 1000), (int)(uptime % 1000),
             mem_used_kb, mem_total_kb,
             mem.total_pages ? (int)((mem.used_pages * 100) / mem.total_pages) : 0);
+        uart::printf("Tasks: %d  CPUs: %d  Switches: %d  Quantum: %dms\n\n",
+            (int)sched::task_count(), (int)smp::online_count(),
+            (int)sched::get_switch_count(), (int)sched::get_quantum_ms());
         
         // Column headers
-        uart::puts("  PID  STATE     CPU(ms)  MEM(KB)  NAME\n");
-        uart::puts("-----  --------  -------  -------  ----------------\n");
+        uart::puts("  PID  CPU  STATE     CPU(ms)  MEM(KB)  NAME\n");
+        uart::puts("-----  ---  --------  -------  -------  ----------------\n");
         
-        // Build process list (kernel + shell + tracked)
-        struct ProcEntry {
-            int pid;
-            char state[12];
-            uint32_t cpu;
-            uint32_t mem;
-            char name[32];
-        };
-        
-        ProcEntry entries[20];
+        // Snapshot the task table
+        sched::TaskInfo entries[sched::MAX_TASKS];
         int entry_count = 0;
-        
-        // Helper to copy strings
-        auto str_cpy = [](char* dst, const char* src, int max) {
-            int i = 0;
-            while (i < max - 1 && src[i]) { dst[i] = src[i]; i++; }
-            dst[i] = '\0';
-        };
-        
-        // Kernel
-        entries[entry_count].pid = 0;
-        str_cpy(entries[entry_count].state, "running ", 12);
-        entries[entry_count].cpu = (uint32_t)uptime;
-        entries[entry_count].mem = 128;
-        str_cpy(entries[entry_count].name, "[kernel]", 32);
-        entry_count++;
-        
-        // Shell
-        entries[entry_count].pid = 1;
-        str_cpy(entries[entry_count].state, "running ", 12);
-        entries[entry_count].cpu = (uint32_t)(uptime/2);
-        entries[entry_count].mem = 64;
-        str_cpy(entries[entry_count].name, "[shell]", 32);
-        entry_count++;
-        
-        // Tracked processes
-        int proc_count = shell::get_process_count();
-        for (int i = 0; i < proc_count && entry_count < 20; i++) {
-            shell::ProcessInfo* proc = shell::get_process_by_index(i);
-            if (proc) {
-                entries[entry_count].pid = proc->pid;
-                switch (proc->state) {
-                    case shell::ProcessState::RUNNING: 
-                        str_cpy(entries[entry_count].state, "running ", 12); break;
-                    case shell::ProcessState::SLEEPING: 
-                        str_cpy(entries[entry_count].state, "sleeping", 12); break;
-                    case shell::ProcessState::STOPPED: 
-                        str_cpy(entries[entry_count].state, "stopped ", 12); break;
-                    default: 
-                        str_cpy(entries[entry_count].state, "unknown ", 12); break;
-                }
-                entries[entry_count].cpu = (uint32_t)proc->cpu_time;
-                entries[entry_count].mem = proc->memory / 1024;
-                str_cpy(entries[entry_count].name, proc->name, 32);
-                entry_count++;
-            }
+        while (entry_count < (int)sched::MAX_TASKS &&
+               sched::get_task_info(entry_count, &entries[entry_count])) {
+            entry_count++;
         }
         
         // Clamp selection
@@ -3467,9 +3973,10 @@ void cmd_top(int argc, char* argv[]) {
             if (i == selected) {
                 uart::puts("\x1b[7m");  // Inverse video for selection
             }
-            uart::printf("%5d  %s  %7d  %7d  %s", 
-                entries[i].pid, entries[i].state, 
-                entries[i].cpu, entries[i].mem, entries[i].name);
+            uart::printf("%5d  %3d  %s  %7d  %7d  %s", 
+                entries[i].pid, (int)entries[i].cpu, task_state_name(entries[i].state),
+                (int)entries[i].cpu_ms, (int)(entries[i].stack_bytes / 1024),
+                entries[i].name);
             if (i == selected) {
                 uart::puts("\x1b[0m");
             }
@@ -3490,14 +3997,14 @@ void cmd_top(int argc, char* argv[]) {
                 if (c == 'q' || c == 'Q' || c == '\x03') {  // q or Ctrl+C
                     running = false;
                 } else if (c == 'k' || c == 'K') {
-                    // Kill selected process
-                    if (selected >= 2 && entries[selected].pid > 1) {
-                        shell::destroy_process(entries[selected].pid);
-                        uart::printf("\nKilled process %d\n", entries[selected].pid);
-                        timer::sleep_ms(500);
+                    // Kill selected task
+                    int pid = entry_count ? entries[selected].pid : 0;
+                    if (pid > 1 && sched::kill(pid)) {
+                        uart::printf("\nKilled process %d\n", pid);
+                        sched::sleep_ms(500);
                     } else {
                         uart::puts("\nCannot kill system processes\n");
-                        timer::sleep_ms(500);
+                        sched::sleep_ms(500);
                     }
                 } else if (c == '\x1b') {  // Escape sequence
                     char c2 = uart::getc();
@@ -3511,7 +4018,7 @@ void cmd_top(int argc, char* argv[]) {
                     }
                 }
             }
-            timer::sleep_ms(10);
+            sched::sleep_ms(10);
         }
     }
     
@@ -3519,6 +4026,472 @@ void cmd_top(int argc, char* argv[]) {
     uart::puts("\x1b[2J\x1b[H");
 }
 
+/*
+ * kill - End a background task
+ */
+void cmd_kill(int argc, char* argv[]) {
+    if (argc < 2) {
+        uart::puts("Usage: kill <pid>\n");
+        return;
+    }
+    
+    bool ok;
+    int pid = (int)parse_uint64(argv[1], &ok);
+    if (!ok) {
+        uart::printf("kill: invalid pid '%s'\n", argv[1]);
+        return;
+    }
+    if (pid <= 1) {
+        uart::puts("kill: cannot kill system processes\n");
+        return;
+    }
+    if (!sched::kill(pid)) {
+        uart::printf("kill: (%d) - No such process\n", pid);
+    }
+}
+
+/*
+ * sleep - Block the calling task; other tasks keep running
+ */
+void cmd_sleep(int argc, char* argv[]) {
+    if (argc < 2) {
+        uart::puts("Usage: sleep <ms>\n");
+        return;
+    }
+    
+    bool ok;
+    uint64_t ms = parse_uint64(argv[1], &ok);
+    if (!ok) {
+        uart::printf("sleep: invalid time '%s'\n", argv[1]);
+        return;
+    }
+    sched::sleep_ms(ms);
+}
+
+/*
+ * nohup - Run a command as a background task (same as a trailing &)
+ */
+void cmd_nohup(int argc, char* argv[]) {
+    if (argc < 2) {
+        uart::puts("Usage: nohup <command> [args...]\n");
+        return;
+    }
+    shell::run_background(argc - 1, argv + 1);
+}
+
+/*
+ * sched - Show scheduler state or set the time slice
+ */
+void cmd_sched(int argc, char* argv[]) {
+    if (argc >= 3 && klib::strcmp(argv[1], "quantum") == 0) {
+        bool ok;
+        uint64_t ms = parse_uint64(argv[2], &ok);
+        if (!ok || ms == 0) {
+            uart::puts("sched: quantum must be a positive number of ms\n");
+            return;
+        }
+        sched::set_quantum_ms(ms);
+        uart::printf("Quantum set to %dms\n", (int)sched::get_quantum_ms());
+        return;
+    }
+    if (argc >= 2) {
+        uart::puts("Usage: sched [quantum <ms>]\n");
+        return;
+    }
+    
+    uart::printf("Quantum:  %dms\n", (int)sched::get_quantum_ms());
+    uart::printf("Switches: %d\n", (int)sched::get_switch_count());
+    uart::printf("Timers:   %d pending / %d per CPU, %d timer IRQs\n", (int)timer::pending_count(),
+                 (int)timer::MAX_TIMERS, (int)timer::get_interrupt_count());
+    uart::printf("Tasks:    %d / %d\n", (int)sched::task_count(), (int)sched::MAX_TASKS);
+    for (uint32_t cpu = 0; cpu < smp::MAX_CPUS; cpu++) {
+        const smp::PerCpu* pc = smp::get_cpu(cpu);
+        if (pc->online) {
+            uart::printf("CPU %d:    %d IRQs, %d IPIs\n", (int)cpu, (int)pc->irqs, (int)pc->ipis);
+        }
+    }
+    uart::puts("\n");
+    print_task_table();
+}
+
+// ============================================================================
+// Benchmarks: bench
+// ============================================================================
+
+/*
+ * Every case takes BENCH_SAMPLES timed samples of BENCH_BATCH operations
+ * (CNTPCT ticks per sample) and prints one line
+ *     BENCH <case> ops=<ops per sample> n=<samples> min=<t> median=<t> p99=<t> [bytes=<b>]
+ * after a "BENCH counter_hz=<f>" header, so `make bench` can grep them
+ * out and compare medians against a stored run
+ */
+constexpr size_t BENCH_SAMPLES = 101;
+constexpr uint32_t BENCH_BATCH = 16;
+constexpr size_t BENCH_CHUNK = 4096;
+constexpr size_t BENCH_FRAG_PAGES = 512;
+constexpr const char* BENCH_DIR = "/.bench";
+
+static uint64_t g_bench_samples[BENCH_SAMPLES];
+static void* g_bench_ptrs[BENCH_FRAG_PAGES];
+static uint8_t g_bench_chunk[BENCH_CHUNK];
+
+// Compute-only program timed by the casm cases unless a file is given
+static const char g_bench_program[] =
+    ".text\n"
+    "_start:\n"
+    "    mov x20, #0\n"
+    "    mov x21, #200\n"
+    "    mov x22, #100\n"
+    "    mov x13, #0\n"
+    "outer:\n"
+    "    cmp x20, x21\n"
+    "    b.ge done\n"
+    "    mov x10, #0\n"
+    "    mov x11, #0x400\n"
+    "inner:\n"
+    "    str x10, [x11]\n"
+    "    ldr x12, [x11]\n"
+    "    add x13, x13, x12\n"
+    "    add x11, x11, #8\n"
+    "    add x10, x10, #1\n"
+    "    cmp x10, x22\n"
+    "    b.lt inner\n"
+    "    add x20, x20, #1\n"
+    "    b outer\n"
+    "done:\n"
+    "    halt\n";
+
+// Sort the samples and print the case's BENCH line
+static void bench_report(const char* name, int variant, uint32_t ops, uint64_t bytes = 0) {
+    uint64_t* s = g_bench_samples;
+    for (size_t i = 1; i < BENCH_SAMPLES; i++) {
+        uint64_t v = s[i];
+        size_t j = i;
+        while (j > 0 && s[j - 1] > v) {
+            s[j] = s[j - 1];
+            j--;
+        }
+        s[j] = v;
+    }
+    
+    uart::printf("BENCH %s", name);
+    if (variant >= 0) {
+        uart::printf(".%d", variant);
+    }
+    uart::printf(" ops=%u n=%u min=%u median=%u p99=%u", ops, (uint32_t)BENCH_SAMPLES,
+                 (uint32_t)s[0], (uint32_t)s[BENCH_SAMPLES / 2],
+                 (uint32_t)s[(BENCH_SAMPLES * 99) / 100]);
+    if (bytes) {
+        uart::printf(" bytes=%u", (uint32_t)bytes);
+    }
+    uart::putc('\n');
+}
+
+// Time BENCH_BATCH allocations of pages pages, then the matching frees
+static bool bench_alloc_free(const char* alloc_name, const char* free_name, size_t pages) {
+    uint64_t free_samples[BENCH_SAMPLES];
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        uint64_t start = timer::get_ticks();
+        for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+            g_bench_ptrs[i] = memory::alloc_pages(pages);
+        }
+        g_bench_samples[s] = timer::get_ticks() - start;
+        
+        bool failed = false;
+        start = timer::get_ticks();
+        for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+            if (g_bench_ptrs[i]) {
+                memory::free_pages(g_bench_ptrs[i], pages);
+            } else {
+                failed = true;
+            }
+        }
+        free_samples[s] = timer::get_ticks() - start;
+        if (failed) {
+            uart::printf("bench: out of memory allocating %d pages\n", (int)pages);
+            return false;
+        }
+    }
+    bench_report(alloc_name, (int)pages, BENCH_BATCH);
+    klib::memcpy(g_bench_samples, free_samples, sizeof(free_samples));
+    bench_report(free_name, (int)pages, BENCH_BATCH);
+    return true;
+}
+
+static void bench_mem() {
+    static const size_t sizes[] = {1, 4, 16, 64};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (!bench_alloc_free("mem.alloc", "mem.free", sizes[i])) return;
+    }
+    
+    // Fragment the buddy lists: keep every other page of a run of singles
+    size_t held = 0;
+    while (held < BENCH_FRAG_PAGES) {
+        g_bench_ptrs[held] = memory::alloc_pages(1);
+        if (!g_bench_ptrs[held]) break;
+        held++;
+    }
+    for (size_t i = 0; i < held; i += 2) {
+        memory::free_pages(g_bench_ptrs[i], 1);
+        g_bench_ptrs[i] = nullptr;
+    }
+    // The timed batches overwrite the first slots; keep the held pages
+    // elsewhere so they can be released afterwards
+    void* kept[BENCH_FRAG_PAGES / 2];
+    size_t kept_count = 0;
+    for (size_t i = 1; i < held; i += 2) {
+        kept[kept_count++] = g_bench_ptrs[i];
+    }
+    if (bench_alloc_free("mem.frag.alloc", "mem.frag.free", 1)) {
+        bench_alloc_free("mem.frag.alloc", "mem.frag.free", 4);
+    }
+    for (size_t i = 0; i < kept_count; i++) {
+        memory::free_pages(kept[i], 1);
+    }
+}
+
+// Append a decimal number to a path prefix
+static void bench_path(char* buf, size_t size, const char* prefix, uint32_t n) {
+    klib::strlcpy(buf, prefix, size);
+    size_t len = klib::strlen(buf);
+    char digits[10];
+    int count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + n % 10);
+        n /= 10;
+    } while (n && count < 10);
+    while (count > 0 && len + 1 < size) {
+        buf[len++] = digits[--count];
+    }
+    buf[len] = '\0';
+}
+
+static void bench_fs() {
+    ramfs::delete_dir(BENCH_DIR, true);
+    if (!ramfs::create_dir(BENCH_DIR)) {
+        uart::printf("bench: cannot create %s\n", BENCH_DIR);
+        return;
+    }
+    
+    char path[ramfs::MAX_PATH];
+    
+    // create, then (timed separately) delete a batch of files
+    uint64_t delete_samples[BENCH_SAMPLES];
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        uint64_t start = timer::get_ticks();
+        for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+            bench_path(path, sizeof(path), "/.bench/f", i);
+            ramfs::create_file(path);
+        }
+        g_bench_samples[s] = timer::get_ticks() - start;
+        
+        start = timer::get_ticks();
+        for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+            bench_path(path, sizeof(path), "/.bench/f", i);
+            ramfs::delete_file(path);
+        }
+        delete_samples[s] = timer::get_ticks() - start;
+    }
+    bench_report("fs.create", -1, BENCH_BATCH);
+    klib::memcpy(g_bench_samples, delete_samples, sizeof(delete_samples));
+    bench_report("fs.delete", -1, BENCH_BATCH);
+    
+    // Resolve a five-component path (a path cache hit after the first)
+    static const char* dirs[] = {"/.bench/a", "/.bench/a/b", "/.bench/a/b/c", "/.bench/a/b/c/d"};
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        ramfs::create_dir(dirs[i]);
+    }
+    ramfs::create_file("/.bench/a/b/c/d/leaf");
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        uint64_t start = timer::get_ticks();
+        for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+            ramfs::resolve_path("/.bench/a/b/c/d/leaf");
+        }
+        g_bench_samples[s] = timer::get_ticks() - start;
+    }
+    bench_report("fs.resolve", -1, BENCH_BATCH);
+    
+    // Sequential 4 KiB writes and reads of one file
+    ramfs::FSNode* file = ramfs::create_file("/.bench/data");
+    if (!file) {
+        uart::puts("bench: cannot create data file\n");
+        ramfs::delete_dir(BENCH_DIR, true);
+        return;
+    }
+    klib::memset(g_bench_chunk, 'x', sizeof(g_bench_chunk));
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        ramfs::truncate_file(file, 0);
+        uint64_t start = timer::get_ticks();
+        for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+            ramfs::write_file(file, g_bench_chunk, i * BENCH_CHUNK, BENCH_CHUNK);
+        }
+        g_bench_samples[s] = timer::get_ticks() - start;
+    }
+    bench_report("fs.write", -1, BENCH_BATCH, BENCH_BATCH * BENCH_CHUNK);
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        uint64_t start = timer::get_ticks();
+        for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+            ramfs::read_file(file, g_bench_chunk, i * BENCH_CHUNK, BENCH_CHUNK);
+        }
+        g_bench_samples[s] = timer::get_ticks() - start;
+    }
+    bench_report("fs.read", -1, BENCH_BATCH, BENCH_BATCH * BENCH_CHUNK);
+    
+    ramfs::delete_dir(BENCH_DIR, true);
+}
+
+// Console output rate; each sample is written and drained to the FIFO
+static void bench_uart() {
+    constexpr uint32_t LINES = 4;
+    char line[64];
+    klib::memset(line, ' ', sizeof(line));
+    klib::memcpy(line, "bench uart", 10);
+    line[sizeof(line) - 1] = '\r';
+    
+    uart::drain();
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        uint64_t start = timer::get_ticks();
+        for (uint32_t i = 0; i < LINES; i++) {
+            uart::write_all(line, sizeof(line));
+        }
+        uart::drain();
+        g_bench_samples[s] = timer::get_ticks() - start;
+    }
+    uart::puts("\n");
+    bench_report("uart.write", -1, LINES, LINES * sizeof(line));
+}
+
+static void bench_svc() {
+    constexpr uint32_t CALLS = 64;
+    for (int fast = 0; fast < 2; fast++) {
+        for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+            g_bench_samples[s] = casm_native::bench_svc(CALLS, fast != 0);
+            if (!g_bench_samples[s]) {
+                uart::puts("bench: out of memory\n");
+                return;
+            }
+        }
+        bench_report(fast ? "svc.fast" : "svc.full", -1, CALLS);
+    }
+}
+
+// Assemble, then run natively and in the VM, the given source
+static void bench_casm(const char* source, size_t length) {
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        casm::CodeGenerator codegen;
+        uint64_t start = timer::get_ticks();
+        bool ok = casm_generate(source, length, false, codegen);
+        g_bench_samples[s] = timer::get_ticks() - start;
+        if (!ok) return;
+    }
+    bench_report("casm.assemble", -1, 1, length);
+    
+    casm::CodeGenerator codegen;
+    if (!casm_generate(source, length, false, codegen)) return;
+    const uint8_t* image = codegen.get_code();
+    size_t image_size = codegen.get_code_size();
+    
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        size_t arena_size;
+        uint8_t* arena = casm_alloc_arena(image, image_size, &arena_size);
+        if (!arena) {
+            uart::puts("bench: out of memory\n");
+            return;
+        }
+        casm_native::init(arena, arena_size);
+        uint64_t start = timer::get_ticks();
+        casm_native::run(arena);
+        g_bench_samples[s] = timer::get_ticks() - start;
+        casm_free_arena(arena, arena_size);
+    }
+    bench_report("casm.native", -1, 1);
+    
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        size_t mem_size;
+        uint8_t* arena = casm_alloc_arena(image, image_size, &mem_size,
+                                          sizeof(casm::ConsoleRing) + 16);
+        casm::Vm vm;
+        if (!arena || !vm.load(arena, mem_size, image_size)) {
+            uart::puts("bench: out of memory\n");
+            if (arena) casm_free_arena(arena, mem_size);
+            return;
+        }
+        // Same layout as casm run -v
+        size_t ring_offset = (mem_size - sizeof(casm::ConsoleRing)) & ~static_cast<size_t>(0xF);
+        casm::ConsoleRing* console = reinterpret_cast<casm::ConsoleRing*>(arena + ring_offset);
+        vm.reg(26) = ring_offset;
+        vm.reg(casm::VM_SP) = ring_offset;
+        VmSession* session = casm_alloc_session(console);
+        if (!session) {
+            uart::puts("bench: out of memory\n");
+            casm_free_arena(arena, mem_size);
+            return;
+        }
+        vm.set_svc_handler(casm_vm_svc, session);
+        
+        uint64_t start = timer::get_ticks();
+        casm::VmStatus status = vm.run(casm::DEFAULT_VM_BUDGET);
+        g_bench_samples[s] = timer::get_ticks() - start;
+        casm_native::drain_console(console, true);
+        casm_free_session(session);
+        casm_free_arena(arena, mem_size);
+        if (status == casm::VmStatus::BUDGET || status == casm::VmStatus::UNKNOWN) {
+            uart::puts("bench: program did not finish in the VM\n");
+            return;
+        }
+    }
+    bench_report("casm.vm", -1, 1);
+}
+
+/*
+ * bench - Run the micro-benchmark suites (all, or the ones named)
+ */
+void cmd_bench(int argc, char* argv[]) {
+    static const char* suites[] = {"mem", "fs", "uart", "svc", "casm"};
+    constexpr size_t SUITES = sizeof(suites) / sizeof(suites[0]);
+    
+    // casm may be followed by a source file to time instead of the built-in one
+    bool selected[SUITES] = {};
+    bool any = false;
+    const char* casm_file = nullptr;
+    for (int i = 1; i < argc; i++) {
+        size_t k = 0;
+        while (k < SUITES && klib::strcmp(argv[i], suites[k]) != 0) k++;
+        if (k == SUITES) {
+            if (i > 1 && klib::strcmp(argv[i - 1], "casm") == 0) {
+                casm_file = argv[i];
+                continue;
+            }
+            uart::puts("Usage: bench [mem] [fs] [uart] [svc] [casm [file.asm]]\n");
+            return;
+        }
+        selected[k] = true;
+        any = true;
+    }
+    
+    uart::printf("BENCH counter_hz=%u cpus=%u\n", (uint32_t)timer::get_frequency(),
+                 smp::online_count());
+    if (!any || selected[0]) bench_mem();
+    if (!any || selected[1]) bench_fs();
+    if (!any || selected[2]) bench_uart();
+    if (!any || selected[3]) bench_svc();
+    if (!any || selected[4]) {
+        if (!casm_file) {
+            bench_casm(g_bench_program, sizeof(g_bench_program) - 1);
+            return;
+        }
+        ramfs::FSNode* file = ramfs::open_file(casm_file);
+        const uint8_t* source;
+        size_t length;
+        if (!file || !ramfs::map_file(file, &source, &length)) {
+            uart::printf("bench: %s: No such file\n", casm_file);
+            return;
+        }
+        bench_casm(reinterpret_cast<const char*>(source), length);
+        ramfs::unmap_file(file);
+    }
+}
+
 // ============================================================================
 // Command Registration
 // ============================================================================
@@ -3538,6 +4511,8 @@ void register_all() {
     shell::register_command("meminfo", "Display memory statistics", cmd_meminfo);
     shell::register_command("cpuinfo", "Display CPU information", cmd_cpuinfo);
     shell::register_command("date", "Display system time", cmd_date);
+    shell::register_command("uartstat", "Display UART driver statistics", cmd_uartstat);
+    shell::register_command("irqstat", "Display per-IRQ counts and latencies", cmd_irqstat);
     
     // System control commands (Requirements: 6.8, 6.9)
     shell::register_command("reboot", "Restart the system", cmd_reboot);
@@ -3575,15 +4550,23 @@ void register_all() {
     shell::register_command("export", "Set environment variable", cmd_export);
     shell::register_command("unset", "Remove environment variable", cmd_unset);
     shell::register_command("time", "Time command execution", cmd_time);
+    shell::register_command("perf", "Count PMU events of a command", cmd_perf);
     shell::register_command("whoami", "Display current user", cmd_whoami);
     shell::register_command("hostname", "Display/set hostname", cmd_hostname);
     
     // Process commands
     shell::register_command("ps", "List processes", cmd_ps);
     shell::register_command("top", "Interactive process viewer", cmd_top);
+    shell::register_command("kill", "End a background task", cmd_kill);
+    shell::register_command("sleep", "Sleep for a number of milliseconds", cmd_sleep);
+    shell::register_command("nohup", "Run a command in the background", cmd_nohup);
+    shell::register_command("sched", "Show scheduler state / set quantum", cmd_sched);
     
     // Developer commands
     shell::register_command("regs", "Display CPU registers", cmd_regs);
+    shell::register_command("svcbench", "Benchmark the SVC fast path", cmd_svcbench);
+    shell::register_command("trace", "Capture and dump kernel events", cmd_trace);
+    shell::register_command("bench", "Run the micro-benchmark suites", cmd_bench);
     
     // CASM assembler (Requirements: 7.11)
     shell::register_command("casm", "Assemble/run/disasm C.ASM files", cmd_casm);
@@ -1,11 +1,28 @@
 /*
  * EmberOS Vi-like Text Editor Implementation
  * Improved line-based text editor with vi-like commands
+ *
+ * The text is a gap buffer: the bytes before the last edit, a gap, then
+ * the rest, so typing stores into the gap and only moving the edit point
+ * copies text. A line index holds the text offset of each line's first
+ * byte; an edit adjusts the entries of the lines after it. Both grow from
+ * the page allocator as needed, up to what a RAMFS file can hold.
+ *
+ * The screen is redrawn incrementally. Edits mark the lines they touched,
+ * only rows showing those lines (plus the status bar) are composed, and
+ * each composed row is compared with a copy of what the terminal shows so
+ * only the span that differs goes over the UART. Scrolling by less than a
+ * screen uses the terminal's scroll region and draws the exposed rows.
+ *
+ * Saving rewrites the file only from the first byte changed since it was
+ * loaded or last saved.
  */
 
 #include "editor.h"
 #include "uart.h"
 #include "ramfs.h"
+#include "memory.h"
+#include "klib.h"
 
 namespace editor {
 
@@ -13,44 +30,6 @@ namespace editor {
 // String Utilities
 // ============================================================================
 
-static size_t str_len(const char* s) {
-    size_t len = 0;
-    while (s[len]) len++;
-    return len;
-}
-
-static void str_copy(char* dst, const char* src, size_t max_len) {
-    size_t i = 0;
-    while (i < max_len - 1 && src[i]) {
-        dst[i] = src[i];
-        i++;
-    }
-    dst[i] = '\0';
-}
-
-static int str_cmp(const char* a, const char* b) {
-    while (*a && *b && *a == *b) {
-        a++;
-        b++;
-    }
-    return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
-}
-
-static void mem_move(void* dst, const void* src, size_t size) {
-    uint8_t* d = static_cast<uint8_t*>(dst);
-    const uint8_t* s = static_cast<const uint8_t*>(src);
-    
-    if (d < s) {
-        for (size_t i = 0; i < size; i++) {
-            d[i] = s[i];
-        }
-    } else {
-        for (size_t i = size; i > 0; i--) {
-            d[i-1] = s[i-1];
-        }
-    }
-}
-
 // Print number without printf
 static void print_num(int n) {
     if (n < 0) {
@@ -63,52 +42,72 @@ static void print_num(int n) {
     uart::putc('0' + (n % 10));
 }
 
-// Print number with padding
-static void print_num_padded(int n, int width) {
-    char buf[12];
-    int len = 0;
-    
-    if (n == 0) {
-        buf[len++] = '0';
-    } else {
-        while (n > 0) {
-            buf[len++] = '0' + (n % 10);
-            n /= 10;
-        }
-    }
-    
-    for (int i = len; i < width; i++) {
-        uart::putc(' ');
-    }
-    
+// Append a decimal number to buf at pos, returning the new position
+static size_t put_num(char* buf, size_t pos, size_t n) {
+    char tmp[20];
+    size_t len = 0;
+    do {
+        tmp[len++] = static_cast<char>('0' + (n % 10));
+        n /= 10;
+    } while (n > 0);
     while (len > 0) {
-        uart::putc(buf[--len]);
+        buf[pos++] = tmp[--len];
     }
+    return pos;
 }
 
 // ============================================================================
 // Editor State
 // ============================================================================
 
+// Terminal dimensions
+constexpr size_t TERM_ROWS = 24;
+constexpr size_t TERM_COLS = 80;
+constexpr size_t EDIT_ROWS = TERM_ROWS - 2;
+constexpr size_t STATUS_ROW = EDIT_ROWS;
+constexpr size_t MESSAGE_ROW = TERM_ROWS - 1;
+constexpr size_t MIN_GUTTER = 4;            // Line number and a space
+
+// Largest text: what a RAMFS file can hold
+constexpr size_t MAX_TEXT = ramfs::MAX_FILE_SIZE;
+
+// No line marked for redraw
+constexpr size_t NO_LINE = ~static_cast<size_t>(0);
+
 struct EditorState {
-    char lines[MAX_LINES][MAX_LINE_LEN];
+    // Gap buffer: the text is buf[0, gap_start) then buf[gap_end, capacity)
+    char* buf;
+    size_t capacity;
+    size_t gap_start;
+    size_t gap_end;
+    size_t text_pages;
+    
+    // Line index: text offset of each line's first byte
+    uint32_t* line_start;
     size_t line_count;
+    size_t line_capacity;
+    size_t line_pages;
+    
     size_t cursor_line;
     size_t cursor_col;
     size_t scroll_offset;
     bool modified;
+    size_t save_from;           // First text offset changed since load or save
+    bool trailing_newline;      // The file's final '\n', not kept in the text
     char filename[ramfs::MAX_FILENAME];
     char status_msg[80];
     bool insert_mode;
+    
+    // Damage: lines [dirty_first, dirty_last] need composing again
+    size_t dirty_first;
+    size_t dirty_last;
+    size_t shown_scroll;        // scroll_offset of what the terminal shows
+    size_t shown_gutter;        // Gutter width the text rows were drawn with
+    char screen[TERM_ROWS][TERM_COLS];  // What the terminal shows
 };
 
 static EditorState g_editor;
 
-// Terminal dimensions
-constexpr size_t TERM_ROWS = 24;
-constexpr size_t TERM_COLS = 80;
-constexpr size_t EDIT_ROWS = TERM_ROWS - 2;
-
 // ============================================================================
 // Terminal Control
 // ============================================================================
@@ -145,89 +144,351 @@ static void show_cursor() {
     uart::puts("\x1b[?25h");
 }
 
+// ============================================================================
+// Gap Buffer and Line Index
+// ============================================================================
+
+static size_t text_length() {
+    return g_editor.capacity - (g_editor.gap_end - g_editor.gap_start);
+}
+
+static char char_at(size_t pos) {
+    if (pos >= g_editor.gap_start) {
+        pos += g_editor.gap_end - g_editor.gap_start;
+    }
+    return g_editor.buf[pos];
+}
+
+static size_t line_offset(size_t line) {
+    return g_editor.line_start[line];
+}
+
+// Offset just past the line's last byte (its '\n', or the end of text)
+static size_t line_end(size_t line) {
+    return line + 1 < g_editor.line_count ? g_editor.line_start[line + 1] - 1 : text_length();
+}
+
+static size_t line_length(size_t line) {
+    return line_end(line) - line_offset(line);
+}
+
+// Move the gap so it starts at text offset pos
+static void move_gap(size_t pos) {
+    if (pos < g_editor.gap_start) {
+        size_t n = g_editor.gap_start - pos;
+        klib::memmove(g_editor.buf + g_editor.gap_end - n, g_editor.buf + pos, n);
+        g_editor.gap_start -= n;
+        g_editor.gap_end -= n;
+    } else if (pos > g_editor.gap_start) {
+        size_t n = pos - g_editor.gap_start;
+        klib::memmove(g_editor.buf + g_editor.gap_start, g_editor.buf + g_editor.gap_end, n);
+        g_editor.gap_start += n;
+        g_editor.gap_end += n;
+    }
+}
+
+static size_t pages_for(size_t bytes) {
+    return (bytes + memory::PAGE_SIZE - 1) / memory::PAGE_SIZE;
+}
+
+// Make room for extra more bytes of text, doubling the buffer
+static bool reserve_text(size_t extra) {
+    if (g_editor.gap_end - g_editor.gap_start >= extra) {
+        return true;
+    }
+    size_t length = text_length();
+    if (length + extra > MAX_TEXT) {
+        return false;
+    }
+    
+    size_t pages = g_editor.text_pages * 2;
+    if (pages < pages_for(length + extra)) {
+        pages = pages_for(length + extra);
+    }
+    if (pages > pages_for(MAX_TEXT)) {
+        pages = pages_for(MAX_TEXT);
+    }
+    char* buf = static_cast<char*>(memory::alloc_pages(pages));
+    if (!buf) {
+        return false;
+    }
+    
+    // Keep the gap where it is, now wider
+    size_t capacity = pages * memory::PAGE_SIZE;
+    size_t tail = g_editor.capacity - g_editor.gap_end;
+    klib::memcpy(buf, g_editor.buf, g_editor.gap_start);
+    klib::memcpy(buf + capacity - tail, g_editor.buf + g_editor.gap_end, tail);
+    memory::free_pages(g_editor.buf, g_editor.text_pages);
+    
+    g_editor.buf = buf;
+    g_editor.gap_end = capacity - tail;
+    g_editor.capacity = capacity;
+    g_editor.text_pages = pages;
+    return true;
+}
+
+// Make room for one more line index entry, doubling the index
+static bool reserve_line() {
+    if (g_editor.line_count < g_editor.line_capacity) {
+        return true;
+    }
+    size_t pages = g_editor.line_pages * 2;
+    uint32_t* index = static_cast<uint32_t*>(memory::alloc_pages(pages));
+    if (!index) {
+        return false;
+    }
+    klib::memcpy(index, g_editor.line_start, g_editor.line_count * sizeof(uint32_t));
+    memory::free_pages(g_editor.line_start, g_editor.line_pages);
+    
+    g_editor.line_start = index;
+    g_editor.line_pages = pages;
+    g_editor.line_capacity = pages * memory::PAGE_SIZE / sizeof(uint32_t);
+    return true;
+}
+
+// Mark lines for redraw; last = NO_LINE runs to the end of the screen
+static void mark_dirty(size_t first, size_t last) {
+    if (g_editor.dirty_first == NO_LINE) {
+        g_editor.dirty_first = first;
+        g_editor.dirty_last = last;
+        return;
+    }
+    if (first < g_editor.dirty_first) g_editor.dirty_first = first;
+    if (last > g_editor.dirty_last) g_editor.dirty_last = last;
+}
+
+static void note_change(size_t pos) {
+    if (pos < g_editor.save_from) {
+        g_editor.save_from = pos;
+    }
+    g_editor.modified = true;
+}
+
+/*
+ * Insert c at column col of line; a '\n' splits the line
+ * Returns false (setting the message) if there is no room
+ */
+static bool text_insert(size_t line, size_t col, char c) {
+    if (!reserve_text(1) || (c == '\n' && !reserve_line())) {
+        klib::strlcpy(g_editor.status_msg, "Error: File too large", 80);
+        return false;
+    }
+    
+    size_t pos = line_offset(line) + col;
+    move_gap(pos);
+    g_editor.buf[g_editor.gap_start++] = c;
+    
+    for (size_t i = line + 1; i < g_editor.line_count; i++) {
+        g_editor.line_start[i]++;
+    }
+    if (c == '\n') {
+        klib::memmove(&g_editor.line_start[line + 2], &g_editor.line_start[line + 1],
+                      (g_editor.line_count - line - 1) * sizeof(uint32_t));
+        g_editor.line_start[line + 1] = static_cast<uint32_t>(pos + 1);
+        g_editor.line_count++;
+        mark_dirty(line, NO_LINE);
+    } else {
+        mark_dirty(line, line);
+    }
+    
+    note_change(pos);
+    return true;
+}
+
+/*
+ * Remove n bytes starting at column col of line, with any newlines in them
+ */
+static void text_erase(size_t line, size_t col, size_t n) {
+    size_t pos = line_offset(line) + col;
+    if (n == 0 || pos + n > text_length()) {
+        return;
+    }
+    
+    // Lines starting inside the erased range disappear
+    size_t joined = 0;
+    while (line + 1 + joined < g_editor.line_count &&
+           g_editor.line_start[line + 1 + joined] <= pos + n) {
+        joined++;
+    }
+    
+    move_gap(pos);
+    g_editor.gap_end += n;
+    
+    size_t remaining = g_editor.line_count - line - 1 - joined;
+    for (size_t i = 0; i < remaining; i++) {
+        g_editor.line_start[line + 1 + i] = g_editor.line_start[line + 1 + joined + i] -
+                                            static_cast<uint32_t>(n);
+    }
+    g_editor.line_count -= joined;
+    mark_dirty(line, joined ? NO_LINE : line);
+    
+    note_change(pos);
+}
+
 // ============================================================================
 // Editor Operations
 // ============================================================================
 
 static void init_editor(const char* filename) {
-    // Zero out state manually
-    for (size_t i = 0; i < MAX_LINES; i++) {
-        g_editor.lines[i][0] = '\0';
-    }
+    g_editor.buf = nullptr;
+    g_editor.capacity = 0;
+    g_editor.gap_start = 0;
+    g_editor.gap_end = 0;
+    g_editor.text_pages = 0;
+    g_editor.line_start = nullptr;
     g_editor.line_count = 1;
+    g_editor.line_capacity = 0;
+    g_editor.line_pages = 0;
     g_editor.cursor_line = 0;
     g_editor.cursor_col = 0;
     g_editor.scroll_offset = 0;
     g_editor.modified = false;
+    g_editor.save_from = 0;
+    g_editor.trailing_newline = false;
     g_editor.insert_mode = false;
     
-    str_copy(g_editor.filename, filename, ramfs::MAX_FILENAME);
-    str_copy(g_editor.status_msg, "NORMAL | hjkl:move i:insert :wq:save&quit :q!:quit", 80);
+    g_editor.dirty_first = 0;
+    g_editor.dirty_last = NO_LINE;
+    g_editor.shown_scroll = 0;
+    g_editor.shown_gutter = MIN_GUTTER;
+    klib::memset(g_editor.screen, ' ', sizeof(g_editor.screen));
+    
+    klib::strlcpy(g_editor.filename, filename, ramfs::MAX_FILENAME);
+    klib::strlcpy(g_editor.status_msg, "NORMAL | hjkl:move i:insert :wq:save&quit :q!:quit", 80);
+}
+
+static void free_editor() {
+    memory::free_pages(g_editor.buf, g_editor.text_pages);
+    memory::free_pages(g_editor.line_start, g_editor.line_pages);
+    g_editor.buf = nullptr;
+    g_editor.line_start = nullptr;
 }
 
-static void load_file() {
+/*
+ * Load the file into a new gap buffer and index its lines
+ * Returns false if there is no memory for them
+ */
+static bool load_file() {
     ramfs::FSNode* file = ramfs::open_file(g_editor.filename);
-    if (!file) {
-        str_copy(g_editor.status_msg, "[New File] Press i to insert text", 80);
-        return;
+    size_t size = file ? file->size : 0;
+    if (size > MAX_TEXT) {
+        size = MAX_TEXT;
+    }
+    
+    // Room for the file and a page of typing
+    g_editor.text_pages = pages_for(size + memory::PAGE_SIZE);
+    g_editor.buf = static_cast<char*>(memory::alloc_pages(g_editor.text_pages));
+    g_editor.line_pages = 1;
+    g_editor.line_start = static_cast<uint32_t*>(memory::alloc_pages(1));
+    if (!g_editor.buf || !g_editor.line_start) {
+        return false;
     }
+    g_editor.capacity = g_editor.text_pages * memory::PAGE_SIZE;
+    g_editor.line_capacity = memory::PAGE_SIZE / sizeof(uint32_t);
+    g_editor.line_start[0] = 0;
     
-    uint8_t buffer[ramfs::MAX_FILE_SIZE];
-    size_t size = ramfs::read_file(file, buffer, 0, ramfs::MAX_FILE_SIZE);
+    if (!file) {
+        klib::strlcpy(g_editor.status_msg, "[New File] Press i to insert text", 80);
+        g_editor.gap_end = g_editor.capacity;
+        return true;
+    }
     
-    g_editor.line_count = 0;
-    size_t line_pos = 0;
+    size = ramfs::read_file(file, reinterpret_cast<uint8_t*>(g_editor.buf), 0, size);
+    g_editor.save_from = size;
     
-    for (size_t i = 0; i < size && g_editor.line_count < MAX_LINES; i++) {
-        if (buffer[i] == '\n' || line_pos >= MAX_LINE_LEN - 1) {
-            g_editor.lines[g_editor.line_count][line_pos] = '\0';
-            g_editor.line_count++;
-            line_pos = 0;
-        } else if (buffer[i] != '\r') {
-            g_editor.lines[g_editor.line_count][line_pos++] = buffer[i];
+    // Drop carriage returns; the file differs from the text from there on
+    size_t length = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (g_editor.buf[i] == '\r') {
+            if (length < g_editor.save_from) g_editor.save_from = length;
+        } else {
+            g_editor.buf[length++] = g_editor.buf[i];
         }
     }
-    
-    if (line_pos > 0 || g_editor.line_count == 0) {
-        g_editor.lines[g_editor.line_count][line_pos] = '\0';
-        g_editor.line_count++;
+    // The file already holds its final '\n' at offset length, so unless a
+    // '\r' moved it, save_from stays past it
+    if (length > 0 && g_editor.buf[length - 1] == '\n') {
+        g_editor.trailing_newline = true;
+        length--;
     }
     
-    if (g_editor.line_count == 0) {
-        g_editor.line_count = 1;
-        g_editor.lines[0][0] = '\0';
+    // The text sits before the gap, which runs to the end of the buffer
+    g_editor.gap_start = length;
+    g_editor.gap_end = g_editor.capacity;
+    
+    for (size_t i = 0; i < length; i++) {
+        if (g_editor.buf[i] == '\n') {
+            if (!reserve_line()) return false;
+            g_editor.line_start[g_editor.line_count++] = static_cast<uint32_t>(i + 1);
+        }
+    }
+    return true;
+}
+
+// Write text[from, to) to file at the same offset; false on a short write
+static bool write_span(ramfs::FSNode* file, size_t from, size_t to) {
+    while (from < to) {
+        const char* data;
+        size_t n;
+        if (from < g_editor.gap_start) {
+            data = g_editor.buf + from;
+            n = (to < g_editor.gap_start ? to : g_editor.gap_start) - from;
+        } else {
+            data = g_editor.buf + from + (g_editor.gap_end - g_editor.gap_start);
+            n = to - from;
+        }
+        if (ramfs::write_file(file, reinterpret_cast<const uint8_t*>(data), from, n) != n) {
+            return false;
+        }
+        from += n;
     }
+    return true;
 }
 
 static bool save_file() {
     ramfs::FSNode* file = ramfs::open_file(g_editor.filename);
+    size_t from = g_editor.save_from;
     if (!file) {
         file = ramfs::create_file(g_editor.filename);
         if (!file) {
-            str_copy(g_editor.status_msg, "Error: Cannot create file", 80);
+            klib::strlcpy(g_editor.status_msg, "Error: Cannot create file", 80);
             return false;
         }
+        from = 0;
     }
     
-    ramfs::truncate_file(file, 0);
+    // Everything before from is already in the file
+    size_t length = text_length();
+    size_t total = length + (g_editor.trailing_newline ? 1 : 0);
+    if (from > file->size) {
+        from = file->size;
+    }
+    if (from > total) {
+        from = total;
+    }
     
-    size_t offset = 0;
-    for (size_t i = 0; i < g_editor.line_count; i++) {
-        size_t len = str_len(g_editor.lines[i]);
-        if (len > 0) {
-            ramfs::write_file(file, reinterpret_cast<const uint8_t*>(g_editor.lines[i]), 
-                             offset, len);
-            offset += len;
-        }
-        if (i < g_editor.line_count - 1) {
-            uint8_t newline = '\n';
-            ramfs::write_file(file, &newline, offset, 1);
-            offset++;
-        }
+    uint8_t newline = '\n';
+    bool ok = write_span(file, from, length);
+    if (ok && g_editor.trailing_newline && from <= length) {
+        ok = ramfs::write_file(file, &newline, length, 1) == 1;
+    }
+    if (ok && file->size > total) {
+        ok = ramfs::truncate_file(file, total);
+    }
+    if (!ok) {
+        klib::strlcpy(g_editor.status_msg, "Error: Cannot write file", 80);
+        return false;
     }
     
+    // The file now matches the text and its final '\n'
+    g_editor.save_from = total;
     g_editor.modified = false;
-    str_copy(g_editor.status_msg, "File saved!", 80);
+    
+    char msg[80];
+    klib::strlcpy(msg, "File saved! (", sizeof(msg));
+    size_t pos = put_num(msg, klib::strlen(msg), total - from);
+    klib::strlcpy(msg + pos, " bytes written)", sizeof(msg) - pos);
+    klib::strlcpy(g_editor.status_msg, msg, 80);
     return true;
 }
 
@@ -239,93 +500,182 @@ static void ensure_cursor_visible() {
         g_editor.scroll_offset = g_editor.cursor_line - EDIT_ROWS + 1;
     }
     
-    size_t line_len = str_len(g_editor.lines[g_editor.cursor_line]);
+    size_t line_len = line_length(g_editor.cursor_line);
     if (g_editor.cursor_col > line_len) {
         g_editor.cursor_col = line_len;
     }
 }
 
-static void draw_screen() {
-    hide_cursor();
-    move_cursor(0, 0);
-    
-    for (size_t row = 0; row < EDIT_ROWS; row++) {
-        size_t line_idx = g_editor.scroll_offset + row;
-        
-        if (line_idx < g_editor.line_count) {
-            print_num_padded((int)(line_idx + 1), 3);
-            uart::putc(' ');
-            
-            const char* line = g_editor.lines[line_idx];
-            size_t len = str_len(line);
-            size_t max_chars = TERM_COLS - 4;
-            
-            for (size_t i = 0; i < len && i < max_chars; i++) {
-                uart::putc(line[i]);
-            }
-        } else {
-            uart::puts("~");
-        }
-        
+// ============================================================================
+// Screen Update
+// ============================================================================
+
+/*
+ * Bring one terminal row to want (TERM_COLS bytes, space padded), sending
+ * only the span that differs from what is shown
+ */
+static void update_row(size_t row, const char* want, bool reverse) {
+    char* have = g_editor.screen[row];
+    size_t first = 0;
+    while (first < TERM_COLS && have[first] == want[first]) first++;
+    if (first == TERM_COLS) return;
+    
+    size_t last = TERM_COLS;
+    while (have[last - 1] == want[last - 1]) last--;
+    
+    // Blank to the end of the row is cheaper as an erase (not in reverse,
+    // which the erase would not paint)
+    size_t used = TERM_COLS;
+    while (used > first && want[used - 1] == ' ') used--;
+    
+    move_cursor(row, first);
+    if (reverse) {
+        set_reverse();
+        uart::write_all(want + first, last - first);
+        reset_attr();
+    } else if (used < last) {
+        uart::write_all(want + first, used - first);
         clear_line();
-        uart::puts("\r\n");
-    }
-    
-    // Status bar
-    set_reverse();
-    
-    if (g_editor.insert_mode) {
-        uart::puts(" INSERT ");
     } else {
-        uart::puts(" NORMAL ");
+        uart::write_all(want + first, last - first);
     }
-    
-    uart::puts("| ");
-    uart::puts(g_editor.filename);
-    if (g_editor.modified) {
-        uart::puts(" [+]");
+    klib::memcpy(have, want, TERM_COLS);
+}
+
+// Columns before the text: the widest line number and a space
+static size_t gutter_width() {
+    char num[20];
+    size_t width = put_num(num, 0, g_editor.line_count) + 1;
+    return width > MIN_GUTTER ? width : MIN_GUTTER;
+}
+
+// Compose the row showing text line line_idx (or '~' past the end)
+static void compose_line(size_t line_idx, size_t gutter, char* row) {
+    klib::memset(row, ' ', TERM_COLS);
+    if (line_idx >= g_editor.line_count) {
+        row[0] = '~';
+        return;
     }
     
-    size_t used = 10 + str_len(g_editor.filename) + (g_editor.modified ? 4 : 0);
-    
-    char pos_info[20];
-    int pos_len = 0;
-    pos_info[pos_len++] = 'L';
-    
-    int ln = (int)(g_editor.cursor_line + 1);
-    char tmp[8];
-    int tlen = 0;
-    do { tmp[tlen++] = '0' + (ln % 10); ln /= 10; } while (ln > 0);
-    while (tlen > 0) pos_info[pos_len++] = tmp[--tlen];
-    
-    pos_info[pos_len++] = ':';
-    pos_info[pos_len++] = 'C';
-    
-    int cn = (int)(g_editor.cursor_col + 1);
-    tlen = 0;
-    do { tmp[tlen++] = '0' + (cn % 10); cn /= 10; } while (cn > 0);
-    while (tlen > 0) pos_info[pos_len++] = tmp[--tlen];
+    // Line number, right-aligned in the gutter
+    char num[20];
+    size_t len = put_num(num, 0, line_idx + 1);
+    size_t pos = gutter - 1 - len;
+    for (size_t i = 0; i < len && pos < TERM_COLS; i++) {
+        row[pos++] = num[i];
+    }
+    pos++;
     
-    pos_info[pos_len++] = ' ';
-    pos_info[pos_len] = '\0';
+    size_t start = line_offset(line_idx);
+    size_t end = line_end(line_idx);
+    for (size_t i = start; i < end && pos < TERM_COLS; i++) {
+        row[pos++] = char_at(i);
+    }
+}
+
+static void compose_status(char* row) {
+    klib::memset(row, ' ', TERM_COLS);
+    size_t pos = 0;
+    const char* mode = g_editor.insert_mode ? " INSERT | " : " NORMAL | ";
+    for (const char* p = mode; *p; p++) row[pos++] = *p;
+    for (const char* p = g_editor.filename; *p && pos < TERM_COLS; p++) row[pos++] = *p;
+    if (g_editor.modified && pos + 4 <= TERM_COLS) {
+        klib::memcpy(row + pos, " [+]", 4);
+    }
     
-    for (size_t i = used; i < TERM_COLS - pos_len; i++) {
-        uart::putc(' ');
+    char pos_info[48];
+    size_t len = 0;
+    pos_info[len++] = 'L';
+    len = put_num(pos_info, len, g_editor.cursor_line + 1);
+    pos_info[len++] = ':';
+    pos_info[len++] = 'C';
+    len = put_num(pos_info, len, g_editor.cursor_col + 1);
+    pos_info[len++] = ' ';
+    klib::memcpy(row + TERM_COLS - len, pos_info, len);
+}
+
+/*
+ * Scroll the text rows by the change in scroll offset, when that is less
+ * than a screen; the rows that come into view are then drawn as damage
+ */
+static void scroll_screen() {
+    size_t from = g_editor.shown_scroll;
+    size_t to = g_editor.scroll_offset;
+    if (from == to) return;
+    
+    size_t delta = to > from ? to - from : from - to;
+    g_editor.shown_scroll = to;
+    if (delta >= EDIT_ROWS) {
+        mark_dirty(to, NO_LINE);
+        return;
     }
-    uart::puts(pos_info);
     
-    reset_attr();
-    uart::puts("\r\n");
+    // Scroll region = the text rows; IND at its bottom / RI at its top
+    uart::puts("\x1b[1;");
+    print_num((int)EDIT_ROWS);
+    uart::putc('r');
+    if (to > from) {
+        move_cursor(EDIT_ROWS - 1, 0);
+        for (size_t i = 0; i < delta; i++) uart::puts("\x1b" "D");
+        klib::memmove(g_editor.screen[0], g_editor.screen[delta], (EDIT_ROWS - delta) * TERM_COLS);
+        klib::memset(g_editor.screen[EDIT_ROWS - delta], ' ', delta * TERM_COLS);
+        mark_dirty(to + EDIT_ROWS - delta, to + EDIT_ROWS - 1);
+    } else {
+        move_cursor(0, 0);
+        for (size_t i = 0; i < delta; i++) uart::puts("\x1b" "M");
+        klib::memmove(g_editor.screen[delta], g_editor.screen[0], (EDIT_ROWS - delta) * TERM_COLS);
+        klib::memset(g_editor.screen[0], ' ', delta * TERM_COLS);
+        mark_dirty(to, to + delta - 1);
+    }
+    uart::puts("\x1b[r");
+}
+
+static void draw_screen() {
+    hide_cursor();
+    scroll_screen();
+    
+    // Another digit in the line numbers shifts every row
+    size_t gutter = gutter_width();
+    if (gutter != g_editor.shown_gutter) {
+        g_editor.shown_gutter = gutter;
+        mark_dirty(g_editor.scroll_offset, NO_LINE);
+    }
+    
+    // Text rows showing damaged lines
+    char row[TERM_COLS];
+    if (g_editor.dirty_first != NO_LINE) {
+        for (size_t r = 0; r < EDIT_ROWS; r++) {
+            size_t line_idx = g_editor.scroll_offset + r;
+            if (line_idx < g_editor.dirty_first || line_idx > g_editor.dirty_last) continue;
+            compose_line(line_idx, gutter, row);
+            update_row(r, row, false);
+        }
+        g_editor.dirty_first = NO_LINE;
+        g_editor.dirty_last = NO_LINE;
+    }
     
-    uart::puts(g_editor.status_msg);
-    clear_line();
+    // Status bar and message line, compared as a whole each time
+    compose_status(row);
+    update_row(STATUS_ROW, row, true);
+    klib::memset(row, ' ', TERM_COLS);
+    for (size_t i = 0; i < TERM_COLS - 1 && g_editor.status_msg[i]; i++) {
+        row[i] = g_editor.status_msg[i];
+    }
+    update_row(MESSAGE_ROW, row, false);
     
     size_t screen_row = g_editor.cursor_line - g_editor.scroll_offset;
-    size_t screen_col = g_editor.cursor_col + 4;
+    size_t screen_col = g_editor.cursor_col + gutter;
+    if (screen_col >= TERM_COLS) {
+        screen_col = TERM_COLS - 1;
+    }
     move_cursor(screen_row, screen_col);
     show_cursor();
 }
 
+// ============================================================================
+// Editing Commands
+// ============================================================================
+
 static void cursor_up() {
     if (g_editor.cursor_line > 0) {
         g_editor.cursor_line--;
@@ -347,98 +697,70 @@ static void cursor_left() {
 }
 
 static void cursor_right() {
-    size_t line_len = str_len(g_editor.lines[g_editor.cursor_line]);
-    if (g_editor.cursor_col < line_len) {
+    if (g_editor.cursor_col < line_length(g_editor.cursor_line)) {
         g_editor.cursor_col++;
     }
 }
 
 static void insert_char(char c) {
-    char* line = g_editor.lines[g_editor.cursor_line];
-    size_t len = str_len(line);
-    
-    if (len >= MAX_LINE_LEN - 1) return;
-    
-    mem_move(line + g_editor.cursor_col + 1, 
-             line + g_editor.cursor_col, 
-             len - g_editor.cursor_col + 1);
-    
-    line[g_editor.cursor_col] = c;
-    g_editor.cursor_col++;
-    g_editor.modified = true;
+    if (text_insert(g_editor.cursor_line, g_editor.cursor_col, c)) {
+        g_editor.cursor_col++;
+    }
 }
 
 static void delete_char_back() {
-    char* line = g_editor.lines[g_editor.cursor_line];
-    size_t len = str_len(line);
-    
     if (g_editor.cursor_col > 0) {
-        mem_move(line + g_editor.cursor_col - 1,
-                 line + g_editor.cursor_col,
-                 len - g_editor.cursor_col + 1);
         g_editor.cursor_col--;
-        g_editor.modified = true;
+        text_erase(g_editor.cursor_line, g_editor.cursor_col, 1);
     } else if (g_editor.cursor_line > 0) {
-        size_t prev_len = str_len(g_editor.lines[g_editor.cursor_line - 1]);
-        
-        if (prev_len + len < MAX_LINE_LEN - 1) {
-            str_copy(g_editor.lines[g_editor.cursor_line - 1] + prev_len, 
-                    line, MAX_LINE_LEN - prev_len);
-            
-            for (size_t i = g_editor.cursor_line; i < g_editor.line_count - 1; i++) {
-                str_copy(g_editor.lines[i], g_editor.lines[i + 1], MAX_LINE_LEN);
-            }
-            g_editor.line_count--;
-            
-            g_editor.cursor_line--;
-            g_editor.cursor_col = prev_len;
-            g_editor.modified = true;
-            ensure_cursor_visible();
-        }
+        // Join with the previous line by removing its newline
+        size_t prev_len = line_length(g_editor.cursor_line - 1);
+        text_erase(g_editor.cursor_line - 1, prev_len, 1);
+        g_editor.cursor_line--;
+        g_editor.cursor_col = prev_len;
+        ensure_cursor_visible();
     }
 }
 
-static void insert_newline() {
-    if (g_editor.line_count >= MAX_LINES) return;
-    
-    char* line = g_editor.lines[g_editor.cursor_line];
-    
-    for (size_t i = g_editor.line_count; i > g_editor.cursor_line + 1; i--) {
-        str_copy(g_editor.lines[i], g_editor.lines[i - 1], MAX_LINE_LEN);
+// Delete the character under the cursor, within the line
+static void delete_char_at() {
+    if (g_editor.cursor_col < line_length(g_editor.cursor_line)) {
+        text_erase(g_editor.cursor_line, g_editor.cursor_col, 1);
     }
-    g_editor.line_count++;
-    
-    str_copy(g_editor.lines[g_editor.cursor_line + 1], 
-            line + g_editor.cursor_col, MAX_LINE_LEN);
-    line[g_editor.cursor_col] = '\0';
-    
-    g_editor.cursor_line++;
-    g_editor.cursor_col = 0;
-    g_editor.modified = true;
-    ensure_cursor_visible();
 }
 
-static void delete_line() {
-    if (g_editor.line_count <= 1) {
-        g_editor.lines[0][0] = '\0';
+static void insert_newline() {
+    if (text_insert(g_editor.cursor_line, g_editor.cursor_col, '\n')) {
+        g_editor.cursor_line++;
         g_editor.cursor_col = 0;
-        g_editor.modified = true;
-        return;
+        ensure_cursor_visible();
     }
-    
-    for (size_t i = g_editor.cursor_line; i < g_editor.line_count - 1; i++) {
-        str_copy(g_editor.lines[i], g_editor.lines[i + 1], MAX_LINE_LEN);
+}
+
+static void delete_line() {
+    size_t line = g_editor.cursor_line;
+    size_t len = line_length(line);
+    if (line + 1 < g_editor.line_count) {
+        // The line and its newline
+        text_erase(line, 0, len + 1);
+    } else if (line > 0) {
+        // The last line, with the newline ending the one before
+        size_t prev_len = line_length(line - 1);
+        text_erase(line - 1, prev_len, len + 1);
+        g_editor.cursor_line--;
+    } else {
+        text_erase(line, 0, len);
     }
-    g_editor.line_count--;
     
-    if (g_editor.cursor_line >= g_editor.line_count) {
-        g_editor.cursor_line = g_editor.line_count - 1;
-    }
     g_editor.cursor_col = 0;
-    g_editor.modified = true;
     ensure_cursor_visible();
 }
 
+static void enter_insert_mode() {
+    g_editor.insert_mode = true;
+    klib::strlcpy(g_editor.status_msg, "INSERT | ESC:normal mode", 80);
+}
+
 // Check if more input is available (non-blocking)
 static bool input_available() {
     return uart::has_input();
@@ -456,7 +778,7 @@ static void process_escape() {
         // Just ESC key - exit insert mode
         if (g_editor.insert_mode) {
             g_editor.insert_mode = false;
-            str_copy(g_editor.status_msg, "NORMAL | hjkl:move i:insert :wq:save&quit", 80);
+            klib::strlcpy(g_editor.status_msg, "NORMAL | hjkl:move i:insert :wq:save&quit", 80);
             if (g_editor.cursor_col > 0) {
                 g_editor.cursor_col--;
             }
@@ -476,19 +798,12 @@ static void process_escape() {
         case 'C': cursor_right(); break;
         case 'D': cursor_left(); break;
         case 'H': g_editor.cursor_col = 0; break;
-        case 'F': g_editor.cursor_col = str_len(g_editor.lines[g_editor.cursor_line]); break;
+        case 'F': g_editor.cursor_col = line_length(g_editor.cursor_line); break;
         case '3':
             if (input_available()) {
                 c = uart::getc();
                 if (c == '~') {
-                    char* line = g_editor.lines[g_editor.cursor_line];
-                    size_t len = str_len(line);
-                    if (g_editor.cursor_col < len) {
-                        mem_move(line + g_editor.cursor_col,
-                                 line + g_editor.cursor_col + 1,
-                                 len - g_editor.cursor_col);
-                        g_editor.modified = true;
-                    }
+                    delete_char_at();
                 }
             }
             break;
@@ -500,9 +815,11 @@ static Result process_command() {
     char cmd[32];
     size_t cmd_len = 0;
     
-    move_cursor(TERM_ROWS - 1, 0);
+    // The prompt overwrites the message row; it is re-sent afterwards
+    move_cursor(MESSAGE_ROW, 0);
     clear_line();
     uart::putc(':');
+    klib::memset(g_editor.screen[MESSAGE_ROW], '?', TERM_COLS);
     
     while (true) {
         char c = uart::getc();
@@ -511,7 +828,7 @@ static Result process_command() {
             cmd[cmd_len] = '\0';
             break;
         } else if (c == '\x1b') {
-            str_copy(g_editor.status_msg, "Command cancelled", 80);
+            klib::strlcpy(g_editor.status_msg, "Command cancelled", 80);
             return Result::ERROR;
         } else if (c == '\x7f' || c == '\b') {
             if (cmd_len > 0) {
@@ -524,31 +841,35 @@ static Result process_command() {
         }
     }
     
-    if (str_cmp(cmd, "q") == 0) {
+    if (klib::strcmp(cmd, "q") == 0) {
         if (g_editor.modified) {
-            str_copy(g_editor.status_msg, "Unsaved changes! :q! to force, :wq to save", 80);
+            klib::strlcpy(g_editor.status_msg, "Unsaved changes! :q! to force, :wq to save", 80);
             return Result::ERROR;
         }
         return Result::QUIT;
-    } else if (str_cmp(cmd, "q!") == 0) {
+    } else if (klib::strcmp(cmd, "q!") == 0) {
         return Result::QUIT;
-    } else if (str_cmp(cmd, "w") == 0) {
+    } else if (klib::strcmp(cmd, "w") == 0) {
         save_file();
         return Result::ERROR;
-    } else if (str_cmp(cmd, "wq") == 0 || str_cmp(cmd, "x") == 0) {
+    } else if (klib::strcmp(cmd, "wq") == 0 || klib::strcmp(cmd, "x") == 0) {
         if (save_file()) {
             return Result::SAVED;
         }
         return Result::ERROR;
     } else {
-        str_copy(g_editor.status_msg, "Unknown command. Try :w :q :wq :q!", 80);
+        klib::strlcpy(g_editor.status_msg, "Unknown command. Try :w :q :wq :q!", 80);
         return Result::ERROR;
     }
 }
 
 Result edit(const char* filename) {
     init_editor(filename);
-    load_file();
+    if (!load_file()) {
+        free_editor();
+        uart::puts("vi: out of memory\n");
+        return Result::ERROR;
+    }
     
     clear_screen();
     
@@ -586,56 +907,37 @@ Result edit(const char* filename) {
                     break;
                 
                 case 'i':
-                    g_editor.insert_mode = true;
-                    str_copy(g_editor.status_msg, "INSERT | ESC:normal mode", 80);
+                    enter_insert_mode();
                     break;
                 
                 case 'a':
-                    g_editor.insert_mode = true;
-                    str_copy(g_editor.status_msg, "INSERT | ESC:normal mode", 80);
+                    enter_insert_mode();
                     cursor_right();
                     break;
                 
                 case 'A':
-                    g_editor.cursor_col = str_len(g_editor.lines[g_editor.cursor_line]);
-                    g_editor.insert_mode = true;
-                    str_copy(g_editor.status_msg, "INSERT | ESC:normal mode", 80);
+                    g_editor.cursor_col = line_length(g_editor.cursor_line);
+                    enter_insert_mode();
                     break;
                 
                 case 'o':
-                    g_editor.cursor_col = str_len(g_editor.lines[g_editor.cursor_line]);
+                    g_editor.cursor_col = line_length(g_editor.cursor_line);
                     insert_newline();
-                    g_editor.insert_mode = true;
-                    str_copy(g_editor.status_msg, "INSERT | ESC:normal mode", 80);
+                    enter_insert_mode();
                     break;
                 
                 case 'O':
-                    if (g_editor.line_count < MAX_LINES) {
-                        for (size_t i = g_editor.line_count; i > g_editor.cursor_line; i--) {
-                            str_copy(g_editor.lines[i], g_editor.lines[i - 1], MAX_LINE_LEN);
-                        }
-                        g_editor.lines[g_editor.cursor_line][0] = '\0';
-                        g_editor.line_count++;
+                    if (text_insert(g_editor.cursor_line, 0, '\n')) {
                         g_editor.cursor_col = 0;
-                        g_editor.modified = true;
-                        g_editor.insert_mode = true;
-                        str_copy(g_editor.status_msg, "INSERT | ESC:normal mode", 80);
+                        enter_insert_mode();
                     }
                     break;
                 
                 case 'x':
-                    {
-                        char* line = g_editor.lines[g_editor.cursor_line];
-                        size_t len = str_len(line);
-                        if (len > 0 && g_editor.cursor_col < len) {
-                            mem_move(line + g_editor.cursor_col,
-                                     line + g_editor.cursor_col + 1,
-                                     len - g_editor.cursor_col);
-                            g_editor.modified = true;
-                            if (g_editor.cursor_col >= str_len(line) && g_editor.cursor_col > 0) {
-                                g_editor.cursor_col--;
-                            }
-                        }
+                    delete_char_at();
+                    if (g_editor.cursor_col >= line_length(g_editor.cursor_line) &&
+                        g_editor.cursor_col > 0) {
+                        g_editor.cursor_col--;
                     }
                     break;
                 
@@ -667,7 +969,7 @@ Result edit(const char* filename) {
                 
                 case '$':
                     {
-                        size_t len = str_len(g_editor.lines[g_editor.cursor_line]);
+                        size_t len = line_length(g_editor.cursor_line);
                         g_editor.cursor_col = len > 0 ? len - 1 : 0;
                     }
                     break;
@@ -677,6 +979,7 @@ Result edit(const char* filename) {
                         Result result = process_command();
                         if (result == Result::SAVED || result == Result::QUIT) {
                             clear_screen();
+                            free_editor();
                             return result;
                         }
                     }
@@ -685,5 +988,5 @@ Result edit(const char* filename) {
         }
     }
 }
-
+    
 } // namespace editor
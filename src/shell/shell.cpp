@@ -8,6 +8,10 @@
 #include "shell.h"
 #include "uart.h"
 #include "ramfs.h"
+#include "klib.h"
+#include "slab.h"
+#include "sched.h"
+#include "stream.h"
 
 namespace shell {
 
@@ -74,60 +78,6 @@ static History g_history;
 static Alias g_aliases[MAX_ALIASES];
 static EnvVar g_env_vars[MAX_ENV_VARS];
 
-// Process table
-static ProcessInfo g_processes[MAX_PROCESSES];
-static int g_next_pid = 1;
-static int g_current_pid = 0;
-
-// ============================================================================
-// String Utilities (no standard library)
-// ============================================================================
-
-static size_t str_len(const char* s) {
-    size_t len = 0;
-    while (s[len]) len++;
-    return len;
-}
-
-static int str_cmp(const char* a, const char* b) {
-    while (*a && *b && *a == *b) {
-        a++;
-        b++;
-    }
-    return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
-}
-
-static void str_copy(char* dst, const char* src, size_t max_len) {
-    size_t i = 0;
-    while (i < max_len - 1 && src[i]) {
-        dst[i] = src[i];
-        i++;
-    }
-    dst[i] = '\0';
-}
-
-static void mem_set(void* ptr, int value, size_t size) {
-    char* p = static_cast<char*>(ptr);
-    for (size_t i = 0; i < size; i++) {
-        p[i] = static_cast<char>(value);
-    }
-}
-
-static void mem_move(void* dst, const void* src, size_t size) {
-    char* d = static_cast<char*>(dst);
-    const char* s = static_cast<const char*>(src);
-    
-    if (d < s) {
-        for (size_t i = 0; i < size; i++) {
-            d[i] = s[i];
-        }
-    } else {
-        for (size_t i = size; i > 0; i--) {
-            d[i-1] = s[i-1];
-        }
-    }
-}
-
 // ============================================================================
 // Command Parser Implementation
 // Requirements: 5.2
@@ -193,7 +143,7 @@ void register_command(const char* name, const char* help, CommandHandler handler
     
     // Check for duplicate
     for (size_t i = 0; i < g_command_count; i++) {
-        if (str_cmp(g_commands[i].name, name) == 0) {
+        if (klib::strcmp(g_commands[i].name, name) == 0) {
             uart::printf("[shell] Warning: command '%s' already registered\n", name);
             return;
         }
@@ -212,7 +162,7 @@ void register_command(const char* name, const char* help, CommandHandler handler
  */
 CommandHandler lookup_command(const char* name) {
     for (size_t i = 0; i < g_command_count; i++) {
-        if (str_cmp(g_commands[i].name, name) == 0) {
+        if (klib::strcmp(g_commands[i].name, name) == 0) {
             return g_commands[i].handler;
         }
     }
@@ -224,7 +174,7 @@ CommandHandler lookup_command(const char* name) {
  */
 const char* get_command_help(const char* name) {
     for (size_t i = 0; i < g_command_count; i++) {
-        if (str_cmp(g_commands[i].name, name) == 0) {
+        if (klib::strcmp(g_commands[i].name, name) == 0) {
             return g_commands[i].help;
         }
     }
@@ -264,25 +214,34 @@ constexpr char CTRL_U = '\x15';
  * Clear the line editor buffer
  */
 static void editor_clear() {
-    mem_set(g_editor.buffer, 0, MAX_CMD_LEN);
+    klib::memset(g_editor.buffer, 0, MAX_CMD_LEN);
     g_editor.cursor = 0;
     g_editor.length = 0;
 }
 
+/*
+ * Write a character n times in one bulk write
+ */
+static void emit_repeat(char c, size_t n) {
+    char run[32];
+    klib::memset(run, c, sizeof(run));
+    while (n > 0) {
+        size_t chunk = (n < sizeof(run)) ? n : sizeof(run);
+        uart::write_all(run, chunk);
+        n -= chunk;
+    }
+}
+
 /*
  * Redraw the current line from cursor position
  */
 static void editor_redraw_from_cursor() {
-    // Print characters from cursor to end
-    for (size_t i = g_editor.cursor; i < g_editor.length; i++) {
-        uart::putc(g_editor.buffer[i]);
-    }
-    // Clear any remaining characters (in case of deletion)
+    // Print characters from cursor to end, then clear any remaining
+    // character (in case of deletion)
+    uart::write_all(&g_editor.buffer[g_editor.cursor], g_editor.length - g_editor.cursor);
     uart::putc(' ');
     // Move cursor back to correct position
-    for (size_t i = g_editor.cursor; i <= g_editor.length; i++) {
-        uart::putc('\b');
-    }
+    emit_repeat('\b', g_editor.length - g_editor.cursor + 1);
 }
 
 /*
@@ -295,7 +254,7 @@ static void editor_insert_char(char c) {
     
     // Shift characters right to make room
     if (g_editor.cursor < g_editor.length) {
-        mem_move(&g_editor.buffer[g_editor.cursor + 1],
+        klib::memmove(&g_editor.buffer[g_editor.cursor + 1],
                  &g_editor.buffer[g_editor.cursor],
                  g_editor.length - g_editor.cursor);
     }
@@ -322,7 +281,7 @@ static void editor_backspace() {
     }
     
     // Shift characters left
-    mem_move(&g_editor.buffer[g_editor.cursor - 1],
+    klib::memmove(&g_editor.buffer[g_editor.cursor - 1],
              &g_editor.buffer[g_editor.cursor],
              g_editor.length - g_editor.cursor + 1);
     
@@ -343,7 +302,7 @@ static void editor_delete() {
     }
     
     // Shift characters left
-    mem_move(&g_editor.buffer[g_editor.cursor],
+    klib::memmove(&g_editor.buffer[g_editor.cursor],
              &g_editor.buffer[g_editor.cursor + 1],
              g_editor.length - g_editor.cursor);
     
@@ -377,20 +336,16 @@ static void editor_cursor_right() {
  * Move cursor to beginning of line
  */
 static void editor_cursor_home() {
-    while (g_editor.cursor > 0) {
-        uart::putc('\b');
-        g_editor.cursor--;
-    }
+    emit_repeat('\b', g_editor.cursor);
+    g_editor.cursor = 0;
 }
 
 /*
  * Move cursor to end of line
  */
 static void editor_cursor_end() {
-    while (g_editor.cursor < g_editor.length) {
-        uart::putc(g_editor.buffer[g_editor.cursor]);
-        g_editor.cursor++;
-    }
+    uart::write_all(&g_editor.buffer[g_editor.cursor], g_editor.length - g_editor.cursor);
+    g_editor.cursor = g_editor.length;
 }
 
 /*
@@ -400,12 +355,8 @@ static void editor_clear_line() {
     // Move to beginning
     editor_cursor_home();
     // Clear display
-    for (size_t i = 0; i < g_editor.length; i++) {
-        uart::putc(' ');
-    }
-    for (size_t i = 0; i < g_editor.length; i++) {
-        uart::putc('\b');
-    }
+    emit_repeat(' ', g_editor.length);
+    emit_repeat('\b', g_editor.length);
     // Reset buffer
     editor_clear();
 }
@@ -415,8 +366,8 @@ static void editor_clear_line() {
  */
 static void editor_set_line(const char* line) {
     editor_clear_line();
-    str_copy(g_editor.buffer, line, MAX_CMD_LEN);
-    g_editor.length = str_len(g_editor.buffer);
+    klib::strlcpy(g_editor.buffer, line, MAX_CMD_LEN);
+    g_editor.length = klib::strlen(g_editor.buffer);
     g_editor.cursor = g_editor.length;
     uart::puts(g_editor.buffer);
 }
@@ -430,7 +381,7 @@ static void editor_set_line(const char* line) {
  * Initialize history
  */
 static void history_init() {
-    mem_set(&g_history, 0, sizeof(g_history));
+    klib::memset(&g_history, 0, sizeof(g_history));
     g_history.count = 0;
     g_history.current = -1;
 }
@@ -447,14 +398,14 @@ static void history_add(const char* cmd) {
     // Don't add duplicate of last command
     if (g_history.count > 0) {
         size_t last = (g_history.count - 1) % HISTORY_SIZE;
-        if (str_cmp(g_history.entries[last], cmd) == 0) {
+        if (klib::strcmp(g_history.entries[last], cmd) == 0) {
             return;
         }
     }
     
     // Add to history (circular buffer)
     size_t index = g_history.count % HISTORY_SIZE;
-    str_copy(g_history.entries[index], cmd, MAX_CMD_LEN);
+    klib::strlcpy(g_history.entries[index], cmd, MAX_CMD_LEN);
     
     if (g_history.count < HISTORY_SIZE) {
         g_history.count++;
@@ -549,8 +500,8 @@ static void alias_init() {
 bool add_alias(const char* name, const char* value) {
     // Check if alias exists
     for (size_t i = 0; i < MAX_ALIASES; i++) {
-        if (g_aliases[i].active && str_cmp(g_aliases[i].name, name) == 0) {
-            str_copy(g_aliases[i].value, value, MAX_CMD_LEN);
+        if (g_aliases[i].active && klib::strcmp(g_aliases[i].name, name) == 0) {
+            klib::strlcpy(g_aliases[i].value, value, MAX_CMD_LEN);
             return true;
         }
     }
@@ -558,8 +509,8 @@ bool add_alias(const char* name, const char* value) {
     // Find empty slot
     for (size_t i = 0; i < MAX_ALIASES; i++) {
         if (!g_aliases[i].active) {
-            str_copy(g_aliases[i].name, name, MAX_VAR_NAME);
-            str_copy(g_aliases[i].value, value, MAX_CMD_LEN);
+            klib::strlcpy(g_aliases[i].name, name, MAX_VAR_NAME);
+            klib::strlcpy(g_aliases[i].value, value, MAX_CMD_LEN);
             g_aliases[i].active = true;
             return true;
         }
@@ -573,7 +524,7 @@ bool add_alias(const char* name, const char* value) {
  */
 bool remove_alias(const char* name) {
     for (size_t i = 0; i < MAX_ALIASES; i++) {
-        if (g_aliases[i].active && str_cmp(g_aliases[i].name, name) == 0) {
+        if (g_aliases[i].active && klib::strcmp(g_aliases[i].name, name) == 0) {
             g_aliases[i].active = false;
             return true;
         }
@@ -586,7 +537,7 @@ bool remove_alias(const char* name) {
  */
 const char* get_alias(const char* name) {
     for (size_t i = 0; i < MAX_ALIASES; i++) {
-        if (g_aliases[i].active && str_cmp(g_aliases[i].name, name) == 0) {
+        if (g_aliases[i].active && klib::strcmp(g_aliases[i].name, name) == 0) {
             return g_aliases[i].value;
         }
     }
@@ -619,8 +570,8 @@ static void env_init() {
 bool set_env(const char* name, const char* value) {
     // Check if var exists
     for (size_t i = 0; i < MAX_ENV_VARS; i++) {
-        if (g_env_vars[i].active && str_cmp(g_env_vars[i].name, name) == 0) {
-            str_copy(g_env_vars[i].value, value, MAX_VAR_VALUE);
+        if (g_env_vars[i].active && klib::strcmp(g_env_vars[i].name, name) == 0) {
+            klib::strlcpy(g_env_vars[i].value, value, MAX_VAR_VALUE);
             return true;
         }
     }
@@ -628,8 +579,8 @@ bool set_env(const char* name, const char* value) {
     // Find empty slot
     for (size_t i = 0; i < MAX_ENV_VARS; i++) {
         if (!g_env_vars[i].active) {
-            str_copy(g_env_vars[i].name, name, MAX_VAR_NAME);
-            str_copy(g_env_vars[i].value, value, MAX_VAR_VALUE);
+            klib::strlcpy(g_env_vars[i].name, name, MAX_VAR_NAME);
+            klib::strlcpy(g_env_vars[i].value, value, MAX_VAR_VALUE);
             g_env_vars[i].active = true;
             return true;
         }
@@ -643,7 +594,7 @@ bool set_env(const char* name, const char* value) {
  */
 const char* get_env(const char* name) {
     for (size_t i = 0; i < MAX_ENV_VARS; i++) {
-        if (g_env_vars[i].active && str_cmp(g_env_vars[i].name, name) == 0) {
+        if (g_env_vars[i].active && klib::strcmp(g_env_vars[i].name, name) == 0) {
             return g_env_vars[i].value;
         }
     }
@@ -655,7 +606,7 @@ const char* get_env(const char* name) {
  */
 bool unset_env(const char* name) {
     for (size_t i = 0; i < MAX_ENV_VARS; i++) {
-        if (g_env_vars[i].active && str_cmp(g_env_vars[i].name, name) == 0) {
+        if (g_env_vars[i].active && klib::strcmp(g_env_vars[i].name, name) == 0) {
             g_env_vars[i].active = false;
             return true;
         }
@@ -826,6 +777,142 @@ static bool read_line() {
     }
 }
 
+// ============================================================================
+// Background Jobs and Pipeline Stages
+// ============================================================================
+
+/*
+ * A command line copied out of the shell's buffers for another task
+ * A background job frees itself; a pipeline stage sets done and the shell
+ * frees it
+ */
+struct Job {
+    CommandHandler handler;
+    int argc;
+    char* argv[MAX_ARGS];
+    char line[MAX_CMD_LEN];     // Arguments, NUL-separated
+    size_t length;              // Bytes of line in use
+    bool piped;                 // A pipeline stage, using io
+    stream::Io io;
+    volatile bool done;
+};
+
+static void job_main(void* arg) {
+    Job* job = static_cast<Job*>(arg);
+    if (job->piped) {
+        sched::set_io(&job->io);
+        job->handler(job->argc, job->argv);
+        sched::set_io(nullptr);
+        stream::close(&job->io.in);
+        stream::close(&job->io.out);
+        job->done = true;
+        return;
+    }
+    job->handler(job->argc, job->argv);
+    
+    // Join the arguments with spaces again for the report
+    for (size_t i = 0; i + 1 < job->length; i++) {
+        if (job->line[i] == '\0') job->line[i] = ' ';
+    }
+    uart::printf("\n[%d] Done: %s\n", sched::current_pid(), job->line);
+    slab::kfree(job, sizeof(Job));
+}
+
+/*
+ * Allocate a job and pack the arguments NUL-separated into its own line
+ * buffer; returns nullptr if no memory is available
+ */
+static Job* make_job(CommandHandler handler, int argc, char* argv[]) {
+    Job* job = static_cast<Job*>(slab::kmalloc(sizeof(Job)));
+    if (!job) {
+        return nullptr;
+    }
+    
+    job->handler = handler;
+    job->argc = 0;
+    size_t used = 0;
+    for (int i = 0; i < argc && i < static_cast<int>(MAX_ARGS); i++) {
+        size_t len = klib::strlen(argv[i]);
+        if (used + len + 1 > MAX_CMD_LEN) break;
+        klib::memcpy(job->line + used, argv[i], len + 1);
+        job->argv[job->argc++] = job->line + used;
+        used += len + 1;
+    }
+    job->length = used;
+    job->piped = false;
+    job->io.in = stream::console();
+    job->io.out = stream::console();
+    job->done = false;
+    return job;
+}
+
+/*
+ * Run a pipeline: every stage but the last in a task of its own, the last
+ * in the shell task, writing to out (which is closed here)
+ * The shell waits until every stage has finished
+ */
+static void run_pipeline(int stages, CommandHandler handlers[], int argcs[], char** argvs[],
+                         stream::Stream out) {
+    Job* jobs[MAX_PIPELINE];
+    int started = 0;
+    bool ok = true;
+    
+    // in is the read end feeding the next stage
+    stream::Stream in = stream::console();
+    for (int s = 0; s < stages - 1; s++) {
+        stream::Stream read_end, write_end;
+        if (!stream::pipe(&read_end, &write_end)) {
+            uart::puts("Cannot create pipe: out of memory\n");
+            ok = false;
+            break;
+        }
+        Job* job = make_job(handlers[s], argcs[s], argvs[s]);
+        if (!job) {
+            uart::puts("Cannot start pipeline: out of memory\n");
+            stream::close(&read_end);
+            stream::close(&write_end);
+            ok = false;
+            break;
+        }
+        job->piped = true;
+        job->io.in = in;
+        job->io.out = write_end;
+        in = read_end;
+        
+        char name[sched::MAX_TASK_NAME];
+        klib::strlcpy(name, "[pipe] ", sizeof(name));
+        klib::strlcpy(name + 7, argvs[s][0], sizeof(name) - 7);
+        if (sched::spawn(name, job_main, job) < 0) {
+            uart::puts("Cannot start pipeline: too many tasks\n");
+            stream::close(&job->io.in);
+            stream::close(&job->io.out);
+            slab::kfree(job, sizeof(Job));
+            ok = false;
+            break;
+        }
+        jobs[started++] = job;
+    }
+    
+    if (ok) {
+        stream::Io io;
+        io.in = in;
+        io.out = out;
+        sched::set_io(&io);
+        handlers[stages - 1](argcs[stages - 1], argvs[stages - 1]);
+        sched::set_io(nullptr);
+    }
+    
+    // Closing the last read end lets writers still blocked upstream finish
+    stream::close(&in);
+    stream::close(&out);
+    for (int s = 0; s < started; s++) {
+        while (!jobs[s]->done) {
+            sched::sleep_ms(1);
+        }
+        slab::kfree(jobs[s], sizeof(Job));
+    }
+}
+
 // ============================================================================
 // Shell Main Loop
 // Requirements: 5.1
@@ -842,63 +929,125 @@ static void display_prompt() {
     uart::puts("> ");
 }
 
+/*
+ * Expand an alias in argv[0] into buffer, re-parsing argv from it
+ * Returns the new argc
+ */
+static int expand_alias(int argc, char* argv[], char* buffer) {
+    const char* alias_value = get_alias(argv[0]);
+    if (!alias_value) {
+        return argc;
+    }
+    
+    // Create expanded command line
+    klib::strlcpy(buffer, alias_value, MAX_CMD_LEN);
+    
+    // Append remaining arguments
+    for (int i = 1; i < argc; i++) {
+        size_t len = klib::strlen(buffer);
+        if (len < MAX_CMD_LEN - 2) {
+            buffer[len] = ' ';
+            klib::strlcpy(buffer + len + 1, argv[i], MAX_CMD_LEN - len - 1);
+        }
+    }
+    
+    // Re-parse expanded command
+    return parse_command(buffer, argv, MAX_ARGS);
+}
+
 /*
  * Execute a command line
+ * Commands separated by '|' run as a pipeline, and the line may end with
+ * '> file' or '>> file' to write the last command's output to a file
  */
 static void execute_command(char* cmdline) {
-    char* argv[MAX_ARGS];
-    int argc = parse_command(cmdline, argv, MAX_ARGS);
+    // Split off a redirection, which must be the last thing on the line
+    const char* target = nullptr;
+    bool append = false;
+    for (char* p = cmdline; *p; p++) {
+        if (*p != '>') continue;
+        *p++ = '\0';
+        if (*p == '>') {
+            append = true;
+            p++;
+        }
+        char* rest[2];
+        if (parse_command(p, rest, 2) != 1 || rest[0][0] == '>') {
+            uart::puts("Syntax error: expected one file name after '>'\n");
+            return;
+        }
+        target = rest[0];
+        break;
+    }
     
-    if (argc == 0) {
-        return;  // Empty command
+    // Split into pipeline stages
+    char* segments[MAX_PIPELINE];
+    int stages = 0;
+    segments[stages++] = cmdline;
+    for (char* p = cmdline; *p; p++) {
+        if (*p != '|') continue;
+        if (stages == static_cast<int>(MAX_PIPELINE)) {
+            uart::printf("Pipeline too long (at most %d commands)\n", (int)MAX_PIPELINE);
+            return;
+        }
+        *p = '\0';
+        segments[stages++] = p + 1;
     }
     
-    // Check for alias expansion
-    const char* alias_value = get_alias(argv[0]);
-    if (alias_value) {
-        // Create expanded command line
-        static char expanded[MAX_CMD_LEN];
-        str_copy(expanded, alias_value, MAX_CMD_LEN);
-        
-        // Append remaining arguments
-        for (int i = 1; i < argc; i++) {
-            size_t len = str_len(expanded);
-            if (len < MAX_CMD_LEN - 2) {
-                expanded[len] = ' ';
-                str_copy(expanded + len + 1, argv[i], MAX_CMD_LEN - len - 1);
+    static char expanded[MAX_PIPELINE][MAX_CMD_LEN];
+    char* argvs[MAX_PIPELINE][MAX_ARGS];
+    char** argv_ptrs[MAX_PIPELINE];
+    int argcs[MAX_PIPELINE];
+    CommandHandler handlers[MAX_PIPELINE];
+    for (int s = 0; s < stages; s++) {
+        argcs[s] = parse_command(segments[s], argvs[s], MAX_ARGS);
+        if (argcs[s] > 0) {
+            argcs[s] = expand_alias(argcs[s], argvs[s], expanded[s]);
+        }
+        if (argcs[s] == 0) {
+            if (stages == 1 && !target) {
+                return;  // Empty command
             }
+            uart::puts("Syntax error: missing command\n");
+            return;
         }
-        
-        // Re-parse expanded command
-        argc = parse_command(expanded, argv, MAX_ARGS);
-        if (argc == 0) return;
+        argv_ptrs[s] = argvs[s];
     }
     
-    // Look up command
-    CommandHandler handler = lookup_command(argv[0]);
+    // A trailing '&' runs the command in a background task
+    int last = stages - 1;
+    if (klib::strcmp(argvs[last][argcs[last] - 1], "&") == 0) {
+        if (stages > 1 || target) {
+            uart::puts("Pipelines and redirections cannot run in the background\n");
+            return;
+        }
+        if (argcs[last] > 1) {
+            run_background(argcs[last] - 1, argvs[last]);
+            return;
+        }
+    }
     
-    if (handler) {
-        handler(argc, argv);
-    } else {
-        // Requirements: 5.4 - display error for invalid command
-        uart::printf("Unknown command: %s. Type 'help' for available commands.\n", argv[0]);
+    // Look up commands
+    for (int s = 0; s < stages; s++) {
+        handlers[s] = lookup_command(argvs[s][0]);
+        if (!handlers[s]) {
+            // Requirements: 5.4 - display error for invalid command
+            uart::printf("Unknown command: %s. Type 'help' for available commands.\n", argvs[s][0]);
+            return;
+        }
     }
-}
-
-// ============================================================================
-// Process Management
-// ============================================================================
-
-/*
- * Initialize process table
- */
-static void process_init() {
-    for (size_t i = 0; i < MAX_PROCESSES; i++) {
-        g_processes[i].state = ProcessState::FREE;
-        g_processes[i].pid = 0;
+    
+    if (stages == 1 && !target) {
+        handlers[0](argcs[0], argvs[0]);
+        return;
     }
-    g_next_pid = 1;
-    g_current_pid = 0;
+    
+    stream::Stream out = stream::console();
+    if (target && !stream::open_output(target, append, &out)) {
+        uart::printf("Cannot write to %s\n", target);
+        return;
+    }
+    run_pipeline(stages, handlers, argcs, argv_ptrs, out);
 }
 
 /*
@@ -918,9 +1067,6 @@ void init() {
     // Initialize environment
     env_init();
     
-    // Initialize process table
-    process_init();
-    
     // Reset command registry
     g_command_count = 0;
     
@@ -954,102 +1100,33 @@ void run() {
 }
 
 /*
- * Create a new process
- */
-int create_process(const char* name) {
-    for (size_t i = 0; i < MAX_PROCESSES; i++) {
-        if (g_processes[i].state == ProcessState::FREE) {
-            g_processes[i].pid = g_next_pid++;
-            g_processes[i].state = ProcessState::RUNNING;
-            str_copy(g_processes[i].name, name, 32);
-            g_processes[i].start_time = 0;  // Will be set by caller
-            g_processes[i].cpu_time = 0;
-            g_processes[i].memory = 0;
-            return g_processes[i].pid;
-        }
-    }
-    return -1;  // No free slots
-}
-
-/*
- * Destroy a process
- */
-void destroy_process(int pid) {
-    for (size_t i = 0; i < MAX_PROCESSES; i++) {
-        if (g_processes[i].pid == pid && g_processes[i].state != ProcessState::FREE) {
-            g_processes[i].state = ProcessState::FREE;
-            g_processes[i].pid = 0;
-            return;
-        }
-    }
-}
-
-/*
- * Update process state
+ * Run a parsed command line in a background task
  */
-void update_process(int pid, ProcessState state, uint32_t cpu_delta) {
-    for (size_t i = 0; i < MAX_PROCESSES; i++) {
-        if (g_processes[i].pid == pid) {
-            g_processes[i].state = state;
-            g_processes[i].cpu_time += cpu_delta;
-            return;
-        }
-    }
-}
-
-/*
- * Get process by PID
- */
-ProcessInfo* get_process(int pid) {
-    for (size_t i = 0; i < MAX_PROCESSES; i++) {
-        if (g_processes[i].pid == pid && g_processes[i].state != ProcessState::FREE) {
-            return &g_processes[i];
-        }
+int run_background(int argc, char* argv[]) {
+    CommandHandler handler = lookup_command(argv[0]);
+    if (!handler) {
+        uart::printf("Unknown command: %s. Type 'help' for available commands.\n", argv[0]);
+        return -1;
     }
-    return nullptr;
-}
-
-/*
- * Get process count
- */
-int get_process_count() {
-    int count = 0;
-    for (size_t i = 0; i < MAX_PROCESSES; i++) {
-        if (g_processes[i].state != ProcessState::FREE) {
-            count++;
-        }
+    
+    Job* job = make_job(handler, argc, argv);
+    if (!job) {
+        uart::puts("Cannot start background job: out of memory\n");
+        return -1;
     }
-    return count;
-}
-
-/*
- * Get process by index
- */
-ProcessInfo* get_process_by_index(int index) {
-    int count = 0;
-    for (size_t i = 0; i < MAX_PROCESSES; i++) {
-        if (g_processes[i].state != ProcessState::FREE) {
-            if (count == index) {
-                return &g_processes[i];
-            }
-            count++;
-        }
+    
+    char name[sched::MAX_TASK_NAME];
+    klib::strlcpy(name, "[bg] ", sizeof(name));
+    klib::strlcpy(name + 5, argv[0], sizeof(name) - 5);
+    
+    int pid = sched::spawn(name, job_main, job);
+    if (pid < 0) {
+        slab::kfree(job, sizeof(Job));
+        uart::puts("Cannot start background job: too many tasks\n");
+        return -1;
     }
-    return nullptr;
-}
-
-/*
- * Get current PID
- */
-int get_current_pid() {
-    return g_current_pid;
-}
-
-/*
- * Set current PID
- */
-void set_current_pid(int pid) {
-    g_current_pid = pid;
+    uart::printf("[%d] %s\n", pid, argv[0]);
+    return pid;
 }
 
 } // namespace shell
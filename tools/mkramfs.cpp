@@ -0,0 +1,174 @@
+/*
+ * EmberOS RAMFS Image Packer
+ * Host tool: packs directories into a boot image (see ramfs_image.h)
+ *
+ * Usage: mkramfs <output> <dir>...
+ *
+ * Each directory is added under its own name at the root, so with
+ * "mkramfs ramfs.img examples" examples/hello.asm boots as
+ * /examples/hello.asm. Entries are sorted so the same tree always packs
+ * to the same bytes; names starting with '.' are skipped.
+ */
+
+#include "ramfs_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Limits of the kernel's ramfs (ramfs.h), checked here so a bad tree
+// fails the build instead of the boot
+constexpr size_t MAX_FILENAME = 64;
+constexpr size_t MAX_PATH = 256;
+constexpr size_t MAX_FILES = 1024;
+constexpr size_t MAX_FILE_SIZE = 65536;
+
+struct Entry {
+    uint32_t type;
+    std::string path;           // Relative to the image root
+    std::vector<uint8_t> data;
+};
+
+static std::vector<Entry> g_entries;
+
+static bool read_file(const std::string& host_path, std::vector<uint8_t>* data) {
+    FILE* f = std::fopen(host_path.c_str(), "rb");
+    if (!f) return false;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) {
+        data->insert(data->end(), buf, buf + n);
+    }
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    return ok;
+}
+
+// Add host_dir as path, then everything below it
+static bool add_dir(const std::string& host_dir, const std::string& path) {
+    g_entries.push_back(Entry{ramfs::IMAGE_DIR, path, {}});
+
+    DIR* dir = opendir(host_dir.c_str());
+    if (!dir) {
+        std::fprintf(stderr, "mkramfs: cannot open %s\n", host_dir.c_str());
+        return false;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* d = readdir(dir)) {
+        if (d->d_name[0] != '.') names.push_back(d->d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    for (const std::string& name : names) {
+        std::string host_path = host_dir + "/" + name;
+        std::string child = path + "/" + name;
+        if (name.size() >= MAX_FILENAME || child.size() + 1 >= MAX_PATH) {
+            std::fprintf(stderr, "mkramfs: %s: name too long\n", host_path.c_str());
+            return false;
+        }
+
+        struct stat st;
+        if (stat(host_path.c_str(), &st) != 0) {
+            std::fprintf(stderr, "mkramfs: cannot stat %s\n", host_path.c_str());
+            return false;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            if (!add_dir(host_path, child)) return false;
+        } else if (S_ISREG(st.st_mode)) {
+            Entry entry{ramfs::IMAGE_FILE, child, {}};
+            if (!read_file(host_path, &entry.data)) {
+                std::fprintf(stderr, "mkramfs: cannot read %s\n", host_path.c_str());
+                return false;
+            }
+            if (entry.data.size() > MAX_FILE_SIZE) {
+                std::fprintf(stderr, "mkramfs: %s: larger than %zu bytes\n",
+                             host_path.c_str(), MAX_FILE_SIZE);
+                return false;
+            }
+            g_entries.push_back(entry);
+        }
+    }
+    return true;
+}
+
+// Fields are written byte by byte so the image is little-endian on any host
+static void put32(std::vector<uint8_t>* out, size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        (*out)[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static void align(std::vector<uint8_t>* out) {
+    out->resize((out->size() + ramfs::IMAGE_ALIGN - 1) & ~(size_t)(ramfs::IMAGE_ALIGN - 1), 0);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: mkramfs <output> <dir>...\n");
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        std::string dir = argv[i];
+        while (dir.size() > 1 && dir.back() == '/') dir.pop_back();
+        size_t slash = dir.rfind('/');
+        std::string name = slash == std::string::npos ? dir : dir.substr(slash + 1);
+        if (name.empty() || name == "." || name == "..") {
+            std::fprintf(stderr, "mkramfs: %s: cannot name a directory after it\n", argv[i]);
+            return 1;
+        }
+        if (!add_dir(dir, name)) return 1;
+    }
+    if (g_entries.size() > MAX_FILES - 1) {
+        std::fprintf(stderr, "mkramfs: %zu entries, ramfs holds %zu\n",
+                     g_entries.size(), MAX_FILES - 1);
+        return 1;
+    }
+
+    // Header and entry table, then names, then data
+    std::vector<uint8_t> out(sizeof(ramfs::ImageHeader) +
+                             g_entries.size() * sizeof(ramfs::ImageEntry), 0);
+    std::vector<uint32_t> name_offsets;
+    for (const Entry& entry : g_entries) {
+        name_offsets.push_back(static_cast<uint32_t>(out.size()));
+        out.insert(out.end(), entry.path.begin(), entry.path.end());
+        out.push_back(0);
+    }
+
+    size_t files = 0;
+    for (size_t i = 0; i < g_entries.size(); i++) {
+        const Entry& entry = g_entries[i];
+        uint32_t data_offset = 0;
+        if (entry.type == ramfs::IMAGE_FILE) {
+            align(&out);
+            data_offset = static_cast<uint32_t>(out.size());
+            out.insert(out.end(), entry.data.begin(), entry.data.end());
+            files++;
+        }
+        size_t at = sizeof(ramfs::ImageHeader) + i * sizeof(ramfs::ImageEntry);
+        put32(&out, at + 0, entry.type);
+        put32(&out, at + 4, name_offsets[i]);
+        put32(&out, at + 8, data_offset);
+        put32(&out, at + 12, static_cast<uint32_t>(entry.data.size()));
+    }
+    align(&out);
+
+    put32(&out, 0, ramfs::IMAGE_MAGIC);
+    put32(&out, 4, ramfs::IMAGE_VERSION);
+    put32(&out, 8, static_cast<uint32_t>(g_entries.size()));
+    put32(&out, 12, static_cast<uint32_t>(out.size()));
+
+    FILE* f = std::fopen(argv[1], "wb");
+    if (!f || std::fwrite(out.data(), 1, out.size(), f) != out.size() || std::fclose(f) != 0) {
+        std::fprintf(stderr, "mkramfs: cannot write %s\n", argv[1]);
+        return 1;
+    }
+    std::printf("mkramfs: %s: %zu files, %zu bytes\n", argv[1], files, out.size());
+    return 0;
+}